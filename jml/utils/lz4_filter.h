@@ -17,6 +17,8 @@
 #include "jml/utils/exc_assert.h"
 
 #include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/operations.hpp>
+#include <algorithm>
 #include <ios>
 #include <vector>
 #include <cstring>
@@ -119,6 +121,31 @@ struct JML_PACKED Header
     {
         Header head;
         lz4::read(src, &head, sizeof(head));
+        head.validate();
+        return std::move(head);
+    }
+
+    /** Reads the header of the next frame of a file made of concatenated
+        frames.  Returns an empty header if the source is at its end.
+    */
+    template<typename Source>
+    static Header readNext(Source& src)
+    {
+        Header head;
+        char* data = (char*) &head;
+
+        std::streamsize n;
+        while ((n = boost::iostreams::read(src, data, 1)) == 0);
+        if (n < 0) return Header();
+
+        lz4::read(src, data + 1, sizeof(head) - 1);
+        head.validate();
+        return std::move(head);
+    }
+
+    void validate() const
+    {
+        const Header& head = *this;
 
         if (head.magic != MagicConst)
             throw lz4_error("invalid magic number");
@@ -133,8 +160,6 @@ struct JML_PACKED Header
 
         if (head.checkBits != head.checksumOptions())
             throw lz4_error("corrupted options");
-
-        return std::move(head);
     }
 
     template<typename Sink>
@@ -200,6 +225,19 @@ struct lz4_compressor : public boost::iostreams::multichar_output_filter
         return n;
     }
 
+    /** Write the data buffered so far as a block of its own, so that it
+        can be decompressed without waiting for the block to be full.
+    */
+    template<typename Sink>
+    void flushBlock(Sink& sink)
+    {
+        if (writeHeader) {
+            head.write(sink);
+            writeHeader = false;
+        }
+        if (pos) flush(sink);
+    }
+
     template<typename Sink>
     void close(Sink& sink)
     {
@@ -268,24 +306,35 @@ private:
 
 struct lz4_decompressor : public boost::iostreams::multichar_input_filter
 {
-    lz4_decompressor() : done(false), toRead(0), pos(0) {}
+    lz4_decompressor() : firstFrame(true), done(false), toRead(0), pos(0) {}
 
+    /** Files written in independent blocks are made of several frames one
+        after the other, which are read as a single stream.
+    */
     template<typename Source>
     std::streamsize read(Source& src, char* s, std::streamsize n)
     {
         if (done) return -1;
-        if (!head) {
-            head = lz4::Header::read(src);
-            if (head.streamChecksum())
-                streamChecksumState = XXH32_init(lz4::ChecksumSeed);
-        }
 
         size_t written = 0;
         while (written < n) {
+            if (!head) {
+                head = firstFrame ?
+                    lz4::Header::read(src) : lz4::Header::readNext(src);
+                firstFrame = false;
+
+                if (!head) {
+                    done = true;
+                    break;
+                }
+                if (head.streamChecksum())
+                    streamChecksumState = XXH32_init(lz4::ChecksumSeed);
+            }
+
             if (pos == toRead)
                 fillBuffer(src);
 
-            if (done) break;
+            if (!head) continue;
 
             size_t toCopy = std::min(n - written, toRead - pos);
             std::memcpy(s, buffer.data() + pos, toCopy);
@@ -317,7 +366,7 @@ private:
                 if (checksum != expected) throw lz4_error("invalid checksum");
             }
 
-            done = true;
+            head = lz4::Header();
             return;
         }
 
@@ -338,6 +387,7 @@ private:
         pos = 0;
 
         if (notCompressed) {
+            buffer.resize(std::max<size_t>(buffer.size(), compressedSize));
             std::memcpy(buffer.data(), compressed, compressedSize);
             toRead = compressedSize;
         }
@@ -358,6 +408,7 @@ private:
 
 
     lz4::Header head;
+    bool firstFrame;
     bool done;
 
     std::vector<char> buffer;
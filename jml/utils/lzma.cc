@@ -107,7 +107,8 @@ lzma_base::lzma_base(bool compress, const lzma_params & params)
         res = lzma_easy_encoder(&stream_, params.level,
                                 (lzma_check)params.crc);
     else
-        res = lzma_stream_decoder(&stream_, 100 * 1024 * 1024, 0 /* flags */);
+        res = lzma_stream_decoder(&stream_, 100 * 1024 * 1024,
+                                  LZMA_CONCATENATED);
     
     if (res != LZMA_OK)
         boost::throw_exception(lzma_error(res));
@@ -157,7 +158,9 @@ int lzma_base::process(const char * & src_begin,
             boost::throw_exception(lzma_error(LZMA_OPTIONS_ERROR));
         }
     } else {
-        action = LZMA_RUN;
+        // Files may hold several streams one after the other, in which case
+        // the decoder can only know that it's done once told so.
+        action = flushLevel == lzma::finish ? LZMA_FINISH : LZMA_RUN;
     }
 
     lzma_ret result = LZMA_OK;
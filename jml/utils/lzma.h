@@ -276,10 +276,10 @@ lzma_decompressor_impl<Alloc>::lzma_decompressor_impl()
 template<typename Alloc>
 bool lzma_decompressor_impl<Alloc>::filter
     ( const char*& src_begin, const char* src_end,
-      char*& dest_begin, char* dest_end, bool /* flush */ )
+      char*& dest_begin, char* dest_end, bool flush )
 {
     int result = process(src_begin, src_end, dest_begin, dest_end,
-                         lzma::run);
+                         flush ? lzma::finish : lzma::run);
     return !(eof_ = result == lzma::stream_end);
 }
 
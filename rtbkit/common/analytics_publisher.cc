@@ -15,16 +15,50 @@
 using namespace std;
 using namespace Datacratic;
 
+namespace {
+
+/* Past this size, the events go in another batch. */
+const size_t MaxBatchSize = 1024 * 1024;
+
+ML::Thread_Specific<std::string> formatBuffers;
+ML::Thread_Specific<std::ostringstream> formatStreams;
+
+} // file scope
+
+
 /********************************************************************************/
 /* ANALYTICS PUBLISHER                                                          */
 /********************************************************************************/
 
+AnalyticsPublisher::
+AnalyticsPublisher()
+    : initialized(false),
+      flushInterval(0.05),
+      bufferCapacity(16384),
+      maxBatchesInFlight(16),
+      live(false),
+      numChannels(0),
+      batchesInFlight(0),
+      numSent(0), numFailed(0), numBatches(0)
+{
+    for (auto & channel: channels)
+        channel.enabled = false;
+}
+
+AnalyticsPublisher::
+~AnalyticsPublisher()
+{
+    // The loop must be stopped before our members go away.
+    MessageLoop::shutdown();
+}
+
 void
 AnalyticsPublisher::
 init(const string & baseUrl, const int numConnections)
 {
     client = make_shared<HttpClient>(baseUrl, numConnections);
     client->sendExpect100Continue(false);
+    client->setRequestCompression(CE_GZIP);
     addSource("analytics::client", client);
     cout << "analytics client is initialized" << endl;
 
@@ -38,6 +72,11 @@ init(const string & baseUrl, const int numConnections)
     };
     addPeriodic("analytics::syncFilters", 10.0, syncFilters);
 
+    auto flushEvents = [&] (uint64_t wakeups) {
+        flush();
+    };
+    addPeriodic("analytics::flush", flushInterval, flushEvents);
+
     initialized = true;
 }
 
@@ -55,27 +94,143 @@ shutdown()
     MessageLoop::shutdown();
 }
 
+AnalyticsPublisher::ChannelEntry *
+AnalyticsPublisher::
+findChannel(const string & name) const
+{
+    unsigned n = numChannels.load(std::memory_order_acquire);
+    for (unsigned i = 0;  i < n;  ++i) {
+        if (channels[i].name == name)
+            return const_cast<ChannelEntry *>(&channels[i]);
+    }
+    return nullptr;
+}
+
+AnalyticsPublisher::Channel
+AnalyticsPublisher::
+channel(const string & name)
+{
+    ChannelEntry * entry = findChannel(name);
+    if (entry)
+        return Channel(entry);
+
+    std::lock_guard<std::mutex> lock(mu);
+    entry = findChannel(name);
+    if (entry)
+        return Channel(entry);
+
+    unsigned n = numChannels.load(std::memory_order_relaxed);
+    if (n == MaxChannels)
+        return Channel();
+
+    channels[n].name = name;
+    channels[n].enabled = false;
+    numChannels.store(n + 1, std::memory_order_release);
+    return Channel(&channels[n]);
+}
+
+string &
+AnalyticsPublisher::
+formatBuffer()
+{
+    return *formatBuffers;
+}
+
+ostringstream &
+AnalyticsPublisher::
+formatStream()
+{
+    return *formatStreams;
+}
+
 void
 AnalyticsPublisher::
-sendEvent(const string & channel, const string & event)
+pushEvent(ChannelEntry * channel, const string & event)
 {
-    auto onResponse = [] (const HttpRequest & rq,
+    auto fill = [&] (Event & slot)
+        {
+            slot.channel = channel;
+            slot.event.assign(event);
+        };
+    buffers.local(bufferCapacity).push(fill);
+}
+
+void
+AnalyticsPublisher::
+flush()
+{
+    // Leave the events in the buffers while the endpoint catches up; if it
+    // doesn't, the buffers fill up and the new events get dropped.
+    if (!live || batchesInFlight >= maxBatchesInFlight)
+        return;
+
+    string batch;
+    AnalyticsBatch::init(batch);
+    size_t numEvents = 0;
+
+    auto onEvent = [&] (Event & slot)
+        {
+            AnalyticsBatch::add(batch, slot.channel->name, slot.event);
+            ++numEvents;
+
+            if (batch.size() >= MaxBatchSize) {
+                sendBatch(std::move(batch), numEvents);
+                AnalyticsBatch::init(batch);
+                numEvents = 0;
+                if (batchesInFlight >= maxBatchesInFlight)
+                    return false;
+            }
+            return true;
+        };
+
+    buffers.drain(onEvent);
+
+    if (numEvents)
+        sendBatch(std::move(batch), numEvents);
+}
+
+void
+AnalyticsPublisher::
+sendBatch(string && batch, size_t numEvents)
+{
+    auto onResponse = [=] (const HttpRequest & rq,
             HttpClientError error,
             int status,
             string && headers,
             string && body)
     {
-        if (status != 200) {
+        --batchesInFlight;
+        if (status == 200) {
+            numSent += numEvents;
+            ++numBatches;
+        }
+        else {
+            numFailed += numEvents;
             cout << "status: " << status << endl
                  << "error: " << error << endl;
         }
     };
-    string ressource("/v1/event");
+    string ressource("/v1/events");
     auto const & cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
-    Json::Value payload(Json::objectValue);
-    payload["channel"] = channel;
-    payload["event"] = event;
-    client->post(ressource, cbs, payload);
+    HttpRequest::Content content;
+    content.str = std::move(batch);
+    content.contentType = "application/octet-stream";
+    if (client->post(ressource, cbs, content))
+        ++batchesInFlight;
+    else numFailed += numEvents;
+}
+
+AnalyticsPublisher::Stats
+AnalyticsPublisher::
+getStats() const
+{
+    Stats stats;
+    stats.published = buffers.numPushed();
+    stats.dropped = buffers.numDropped();
+    stats.sent = numSent;
+    stats.failed = numFailed;
+    stats.batches = numBatches;
+    return stats;
 }
 
 void
@@ -114,9 +269,10 @@ syncChannelFilters()
         if (status != 200) return;
         Json::Value filters = Json::parse(body);
         if (filters.isObject()) {
-            std::lock_guard<std::mutex> lock(mu);
             for ( auto it = filters.begin(); it != filters.end(); ++it) {
-                channelFilter[it.memberName()] = (*it).asBool();
+                ChannelEntry * entry = channel(it.memberName()).entry;
+                if (entry)
+                    entry->enabled = (*it).asBool();
             }
         }
     };
@@ -125,4 +281,3 @@ syncChannelFilters()
     auto cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
     client->get(ressource, cbs);
 }
-
@@ -6,24 +6,103 @@
 */
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <sstream>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "soa/service/message_loop.h"
 #include "soa/service/http_client.h"
 #include "soa/service/service_utils.h"
+#include "soa/service/thread_buffers.h"
+#include "soa/types/varint.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/thread_specific.h"
 
 typedef std::unordered_map< std::string, bool > ChannelFilter;
 
+/********************************************************************************/
+/* ANALYTICS BATCH                                                              */
+/********************************************************************************/
+
+/** Binary framing of the batches of events POSTed to /v1/events.
+
+    A batch is a version byte followed by the events, each one being the
+    varint length of its channel, the channel, the varint length of the
+    event and the event.  The batches go out gzipped.
+*/
+struct AnalyticsBatch {
+    enum { Version = 1 };
+
+    static void init(std::string & batch)
+    {
+        batch.clear();
+        batch.push_back(Version);
+    }
+
+    static void add(std::string & batch,
+                    const std::string & channel, const std::string & event)
+    {
+        Datacratic::appendVarintString(batch, channel);
+        Datacratic::appendVarintString(batch, event);
+    }
+
+    /** Call onEvent(channel, event) for each event of the batch.  Throws if
+        the batch is malformed.
+    */
+    template<typename OnEvent>
+    static size_t decode(const std::string & batch, const OnEvent & onEvent)
+    {
+        const char * p = batch.data(), * e = p + batch.size();
+        if (p == e || *p++ != Version)
+            throw ML::Exception("unknown analytics batch version");
+
+        size_t numEvents = 0;
+        std::string channel, event;
+        while (p != e) {
+            Datacratic::readVarintString(p, e, channel, "analytics batch");
+            Datacratic::readVarintString(p, e, event, "analytics batch");
+            onEvent(channel, event);
+            ++numEvents;
+        }
+        return numEvents;
+    }
+};
+
+
 /********************************************************************************/
 /* ANALYTICS PUBLISHER                                                          */
 /********************************************************************************/
 
+/** Publishes events to the analytics endpoint.
+
+    Publishing never blocks nor takes a lock: the event is formatted into a
+    buffer owned by the calling thread, which the publisher's message loop
+    drains every flushInterval seconds into a single compressed POST.  When
+    the endpoint can't keep up and a thread's buffer fills up, its events
+    are dropped and counted.
+
+    Channels are resolved once with channel() into a handle whose enabled
+    flag is kept in sync with the endpoint.  Publishing on the name of a
+    channel works too, at the cost of a scan of the known channels.
+*/
 struct AnalyticsPublisher : public Datacratic::MessageLoop {
 
-    AnalyticsPublisher() : initialized(false) {}
+    struct ChannelEntry;
+
+    /** Handle on a channel, valid for the lifetime of the publisher. */
+    struct Channel {
+        explicit Channel(ChannelEntry * entry = nullptr) : entry(entry) {}
+        ChannelEntry * entry;
+    };
+
+    AnalyticsPublisher();
+    ~AnalyticsPublisher();
 
     void init(const std::string & baseUrl, const int numConnections);
     bool initialized;
@@ -34,41 +113,138 @@ struct AnalyticsPublisher : public Datacratic::MessageLoop {
 
     void syncChannelFilters();
 
+    /** Return the handle of the given channel, which is disabled until the
+        endpoint says otherwise.
+    */
+    Channel channel(const std::string & name);
+
+    bool isEnabled(Channel channel) const
+    {
+        return live.load(std::memory_order_relaxed)
+            && channel.entry
+            && channel.entry->enabled.load(std::memory_order_relaxed);
+    }
+
     template<typename... Args>
-    void publish(const std::string & channel, const Args & ... args)
+    void publish(Channel channel, const Args & ... args)
     {
-        if (!live) return;
+        if (!isEnabled(channel)) return;
 
-        std::lock_guard<std::mutex> lock(mu);
-        auto it = channelFilter.find(channel);
-        if (it == channelFilter.end() || !it->second) return;
+        std::string & message = formatBuffer();
+        message.clear();
+        make_message(message, args...);
+        pushEvent(channel.entry, message);
+    }
 
-        std::stringstream ss;
-        make_message(ss, args...);
-        sendEvent(channel, ss.str());
+    template<typename... Args>
+    void publish(const std::string & channelName, const Args & ... args)
+    {
+        if (!live.load(std::memory_order_relaxed)) return;
+        publish(channel(channelName), args...);
     }
 
+    /** Seconds between two batches. */
+    double flushInterval;
+
+    /** Size of the buffer of each publishing thread, in events. */
+    size_t bufferCapacity;
+
+    /** Batches waiting on the endpoint after which we stop sending. */
+    size_t maxBatchesInFlight;
+
+    struct Stats {
+        uint64_t published;     ///< events accepted by publish()
+        uint64_t dropped;       ///< events dropped because a buffer was full
+        uint64_t sent;          ///< events acknowledged by the endpoint
+        uint64_t failed;        ///< events in batches that the endpoint lost
+        uint64_t batches;       ///< batches acknowledged by the endpoint
+    };
+
+    Stats getStats() const;
+
+    struct ChannelEntry {
+        std::string name;
+        std::atomic<bool> enabled;
+    };
+
 private:
-    std::mutex mu;
+    enum { MaxChannels = 256 };
+
+    mutable std::mutex mu;  ///< only to register channels
     std::shared_ptr<Datacratic::HttpClient> client;
-    bool live;
-    ChannelFilter channelFilter;
+    std::atomic<bool> live;
+
+    ChannelEntry channels[MaxChannels];
+    std::atomic<unsigned> numChannels;
+
+    ChannelEntry * findChannel(const std::string & name) const;
+
+    /** Events published by each thread, waiting for the message loop. */
+    struct Event {
+        const ChannelEntry * channel;
+        std::string event;
+    };
+    Datacratic::ThreadBuffers<Event> buffers;
+
+    void pushEvent(ChannelEntry * channel, const std::string & event);
+
+    /** Thread local string in which events are formatted. */
+    static std::string & formatBuffer();
+
+    /** Thread local stream for the fields that aren't strings. */
+    static std::ostringstream & formatStream();
 
-    void sendEvent(const std::string & channel, const std::string & event);
+    void flush();
+    void sendBatch(std::string && batch, size_t numEvents);
+
+    size_t batchesInFlight;
+    std::atomic<uint64_t> numSent;
+    std::atomic<uint64_t> numFailed;
+    std::atomic<uint64_t> numBatches;
 
     void checkHeartbeat();
 
+    static void appendField(std::string & message, const std::string & field)
+    {
+        message.append(field);
+    }
+
+    static void appendField(std::string & message, const char * field)
+    {
+        message.append(field);
+    }
+
+    template<typename T>
+    static void appendField(std::string & message, const T & field,
+                            typename std::enable_if<std::is_integral<T>::value>::type * = 0)
+    {
+        message.append(std::to_string(field));
+    }
+
+    template<typename T>
+    static void appendField(std::string & message, const T & field,
+                            typename std::enable_if<!std::is_integral<T>::value>::type * = 0)
+    {
+        std::ostringstream & stream = formatStream();
+        stream.str("");
+        stream.clear();
+        stream << field;
+        message.append(stream.str());
+    }
+
     template<typename Head>
-    void make_message(std::stringstream & ss, const Head & head)
+    static void make_message(std::string & message, const Head & head)
     {
-        ss << head;
+        appendField(message, head);
     }
 
     template<typename Head, typename... Tail>
-    void make_message(std::stringstream & ss, const Head & head, const Tail & ... tail)
+    static void make_message(std::string & message,
+                             const Head & head, const Tail & ... tail)
     {
-        ss << head << " ";
-        make_message(ss, tail...);
+        appendField(message, head);
+        message.push_back(' ');
+        make_message(message, tail...);
     }
 
 };
@@ -241,7 +241,6 @@ Auction(ExchangeConnector * exchangeConnector,
     ML::atomic_add(created, 1);
 
     this->id = request->auctionId;
-    this->requestSerialized = request->serializeToString();
 }
 
 Auction::
@@ -258,6 +257,89 @@ Auction::
     ML::atomic_add(destroyed, 1);
 }
 
+const std::string &
+Auction::
+requestSerialized() const
+{
+    std::call_once(requestSerializedOnce, [&] () {
+            if (request)
+                requestSerialized_ = request->serializeToString();
+        });
+    return requestSerialized_;
+}
+
+const std::string &
+Auction::
+encodedRequest(BidRequestFormat format) const
+{
+    switch (format) {
+    case BRF_JSON_RAW:
+        return requestStr;
+    case BRF_JSON_NORM:
+        std::call_once(requestNormalizedOnce, [&] () {
+                if (request)
+                    requestNormalized_ = request->toJsonStr();
+            });
+        return requestNormalized_;
+    case BRF_BINARY_V1:
+        return requestSerialized();
+    default:
+        throw ML::Exception("unknown BidRequestFormat");
+    }
+}
+
+const std::string &
+Auction::
+encodedRequestFormat(BidRequestFormat format) const
+{
+    static const std::string normalized("datacratic");
+    static const std::string binary("datacratic-binary");
+
+    switch (format) {
+    case BRF_JSON_RAW:   return requestStrFormat;
+    case BRF_JSON_NORM:  return normalized;
+    case BRF_BINARY_V1:  return binary;
+    default:
+        throw ML::Exception("unknown BidRequestFormat");
+    }
+}
+
+const std::string &
+Auction::
+augmentationsForAccount(const AccountKey & account)
+{
+    /* The result only depends on which prefixes of the account appear in
+       the augmentation lists, and those are the prefixes of the longest
+       one that appears in any list.  Use it to key the cache.
+    */
+    AccountKey key = account;
+    for (;;) {
+        bool found = false;
+        for (const auto & aug: augmentations) {
+            if (aug.second.count(key)) {
+                found = true;
+                break;
+            }
+        }
+        if (found || key.empty()) break;
+        key.pop_back();
+    }
+
+    for (const auto & view: augmentationViews_)
+        if (view.first == key) return view.second;
+
+    Json::Value aggregatedAug;
+    for (const auto & aug: augmentations)
+        aggregatedAug[aug.first] = aug.second.filterForAccount(key).toJson();
+
+    std::string encoded = aggregatedAug.toString();
+    while (!encoded.empty() && encoded[encoded.size() - 1] == '\n')
+        encoded.erase(encoded.size() - 1);
+
+    augmentationViews_.emplace_back(std::move(key), std::move(encoded));
+    return augmentationViews_.back().second;
+}
+
 long long Auction::created = 0;
 long long Auction::destroyed = 0;
 
@@ -16,6 +16,8 @@
 #include "rtbkit/common/win_cost_model.h"
 #include <boost/function.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <mutex>
+#include <deque>
 #include "soa/jsoncpp/json.h"
 #include "soa/types/date.h"
 #include "jml/arch/atomic_ops.h"
@@ -72,13 +74,41 @@ struct Auction : public std::enable_shared_from_this<Auction> {
     std::shared_ptr<BidRequest>  request;
     std::string requestStr;  ///< Stringified version of request
     std::string requestStrFormat;  ///< Format of stringified request
-    std::string requestSerialized; ///< Serialized bid request (canonical)
     std::string requestOriginal;
 
+    /** Serialized bid request (canonical binary format).  This is computed
+        on first use, as most deployments never need it.
+
+        Thread safe.
+    */
+    const std::string & requestSerialized() const;
+
+    /** Return the bid request encoded in the given format.  Each format is
+        encoded at most once per auction, and the result is shared between
+        every agent and bidder interface that asks for it.
+
+        Thread safe.
+    */
+    const std::string & encodedRequest(BidRequestFormat format) const;
+
+    /** Return the name of the given format as understood by
+        BidRequest::parse() on the receiving side.
+    */
+    const std::string & encodedRequestFormat(BidRequestFormat format) const;
+
     ///< AugmentationList for each augmentors.
     std::unordered_map<std::string, AugmentationList> augmentations;
     AgentAugmentations agentAugmentations; ///< per agent augmentations.
 
+    /** Return the augmentations merged for the given account and encoded in
+        JSON, as sent to the agents.  Accounts that match the same account
+        prefixes in every augmentation list get identical results, so each
+        distinct result is merged and encoded only once per auction.
+
+        Not thread safe; must only be called once augmentation is finished.
+    */
+    const std::string & augmentationsForAccount(const AccountKey & account);
+
     /** How much time is still available for the auction (in seconds). */
     double timeAvailable(Date now = Date::now()) const;
 
@@ -299,6 +329,15 @@ struct Auction : public std::enable_shared_from_this<Auction> {
 private:
     Data * data;
 
+    mutable std::once_flag requestSerializedOnce;
+    mutable std::string requestSerialized_;
+    mutable std::once_flag requestNormalizedOnce;
+    mutable std::string requestNormalized_;
+
+    /// Encoded augmentations, keyed by the longest matched account prefix.
+    /// A deque so that references returned earlier stay valid.
+    std::deque<std::pair<AccountKey, std::string> > augmentationViews_;
+
 public:
     /// Memory leak tracking
     static long long created;
@@ -0,0 +1,34 @@
+/** auction_tracer.cc
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Tracing of the stages that auctions go through in the router.
+*/
+
+#include "auction_tracer.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace RTBKIT {
+
+EventTracer &
+auctionTracer()
+{
+    static EventTracer tracer({
+            "exchangeReceive",
+            "parse",
+            "filter",
+            "augment",
+            "agentSend",
+            "bidReceive",
+            "bankerAuthorize",
+            "respond",
+            "postAuctionSubmit"
+        });
+
+    return tracer;
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,53 @@
+/** auction_tracer.h                                             -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Tracing of the stages that auctions go through in the router.
+*/
+
+#pragma once
+
+#include "soa/service/event_tracer.h"
+#include "soa/types/id.h"
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* AUCTION STAGE                                                             */
+/*****************************************************************************/
+
+/** Stages of an auction on its hot path, in the order in which they
+    normally happen.
+*/
+enum AuctionStage {
+    AS_EXCHANGE_RECEIVE,    ///< request received from the exchange
+    AS_PARSE,               ///< bid request parsed
+    AS_FILTER,              ///< agents filtered
+    AS_AUGMENT,             ///< augmentation finished
+    AS_AGENT_SEND,          ///< bid request sent to the agents
+    AS_BID_RECEIVE,         ///< bid received from an agent
+    AS_BANKER_AUTHORIZE,    ///< bid authorized by the banker
+    AS_RESPOND,             ///< response sent to the exchange
+    AS_POST_AUCTION_SUBMIT  ///< auction submitted to the post auction loop
+};
+
+/** Tracer of the auction stages of this process.  It records continuously;
+    its events can be dumped through the router's REST API.
+*/
+Datacratic::EventTracer & auctionTracer();
+
+inline void traceAuctionStage(AuctionStage stage,
+                              const Datacratic::Id & auctionId)
+{
+    auctionTracer().record(stage, auctionId.hash());
+}
+
+inline void traceAuctionStage(AuctionStage stage,
+                              const Datacratic::Id & auctionId,
+                              uint64_t ticks)
+{
+    auctionTracer().record(stage, auctionId.hash(), ticks);
+}
+
+} // namespace RTBKIT
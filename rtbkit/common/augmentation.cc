@@ -7,12 +7,16 @@
 */
 
 #include "rtbkit/common/augmentation.h"
+#include "soa/types/varint.h"
 #include "jml/arch/format.h"
+#include "jml/arch/exception.h"
 
 #include <iostream>
 #include <algorithm>
+#include <cstring>
 
 using namespace std;
+using namespace Datacratic;
 
 namespace RTBKIT {
 
@@ -185,4 +189,109 @@ fromJson(const Json::Value& json)
     return list;
 }
 
+
+/******************************************************************************/
+/* AUGMENT MESSAGE                                                            */
+/******************************************************************************/
+
+namespace {
+
+const char * const Message = "augment message";
+
+} // namespace anonymous
+
+string
+AugmentMessage::
+encodePayload(
+        const Id& auctionId,
+        const string& requestStrFormat,
+        const string& requestStr)
+{
+    string id = auctionId.toString();
+
+    string payload;
+    payload.reserve(id.size() + requestStrFormat.size() + requestStr.size() + 16);
+
+    appendVarintString(payload, id);
+    appendVarintString(payload, requestStrFormat);
+    appendVarintString(payload, requestStr);
+
+    return payload;
+}
+
+void
+AugmentMessage::
+decodePayload(
+        const string& payload,
+        Id& auctionId,
+        string& requestStrFormat,
+        string& requestStr)
+{
+    size_t pos = 0;
+
+    string id;
+    readVarintString(payload, pos, id, Message);
+    auctionId = Id(id);
+
+    readVarintString(payload, pos, requestStrFormat, Message);
+    readVarintString(payload, pos, requestStr, Message);
+}
+
+Id
+AugmentMessage::
+decodeAuctionId(const string& payload)
+{
+    size_t pos = 0;
+    string id;
+    readVarintString(payload, pos, id, Message);
+    return Id(id);
+}
+
+string
+AugmentMessage::
+encodeAgents(const vector<string>& agents)
+{
+    string frame;
+    appendVarint(frame, agents.size());
+    for (const auto& agent : agents)
+        appendVarintString(frame, agent);
+    return frame;
+}
+
+void
+AugmentMessage::
+decodeAgents(const string& frame, vector<string>& agents)
+{
+    size_t pos = 0;
+    size_t count = readVarint(frame, pos, Message);
+
+    // Every agent takes at least a byte so this bounds bogus counts.
+    if (count > frame.size() - pos)
+        throw ML::Exception("invalid agent count in augment message");
+
+    agents.resize(count);
+    for (auto& agent : agents)
+        readVarintString(frame, pos, agent, Message);
+}
+
+string
+AugmentMessage::
+encodeStartTime(Date startTime)
+{
+    double seconds = startTime.secondsSinceEpoch();
+    return string(reinterpret_cast<const char*>(&seconds), sizeof(seconds));
+}
+
+Date
+AugmentMessage::
+decodeStartTime(const string& frame)
+{
+    double seconds;
+    if (frame.size() != sizeof(seconds))
+        throw ML::Exception("invalid start time in augment message");
+
+    memcpy(&seconds, frame.data(), sizeof(seconds));
+    return Date::fromSecondsSinceEpoch(seconds);
+}
+
 } // namespace RTBKIT
@@ -11,6 +11,8 @@
 
 #include "rtbkit/common/account_key.h"
 #include "soa/jsoncpp/value.h"
+#include "soa/types/id.h"
+#include "soa/types/date.h"
 
 #include <set>
 #include <string>
@@ -87,6 +89,47 @@ struct AugmentationList : public AugmentationListBase
 };
 
 
+/******************************************************************************/
+/* AUGMENT MESSAGE                                                            */
+/******************************************************************************/
+
+/** Binary encoding of the frames of a version 2.0 AUGMENT message sent from
+    the router to the augmentors:
+
+        "AUGMENT" "2.0" augmentor payload agents startTime
+
+    The payload holds everything that's the same for all the augmentors of an
+    auction (auction id, bid request format and bid request) so that the
+    router can encode it once and share it between all of its sends.  The
+    agents frame lists the agents interested in the augmentor and the start
+    time is the raw seconds since epoch.
+
+    Strings are all length prefixed with a little-endian base 128 varint.
+ */
+struct AugmentMessage
+{
+    static std::string encodePayload(
+            const Datacratic::Id & auctionId,
+            const std::string & requestStrFormat,
+            const std::string & requestStr);
+
+    static void decodePayload(
+            const std::string & payload,
+            Datacratic::Id & auctionId,
+            std::string & requestStrFormat,
+            std::string & requestStr);
+
+    /** Decodes only the auction id which is at the start of the payload. */
+    static Datacratic::Id decodeAuctionId(const std::string & payload);
+
+    static std::string encodeAgents(const std::vector<std::string> & agents);
+    static void decodeAgents(
+            const std::string & frame, std::vector<std::string> & agents);
+
+    static std::string encodeStartTime(Datacratic::Date startTime);
+    static Datacratic::Date decodeStartTime(const std::string & frame);
+};
+
 } // namespace RTBKIT
 
 #endif // __rtb__augmentation_h__
@@ -16,6 +16,7 @@
 #include "rtbkit/openrtb/openrtb_parsing.h"
 #include "soa/types/json_printing.h"
 #include "soa/service/json_codec.h"
+#include "rtbkit/common/json_binary.h"
 
 
 using namespace std;
@@ -686,8 +687,9 @@ void
 AdSpot::
 serialize(ML::DB::Store_Writer & store) const
 {
-    unsigned char version = 2;
-    store << version << toJson().toString();
+    unsigned char version = 3;
+    store << version;
+    serializeJsonBinary(store, toJson());
 }
 
 void
@@ -696,11 +698,17 @@ reconstitute(ML::DB::Store_Reader & store)
 {
     unsigned char version;
     store >> version;
-    if (version != 2)
-        throw ML::Exception("unknown AdSpot serialization version");
-    string s;
-    store >> s;
-    fromJson(Json::parse(s));
+    if (version == 2) {
+        string s;
+        store >> s;
+        fromJson(Json::parse(s));
+    }
+    else if (version == 3) {
+        Json::Value json;
+        reconstituteJsonBinary(store, json);
+        fromJson(json);
+    }
+    else throw ML::Exception("unknown AdSpot serialization version");
 }
 
 
@@ -1130,12 +1138,21 @@ struct CanonicalParser {
     }
 };
 
+struct BinaryParser {
+
+    static BidRequest * parse(const std::string & str)
+    {
+        return new BidRequest(BidRequest::createFromString(str));
+    }
+};
+
 struct AtInit {
     AtInit()
     {
         PluginInterface<BidRequest>::registerPlugin("recoset", CanonicalParser::parse);
         PluginInterface<BidRequest>::registerPlugin("datacratic", CanonicalParser::parse);
         PluginInterface<BidRequest>::registerPlugin("rtbkit", CanonicalParser::parse);
+        PluginInterface<BidRequest>::registerPlugin("datacratic-binary", BinaryParser::parse);
     }
 } atInit;
 } // file scope
@@ -1218,14 +1235,56 @@ getUserId(const std::string & domain) const
     return it->second;
 }
 
+namespace {
+
+/** Output buffer that writes straight into a preallocated string, so that
+    serializing a bid request doesn't go through an ostringstream and then
+    copy the result out again.
+*/
+struct StringOutputBuffer : public std::streambuf {
+    StringOutputBuffer(std::string & output, size_t reserved)
+        : output(output)
+    {
+        output.clear();
+        output.reserve(reserved);
+    }
+
+    virtual std::streamsize xsputn(const char * s, std::streamsize n)
+    {
+        output.append(s, n);
+        return n;
+    }
+
+    virtual int_type overflow(int_type c)
+    {
+        if (c != traits_type::eof())
+            output.push_back(traits_type::to_char_type(c));
+        return c;
+    }
+
+    std::string & output;
+};
+
+/** Size of the last serialized bid request on this thread; used to size the
+    output buffer for the next one so that it is almost never reallocated.
+*/
+__thread size_t lastSerializedSize = 2048;
+
+} // file scope
+
 std::string
 BidRequest::
 serializeToString() const
 {
-    ostringstream stream;
-    DB::Store_Writer store(stream);
-    serialize(store);
-    return stream.str();
+    std::string result;
+    {
+        StringOutputBuffer buffer(result, lastSerializedSize + 256);
+        std::ostream stream(&buffer);
+        DB::Store_Writer store(stream);
+        serialize(store);
+    }
+    lastSerializedSize = result.size();
+    return result;
 }
 
 BidRequest
@@ -1238,33 +1297,18 @@ createFromString(const std::string & str)
     return result;
 }
 
-inline ML::DB::Store_Writer &
-operator << (ML::DB::Store_Writer & store, const Json::Value & val)
-{
-    return store << val.toString();
-}
-
-inline ML::DB::Store_Reader &
-operator >> (ML::DB::Store_Reader & store, Json::Value & val)
-{
-    string s;
-    store >> s;
-    val = Json::parse(s);
-    return store;
-}
-
-
 void
 BidRequest::
 serialize(ML::DB::Store_Writer & store) const
 {
     using namespace ML::DB;
-    unsigned char version = 2;
+    unsigned char version = 3;
     store << version << auctionId << language << protocolVersion
           << exchange << provider << timestamp << isTest
           << location << userIds << imp << url << ipAddress << userAgent
-          << restrictions << segments << meta
-          << winSurcharges;
+          << restrictions << segments;
+    serializeJsonBinary(store, meta);
+    store << winSurcharges;
 }
 
 void
@@ -1277,14 +1321,52 @@ reconstitute(ML::DB::Store_Reader & store)
 
     store >> version;
 
-    if (version != 2)
+    if (version != 2 && version != 3)
         throw ML::Exception("problem reconstituting BidRequest: "
                             "invalid version");
 
     store >> auctionId >> language >> protocolVersion
           >> exchange >> provider >> timestamp >> isTest
           >> location >> userIds >> imp >> url >> ipAddress >> userAgent
-          >> restrictions >> segments >> meta >> winSurcharges;
+          >> restrictions >> segments;
+
+    if (version == 2) {
+        // Version 2 stored the metadata as stringified JSON
+        string metaStr;
+        store >> metaStr;
+        meta = Json::parse(metaStr);
+    }
+    else reconstituteJsonBinary(store, meta);
+
+    store >> winSurcharges;
+}
+
+
+/*****************************************************************************/
+/* BID REQUEST FORMAT                                                        */
+/*****************************************************************************/
+
+std::string print(BidRequestFormat format)
+{
+    switch (format) {
+    case BRF_JSON_RAW:   return "jsonRaw";
+    case BRF_JSON_NORM:  return "jsonNorm";
+    case BRF_BINARY_V1:  return "binary";
+    default:
+        throw ML::Exception("unknown BidRequestFormat");
+    }
+}
+
+BidRequestFormat parseBidRequestFormat(const std::string & format)
+{
+    if (format == "jsonRaw")
+        return BRF_JSON_RAW;
+    else if (format == "jsonNorm")
+        return BRF_JSON_NORM;
+    else if (format == "binary")
+        return BRF_BINARY_V1;
+    throw ML::Exception("unknown BidRequestFormat " + format + ": accepted "
+                        "jsonRaw, jsonNorm, binary");
 }
 
 } // namespace RTBKIT
@@ -431,6 +431,23 @@ struct BidRequest {
 
 IMPL_SERIALIZE_RECONSTITUTE(BidRequest);
 
+/*****************************************************************************/
+/* BID REQUEST FORMAT                                                        */
+/*****************************************************************************/
+
+/** Wire formats in which a bid request can be sent to a bidder. */
+enum BidRequestFormat {
+    BRF_JSON_RAW,   ///< Send raw exchange JSON bid requests
+    BRF_JSON_NORM,  ///< Send normalized (canonical) JSON bid requests
+    BRF_BINARY_V1   ///< Send canonical binary bid requests
+};
+
+/** Convert to and from the names used in agent configurations ("jsonRaw",
+    "jsonNorm" and "binary").
+*/
+std::string print(BidRequestFormat format);
+BidRequestFormat parseBidRequestFormat(const std::string & format);
+
 } // namespace RTBKIT
 
 namespace Datacratic {
@@ -41,7 +41,7 @@ struct BidderInterface : public ServiceBase
     virtual
     void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                             double timeLeftMs,
-                            std::map<std::string, BidInfo> const & bidders) = 0;
+                            AuctionBidders const & bidders) = 0;
 
     virtual
     void sendWinLossMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
@@ -7,10 +7,13 @@
 */
 
 #include "bids.h"
+#include "soa/types/varint.h"
 
 #include "jml/utils/exc_check.h"
 #include "jml/utils/json_parsing.h"
 
+#include <cstring>
+
 using namespace std;
 using namespace ML;
 
@@ -278,6 +281,179 @@ fromJson(const std::string& raw)
     return result;
 }
 
+/******************************************************************************/
+/* BID RESPONSE BATCH                                                         */
+/******************************************************************************/
+
+namespace {
+
+const char BatchVersion = 1;
+
+enum BidFlags {
+    BF_NULL = 1,        ///< Null bid; only the spot index follows
+    BF_ACCOUNT = 2,     ///< Account follows
+    BF_EXT = 4          ///< JSON encoded ext follows
+};
+
+const char * const Batch = "bid response batch";
+
+template<typename T>
+void writeRaw(string& out, T val)
+{
+    out.append(reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+template<typename T>
+T readRaw(const string& in, size_t& pos)
+{
+    if (sizeof(T) > in.size() - pos)
+        throw ML::Exception("truncated bid response batch");
+
+    T val;
+    memcpy(&val, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return val;
+}
+
+} // file scope
+
+BidResponseBatch::
+BidResponseBatch() :
+    count(0)
+{
+}
+
+void
+BidResponseBatch::
+add(const Id & auctionId,
+    const Bids & bids,
+    const std::string & wcm,
+    const std::string & meta)
+{
+    if (data.empty()) data.push_back(BatchVersion);
+
+    appendVarintString(data, auctionId.toString());
+
+    appendVarint(data, bids.size());
+    for (const Bid& bid : bids) {
+        if (bid.isNullBid()) {
+            appendVarint(data, BF_NULL);
+            appendSignedVarint(data, bid.spotIndex);
+            continue;
+        }
+
+        int flags = 0;
+        if (!bid.account.empty()) flags |= BF_ACCOUNT;
+        if (!bid.ext.isNull()) flags |= BF_EXT;
+        appendVarint(data, flags);
+
+        appendSignedVarint(data, bid.spotIndex);
+        appendSignedVarint(data, bid.creativeIndex);
+        writeRaw(data, uint32_t(bid.price.currencyCode));
+        appendSignedVarint(data, bid.price.value);
+        writeRaw(data, bid.priority);
+
+        if (flags & BF_ACCOUNT)
+            appendVarintString(data, bid.account.toString());
+        if (flags & BF_EXT)
+            appendVarintString(data, bid.ext.toStringNoNewLine());
+    }
+
+    appendVarint(data, bids.dataSources.size());
+    for (const string& dataSource : bids.dataSources)
+        appendVarintString(data, dataSource);
+
+    appendVarintString(data, wcm);
+    appendVarintString(data, meta);
+
+    ++count;
+}
+
+std::string
+BidResponseBatch::
+release()
+{
+    std::string result;
+    result.swap(data);
+    count = 0;
+    return result;
+}
+
+void
+BidResponseBatch::
+decode(const std::string & data,
+       const std::function<void (Response &)> & onResponse,
+       const OnError & onError)
+{
+    if (data.empty() || data[0] != BatchVersion)
+        throw ML::Exception("unknown bid response batch version");
+
+    size_t pos = 1;
+    string str;
+
+    while (pos < data.size()) {
+        Response response;
+        string error;
+
+        readVarintString(data, pos, str, Batch);
+        response.auctionId = Id(str);
+
+        uint64_t numBids = readVarint(data, pos, Batch);
+        if (numBids > data.size() - pos)
+            throw ML::Exception("invalid number of bids in batch");
+        response.bids.reserve(numBids);
+
+        for (uint64_t i = 0;  i < numBids;  ++i) {
+            Bid bid;
+
+            uint64_t flags = readVarint(data, pos, Batch);
+            bid.spotIndex = readSignedVarint(data, pos, Batch);
+
+            if (!(flags & BF_NULL)) {
+                bid.creativeIndex = readSignedVarint(data, pos, Batch);
+                auto currency = CurrencyCode(readRaw<uint32_t>(data, pos));
+                bid.price = Amount(currency, readSignedVarint(data, pos, Batch));
+                bid.priority = readRaw<double>(data, pos);
+
+                if (flags & BF_ACCOUNT) {
+                    readVarintString(data, pos, str, Batch);
+                    bid.account = AccountKey(str);
+                }
+                if (flags & BF_EXT) {
+                    readVarintString(data, pos, str, Batch);
+                    try {
+                        bid.ext = Json::parse(str);
+                    } catch (const std::exception & exc) {
+                        error = "couldn't parse bid ext: "
+                            + string(exc.what());
+                    }
+                }
+            }
+
+            response.bids.push_back(std::move(bid));
+        }
+
+        uint64_t numDataSources = readVarint(data, pos, Batch);
+        for (uint64_t i = 0;  i < numDataSources;  ++i) {
+            readVarintString(data, pos, str, Batch);
+            response.bids.dataSources.insert(str);
+        }
+
+        readVarintString(data, pos, response.wcm, Batch);
+        readVarintString(data, pos, response.meta, Batch);
+
+        if (!error.empty()) {
+            if (!onError)
+                throw ML::Exception(error);
+            onError(response.auctionId, error);
+            continue;
+        }
+
+        onResponse(response);
+    }
+}
+
+
 /******************************************************************************/
 /* BID RESULT                                                                 */
 /******************************************************************************/
@@ -15,6 +15,8 @@
 #include "soa/jsoncpp/value.h"
 #include "jml/utils/compact_vector.h"
 
+#include <functional>
+
 namespace ML { struct Parse_Context; }
 
 namespace RTBKIT {
@@ -118,6 +120,60 @@ struct Bids : public ML::compact_vector<Bid, 4>
 };
 
 
+/******************************************************************************/
+/* BID RESPONSE BATCH                                                         */
+/******************************************************************************/
+
+/** Bid responses of an agent packed together in a compact binary encoding,
+    so that they can be sent to the router in a single BIDS message instead
+    of one JSON encoded BID message each.
+
+    Each bid is encoded as its spot index, creative index, price in micros
+    of its currency, priority and account; the win cost model and the meta
+    data of each response are kept as the JSON strings of the BID message.
+*/
+struct BidResponseBatch
+{
+    BidResponseBatch();
+
+    void add(const Id & auctionId,
+             const Bids & bids,
+             const std::string & wcm,
+             const std::string & meta);
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    /** Return the encoded batch and start a new one. */
+    std::string release();
+
+    struct Response {
+        Id auctionId;
+        Bids bids;
+        std::string wcm;
+        std::string meta;
+    };
+
+    typedef std::function<void (const Id & auctionId,
+                                const std::string & error)> OnError;
+
+    /** Decode an encoded batch, calling onResponse for each of the
+        responses in it.  A response whose content can't be decoded (eg an
+        ext that isn't JSON) is passed to onError instead and the following
+        ones are still decoded; without onError, that throws.  Throws if the
+        batch is malformed, since the responses after the error can't be
+        found.
+    */
+    static void decode(const std::string & data,
+                       const std::function<void (Response &)> & onResponse,
+                       const OnError & onError = OnError());
+
+private:
+    std::string data;
+    size_t count;
+};
+
+
 /******************************************************************************/
 /* BID RESULT                                                                 */
 /******************************************************************************/
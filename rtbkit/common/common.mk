@@ -4,6 +4,7 @@ LIBBIDREQUEST_SOURCES := \
 	bid_request.cc \
 	segments.cc \
 	json_holder.cc \
+	json_binary.cc \
 	currency.cc \
 	expand_variable.cc 
 
@@ -15,6 +16,7 @@ $(eval $(call library,bid_request,$(LIBBIDREQUEST_SOURCES),$(LIBBIDREQUEST_LINK)
 LIBRTB_SOURCES := \
 	auction.cc \
 	augmentation.cc \
+	local_augmentor.cc \
 	account_key.cc \
 	bids.cc \
 	auction_events.cc \
@@ -22,7 +24,8 @@ LIBRTB_SOURCES := \
 	bidder_interface.cc \
 	win_cost_model.cc \
 	post_auction_proxy.cc \
-	analytics_publisher.cc
+	analytics_publisher.cc \
+	auction_tracer.cc
 
 LIBRTB_LINK := \
 	ACE arch utils jsoncpp boost_thread endpoint boost_regex zmq opstats bid_request
@@ -0,0 +1,127 @@
+/* json_binary.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Native binary encoding of Json::Value.
+*/
+
+#include "rtbkit/common/json_binary.h"
+#include "jml/db/persistent.h"
+#include "jml/arch/exception.h"
+
+using namespace std;
+using namespace ML;
+
+
+namespace RTBKIT {
+
+void
+serializeJsonBinary(ML::DB::Store_Writer & store, const Json::Value & val)
+{
+    unsigned char type = val.type();
+    store << type;
+
+    switch (val.type()) {
+    case Json::nullValue:
+        break;
+    case Json::intValue:
+        store << (long long)val.asInt();
+        break;
+    case Json::uintValue:
+        store << (unsigned long long)val.asUInt();
+        break;
+    case Json::realValue:
+        store << val.asDouble();
+        break;
+    case Json::stringValue:
+        store << val.asString();
+        break;
+    case Json::booleanValue:
+        store << val.asBool();
+        break;
+    case Json::arrayValue: {
+        DB::compact_size_t size(val.size());
+        store << size;
+        for (unsigned i = 0;  i < val.size();  ++i)
+            serializeJsonBinary(store, val[i]);
+        break;
+    }
+    case Json::objectValue: {
+        DB::compact_size_t size(val.size());
+        store << size;
+        for (auto it = val.begin(), end = val.end();  it != end;  ++it) {
+            store << it.memberName();
+            serializeJsonBinary(store, *it);
+        }
+        break;
+    }
+    default:
+        throw ML::Exception("serializeJsonBinary: unknown JSON value type");
+    }
+}
+
+void
+reconstituteJsonBinary(ML::DB::Store_Reader & store, Json::Value & val)
+{
+    unsigned char type;
+    store >> type;
+
+    switch (type) {
+    case Json::nullValue:
+        val = Json::Value();
+        break;
+    case Json::intValue: {
+        long long i;
+        store >> i;
+        val = Json::Value(i);
+        break;
+    }
+    case Json::uintValue: {
+        unsigned long long u;
+        store >> u;
+        val = Json::Value(u);
+        break;
+    }
+    case Json::realValue: {
+        double d;
+        store >> d;
+        val = Json::Value(d);
+        break;
+    }
+    case Json::stringValue: {
+        string s;
+        store >> s;
+        val = Json::Value(s);
+        break;
+    }
+    case Json::booleanValue: {
+        bool b;
+        store >> b;
+        val = Json::Value(b);
+        break;
+    }
+    case Json::arrayValue: {
+        DB::compact_size_t size(store);
+        val = Json::Value(Json::arrayValue);
+        if (size > 0)
+            val.resize(size);
+        for (unsigned i = 0;  i < size;  ++i)
+            reconstituteJsonBinary(store, val[i]);
+        break;
+    }
+    case Json::objectValue: {
+        DB::compact_size_t size(store);
+        val = Json::Value(Json::objectValue);
+        string key;
+        for (unsigned i = 0;  i < size;  ++i) {
+            store >> key;
+            reconstituteJsonBinary(store, val[key]);
+        }
+        break;
+    }
+    default:
+        throw ML::Exception("reconstituteJsonBinary: unknown JSON value type %d",
+                            (int)type);
+    }
+}
+
+} // namespace RTBKIT
@@ -0,0 +1,31 @@
+/* json_binary.h                                                   -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Native binary encoding of Json::Value for the persistence layer, so that
+   serialized structures don't need to print and re-parse JSON text.
+*/
+
+#pragma once
+
+#include "soa/jsoncpp/json.h"
+#include "jml/db/persistent_fwd.h"
+
+
+namespace RTBKIT {
+
+/*****************************************************************************/
+/* JSON BINARY ENCODING                                                      */
+/*****************************************************************************/
+
+/** Write the given JSON value as a tagged binary tree.  Integers use the
+    compact encoding, strings are length-prefixed and objects are written as
+    a count followed by (key, value) pairs.
+*/
+void serializeJsonBinary(ML::DB::Store_Writer & store,
+                         const Json::Value & val);
+
+/** Read back a value written by serializeJsonBinary(). */
+void reconstituteJsonBinary(ML::DB::Store_Reader & store,
+                            Json::Value & val);
+
+} // namespace RTBKIT
@@ -0,0 +1,63 @@
+/* local_augmentor.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Augmentors that run inside the router.
+*/
+
+#include "rtbkit/common/local_augmentor.h"
+#include "rtbkit/common/bid_request.h"
+
+using namespace std;
+using namespace Datacratic;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* AUGMENTATION REQUEST                                                       */
+/******************************************************************************/
+
+std::shared_ptr<BidRequest>
+AugmentationRequest::
+parseBidRequest() const
+{
+    if (bidRequest) return bidRequest;
+    return std::shared_ptr<BidRequest>(
+            BidRequest::parse(bidRequestStrFormat, bidRequestStr));
+}
+
+
+/******************************************************************************/
+/* LOCAL AUGMENTOR                                                            */
+/******************************************************************************/
+
+LocalAugmentor::
+LocalAugmentor(std::string augmentorName,
+               std::shared_ptr<ServiceProxies> proxies)
+    : ServiceBase("augmentor." + augmentorName, proxies),
+      augmentorName(std::move(augmentorName))
+{
+}
+
+LocalAugmentor::
+~LocalAugmentor()
+{
+}
+
+std::shared_ptr<LocalAugmentor>
+LocalAugmentor::
+create(std::shared_ptr<ServiceProxies> const & proxies,
+       Json::Value const & config)
+{
+    string name = config.get("name", "").asString();
+    if (name.empty())
+        throw ML::Exception("local augmentor configuration has no name: "
+                            + config.toString());
+
+    string type = config.get("type", "unknown").asString();
+
+    auto factory = PluginInterface<LocalAugmentor>::getPlugin(type);
+    return std::shared_ptr<LocalAugmentor>(factory(name, proxies, config));
+}
+
+} // namespace RTBKIT
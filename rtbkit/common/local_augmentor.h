@@ -0,0 +1,123 @@
+/* local_augmentor.h                                               -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Augmentors that run inside the router.
+*/
+
+#pragma once
+
+#include "soa/service/service_base.h"
+#include "soa/types/id.h"
+#include "soa/types/date.h"
+#include "rtbkit/common/augmentation.h"
+#include "rtbkit/common/plugin_interface.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace RTBKIT {
+
+struct BidRequest;
+
+
+/******************************************************************************/
+/* AUGMENTATION REQUEST                                                       */
+/******************************************************************************/
+
+/** Regroups the various parameters for the augmentation request.
+
+    Note that this object must be relatively copy friendly because it must be
+    transfered to worker threads in the MultiThreadedAugmentor and the
+    AsyncAugmentor.
+ */
+struct AugmentationRequest
+{
+    std::string augmentor;                    // Name of the augmentor
+    std::string router;                       // Router to respond to
+    Datacratic::Id id;                        // Auction id
+    std::shared_ptr<BidRequest> bidRequest;   // Bid request to augment
+    std::string bidRequestStr;                // Bid request as received
+    std::string bidRequestStrFormat;          // Format of bidRequestStr
+    std::vector<std::string> agents;          // Agents availble to bid
+    double timeAvailableMs;                   // Time to respond
+    Datacratic::Date startTime;               // Start of the latency timer
+
+    /** Returns the bid request, parsing it from bidRequestStr if the
+        augmentor didn't already do it (see Augmentor::setLazyBidRequests).
+        The result isn't cached so hold on to it rather than calling this
+        repeatedly.
+     */
+    std::shared_ptr<BidRequest> parseBidRequest() const;
+};
+
+
+/******************************************************************************/
+/* LOCAL AUGMENTOR                                                            */
+/******************************************************************************/
+
+/** Augmentor that runs in-process on the worker threads of the router's
+    augmentation loop instead of as a separate service, which saves the
+    network round trip for cheap augmentations.
+
+    A local augmentor is seen by the loop as one more instance of the
+    augmentor called augmentorName: its answers are merged and timed out
+    exactly like those of remote instances, which can run alongside it.
+
+    Local augmentors are plugins: they register a factory with
+    PluginInterface<LocalAugmentor> and get loaded by type from a library
+    called lib<type>_augmentor.so if they aren't already linked in.
+ */
+struct LocalAugmentor : public Datacratic::ServiceBase
+{
+    LocalAugmentor(std::string augmentorName,
+                   std::shared_ptr<Datacratic::ServiceProxies> proxies);
+
+    virtual ~LocalAugmentor();
+
+    LocalAugmentor(const LocalAugmentor & other) = delete;
+    LocalAugmentor & operator=(const LocalAugmentor & other) = delete;
+
+    virtual void init() {}
+    virtual void start() {}
+    virtual void shutdown() {}
+
+    typedef std::function<void (const AugmentationList &)> SendResponseCB;
+
+    /** Augment a request.  Called on one of the worker threads of the loop;
+        the bid request is always parsed.
+
+        sendResponse may be called from any thread but only once.  Requests
+        that aren't answered in time count as timed out.
+     */
+    virtual void onRequest(const AugmentationRequest & request,
+                           SendResponseCB sendResponse) = 0;
+
+    /** Name of the augmentation provided, as used in the agent configs. */
+    const std::string augmentorName;
+
+    //
+    // factory
+    //
+
+    /** Create the local augmentor described by the given configuration:
+
+            { "name": <augmentor name>, "type": <plugin>, ... }
+
+        The whole object is passed on to the plugin's factory.
+     */
+    static std::shared_ptr<LocalAugmentor>
+    create(std::shared_ptr<Datacratic::ServiceProxies> const & proxies,
+           Json::Value const & config);
+
+    typedef std::function<LocalAugmentor * (
+            std::string augmentorName,
+            std::shared_ptr<Datacratic::ServiceProxies> const & proxies,
+            Json::Value const & config)> Factory;
+
+    /** plugin interface needs to be able to request the root name of the plugin library */
+    static const std::string libNameSufix() { return "augmentor"; }
+};
+
+} // namespace RTBKIT
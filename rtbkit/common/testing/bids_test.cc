@@ -19,3 +19,84 @@ BOOST_AUTO_TEST_CASE(creativeMatrixTest)
   BOOST_CHECK_EQUAL(bidObj[0].spotIndex, 0);
   BOOST_CHECK_EQUAL(bidObj[0].ext.toStringNoNewLine(), "[\"test1\",\"test2\"]");
 }
+
+BOOST_AUTO_TEST_CASE(bidResponseBatchTest)
+{
+    Bids bids;
+
+    Bid bid;
+    bid.spotIndex = 0;
+    bid.bid(2, USD_CPM(1.25), 0.5);
+    bid.account = AccountKey("campaign:strategy");
+    bid.ext = Json::parse("{\"deal\":\"abc\"}");
+    bids.push_back(bid);
+
+    Bid nullBid;
+    nullBid.spotIndex = 1;
+    bids.push_back(nullBid);
+
+    bids.dataSources.insert("segments");
+
+    BidResponseBatch batch;
+    BOOST_CHECK(batch.empty());
+    batch.add(Id("85885bb0-b91b-11e2-c4cf-7fba90171555"), bids, "", "{\"x\":1}");
+    batch.add(Id(42), Bids(), "{\"name\":\"none\"}", "null");
+    BOOST_CHECK_EQUAL(batch.size(), 2);
+
+    string data = batch.release();
+    BOOST_CHECK(batch.empty());
+
+    vector<BidResponseBatch::Response> responses;
+    BidResponseBatch::decode(data, [&] (BidResponseBatch::Response & response)
+        {
+            responses.push_back(std::move(response));
+        });
+
+    BOOST_REQUIRE_EQUAL(responses.size(), 2);
+
+    const auto & first = responses[0];
+    BOOST_CHECK_EQUAL(first.auctionId, Id("85885bb0-b91b-11e2-c4cf-7fba90171555"));
+    BOOST_CHECK_EQUAL(first.meta, "{\"x\":1}");
+    BOOST_CHECK_EQUAL(first.wcm, "");
+    // Same thing as the JSON encoding, for what the router looks at
+    BOOST_CHECK_EQUAL(first.bids.toJsonStr(), bids.toJsonStr());
+    BOOST_CHECK_EQUAL(first.bids[0].spotIndex, 0);
+    BOOST_CHECK_EQUAL(first.bids[1].spotIndex, 1);
+    BOOST_CHECK(first.bids[1].isNullBid());
+
+    const auto & second = responses[1];
+    BOOST_CHECK_EQUAL(second.auctionId, Id(42));
+    BOOST_CHECK(second.bids.empty());
+    BOOST_CHECK_EQUAL(second.wcm, "{\"name\":\"none\"}");
+
+    BOOST_CHECK_THROW(BidResponseBatch::decode(data.substr(0, data.size() - 3),
+                                               [] (BidResponseBatch::Response &) {}),
+                      ML::Exception);
+
+    // A response that can't be decoded doesn't prevent the next ones
+    string corrupted = data;
+    size_t ext = corrupted.find("{\"deal\"");
+    BOOST_REQUIRE(ext != string::npos);
+    corrupted[ext] = '[';
+
+    responses.clear();
+    vector<Id> errors;
+    BidResponseBatch::decode(corrupted,
+                             [&] (BidResponseBatch::Response & response)
+                             {
+                                 responses.push_back(std::move(response));
+                             },
+                             [&] (const Id & auctionId, const string & error)
+                             {
+                                 errors.push_back(auctionId);
+                             });
+
+    BOOST_REQUIRE_EQUAL(errors.size(), 1);
+    BOOST_CHECK_EQUAL(errors[0], Id("85885bb0-b91b-11e2-c4cf-7fba90171555"));
+    BOOST_REQUIRE_EQUAL(responses.size(), 1);
+    BOOST_CHECK_EQUAL(responses[0].auctionId, Id(42));
+
+    BOOST_CHECK_THROW(BidResponseBatch::decode(corrupted,
+                                               [] (BidResponseBatch::Response &) {}),
+                      ML::Exception);
+}
@@ -423,6 +423,7 @@ AgentConfig()
       roundRobinWeight(0),
       bidProbability(1.0), minTimeAvailableMs(5.0),
       maxInFlight(100),
+      bidRequestFormat(BRF_JSON_RAW),
       blacklistType(BL_OFF),
       blacklistScope(BL_ACCOUNT), blacklistTime(15.0),
       bidControlType(BC_RELAY), fixedBidCpmInMicros(0),
@@ -638,6 +639,8 @@ createFromJson(const Json::Value & json)
         }
         else if (it.memberName() == "bidderInterface")
             newConfig.bidderInterface = it->asString();
+        else if (it.memberName() == "bidRequestFormat")
+            newConfig.bidRequestFormat = parseBidRequestFormat(it->asString());
         else if (it.memberName() == "userPartition") {
             newConfig.userPartition.fromJson(*it);
         }
@@ -771,9 +774,37 @@ createFromJson(const Json::Value & json)
     if (newConfig.creatives.empty())
         throw Exception("can't configure a agent with no creatives");
 
+    newConfig.indexCreatives();
+
     return newConfig;
 }
 
+int
+AgentConfig::
+creativeIndex(int creativeId) const
+{
+    auto it = creativeIndexById.find(creativeId);
+    if (it != creativeIndexById.end()
+        && it->second < creatives.size()
+        && creatives[it->second].id == creativeId)
+        return it->second;
+
+    // Not indexed, or the index is stale; scan
+    for (unsigned i = 0;  i < creatives.size();  ++i)
+        if (creatives[i].id == creativeId)
+            return i;
+    return -1;
+}
+
+void
+AgentConfig::
+indexCreatives()
+{
+    creativeIndexById.clear();
+    for (unsigned i = 0;  i < creatives.size();  ++i)
+        creativeIndexById.insert(std::make_pair(creatives[i].id, i));
+}
+
 Json::Value
 AgentConfig::SegmentInfo::
 toJson() const
@@ -811,6 +842,8 @@ toJson(bool includeCreatives) const
 
     if (!bidderInterface.empty())
         result["bidderInterface"] = bidderInterface;
+    if (bidRequestFormat != BRF_JSON_RAW)
+        result["bidRequestFormat"] = print(bidRequestFormat);
 
     if (!urlFilter.empty())
         result["urlFilter"] = urlFilter.toJson();
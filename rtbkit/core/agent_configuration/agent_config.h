@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <unordered_map>
 #include "jml/arch/spinlock.h"
 #include "soa/jsoncpp/json.h"
 #include <boost/regex.hpp>
@@ -311,6 +312,9 @@ struct AgentConfig {
 
     std::string bidderInterface;
 
+    /** Format in which the agent wants to receive bid requests. */
+    BidRequestFormat bidRequestFormat;
+
     std::vector<std::string> requiredIds;
 
     IncludeExclude<DomainMatcher> hostFilter;
@@ -368,6 +372,19 @@ struct AgentConfig {
 
     std::vector<Creative> creatives;
 
+    /** Return the index in creatives of the creative with the given id, or
+        -1 if there is none.  This uses the index built by indexCreatives(),
+        and only falls back to a linear scan on a miss.
+    */
+    int creativeIndex(int creativeId) const;
+
+    /** Rebuild the creative id to index mapping.  Called automatically when
+        the configuration is parsed.
+    */
+    void indexCreatives();
+
+    std::unordered_map<int, int> creativeIndexById;
+
     BlacklistType blacklistType;
     BlacklistScope blacklistScope;
     double blacklistTime;
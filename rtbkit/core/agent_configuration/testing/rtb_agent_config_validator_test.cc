@@ -235,3 +235,77 @@ BOOST_AUTO_TEST_CASE( test_agent_config_language_filter )
 
     BOOST_CHECK_THROW(config.parse(payload),ML::Exception);
 }
+
+BOOST_AUTO_TEST_CASE( test_agent_config_bid_request_format )
+{
+    AgentConfig config;
+    std::string payload;
+
+    // Default is the raw exchange format
+    payload = R"JSON( {
+            "account" : ["hello", "worlds"],
+            "creatives": [
+            {
+                "name": "MaCreative",
+                "height": 250,
+                "width": 300,
+                "id": 5
+            }]}
+        )JSON";
+
+    config.parse(payload);
+    BOOST_CHECK_EQUAL(config.bidRequestFormat, BRF_JSON_RAW);
+    BOOST_CHECK(!config.toJson().isMember("bidRequestFormat"));
+
+    payload = R"JSON( {
+            "account" : ["hello", "worlds"],
+            "bidRequestFormat": "binary",
+            "creatives": [
+            {
+                "name": "MaCreative",
+                "height": 250,
+                "width": 300,
+                "id": 5
+            }]}
+        )JSON";
+
+    config.parse(payload);
+    BOOST_CHECK_EQUAL(config.bidRequestFormat, BRF_BINARY_V1);
+    BOOST_CHECK_EQUAL(config.toJson()["bidRequestFormat"].asString(), "binary");
+
+    // Unknown format
+    payload = R"JSON( {
+            "account" : ["hello", "worlds"],
+            "bidRequestFormat": "xml",
+            "creatives": [
+            {
+                "name": "MaCreative",
+                "height": 250,
+                "width": 300,
+                "id": 5
+            }]}
+        )JSON";
+
+    BOOST_CHECK_THROW(config.parse(payload), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_agent_config_creative_index )
+{
+    AgentConfig config;
+    std::string payload = R"JSON( {
+            "account" : ["hello", "worlds"],
+            "creatives": [
+            { "name": "c1", "height": 250, "width": 300, "id": 5 },
+            { "name": "c2", "height": 90, "width": 728, "id": 12 }
+            ]}
+        )JSON";
+
+    config.parse(payload);
+    BOOST_CHECK_EQUAL(config.creativeIndex(5), 0);
+    BOOST_CHECK_EQUAL(config.creativeIndex(12), 1);
+    BOOST_CHECK_EQUAL(config.creativeIndex(7), -1);
+
+    // Creatives added after parsing are still found
+    config.creatives.push_back(Creative(160, 600, "c3", 7));
+    BOOST_CHECK_EQUAL(config.creativeIndex(7), 2);
+}
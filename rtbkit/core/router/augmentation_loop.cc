@@ -13,6 +13,8 @@
 #include "jml/arch/exception_handler.h"
 #include "soa/service/zmq_utils.h"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <boost/make_shared.hpp>
 #include "rtbkit/core/agent_configuration/agent_config.h"
 
@@ -24,6 +26,22 @@ using namespace ML;
 
 namespace RTBKIT {
 
+namespace {
+
+/** Give back the in-flight slot taken by a request on an instance, unless
+    that was already done.  Returns the instance if a slot was released.
+*/
+std::shared_ptr<AugmentorInstanceInfo>
+releaseRequest(std::weak_ptr<AugmentorInstanceInfo> & request)
+{
+    auto instance = request.lock();
+    request.reset();
+    if (instance) instance->numInFlight--;
+    return instance;
+}
+
+} // file scope
+
 
 /*****************************************************************************/
 /* AUGMENTATION LOOP                                                         */
@@ -34,10 +52,15 @@ AugmentationLoop(ServiceBase & parent,
                  const std::string & name)
     : ServiceBase(name, parent),
       allAugmentors(0),
+      hedgeFraction(0.0),
       idle_(1),
       inbox(65536),
       disconnections(1024),
-      toAugmentors(getZmqContext())
+      toAugmentors(getZmqContext()),
+      localRequests(4096),
+      localResponses(65536),
+      stopLocalWorkers(false),
+      numLocalThreads(2)
 {
     updateAllAugmentors();
 }
@@ -47,10 +70,15 @@ AugmentationLoop(std::shared_ptr<ServiceProxies> proxies,
                  const std::string & name)
     : ServiceBase(name, proxies),
       allAugmentors(0),
+      hedgeFraction(0.0),
       idle_(1),
       inbox(65536),
       disconnections(1024),
-      toAugmentors(getZmqContext())
+      toAugmentors(getZmqContext()),
+      localRequests(4096),
+      localResponses(65536),
+      stopLocalWorkers(false),
+      numLocalThreads(2)
 {
     updateAllAugmentors();
 }
@@ -100,9 +128,18 @@ init()
             doAugmentation(std::move(entry));
         };
 
+    localResponses.onEvent = [&] (LocalResponse && response)
+        {
+            doLocalResponse(std::move(response));
+        };
+
+    for (auto & augmentor: localAugmentors)
+        augmentor->init();
+
     addSource("AugmentationLoop::inbox", inbox);
     addSource("AugmentationLoop::disconnections", disconnections);
     addSource("AugmentationLoop::toAugmentors", toAugmentors);
+    addSource("AugmentationLoop::localResponses", localResponses);
 
     addPeriodic("AugmentationLoop::checkExpiries", 0.001,
                 [=] (int) { checkExpiries(); });
@@ -116,6 +153,16 @@ AugmentationLoop::
 start()
 {
     //toAugmentors.start();
+
+    if (!localAugmentors.empty()) {
+        for (auto & augmentor: localAugmentors)
+            augmentor->start();
+
+        stopLocalWorkers = false;
+        for (int i = 0;  i < numLocalThreads;  ++i)
+            localWorkers.create_thread([=] { this->runLocalWorker(); });
+    }
+
     MessageLoop::start();
 }
 
@@ -131,8 +178,14 @@ void
 AugmentationLoop::
 shutdown()
 {
+    stopLocalWorkers = true;
+    localWorkers.join_all();
+
     MessageLoop::shutdown();
     toAugmentors.shutdown();
+
+    for (auto & augmentor: localAugmentors)
+        augmentor->shutdown();
 }
 
 size_t
@@ -154,6 +207,92 @@ bindAugmentors(const std::string & uri)
     }
 }
 
+void
+AugmentationLoop::
+setHedging(double fraction)
+{
+    if (fraction < 0.0 || fraction >= 1.0)
+        throw ML::Exception("hedging fraction must be in [0, 1): %f",
+                            fraction);
+    hedgeFraction = fraction;
+}
+
+void
+AugmentationLoop::
+addLocalAugmentor(std::shared_ptr<LocalAugmentor> augmentor, int maxInFlight)
+{
+    ExcCheck(augmentor, "null local augmentor");
+
+    const string & name = augmentor->augmentorName;
+    ExcCheck(!name.empty(), "no augmentor name specified");
+
+    auto& info = augmentors[name];
+    if (!info) info = std::make_shared<AugmentorInfo>(name);
+
+    if (info->findInstance("local"))
+        throw ML::Exception("augmentor %s already has a local instance",
+                            name.c_str());
+
+    auto instance = std::make_shared<AugmentorInstanceInfo>("local", maxInFlight);
+    instance->local = augmentor;
+    instance->requestEvent = "augmentor." + name + ".instances.local.request";
+    info->instances.push_back(instance);
+
+    localAugmentors.push_back(augmentor);
+
+    updateAllAugmentors();
+}
+
+void
+AugmentationLoop::
+setLocalThreads(int numThreads)
+{
+    if (numThreads < 1)
+        throw ML::Exception("need at least one local augmentor thread");
+    numLocalThreads = numThreads;
+}
+
+void
+AugmentationLoop::
+runLocalWorker()
+{
+    LocalRequest item;
+
+    while (!stopLocalWorkers) {
+        if (!localRequests.tryPop(item, 0.1)) continue;
+
+        const string & name = item.request.augmentor;
+
+        // Already timed out; the loop has given up on it.
+        if (Date::now() >= item.deadline) {
+            recordHit("augmentor.%s.instances.local.expiredInQueue", name);
+            continue;
+        }
+
+        Id id = item.request.id;
+        Date startTime = item.request.startTime;
+
+        auto sendResponse = [=] (const AugmentationList & augmentation)
+            {
+                LocalResponse response;
+                response.id = id;
+                response.augmentor = name;
+                response.startTime = startTime;
+                response.augmentation = augmentation;
+
+                if (!localResponses.tryPush(std::move(response)))
+                    recordHit("augmentor.%s.instances.local.droppedResponse",
+                              name);
+            };
+
+        try {
+            item.augmentor->onRequest(item.request, sendResponse);
+        } catch (const std::exception &) {
+            recordHit("augmentor.%s.instances.local.exceptions", name);
+        }
+    }
+}
+
 void
 AugmentationLoop::
 handleAugmentorMessage(const std::vector<std::string> & message)
@@ -180,9 +319,17 @@ recordStats()
          it != end;  ++it)
     {
         size_t inFlights = 0;
-        for (const auto& instance : it->second->instances)
+        for (const auto& instance : it->second->instances) {
             inFlights += instance->numInFlight;
 
+            recordLevel(instance->latencyEwma * 1000.0,
+                        "augmentor.%s.instances.%s.latencyEwmaMs",
+                        it->first, instance->addr);
+            recordLevel(instance->timeoutEwma,
+                        "augmentor.%s.instances.%s.timeoutRateEwma",
+                        it->first, instance->addr);
+        }
+
         recordLevel(inFlights, "augmentor.%s.numInFlight", it->first);
     }
 }
@@ -208,6 +355,17 @@ checkExpiries()
             return Date();
         };
 
+    auto onHedge = [&] (const Id & id,
+                        const std::weak_ptr<Entry> & weakEntry) -> Date
+        {
+            auto entry = weakEntry.lock();
+            if (entry) this->doHedge(*entry);
+            return Date();
+        };
+
+    if (hedging.earliest <= now)
+        hedging.expire(onHedge, now);
+
     if (augmenting.earliest <= now)
         augmenting.expire(onExpired, now);
 
@@ -270,7 +428,9 @@ augment(const std::shared_ptr<AugmentationInfo> & info,
     // Get a set of all augmentors
     std::set<std::string> augmentors;
 
-    // Now go through and find all of the bidders
+    // Now go through and find all of the bidders.  Each agent appears once
+    // in the groups, so the lists only have duplicates when a config names
+    // the same augmentor twice, which is checked on its few augmentations.
     for (unsigned i = 0;  i < info->potentialGroups.size();  ++i) {
         const GroupPotentialBidders & group = info->potentialGroups[i];
         for (unsigned j = 0;  j < group.size();  ++j) {
@@ -278,8 +438,14 @@ augment(const std::shared_ptr<AugmentationInfo> & info,
             const AgentConfig & config = *bidder.config;
             for (unsigned k = 0;  k < config.augmentations.size();  ++k) {
                 const std::string & name = config.augmentations[k].name;
+
+                bool seen = false;
+                for (unsigned l = 0;  l < k && !seen;  ++l)
+                    seen = config.augmentations[l].name == name;
+                if (seen) continue;
+
                 augmentors.insert(name);
-                entry->augmentorAgents[name].insert(bidder.agent);
+                entry->augmentorAgents[name].push_back(bidder.agent);
             }
         }
     }
@@ -300,10 +466,9 @@ augment(const std::shared_ptr<AugmentationInfo> & info,
             // Augmentor we need to run
             //cerr << "augmenting with " << it2->name << endl;
             recordEvent("augmentation.request");
-            string eventName = "augmentor." + it2->name + ".request";
-            recordEvent(eventName.c_str());
-            
-             entry->outstanding.insert(*it1);
+            recordEvent(it2->info->requestEvent.c_str());
+
+            entry->outstanding.insert(*it1);
 
             ++it1;
             ++it2;
@@ -345,22 +510,29 @@ augment(const std::shared_ptr<AugmentationInfo> & info,
 
 std::shared_ptr<AugmentorInstanceInfo>
 AugmentationLoop::
-pickInstance(AugmentorInfo& aug)
+pickInstance(AugmentorInfo& aug, double timeoutCost,
+             const AugmentorInstanceInfo * exclude)
 {
     std::shared_ptr<AugmentorInstanceInfo> instance;
-    int minInFlights = std::numeric_limits<int>::max();
-
-    stringstream ss;
+    double minCost = INFINITY;
 
     for (auto it = aug.instances.begin(), end = aug.instances.end();
          it != end; ++it)
     {
         auto & ptr = *it;
-        if (ptr->numInFlight >= minInFlights) continue;
+        if (ptr.get() == exclude) continue;
         if (ptr->numInFlight >= ptr->maxInFlight) continue;
 
+        // Ties (eg, instances that haven't answered anything yet) go to the
+        // least loaded instance.
+        double cost = ptr->cost(timeoutCost);
+        if (cost > minCost) continue;
+        if (cost == minCost && instance
+            && ptr->numInFlight >= instance->numInFlight)
+            continue;
+
         instance = ptr;
-        minInFlights = ptr->numInFlight;
+        minCost = cost;
     }
 
     if (instance) instance->numInFlight++;
@@ -385,41 +557,38 @@ doAugmentation(std::shared_ptr<Entry>&& entry)
 
     bool sentToAugmentor = false;
 
+    // A request that times out costs us the whole window
+    double timeoutCost = std::max(0.0, now.secondsUntil(entry->timeout));
+
     for (auto it = entry->outstanding.begin(), end = entry->outstanding.end();
          it != end;  ++it)
     {
         auto & aug = *augmentors[*it];
 
-        auto instance = pickInstance(aug);
+        auto instance = pickInstance(aug, timeoutCost);
         if (!instance) {
             recordHit("augmentor.%s.skippedTooManyInFlight", *it);
             continue;
         }
-        recordHit("augmentor.%s.instances.%s.request", *it, instance->addr);
+        recordHit(instance->requestEvent);
 
-        set<string> agents = entry->augmentorAgents[*it];
-
-        entry->instances[*it] = instance;
-        
-        std::ostringstream availableAgentsStr;
-        ML::DB::Store_Writer writer(availableAgentsStr);
-        writer.save(agents);
-
-        // Send the message to the augmentor
-        toAugmentors.sendMessage(
-                instance->addr,
-                "AUGMENT", "1.0", *it,
-                entry->info->auction->id.toString(),
-                entry->info->auction->requestStrFormat,
-                entry->info->auction->requestStr,
-                availableAgentsStr.str(),
-                Date::now());
+        auto & requests = entry->instances[*it];
+        requests.primary = instance;
+        requests.sent = now;
+        sendRequest(*entry, *it, *instance);
 
         sentToAugmentor = true;
     }
 
-    if (sentToAugmentor)
-        augmenting.insert(entry->info->auction->id, std::move(entry), entry->timeout);
+    if (sentToAugmentor) {
+        const Id & id = entry->info->auction->id;
+        if (hedgeFraction > 0.0) {
+            Date hedgeAt = now.plusSeconds(hedgeFraction * timeoutCost);
+            hedging.erase(id);
+            hedging.insert(id, std::weak_ptr<Entry>(entry), hedgeAt);
+        }
+        augmenting.insert(id, std::move(entry), entry->timeout);
+    }
     else entry->onFinished(entry->info);
 
     recordLevel(Date::now().secondsSince(now), "requestTimeMs");
@@ -427,6 +596,102 @@ doAugmentation(std::shared_ptr<Entry>&& entry)
     idle_ = 0;
 }
 
+void
+AugmentationLoop::
+sendRequest(Entry & entry, const std::string & augmentor,
+            const AugmentorInstanceInfo & instance)
+{
+    auto agentsIt = entry.augmentorAgents.find(augmentor);
+    ExcAssert(agentsIt != entry.augmentorAgents.end());
+
+    const Auction & auction = *entry.info->auction;
+
+    // Local augmentors get the request itself; nothing is serialized.
+    if (instance.local) {
+        LocalRequest item;
+        item.augmentor = instance.local;
+        item.deadline = entry.timeout;
+
+        AugmentationRequest & request = item.request;
+        request.augmentor = augmentor;
+        request.router = serviceName();
+        request.id = auction.id;
+        request.bidRequest = auction.request;
+        request.agents = agentsIt->second;
+        request.startTime = Date::now();
+        request.timeAvailableMs =
+            std::max(0.0, request.startTime.secondsUntil(entry.timeout)) * 1000.0;
+
+        // Nobody is going to answer so the request will time out.
+        if (!localRequests.tryPush(std::move(item)))
+            recordHit("augmentor.%s.instances.local.queueFull", augmentor);
+        return;
+    }
+
+    if (instance.binaryRequests) {
+        if (entry.payload.size() == 0) {
+            entry.payload = zmq::message_t(AugmentMessage::encodePayload(
+                            auction.id,
+                            auction.requestStrFormat,
+                            auction.requestStr));
+        }
+
+        // The payload frame is passed by reference so every augmentor of
+        // the auction sends the same buffer.
+        toAugmentors.sendMessage(
+                instance.addr,
+                "AUGMENT", "2.0", augmentor,
+                entry.payload,
+                AugmentMessage::encodeAgents(agentsIt->second),
+                AugmentMessage::encodeStartTime(Date::now()));
+        return;
+    }
+
+    std::ostringstream availableAgentsStr;
+    ML::DB::Store_Writer writer(availableAgentsStr);
+    writer.save(agentsIt->second);
+
+    // Send the message to the augmentor
+    toAugmentors.sendMessage(
+            instance.addr,
+            "AUGMENT", "1.0", augmentor,
+            auction.id.toString(),
+            auction.requestStrFormat,
+            auction.requestStr,
+            availableAgentsStr.str(),
+            Date::now());
+}
+
+void
+AugmentationLoop::
+doHedge(Entry & entry)
+{
+    double timeoutCost = std::max(0.0, Date::now().secondsUntil(entry.timeout));
+
+    for (const auto & augmentor: entry.outstanding) {
+        auto requestsIt = entry.instances.find(augmentor);
+        if (requestsIt == entry.instances.end()) continue;
+
+        auto & requests = requestsIt->second;
+        if (requests.hedged) continue;
+        requests.hedged = true;
+
+        auto augIt = augmentors.find(augmentor);
+        if (augIt == augmentors.end()) continue;
+
+        auto primary = requests.primary.lock();
+        auto instance = pickInstance(*augIt->second, timeoutCost, primary.get());
+        if (!instance) {
+            recordHit("augmentor.%s.hedgeSkipped", augmentor);
+            continue;
+        }
+        recordHit("augmentor.%s.instances.%s.hedge", augmentor, instance->addr);
+
+        requests.hedge = instance;
+        sendRequest(entry, augmentor, *instance);
+    }
+}
+
 void
 AugmentationLoop::
 doConfig(const std::vector<std::string> & message)
@@ -443,7 +708,8 @@ doConfig(const std::vector<std::string> & message)
         maxInFlight = std::stoi(message[4]);
     if (maxInFlight < 0) maxInFlight = 3000;
 
-    ExcCheckEqual(version, "1.0", "unknown version for config message");
+    ExcCheck(version == "1.0" || version == "2.0",
+             "unknown version for config message");
     ExcCheck(!name.empty(), "no augmentor name specified");
 
     //cerr << "configuring augmentor " << name << " on " << connectTo
@@ -457,7 +723,11 @@ doConfig(const std::vector<std::string> & message)
         recordHit("augmentor.%s.configured", name);
     }
 
-    info->instances.push_back(std::make_shared<AugmentorInstanceInfo>(addr, maxInFlight));
+    auto instance = std::make_shared<AugmentorInstanceInfo>(addr, maxInFlight);
+    instance->binaryRequests = version == "2.0";
+    instance->requestEvent =
+        "augmentor." + name + ".instances." + addr + ".request";
+    info->instances.push_back(instance);
     recordHit("augmentor.%s.instances.%s.configured", name, addr);
 
 
@@ -548,24 +818,51 @@ doResponse(const std::vector<std::string> & message)
 
     recordLevel(timer.elapsed_wall(), "responseParseTimeMs");
 
-    {
-        double timeTakenMs = startTime.secondsUntil(Date::now()) * 1000.0;
-        string eventName = "augmentor." + augmentor + ".timeTakenMs";
-        recordEvent(eventName.c_str(), ET_OUTCOME, timeTakenMs);
-    }
-
     {
         double responseLength = augmentation.size();
         string eventName = "augmentor." + augmentor + ".responseLengthBytes";
         recordEvent(eventName.c_str(), ET_OUTCOME, responseLength);
     }
 
+    handleResponse(addr, startTime, id, augmentor, augmentationList,
+                   augmentation == "" || augmentation == "null");
+}
+
+void
+AugmentationLoop::
+doLocalResponse(LocalResponse && response)
+{
+    recordEvent("augmentation.response");
+
+    handleResponse("local", response.startTime, response.id,
+                   response.augmentor, response.augmentation,
+                   response.augmentation.empty());
+}
+
+void
+AugmentationLoop::
+handleResponse(const std::string & addr, Date startTime,
+               const Id & id, const std::string & augmentor,
+               const AugmentationList & augmentationList,
+               bool nullResponse)
+{
+    {
+        double timeTakenMs = startTime.secondsUntil(Date::now()) * 1000.0;
+        string eventName = "augmentor." + augmentor + ".timeTakenMs";
+        recordEvent(eventName.c_str(), ET_OUTCOME, timeTakenMs);
+    }
+
+    // Late answers still tell us how fast the instance is.
     auto augmentorIt = augmentors.find(augmentor);
     if (augmentorIt != augmentors.end()) {
         auto instance = augmentorIt->second->findInstance(addr);
-        if (instance) instance->numInFlight--;
+        if (instance)
+            instance->recordLatency(startTime.secondsUntil(Date::now()));
     }
 
+    // The in-flight slots of a request are released when the request is
+    // resolved: here if it's still pending, otherwise on expiry or when
+    // another instance answered first.
     auto augmentingIt = augmenting.find(id);
     if (augmentingIt == augmenting.end()) {
         recordHit("augmentation.unknown");
@@ -576,9 +873,53 @@ doResponse(const std::vector<std::string> & message)
 
     auto& entry = *augmentingIt;
 
-    const char* eventType =
-        (augmentation == "" || augmentation == "null") ?
-        "nullResponse" : "validResponse";
+    bool wonByHedge = false;
+    auto requestsIt = entry.second->instances.find(augmentor);
+    if (requestsIt != entry.second->instances.end()) {
+        auto & requests = requestsIt->second;
+
+        auto matches = [&] (const std::weak_ptr<AugmentorInstanceInfo> & r)
+            {
+                auto instance = r.lock();
+                return instance && instance->addr == addr;
+            };
+
+        std::weak_ptr<AugmentorInstanceInfo> * answered = nullptr;
+        std::weak_ptr<AugmentorInstanceInfo> * other = nullptr;
+        if (matches(requests.primary)) {
+            answered = &requests.primary;
+            other = &requests.hedge;
+        }
+        else if (matches(requests.hedge)) {
+            answered = &requests.hedge;
+            other = &requests.primary;
+            wonByHedge = true;
+        }
+
+        if (answered) {
+            releaseRequest(*answered)->recordOutcome(false);
+
+            // First answer wins; the other request is abandoned.  If the
+            // primary lost, the time it's been out is a lower bound of its
+            // latency so count that against it now.
+            if (entry.second->outstanding.count(augmentor)) {
+                auto loser = releaseRequest(*other);
+                if (loser && wonByHedge)
+                    loser->recordLatency(requests.sent.secondsUntil(Date::now()));
+            }
+        }
+    }
+
+    if (!entry.second->outstanding.count(augmentor)) {
+        // Duplicate of a request that was already answered
+        recordHit("augmentor.%s.hedgeLost", augmentor);
+        return;
+    }
+
+    if (wonByHedge)
+        recordHit("augmentor.%s.hedgeWon", augmentor);
+
+    const char* eventType = nullResponse ? "nullResponse" : "validResponse";
     recordHit("augmentor.%s.%s", augmentor, eventType);
     recordHit("augmentor.%s.instances.%s.%s", augmentor, addr, eventType);
 
@@ -588,22 +929,28 @@ doResponse(const std::vector<std::string> & message)
     entry.second->outstanding.erase(augmentor);
     if (entry.second->outstanding.empty()) {
         entry.second->onFinished(entry.second->info);
+        hedging.erase(id);
         augmenting.erase(augmentingIt);
     }
 }
 
 void
 AugmentationLoop::
-augmentationExpired(const Id & id, const Entry & entry)
+augmentationExpired(const Id & id, Entry & entry)
 {
-    for (const auto & instance: entry.instances) {
-        // If the instance still exsits (it is still alive), we decrement
-        // the inFlight count
-        auto info = instance.second.lock();
-        if (info) info->numInFlight--;
+    hedging.erase(id);
+
+    for (auto & requests: entry.instances) {
+        // Requests that weren't answered timed out.  If the instance still
+        // exists (it is still alive), this gives back its in-flight slot.
+        for (auto request: { &requests.second.primary,
+                             &requests.second.hedge }) {
+            auto instance = releaseRequest(*request);
+            if (instance) instance->recordOutcome(true);
+        }
     }
 
     entry.onFinished(entry.info);
-}                     
+}
 
 } // namespace RTBKIT
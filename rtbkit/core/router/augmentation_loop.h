@@ -9,6 +9,7 @@
 #define __rtb_router__augmentation_loop_h__
 
 #include "rtbkit/common/augmentation.h"
+#include "rtbkit/common/local_augmentor.h"
 #include "soa/service/timeout_map.h"
 #include "soa/service/zmq_endpoint.h"
 #include "soa/service/typed_message_channel.h"
@@ -19,7 +20,9 @@
 #include "soa/service/socket_per_thread.h"
 #include "soa/service/stats_events.h"
 #include "jml/arch/spinlock.h"
+#include "jml/utils/ring_buffer.h"
 #include <boost/thread/locks.hpp>
+#include <atomic>
 #include "soa/gc/gc_lock.h"
 
 
@@ -34,19 +37,66 @@ namespace RTBKIT {
  */
 struct AugmentorInstanceInfo {
     AugmentorInstanceInfo(const std::string& addr = "", int maxInFlight = 0) :
-        addr(addr), numInFlight(0), maxInFlight(maxInFlight)
+        addr(addr), numInFlight(0), maxInFlight(maxInFlight),
+        binaryRequests(false),
+        latencyEwma(DefaultLatency), timeoutEwma(0.0)
     {}
 
     std::string addr;
     int numInFlight;
     int maxInFlight;
+
+    /** Whether the instance understands version 2.0 AUGMENT messages (see
+        AugmentMessage).  Older instances get the 1.0 text version.
+    */
+    bool binaryRequests;
+
+    /// Pre-formatted name of the event recorded for each request sent.
+    std::string requestEvent;
+
+    /// Set if the instance runs in-process on the local worker threads.
+    std::shared_ptr<LocalAugmentor> local;
+
+    /** Exponentially weighted moving averages of the response time of the
+        instance (in seconds) and of the fraction of its requests that time
+        out.  Used to steer requests towards fast and reliable instances.
+    */
+    double latencyEwma;
+    double timeoutEwma;
+
+    /// Latency assumed for an instance until it has answered something.
+    static constexpr double DefaultLatency = 0.001;
+
+    /// Weight given to each new sample in the moving averages.
+    static constexpr double EwmaWeight = 0.1;
+
+    void recordLatency(double seconds)
+    {
+        latencyEwma += EwmaWeight * (seconds - latencyEwma);
+    }
+
+    void recordOutcome(bool timedOut)
+    {
+        timeoutEwma += EwmaWeight * ((timedOut ? 1.0 : 0.0) - timeoutEwma);
+    }
+
+    /** Expected cost (in seconds) of sending one more request to this
+        instance, given what a timeout costs us.
+    */
+    double cost(double timeoutCost) const
+    {
+        return (latencyEwma + timeoutEwma * timeoutCost) * (numInFlight + 1);
+    }
 };
 
 /** Information about a given class of augmentor. */
 struct AugmentorInfo {
-    AugmentorInfo(const std::string& name = "") : name(name) {}
+    AugmentorInfo(const std::string& name = "") :
+        name(name), requestEvent("augmentor." + name + ".request")
+    {}
 
     std::string name;                   ///< What the augmentation is called
+    std::string requestEvent;           ///< Event recorded for each auction
     std::vector<std::shared_ptr<AugmentorInstanceInfo>> instances;
 
     std::shared_ptr<AugmentorInstanceInfo> findInstance(const std::string& addr)
@@ -103,6 +153,32 @@ struct AugmentationLoop : public ServiceBase, public MessageLoop {
 
     void bindAugmentors(const std::string & uri);
 
+    /** Send a duplicate of any augmentation request that hasn't been
+        answered once the given fraction of the augmentation window has gone
+        by to a second instance of the augmentor; the first answer wins.  A
+        fraction of 0 (the default) disables hedging.
+
+        Must be called before start().
+    */
+    void setHedging(double fraction);
+
+    /** Run an augmentor in-process.  Its requests are handed to the local
+        worker threads instead of going over the network, and it shows up
+        as an instance of the augmentor named augmentor->augmentorName
+        alongside any remote ones.
+
+        Must be called before init().
+    */
+    void addLocalAugmentor(std::shared_ptr<LocalAugmentor> augmentor,
+                           int maxInFlight = 3000);
+
+    /** Number of worker threads running the local augmentors.  Defaults to
+        2; none are started if there are no local augmentors.
+
+        Must be called before start().
+    */
+    void setLocalThreads(int numThreads);
+
     /** Push an auction into the augmentor.  Can be called from any thread. */
     void augment(const std::shared_ptr<AugmentationInfo> & info,
                  Date timeout,
@@ -120,8 +196,26 @@ private:
         // Note that we are keeping a weak_ptr in the case where the instance
         // either disconnects or crashes. Keeping a weak_ptr prevents us from
         // possibly keeping a dangling pointer
-        std::map<std::string, std::weak_ptr<AugmentorInstanceInfo>> instances;
-        std::map<std::string, std::set<std::string> > augmentorAgents;
+        //
+        // Each augmentor has the instance picked first and, if the request
+        // was hedged, the instance that got the duplicate.  Each one is
+        // reset once its in-flight slot has been released.
+        struct Requests {
+            Requests() : hedged(false) {}
+
+            std::weak_ptr<AugmentorInstanceInfo> primary;
+            std::weak_ptr<AugmentorInstanceInfo> hedge;
+            Date sent;          ///< When the primary request went out
+            bool hedged;
+        };
+        std::map<std::string, Requests> instances;
+        // Agents for each augmentor, without duplicates; the list goes on
+        // the wire in the same format as a set of names.
+        std::map<std::string, std::vector<std::string> > augmentorAgents;
+        // Binary payload of the AUGMENT message, encoded the first time it's
+        // needed (empty until then) and shared by all the sends for this
+        // auction.
+        zmq::message_t payload;
         OnFinished onFinished;
         Date timeout;
     };
@@ -132,6 +226,16 @@ private:
     typedef TimeoutMap<Id, std::shared_ptr<Entry> > Augmenting;
     Augmenting augmenting;
 
+    /** Auctions for which we'll send a duplicate of the outstanding requests
+        when they time out.
+    */
+    TimeoutMap<Id, std::weak_ptr<Entry> > hedging;
+
+    /** Fraction of the augmentation window after which we hedge; 0 means
+        never.
+    */
+    double hedgeFraction;
+
     /** Currently configured augmentors.  Indexed by the augmentor name. */
     std::map<std::string, std::shared_ptr<AugmentorInfo> > augmentors;
 
@@ -161,15 +265,55 @@ private:
     /// Connection to all of our augmentors
     ZmqNamedClientBus toAugmentors;
 
+    /// Request for a local augmentor, handed to a worker thread
+    struct LocalRequest {
+        std::shared_ptr<LocalAugmentor> augmentor;
+        AugmentationRequest request;
+        Date deadline;
+    };
+
+    /// Answer of a local augmentor, handed back to the loop thread
+    struct LocalResponse {
+        Id id;
+        std::string augmentor;
+        Date startTime;
+        AugmentationList augmentation;
+    };
+
+    std::vector<std::shared_ptr<LocalAugmentor> > localAugmentors;
+    ML::RingBufferSWMR<LocalRequest> localRequests;
+    TypedMessageSink<LocalResponse> localResponses;
+    boost::thread_group localWorkers;
+    std::atomic<bool> stopLocalWorkers;
+    int numLocalThreads;
+
+    void runLocalWorker();
+
     /** Update the augmentors from the configuration settings. */
     void updateAllAugmentors();
 
 
     void handleAugmentorMessage(const std::vector<std::string> & message);
 
-    std::shared_ptr<AugmentorInstanceInfo> pickInstance(AugmentorInfo& aug);
+    /** Pick the instance with the lowest expected cost that can take one
+        more request, skipping the given instance.  Returns null if none
+        can.
+    */
+    std::shared_ptr<AugmentorInstanceInfo>
+    pickInstance(AugmentorInfo& aug, double timeoutCost,
+                 const AugmentorInstanceInfo * exclude = nullptr);
+
     void doAugmentation(std::shared_ptr<Entry>&& entry);
 
+    /** Send the augmentation request for the given augmentor to an
+        instance.
+    */
+    void sendRequest(Entry & entry, const std::string & augmentor,
+                     const AugmentorInstanceInfo & instance);
+
+    /** Send duplicates of the unanswered requests of an entry. */
+    void doHedge(Entry & entry);
+
     void recordStats();
 
     void checkExpiries();
@@ -183,10 +327,21 @@ private:
     /** Handle a response from an augmentation. */
     void doResponse(const std::vector<std::string> & message);
 
+    /** Handle a response from a local augmentor. */
+    void doLocalResponse(LocalResponse && response);
+
+    /** Merge the answer of an augmentor instance into its auction, for
+        both remote and local instances.
+    */
+    void handleResponse(const std::string & addr, Date startTime,
+                        const Id & id, const std::string & augmentor,
+                        const AugmentationList & augmentationList,
+                        bool nullResponse);
+
     /** Handle a message asking for augmentation. */
     void doAugment(const std::vector<std::string> & message);
 
-    void augmentationExpired(const Id & id, const Entry & entry);
+    void augmentationExpired(const Id & id, Entry & entry);
 };
 
 } // namespace RTBKIT
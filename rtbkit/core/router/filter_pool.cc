@@ -159,6 +159,7 @@ filter(const BidRequest& br, const ExchangeConnector* conn, const ConfigSet& mas
     ConfigList result;
     for (size_t i = configs.next(); i < configs.size(); i = configs.next(i + 1)) {
         ConfigEntry entry = current->configs[i];
+        entry.index = i;
         entry.biddableSpots = std::move(biddableSpots[i]);
         result.emplace_back(std::move(entry));
     }
@@ -339,10 +340,13 @@ FilterPool::Data::
 addConfig(const string& name, const AgentInfo& info)
 {
     // If our config already exists, we have to deregister it with the filters
-    // before we can add the new config.
-    removeConfig(name);
+    // before we can add the new config.  The new config goes back in the same
+    // slot so that the agent keeps its id.
+    ssize_t index = findConfig(name);
+    if (index >= 0)
+        removeConfig(name);
+    else index = findConfig("");
 
-    ssize_t index = findConfig("");
     if (index >= 0)
         configs[index] = ConfigEntry(name, info);
     else {
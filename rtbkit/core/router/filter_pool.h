@@ -48,6 +48,7 @@ struct FilterPool
     {
         ConfigEntry(std::string name, const AgentInfo& info) :
             name(std::move(name)),
+            index(NoAgentId),
             config(info.config),
             status(info.status),
             stats(info.stats)
@@ -61,6 +62,7 @@ struct FilterPool
         }
 
         std::string name;
+        AgentId index;          ///< Slot of the config; also the agent id
         std::shared_ptr<AgentConfig> config;
         std::shared_ptr<AgentStatus> status;
         std::shared_ptr<AgentStats> stats;
@@ -84,6 +86,11 @@ struct FilterPool
 
 
     // \todo Need batch interfaces to alleviate overhead.
+
+    /** Add or replace the config of the given agent and return its slot,
+        which the router uses as the agent id.  Replacing the config of an
+        agent keeps its slot.
+    */
     unsigned addConfig(const std::string& name, const AgentInfo& info);
     void removeConfig(const std::string& name);
 
@@ -22,6 +22,7 @@
 #include <boost/tuple/tuple.hpp>
 #include "jml/utils/pair_utils.h"
 #include "jml/utils/exc_assert.h"
+#include "jml/arch/thread_specific.h"
 #include "jml/db/persistent.h"
 #include "jml/utils/json_parsing.h"
 #include "profiler.h"
@@ -30,6 +31,7 @@
 #include <boost/algorithm/string.hpp>
 #include "rtbkit/common/bids.h"
 #include "rtbkit/common/auction_events.h"
+#include "rtbkit/common/auction_tracer.h"
 #include "rtbkit/common/messages.h"
 #include "rtbkit/common/win_cost_model.h"
 #include "rtbkit/common/bidder_interface.h"
@@ -52,6 +54,8 @@ toJson() const
     if (!valid()) return result;
     result["config"] = config->toJson();
     result["stats"] = stats->toJson();
+    if (latency)
+        result["latency"] = latency->toJson();
     return result;
 }
 
@@ -155,7 +159,9 @@ Router(ServiceBase & parent,
       monitorProviderClient(getZmqContext()),
       maxBidAmount(maxBidAmount),
       slowModeTolerance(MonitorClient::DefaultTolerance),
-      augmentationWindow(augmentationWindow)
+      augmentationWindow(augmentationWindow),
+      adaptiveBidTimeouts(false),
+      binaryLogRecords(false)
 {
     monitorProviderClient.addProvider(this);
 }
@@ -209,7 +215,9 @@ Router(std::shared_ptr<ServiceProxies> services,
       monitorProviderClient(getZmqContext()),
       maxBidAmount(maxBidAmount),
       slowModeTolerance(MonitorClient::DefaultTolerance),
-      augmentationWindow(augmentationWindow)
+      augmentationWindow(augmentationWindow),
+      adaptiveBidTimeouts(false),
+      binaryLogRecords(false)
 
 {
     monitorProviderClient.addProvider(this);
@@ -229,6 +237,21 @@ Router::
 initAnalytics(const string & baseUrl, const int numConnections)
 {
     analytics.init(baseUrl, numConnections);
+    analyticsAuctionChannel = analytics.channel("AUCTION");
+    analyticsBidChannel = analytics.channel("BID");
+}
+
+namespace {
+
+ML::Thread_Specific<std::string> logRecordBuffers;
+
+} // file scope
+
+std::string &
+Router::
+logRecordBuffer()
+{
+    return *logRecordBuffers;
 }
 
 void
@@ -330,6 +353,11 @@ init()
     bridge.agents.onDisconnection = [=] (const std::string & agent)
         {
             cerr << "agent " << agent << " disconnected from router" << endl;
+
+            // Called from the main loop, which reads the agents' socket.
+            // An agent that comes back asks for a new channel.
+            if (shmAgents)
+                shmAgents->removeAgent(agent);
         };
 
     configListener.onConfigChange = [=] (const std::string & agent,
@@ -412,6 +440,14 @@ bindAgents(std::string agentUri)
     }
 }
 
+void
+Router::
+bindSharedMemoryAgents(const std::string & socketPath)
+{
+    shmAgents.reset(new ShmAgentServer(serviceName(), getServices()));
+    shmAgents->init(socketPath, wakeupMainLoop.fd());
+}
+
 void
 Router::
 bindAugmentors(const std::string & uri)
@@ -561,8 +597,10 @@ run()
 
     zmq_pollitem_t items [] = {
         { bridge.agents.getSocketUnsafe(), 0, ZMQ_POLLIN, 0 },
-        { 0, wakeupMainLoop.fd(), ZMQ_POLLIN, 0 }
+        { 0, wakeupMainLoop.fd(), ZMQ_POLLIN, 0 },
+        { 0, shmAgents ? shmAgents->selectFd() : -1, ZMQ_POLLIN, 0 }
     };
+    int numItems = shmAgents ? 3 : 2;
 
     double last_check = ML::wall_time(), last_check_pace = last_check,
         lastPings = last_check;
@@ -573,7 +611,6 @@ run()
 
     double beforeSleep, afterSleep = getTime();
     int numTimesCouldSleep = 0;
-    int totalSleeps = 0;
     double lastTimestamp = 0;
 
     double totalActive = 0;
@@ -589,27 +626,6 @@ run()
 
     //double lastDump = ML::wall_time();
 
-    struct TimesEntry {
-        TimesEntry()
-            : time(0.0), count(0)
-        {
-        };
-
-        void add(double time)
-        {
-            this->time += time;
-            ++count;
-        }
-
-        double time;
-        uint64_t count;
-    };
-
-    std::map<std::string, TimesEntry> times;
-    auto recordTime = [&] (std::string name, double start) {
-        times[std::move(name)].add(microsecondsBetween(getTime(), start));
-    };
-
 
     // Attempt to wake up once per millisecond
 
@@ -623,25 +639,25 @@ run()
         int rc = 0;
 
         {
-            double atStart = getTime();
+            uint64_t atStart = ML::ticks();
 
             for (unsigned i = 0;  i < 20 && rc == 0;  ++i)
-                rc = zmq_poll(items, 2, 0);
+                rc = zmq_poll(items, numItems, 0);
 
-            recordTime("spinPoll", atStart);
+            loopTimes.record(RLS_SPIN_POLL, atStart);
         }
 
         if (rc == 0) {
             ++numTimesCouldSleep;
 
             {
-                double atStart = getTime();
+                uint64_t atStart = ML::ticks();
                 checkExpiredAuctions();
-                recordTime("checkExpiredAuctions", atStart);
+                loopTimes.record(RLS_CHECK_EXPIRED_AUCTIONS, atStart);
             }
 
             {
-                double atStart = getTime();
+                uint64_t atStart = ML::ticks();
 
                 // Try to sleep only once per 1/2 a millisecond to avoid too
                 // many context switches.
@@ -653,12 +669,12 @@ run()
                 }
                 lastSleep = now;
 
-                recordTime("sleep", atStart);
+                loopTimes.record(RLS_SLEEP, atStart);
             }
 
-            double pollStart = getTime();
-            rc = zmq_poll(items, 2, 50 /* milliseconds */);
-            recordTime("sleepPoll", pollStart);
+            uint64_t pollStart = ML::ticks();
+            rc = zmq_poll(items, numItems, 50 /* milliseconds */);
+            loopTimes.record(RLS_SLEEP_POLL, pollStart);
         }
 
         afterSleep = getTime();
@@ -671,28 +687,28 @@ run()
         }
 
         {
-            double atStart = getTime();
+            uint64_t atStart = ML::ticks();
             std::shared_ptr<AugmentationInfo> info;
             while (startBiddingBuffer.tryPop(info)) {
                 doStartBidding(info);
             }
 
-            recordTime("doStartBidding", atStart);
+            loopTimes.record(RLS_START_BIDDING, atStart);
         }
 
         {
-            double atStart = getTime();
+            uint64_t atStart = ML::ticks();
 
             BidMessage message;
             while (doBidBuffer.tryPop(message)) {
                 doBidImpl(message);
             }
 
-            recordTime("doBid", atStart);
+            loopTimes.record(RLS_BID, atStart);
         }
 
         {
-            double atStart = getTime();
+            uint64_t atStart = ML::ticks();
 
             std::shared_ptr<ExchangeConnector> exchange;
             while (exchangeBuffer.tryPop(exchange)) {
@@ -703,32 +719,32 @@ run()
                 };
             }
 
-            recordTime("configureAgentOnExchange", atStart);
+            loopTimes.record(RLS_CONFIGURE_AGENT_ON_EXCHANGE, atStart);
         }
 
         {
-            double atStart = getTime();
+            uint64_t atStart = ML::ticks();
 
             std::pair<std::string, std::shared_ptr<const AgentConfig> > config;
             while (configBuffer.tryPop(config)) {
                 doConfig(config.first, config.second);
             }
 
-            recordTime("doConfig", atStart);
+            loopTimes.record(RLS_CONFIG, atStart);
         }
 
         {
-            double atStart = getTime();
+            uint64_t atStart = ML::ticks();
 
             std::shared_ptr<Auction> auction;
             while (submittedBuffer.tryPop(auction))
                 doSubmitted(auction);
 
-            recordTime("doSubmitted", atStart);
+            loopTimes.record(RLS_SUBMITTED, atStart);
         }
 
         if (items[0].revents & ZMQ_POLLIN) {
-            double atStart = getTime();
+            uint64_t atStart = ML::ticks();
             // Agent message
             vector<string> message;
             try {
@@ -742,33 +758,54 @@ run()
                                message);
             }
 
-            recordTime(message.at(1), atStart);
+            loopTimes.record(RLS_AGENT_MESSAGE, atStart);
         }
 
         if (items[1].revents & ZMQ_POLLIN) {
             wakeupMainLoop.read();
         }
 
+        if (shmAgents) {
+            if (items[2].revents & ZMQ_POLLIN)
+                shmAgents->handleEvents();
+
+            uint64_t atStart = ML::ticks();
+
+            auto onMessage = [&] (const std::vector<std::string> & message)
+                {
+                    try {
+                        handleAgentMessage(message);
+                    } catch (const std::exception & exc) {
+                        cerr << "error handling shm agent message " << message
+                             << ": " << exc.what() << endl;
+                    }
+                };
+
+            if (shmAgents->processAgentMessages(onMessage))
+                loopTimes.record(RLS_SHM_AGENT_MESSAGES, atStart);
+        }
+
         double now = ML::wall_time();
 
         if (now - lastPings > 1.0) {
-            double atStart = getTime();
+            uint64_t atStart = ML::ticks();
 
             // Send out pings and interpret the results of the last lot of
             // pinging.
             sendPings();
             lastPings = now;
 
-            recordTime("sendPings", atStart);
+            if (shmAgents)
+                shmAgents->expireHandshakes();
+
+            loopTimes.record(RLS_SEND_PINGS, atStart);
         }
 
-        double beforeChecks = getTime();
+        uint64_t beforeChecks = ML::ticks();
 
         if (now - last_check_pace > 10.0) {
             recordEvent("numTimesCouldSleep", ET_LEVEL, numTimesCouldSleep);
 
-            totalSleeps += numTimesCouldSleep;
-
             numTimesCouldSleep = 0;
             last_check_pace = now;
         }
@@ -793,43 +830,30 @@ run()
                                        dutyCycleHistory.end() - 100);
 
             checkDeadAgents();
+            rotateAgentLatencies();
 
-            double total = 0.0;
-            for (auto it = times.begin(); it != times.end();  ++it)
-                total += it->second.time;
-
-            cerr << "total of " << total << " microseconds and "
-                 << totalSleeps << " sleeps" << endl;
-
-            for (auto it = times.begin(); it != times.end();  ++it) {
-                cerr << ML::format("%-30s %8lld %10.0f %6.2f%% %8.2fus/call\n",
-                                   it->first.c_str(),
-                                   (unsigned long long)it->second.count,
-                                   it->second.time,
-                                   100.0 * it->second.time / total,
-                                   it->second.time / it->second.count);
-
-                recordEvent(("routerLoop." + it->first).c_str(), ET_LEVEL,
-                        1.0 * it->second.time / (now - last_check) / 1000000.0);
-
+            if (analytics.initialized) {
+                auto stats = analytics.getStats();
+                recordLevel(stats.published, "analytics.publishedEvents");
+                recordLevel(stats.dropped, "analytics.droppedEvents");
+                recordLevel(stats.failed, "analytics.failedEvents");
             }
 
-            times.clear();
-            totalSleeps = 0;
+            logLoopTimes(now - last_check);
 
             last_check = now;
         }
 
-        recordTime("checks", beforeChecks);
+        loopTimes.record(RLS_CHECKS, beforeChecks);
 
         if (now - lastTimestamp >= 1.0) {
-            double atStart = getTime();
+            uint64_t atStart = ML::ticks();
 
             banker->logBidEvents(*this);
             //issueTimestamp();
             lastTimestamp = now;
 
-            recordTime("logBidEvents", atStart);
+            loopTimes.record(RLS_LOG_BID_EVENTS, atStart);
         }
     }
 
@@ -857,6 +881,8 @@ shutdown()
     if (runThread)
         runThread->join();
     runThread.reset();
+    if (shmAgents)
+        shmAgents->shutdown();
     if (cleanupThread)
         cleanupThread->join();
     cleanupThread.reset();
@@ -967,6 +993,17 @@ handleAgentMessage(const std::vector<std::string> & message)
             return;
         }
 
+        if (request == "SHM_CONNECT") {
+            // Agents of routers without shared memory stay on zmq.
+            if (!shmAgents) return;
+
+            // The agent may have restarted and lost its old channel.
+            string nonce = shmAgents->expectAgent(address);
+            bridge.agents.sendMessage(address, "SHM_READY",
+                                      shmAgents->socketPath(), nonce);
+            return;
+        }
+
         if (!agents.count(address)) {
             cerr << "doing NEEDCONFIG for " << address << endl;
             return;
@@ -984,6 +1021,11 @@ handleAgentMessage(const std::vector<std::string> & message)
             return;
         }
 
+        if (request[0] == 'B' && request == "BIDS") {
+            doBids(message);
+            return;
+        }
+
         //cerr << "router got message " << message << endl;
 
         if (request[0] == 'P' && request == "PONG0") {
@@ -1184,8 +1226,7 @@ checkDeadAgents()
         cerr << "WARNING: dead agent doesn't clean up its state properly"
              << endl;
         // TODO: undo all bids in progress
-        filters.removeConfig((*it)->first);
-        agents.erase(*it);
+        removeAgent(*it);
     }
 
     if (!deadAgents.empty())
@@ -1217,13 +1258,21 @@ checkExpiredAuctions()
                 for (auto it = auctionInfo.bidders.begin(),
                          end = auctionInfo.bidders.end();
                      it != end;  ++it) {
-                    string agent = it->first;
-                    if (!agents.count(agent)) continue;
+                    const string & agent = it->first;
+                    AgentInfo * agentInfo
+                        = this->findAgent(it->second.agentId, agent);
+                    if (!agentInfo) continue;
 
-                    if (agents[agent].expireBidInFlight(auctionId)) {
-                        AgentInfo & info = this->agents[agent];
+                    if (agentInfo->expireBidInFlight(auctionId)) {
+                        AgentInfo & info = *agentInfo;
                         ++info.stats->tooLate;
 
+                        // Agents that never answer are the slowest ones;
+                        // leaving them out would hide them from the
+                        // adaptive timeout.
+                        info.latency->record(
+                                it->second.bidTime.secondsUntil(start));
+
                         this->recordHit("accounts.%s.EXPIRED",
                                         info.config->account.toString('.'));
 
@@ -1428,6 +1477,7 @@ augmentAuction(const std::shared_ptr<AugmentationInfo> & info)
     auto onDoneAugmenting = [=] (const std::shared_ptr<AugmentationInfo> & info)
         {
             info->auction->doneAugmenting = Date::now();
+            traceAuctionStage(AS_AUGMENT, info->auction->id);
 
             if (info->auction->tooLate()) {
                 this->recordHit("tooLateAfterAugmenting");
@@ -1502,6 +1552,7 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
 
     // Do the actual filtering.
     auto biddableConfigs = filters.filter(*auction->request, exchangeConnector);
+    traceAuctionStage(AS_FILTER, auction->id);
 
     auto checkAgent = [&] (
             const AgentConfig & config,
@@ -1542,6 +1593,7 @@ preprocessAuction(const std::shared_ptr<Auction> & auction)
 
         PotentialBidder bidder;
         bidder.agent = entry.name;
+        bidder.agentId = entry.index;
         bidder.config = entry.config;
         bidder.stats = entry.stats;
         bidder.imp = std::move(entry.biddableSpots);
@@ -1659,8 +1711,9 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
             for (unsigned i = 0;  i < bidders.size();  ++i) {
                 PotentialBidder & bidder = bidders[i];
-                if (!agents.count(bidder.agent)) continue;
-                AgentInfo & info = agents[bidder.agent];
+                AgentInfo * agentInfo = findAgent(bidder.agentId, bidder.agent);
+                if (!agentInfo) continue;
+                AgentInfo & info = *agentInfo;
                 const AgentConfig & config = *bidder.config;
 
                 auto doFilterStat = [&] (const char * reason)
@@ -1745,6 +1798,16 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
                     continue;
                 }
 
+                /* Check that the agent usually answers in the time left.  A
+                   few auctions still go through to keep measuring it. */
+                if (adaptiveBidTimeouts && info.latency->p99Ms > timeLeftMs
+                    && !info.latency->probe()) {
+                    ML::atomic_inc(info.stats->tooSlow);
+                    bidder.inFlightProp = PotentialBidder::NULL_PROP;
+                    doFilterStat("dynamic.tooSlow");
+                    continue;
+                }
+
                 stringstream ss;
                 ss << endl;
 
@@ -1812,32 +1875,31 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
 
             // Best one is the first one
             PotentialBidder & winner = bidders[best];
-            string agent = winner.agent;
+            const string & agent = winner.agent;
 
-            if (!agents.count(agent)) {
+            AgentInfo * agentInfo = findAgent(winner.agentId, agent);
+            if (!agentInfo) {
                 //cerr << "!!!AGENT IS GONE" << endl;
                 continue;  // agent is gone
             }
-            AgentInfo & info = agents[agent];
+            AgentInfo & info = *agentInfo;
 
             ++info.stats->auctions;
 
-            Json::Value aggregatedAug;
-            for (const auto& aug : augList) {
-                aggregatedAug[aug.first] =
-                    aug.second.filterForAccount(winner.config->account).toJson();
-            }
-            auction->agentAugmentations[agent] = chomp(aggregatedAug.toString());
+            auction->agentAugmentations[agent]
+                = auction->augmentationsForAccount(winner.config->account);
 
             //auctionInfo.activities.push_back("sent to " + agent);
 
             BidInfo bidInfo;
+            bidInfo.agentId = winner.agentId;
             bidInfo.agentConfig = winner.config;
             bidInfo.bidTime = Date::now();
             bidInfo.imp = winner.imp;
 
-            auctionInfo.bidders.insert(make_pair(agent, std::move(bidInfo)));  // create empty bid response
-            if (!info.trackBidInFlight(auctionId, bidInfo.bidTime))
+            Date bidTime = bidInfo.bidTime;
+            auctionInfo.bidders.insert(agent, std::move(bidInfo));  // create empty bid response
+            if (!info.trackBidInFlight(auctionId, bidTime))
                 throwException("doStartBidding.agentAlreadyBidding",
                                "agent %s is already processing auction %s",
                                agent.c_str(),
@@ -1857,8 +1919,14 @@ doStartBidding(const std::shared_ptr<AugmentationInfo> & augInfo)
         this->recordLevel(auctionInfo.bidders.size(), "bidRequestsSentToBiddersPerRequest");
 
         if (!auctionInfo.bidders.empty()) {
+            // The latency of the agents is measured from here.
+            Date sent = Date::now();
+            for (auto & entry: auctionInfo.bidders)
+                entry.second.bidTime = sent;
+
             bidder->sendAuctionMessage(
                     auctionInfo.auction, timeLeftMs, auctionInfo.bidders);
+            traceAuctionStage(AS_AGENT_SEND, auctionId);
         }
         else {
             /* No bidders; don't bother with the bid */
@@ -1959,6 +2027,76 @@ doBid(const std::vector<std::string> & message)
     doBidImpl(bidMessage, message);
 }
 
+void
+Router::
+doBids(const std::vector<std::string> & message)
+{
+    if (message.size() != 3) {
+        returnErrorResponse(message,
+                            ML::format("BIDS message has %zu parts instead of 3",
+                                       message.size()));
+        return;
+    }
+
+    const string & agent = message[0];
+
+    // What the errors about each of the bids get reported with.
+    vector<string> originalMessage = { agent, "BID", "" };
+
+    // A bad response is reported on its own; the others are still handled.
+    auto onError = [&] (const Id & auctionId, const std::string & error)
+        {
+            originalMessage[2] = auctionId.toString();
+
+            auto it = inFlight.find(auctionId);
+            if (it == inFlight.end()) {
+                recordHit("bidError.unknownAuction");
+                returnErrorResponse(originalMessage, "unknown auction");
+                return;
+            }
+
+            returnInvalidBid(agent, "", it->second.auction,
+                             "bidParseError",
+                             "couldn't decode batched bid: %s", error.c_str());
+        };
+
+    auto onResponse = [&] (BidResponseBatch::Response & response)
+        {
+            BidMessage bidMessage;
+            bidMessage.agents.push_back(agent);
+            bidMessage.auctionId = response.auctionId;
+            try {
+                if (!response.wcm.empty())
+                    bidMessage.wcm
+                        = WinCostModel::fromJson(Json::parse(response.wcm));
+            } catch (const std::exception & exc) {
+                onError(response.auctionId,
+                        "couldn't parse win cost model: "
+                        + string(exc.what()));
+                return;
+            }
+            bidMessage.meta = std::move(response.meta);
+            bidMessage.bids = std::move(response.bids);
+
+            originalMessage[2] = response.auctionId.toString();
+            try {
+                doBidImpl(bidMessage, originalMessage);
+            } catch (const std::exception & exc) {
+                returnErrorResponse(originalMessage,
+                                    "threw exception: " + string(exc.what()));
+            }
+        };
+
+    try {
+        BidResponseBatch::decode(message[2], onResponse, onError);
+    } catch (const std::exception & exc) {
+        // The rest of the batch can't be found
+        recordHit("bidError.malformedBatch");
+        returnErrorResponse(message,
+                            "malformed BIDS message: " + string(exc.what()));
+    }
+}
+
 void
 Router::
 doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMessage)
@@ -1973,6 +2111,8 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
     ExcAssert(!message.agents.empty());
 
     const auto& auctionId = message.auctionId;
+    traceAuctionStage(AS_BID_RECEIVE, auctionId);
+
     auto it = inFlight.find(auctionId);
     if (it == inFlight.end()) {
         recordHit("bidError.unknownAuction");
@@ -1982,29 +2122,37 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
     AuctionInfo & auctionInfo = it->second;
 
+    /* Ids of the agents in the message, in the same order. */
+    ML::compact_vector<AgentId, 4> agentIds;
+
     for (const auto &agent: message.agents) {
-        if (!agents.count(agent)) {
+        auto agentIt = agents.find(agent);
+        if (agentIt == agents.end()) {
             returnErrorResponse(originalMessage, "unknown agent");
             return;
         }
 
-        auto biddersIt = auctionInfo.bidders.find(agent);
-        if (biddersIt == auctionInfo.bidders.end()) {
+        AgentInfo & info = agentIt->second;
+        auto biddersIt = auctionInfo.bidders.find(info.filterIndex);
+        if (biddersIt == auctionInfo.bidders.end()
+            || biddersIt->first != agent) {
             recordHit("bidError.agentSkippedAuction");
             returnErrorResponse(originalMessage,
                                 "agent shouldn't bid on this auction");
             return;
         }
 
-        AgentInfo & info = agents[agent];
         /* One less in flight. */
         if (!info.expireBidInFlight(auctionId)) {
             recordHit("bidError.agentNotBidding");
             returnErrorResponse(originalMessage, "agent wasn't bidding on this auction");
             return;
         }
+        info.latency->record(biddersIt->second.bidTime.secondsUntil(dateGotBid));
         auto & config = *biddersIt->second.agentConfig;
         recordHit("accounts.%s.bids", config.account.toString('.'));
+
+        agentIds.push_back(info.filterIndex);
     }
 
 
@@ -2015,13 +2163,21 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
     recordHit("bid");
 
     const auto& agent = message.agents[0];
-    auto biddersIt = auctionInfo.bidders.find(agent);
+    auto biddersIt = auctionInfo.bidders.find(agentIds[0]);
     auto & config = *biddersIt->second.agentConfig;
-    AgentInfo & info = agents[agent];
+    AgentInfo & info = agentsById[agentIds[0]]->second;
     const auto& agentConfig = info.config;
 
     const auto& bids = message.bids;
-    auto bidsString = bids.toJson().toStringNoNewLine();
+
+    // Only needed to report and log the bids, which most don't need.
+    std::string bidsStr;
+    auto bidsString = [&] () -> const std::string &
+        {
+            if (bidsStr.empty())
+                bidsStr = bids.toJson().toStringNoNewLine();
+            return bidsStr;
+        };
 
     BidInfo bidInfo(std::move(biddersIt->second));
 
@@ -2050,21 +2206,21 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
         int spotIndex = bidInfo.imp[i].first;
 
         if (bid.creativeIndex == -1) {
-            returnInvalidBid(agent, bidsString, auctionInfo.auction,
+            returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                     "nullCreativeField",
                     "creative field is null in response %s",
-                    bidsString.c_str());
+                    bidsString().c_str());
             continue;
         }
 
         if (bid.creativeIndex < 0
                 || bid.creativeIndex >= config.creatives.size())
         {
-            returnInvalidBid(agent, bidsString, auctionInfo.auction,
+            returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                     "outOfRangeCreative",
                     "parsing field 'creative' of %s: creative "
                     "number %d out of range 0-%zd",
-                    bidsString.c_str(), bid.creativeIndex,
+                    bidsString().c_str(), bid.creativeIndex,
                     config.creatives.size());
             continue;
         }
@@ -2073,12 +2229,12 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
             if (slowModePeriodicSpentReached) {
                 bid.price = maxBidAmount;
             } else {
-                returnInvalidBid(agent, bidsString, auctionInfo.auction,
+                returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                     "invalidPrice",
                     "bid price of %s is outside range of $0-%s parsing bid %s",
                     bid.price.toString().c_str(),
                     maxBidAmount.toString().c_str(),
-                    bidsString.c_str());
+                    bidsString().c_str());
                 continue;
             }
         }
@@ -2086,7 +2242,7 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
      auto getbid = auctionInfo.auction->exchangeConnector->getBidValidity(bid, imp, spotIndex);
 
         if (!getbid.isValidbid) {
-            returnInvalidBid(agent, bidsString, auctionInfo.auction,
+            returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                 getbid.reason_,
                 "no bid");
             continue;
@@ -2099,14 +2255,14 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
             cerr << "auction: " << auctionInfo.auction->requestStr
                 << endl;
             cerr << "config: " << config.toJson().toStringNoNewLine() << endl;
-            cerr << "bid: " << bidsString << endl;
+            cerr << "bid: " << bidsString() << endl;
             cerr << "spot: " << imp[i].toJson().toStringNoNewLine() << endl;
             cerr << "spot num: " << spotIndex << endl;
             cerr << "bid num: " << i << endl;
             cerr << "creative num: " << bid.creativeIndex << endl;
             cerr << "creative: " << creative.toJson().toStringNoNewLine() << endl;
 #endif
-            returnInvalidBid(agent, bidsString, auctionInfo.auction,
+            returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                     "creativeNotCompatibleWithSpot",
                     "creative %s not compatible with spot %s",
                     creative.toJson().toString().c_str(),
@@ -2116,7 +2272,7 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
 
         if (!creative.biddable(auctionInfo.auction->request->exchange,
                         auctionInfo.auction->request->protocolVersion)) {
-            returnInvalidBid(agent, bidsString, auctionInfo.auction,
+            returnInvalidBid(agent, bidsString(), auctionInfo.auction,
                     "creativeNotBiddableOnExchange",
                     "creative not biddable on exchange/version");
             continue;
@@ -2169,12 +2325,14 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
             bidder->sendNoBudgetMessage(agentConfig, agent, auctionInfo.auction);
 
             this->logMessage("NOBUDGET", agent, auctionId,
-                    bidsString, message.meta);
+                    bidsString(), message.meta);
             this->logMessageToAnalytics("NOBUDGET", agent, auctionId);
             recordHit("accounts.%s.NOBUDGET", config.account.toString('.'));
             continue;
         }
-        
+
+        traceAuctionStage(AS_BANKER_AUTHORIZE, auctionId);
+
         recordCount(bid.price.value, "cummulatedBidPrice");
         recordCount(price.value, "cummulatedAuthorizedPrice");
 
@@ -2264,8 +2422,9 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
                 throw ML::Exception("logic error");
             }
 
-            this->logMessage(msg, agent, auctionId, bidsString, message.meta);
-            this->logMessageToAnalytics(msg, agent, auctionId, bidsString);
+            this->logMessage(msg, agent, auctionId, bidsString(), message.meta);
+            if (analytics.isEnabled(analytics.channel(msg)))
+                this->logMessageToAnalytics(msg, agent, auctionId, bidsString());
             continue;
         }
         case Auction::WinLoss::WIN:
@@ -2282,8 +2441,10 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
     if (numValidBids > 0) {
         if (logBids)
             // Send BID to logger
-            logMessage("BID", agent, auctionId, bidsString, message.meta);
-        logMessageToAnalytics("BID", agent, auctionId, bidsString);
+            logMessage("BID", agent, auctionId, bidsString(), message.meta);
+        if (analytics.isEnabled(analyticsBidChannel))
+            logMessageToAnalytics(analyticsBidChannel,
+                                  agent, auctionId, bidsString());
         ML::atomic_add(numNonEmptyBids, 1);
     }
     else if (numPassedBids > 0) {
@@ -2294,8 +2455,8 @@ doBidImpl(const BidMessage &message, const std::vector<std::string> &originalMes
         }
     }
 
-    for (const auto& agent: message.agents) {
-        auctionInfo.bidders.erase(agent);
+    for (AgentId agentId: agentIds) {
+        auctionInfo.bidders.erase(agentId);
     }
 
     double bidTime = dateGotBid.secondsSince(bidInfo.bidTime);
@@ -2514,10 +2675,19 @@ onNewAuction(std::shared_ptr<Auction> auction)
 
     //cerr << "AUCTION GOT THROUGH" << endl;
 
-    if (logAuctions)
-        // Send AUCTION to logger
-        logMessage("AUCTION", auction->id, auction->requestStr);
-    logMessageToAnalytics("AUCTION", auction->id);
+    if (logAuctions) {
+        // Send AUCTION to logger.  The request goes out of the auction's own
+        // buffer, which its part keeps alive until it has been sent.
+        if (binaryLogRecords)
+            logMessage("AUCTION", auction->id, auction->requestStr);
+        else {
+            std::shared_ptr<const std::string>
+                requestStr(auction, &auction->requestStr);
+            logger.publish("AUCTION", Date::now().print(5), auction->id,
+                           logger.sharedPart(requestStr));
+        }
+    }
+    logMessageToAnalytics(analyticsAuctionChannel, auction->id);
 
     const BidRequest & request = *auction->request;
     int numFields = 0;
@@ -2592,6 +2762,7 @@ updateAllAgents()
             entry.filterIndex = it->second.filterIndex;
             entry.config = it->second.config;
             entry.stats = it->second.stats;
+            entry.latency = it->second.latency;
             entry.status = it->second.status;
             int i = newInfo->size();
             newInfo->push_back(entry);
@@ -2624,8 +2795,7 @@ doConfig(const std::string & agent,
         // configuration to the ACS.
         if (it != std::end(agents)) {
             cerr << "agent " << agent << " lost configuration" << endl;
-            filters.removeConfig(agent);
-            agents.erase(it);
+            removeAgent(it);
         }
     } else {
         AgentInfo & info = agents[agent];
@@ -2647,20 +2817,42 @@ doConfig(const std::string & agent,
         //cerr << "configured " << agent << " strategy : " << info.config->strategy << " campaign "
         //     <<  info.config->campaign << endl;
 
-        string bidRequestFormat = "jsonRaw";
-        info.setBidRequestFormat(bidRequestFormat);
+        info.bidRequestFormat = newConfig->bidRequestFormat;
 
         configure(agent, *newConfig);
         info.configured = true;
         bidder->sendMessage(config, agent, "GOTCONFIG");
 
         info.filterIndex = filters.addConfig(agent, info);
+        if (info.filterIndex >= agentsById.size())
+            agentsById.resize(info.filterIndex + 1);
+        agentsById[info.filterIndex] = &*agents.find(agent);
     }
 
     // Broadcast that we have a new agent or it has a new configuration
     updateAllAgents();
 }
 
+void
+Router::
+removeAgent(Agents::iterator it)
+{
+    AgentId agentId = it->second.filterIndex;
+    if (agentId < agentsById.size() && agentsById[agentId] == &*it)
+        agentsById[agentId] = nullptr;
+
+    filters.removeConfig(it->first);
+
+    // Stop writing auctions to its channel; if the agent is still alive,
+    // it will ask for a new one.
+    if (shmAgents && shmAgents->isConnected(it->first)) {
+        shmAgents->removeAgent(it->first);
+        bridge.agents.sendMessage(it->first, "SHM_CLOSED");
+    }
+
+    agents.erase(it);
+}
+
 void
 Router::
 unconfigure(const std::string & agent, const AgentConfig & config)
@@ -2772,6 +2964,73 @@ getAllAgentInfo() const
     return result;
 }
 
+Json::Value
+Router::
+getAllAgentLatencies() const
+{
+    Json::Value result(Json::objectValue);
+
+    auto onAgent = [&] (const AgentInfoEntry & info)
+        {
+            if (info.latency)
+                result[info.name] = info.latency->toJson();
+        };
+
+    forEachAgent(onAgent);
+
+    return result;
+}
+
+Json::Value
+Router::
+getLoopTimes() const
+{
+    return loopTimes.toJson();
+}
+
+void
+Router::
+logLoopTimes(double elapsed)
+{
+    for (unsigned i = 0;  i < RLS_NUM_STAGES;  ++i) {
+        const char * name = routerLoopStageName(RouterLoopStage(i));
+        const LatencyHistogram & times = loopTimes.window[i];
+
+        // Proportion of the time that the loop spent in the stage
+        double seconds = times.mean() * times.count() / 1000000000.0;
+        recordLevel(seconds / elapsed, "routerLoop.%s", name);
+
+        if (!times.count())
+            continue;
+
+        recordLevel(times.percentile(50) / 1000.0, "routerLoop.%s.p50Us", name);
+        recordLevel(times.percentile(99) / 1000.0, "routerLoop.%s.p99Us", name);
+        recordLevel(times.percentile(99.9) / 1000.0,
+                    "routerLoop.%s.p999Us", name);
+    }
+
+    loopTimes.rotate();
+}
+
+void
+Router::
+rotateAgentLatencies()
+{
+    // Fewer samples than this and the p99 is just noise.
+    static const uint64_t minSamples = 100;
+
+    for (auto & agent: agents) {
+        AgentLatency & latency = *agent.second.latency;
+        latency.rotate(minSamples);
+
+        if (!agent.second.configured || latency.p99Ms == 0.0)
+            continue;
+
+        recordLevel(latency.p99Ms, "accounts.%s.bidLatencyP99Ms",
+                    agent.second.config->account.toString('.'));
+    }
+}
+
 void
 Router::
 sendPings()
@@ -2909,6 +3168,7 @@ submitToPostAuctionService(std::shared_ptr<Auction> auction,
         event->bidResponse = bid;
 
         postAuctionEndpoint.sendAuction(event);
+        traceAuctionStage(AS_POST_AUCTION_SUBMIT, auction->id);
     }
 
     if (auction.unique()) {
@@ -20,7 +20,9 @@
 #include "soa/service/timeout_map.h"
 #include "soa/service/pending_list.h"
 #include "soa/service/loop_monitor.h"
+#include "soa/logger/log_record.h"
 #include "augmentation_loop.h"
+#include "shm_agent_server.h"
 #include "router_types.h"
 #include "soa/gc/gc_lock.h"
 #include "jml/utils/ring_buffer.h"
@@ -55,6 +57,7 @@ struct AgentInfoEntry {
     std::shared_ptr<const AgentConfig> config;
     std::shared_ptr<const AgentStatus> status;
     std::shared_ptr<AgentStats> stats;
+    std::shared_ptr<AgentLatency> latency;
 
     bool valid() const { return config && stats; }
 
@@ -165,6 +168,12 @@ struct Router : public ServiceBase,
     /** Bind a zeroMQ URI to listen for augmentation messages on. */
     void bindAugmentors(const std::string & uri);
 
+    /** Let the agents running on this host exchange auctions and bids with
+        the router through shared memory, connecting on the unix socket at
+        the given path.  Must be called after init().
+    */
+    void bindSharedMemoryAgents(const std::string & socketPath);
+
     /** Disable the monitor for testing purposes.  In production this could lead
         to unbounded overspend, so please do really only use it for testing.
     */
@@ -360,6 +369,12 @@ struct Router : public ServiceBase,
     /** Return information about all agents. */
     Json::Value getAllAgentInfo() const;
 
+    /** Return the bid latency histograms of all agents. */
+    Json::Value getAllAgentLatencies() const;
+
+    /** Return the time histograms of the stages of the main loop. */
+    Json::Value getLoopTimes() const;
+
     /** Return information about all agents bidding on the given
         account. */
     Json::Value getAccountInfo(const AccountKey & account) const;
@@ -372,6 +387,19 @@ struct Router : public ServiceBase,
     */
     void setBidsErrorRate(double val) { bidsErrorRate = val; }
 
+    /** Don't send auctions to the agents whose p99 bid latency over the
+        last window is longer than the time left in the auction.  Their bids
+        would come in too late anyway.  One in AgentLatency::ProbeInterval
+        of those auctions is still sent, to notice when they speed up.
+    */
+    void setAdaptiveBidTimeouts(bool enabled) { adaptiveBidTimeouts = enabled; }
+
+    /** Publish the log messages as binary LogRecords, which are formatted
+        by the data logger instead of the router.  Only data loggers that
+        know about LogRecord can read them.
+    */
+    void setBinaryLogRecords(bool enabled) { binaryLogRecords = enabled; }
+
     /** Proportion of bids that should be rejected with an out of budget 
         error. 
     */
@@ -425,6 +453,23 @@ public:
     typedef std::map<std::string, AgentInfo> Agents;
     Agents agents;
 
+    /** Configured agents indexed by agent id (see AgentId), null where the
+        id is not in use.  Points into agents; router thread only.
+    */
+    std::vector<Agents::value_type *> agentsById;
+
+    /** Return the info of the agent with the given id, or null if the id
+        is not in use or has since been recycled for an agent with a
+        different name.
+    */
+    AgentInfo * findAgent(AgentId agentId, const std::string & agent)
+    {
+        if (agentId >= agentsById.size()) return nullptr;
+        auto entry = agentsById[agentId];
+        if (!entry || entry->first != agent) return nullptr;
+        return &entry->second;
+    }
+
     ML::RingBufferSRMW<std::pair<std::string, std::shared_ptr<const AgentConfig> > > configBuffer;
     ML::RingBufferSRMW<std::shared_ptr<ExchangeConnector> > exchangeBuffer;
     ML::RingBufferSRMW<std::shared_ptr<AugmentationInfo> > startBiddingBuffer;
@@ -434,6 +479,9 @@ public:
 
     ML::Wakeup_Fd wakeupMainLoop;
 
+    /** Agents connected through shared memory, if enabled. */
+    std::unique_ptr<ShmAgentServer> shmAgents;
+
     FilterPool filters;
 
     AugmentationLoop augmentationLoop;
@@ -453,6 +501,14 @@ public:
     DutyCycleEntry dutyCycleCurrent;
     std::vector<DutyCycleEntry> dutyCycleHistory;
 
+    /** Time spent in each stage of run(). */
+    RouterLoopTimes loopTimes;
+
+    /** Record the loop times of the last window (of elapsed seconds) as
+        metrics and start a new one.
+    */
+    void logLoopTimes(double elapsed);
+
     void run();
 
     void handleAgentMessage(const std::vector<std::string> & message);
@@ -503,6 +559,9 @@ public:
     /** An agent bid on an auction.  Arrange for this bid to be recorded. */
     void doBid(const std::vector<std::string> & message);
 
+    /** An agent sent a batch of bids (see BidResponseBatch). */
+    void doBids(const std::vector<std::string> & message);
+
     void doBidImpl(const BidMessage &message,
                    const std::vector<std::string> &originalMessage = std::vector<std::string>());
 
@@ -549,6 +608,9 @@ public:
     */
     void configure(const std::string & agent, AgentConfig & config);
 
+    /** Remove the given agent from the router and the filters. */
+    void removeAgent(Agents::iterator it);
+
     mutable Lock lock;
 
     std::shared_ptr<Banker> banker;
@@ -717,10 +779,17 @@ public:
 
     /** Log a given message to the given channel. */
     template<typename... Args>
-    void logMessage(const std::string & channel, Args... args)
+    void logMessage(const std::string & channel, const Args & ... args)
     {
         using namespace std;
         //cerr << "********* logging message to " << channel << endl;
+        if (binaryLogRecords) {
+            std::string & record = logRecordBuffer();
+            LogRecord::init(record, channel, Date::now());
+            LogRecord::append(record, args...);
+            logger.publish(channel, record);
+            return;
+        }
         logger.publish(channel, Date::now().print(5), args...);
     }
 
@@ -728,18 +797,37 @@ public:
     template<typename... Args>
     void logMessageToAnalytics(const std::string & channel, Args... args)
     {
+        logMessageToAnalytics(analytics.channel(channel), args...);
+    }
+
+    template<typename... Args>
+    void logMessageToAnalytics(AnalyticsPublisher::Channel channel,
+                               Args... args)
+    {
+        if (!analytics.isEnabled(channel)) return;
         analytics.publish(channel, Date::now().print(5), args...);
     }
 
     /** Log a given message to the given channel. */
     template<typename... Args>
-    void logMessageNoTimestamp(const std::string & channel, Args... args)
+    void logMessageNoTimestamp(const std::string & channel,
+                               const Args & ... args)
     {
         using namespace std;
         //cerr << "********* logging message to " << channel << endl;
+        if (binaryLogRecords) {
+            std::string & record = logRecordBuffer();
+            LogRecord::init(record, channel);
+            LogRecord::append(record, args...);
+            logger.publish(channel, record);
+            return;
+        }
         logger.publish(channel, args...);
     }
 
+    /** Thread local string in which the log records are serialized. */
+    static std::string & logRecordBuffer();
+
     /*************************************************************************/
     /* DEBUGGING                                                             */
     /*************************************************************************/
@@ -780,6 +868,10 @@ public:
     ZmqNamedPublisher logger;
     AnalyticsPublisher analytics;
 
+    /** Channels published on for every auction and bid. */
+    AnalyticsPublisher::Channel analyticsAuctionChannel;
+    AnalyticsPublisher::Channel analyticsBidChannel;
+
     /** Debug only */
     bool doDebug;
 
@@ -818,6 +910,15 @@ public:
 
     double slowModeTolerance;
     Seconds augmentationWindow;
+
+    /** See setAdaptiveBidTimeouts(). */
+    bool adaptiveBidTimeouts;
+
+    /** See setBinaryLogRecords(). */
+    bool binaryLogRecords;
+
+    /** Start a new latency window for each agent. */
+    void rotateAgentLatencies();
 };
 
 
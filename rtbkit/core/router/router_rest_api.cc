@@ -7,6 +7,7 @@
 
 #include "router_rest_api.h"
 #include "router.h"
+#include "rtbkit/common/auction_tracer.h"
 #include "jml/utils/json_parsing.h"
 
 using namespace std;
@@ -21,9 +22,8 @@ namespace RTBKIT {
 
 RouterRestApiConnection::
 RouterRestApiConnection(const string& name,
-                        ServiceBase& parent,
                         Router* router) :
-    HttpMonitorHandler(name, parent, router),
+    HttpMonitorHandler(name, router),
     router(router)
 {
 }
@@ -41,13 +41,24 @@ doGet(const std::string& resource)
         string agentName(header.resource, 7);
         sendResponse(router->getAgentInfo(agentName));
     }
-    else if (header.resource.find("/strategy/") == 0) {
-        string strategyName(header.resource, 10);
-        sendResponse(router->getStrategyInfo(strategyName));
+    else if (header.resource == "/latency") {
+        sendResponse(router->getAllAgentLatencies());
     }
-    else if (header.resource.find("/campaign/") == 0) {
-        string campaignName(header.resource, 10);
-        sendResponse(router->getCampaignInfo(campaignName));
+    else if (header.resource.find("/latency/") == 0) {
+        string agentName(header.resource, 9);
+        Json::Value latency = router->getAllAgentLatencies();
+        if (!latency.isMember(agentName))
+            sendErrorResponse(404, "unknown agent '" + agentName + "'");
+        else sendResponse(latency[agentName]);
+    }
+    else if (header.resource == "/loop") {
+        sendResponse(router->getLoopTimes());
+    }
+    else if (header.resource == "/trace") {
+        sendResponse(auctionTracer().eventsJson());
+    }
+    else if (header.resource == "/trace/breakdown") {
+        sendResponse(auctionTracer().breakdown());
     }
     else {
         sendErrorResponse(
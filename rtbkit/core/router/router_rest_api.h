@@ -20,8 +20,19 @@ struct Router;
 /* ROUTER REST API CONNECTION                                                 */
 /******************************************************************************/
 
+/** Read-only view of the router over http:
+
+    GET /agents            info about all of the agents
+    GET /agent/<name>      info about one agent
+    GET /latency           bid latency histograms of all of the agents
+    GET /latency/<name>    bid latency histogram of one agent
+    GET /loop              time histograms of the stages of the main loop
+    GET /trace             last events of the auction tracer
+    GET /trace/breakdown   latency histograms of each auction stage
+    POST /validateConfig   check an agent configuration
+*/
 struct RouterRestApiConnection
-    : public HttpMonitorHandler<RouterRestApiConnection, Router*> {
+    : public Datacratic::HttpMonitorHandler<RouterRestApiConnection, Router*> {
 
     RouterRestApiConnection(const std::string& name,
                             Router* router);
@@ -34,7 +45,7 @@ struct RouterRestApiConnection
                         const std::string& payload);
 };
 
-typedef HttpMonitor<RouterRestApiConnection, Router*> RouterRestApi;
+typedef Datacratic::HttpMonitor<RouterRestApiConnection, Router*> RouterRestApi;
 
 } // namespace RTBKIT
 
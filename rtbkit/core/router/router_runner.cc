@@ -62,6 +62,11 @@ RouterRunner() :
     analyticsOn(false),
     analyticsConnections(1),
     augmentationWindowms(5),
+    augmentationHedgePercent(0),
+    localAugmentorThreads(2),
+    restApiPort(0),
+    adaptiveBidTimeouts(false),
+    binaryLogRecords(false),
     dableSlowMode(false),
     enableJsonFiltersFile("")
 {
@@ -112,6 +117,24 @@ doOptions(int argc, char ** argv,
          "split or local banker can be chosen.")
          ("augmenter-timeout",value<int>(&augmentationWindowms),
          "configure the augmenter  timeout (in milliseconds)")
+        ("augmenter-hedge-percent", value<int>(&augmentationHedgePercent),
+         "percentage of the augmenter timeout after which an unanswered "
+         "request is sent to a second augmenter instance (0 disables)")
+        ("local-augmentors", value<string>(&localAugmentorsFile),
+         "configuration file with the augmentors to run inside the router")
+        ("local-augmentor-threads", value<int>(&localAugmentorThreads),
+         "number of threads running the local augmentors")
+        ("shm-agent-socket", value<string>(&shmAgentSocket),
+         "unix socket on which the agents of this host can connect to "
+         "exchange auctions and bids through shared memory")
+        ("rest-api-port", value<int>(&restApiPort),
+         "port of the http api giving the agents' info and bid latencies")
+        ("adaptive-bid-timeouts", bool_switch(&adaptiveBidTimeouts),
+         "don't send auctions to agents whose p99 bid latency is longer "
+         "than the time left in the auction")
+        ("binary-log-records", bool_switch(&binaryLogRecords),
+         "publish the log messages as binary records, formatted by the "
+         "data logger")
         ("no slow mode", value<bool>(&dableSlowMode)->zero_tokens(),
          "disable the slow mode.")
         ("filters-configuration", value<string>(&enableJsonFiltersFile),
@@ -152,6 +175,9 @@ init()
     if (!enableJsonFiltersFile.empty())
         filtersConfig = loadJsonFromFile(enableJsonFiltersFile);
 
+    if (!localAugmentorsFile.empty())
+        localAugmentorsConfig = loadJsonFromFile(localAugmentorsFile);
+
     const auto amountSlowModeMoneyLimit = Amount::parse(slowModeMoneyLimit);
     const auto maxBidPriceAmount = USD_CPM(maxBidPrice);
 
@@ -175,6 +201,15 @@ init()
                                       USD_CPM(maxBidPrice),
                                       slowModeTimeout, amountSlowModeMoneyLimit, augmentationWindow);
     router->slowModeTolerance = slowModeTolerance;
+    router->setAdaptiveBidTimeouts(adaptiveBidTimeouts);
+    router->setBinaryLogRecords(binaryLogRecords);
+    router->augmentationLoop.setHedging(augmentationHedgePercent / 100.0);
+    router->augmentationLoop.setLocalThreads(localAugmentorThreads);
+    for (const auto & config: localAugmentorsConfig) {
+        router->augmentationLoop.addLocalAugmentor(
+                LocalAugmentor::create(proxies, config),
+                config.get("maxInFlight", 3000).asInt());
+    }
     router->initBidderInterface(bidderConfig);
     if (dableSlowMode) {
        router->unsafeDisableSlowMode();
@@ -220,6 +255,8 @@ init()
     router->initExchanges(exchangeConfig);
     router->initFilters(filtersConfig);
     router->bindTcp();
+    if (!shmAgentSocket.empty())
+        router->bindSharedMemoryAgents(shmAgentSocket);
 }
 
 void
@@ -229,12 +266,18 @@ start()
     if (slaveBanker) slaveBanker->start();
     if (localBanker) localBanker->start();
     router->start();
+
+    if (restApiPort) {
+        restApi.reset(new RouterRestApi(router->serviceName() + ".restApi"));
+        restApi->start(restApiPort, router.get());
+    }
 }
 
 void
 RouterRunner::
 shutdown()
 {
+    if (restApi) restApi->shutdown();
     router->shutdown();
     if (slaveBanker) slaveBanker->shutdown();
     if (localBanker) localBanker->shutdown();
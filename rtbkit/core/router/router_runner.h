@@ -10,6 +10,7 @@
 
 #include <boost/program_options/options_description.hpp>
 #include "rtbkit/core/router/router.h"
+#include "rtbkit/core/router/router_rest_api.h"
 #include "rtbkit/core/banker/slave_banker.h"
 #include "rtbkit/core/banker/local_banker.h"
 #include "soa/service/service_utils.h"
@@ -53,6 +54,13 @@ struct RouterRunner {
     bool analyticsOn;
     int analyticsConnections;
     int augmentationWindowms;
+    int augmentationHedgePercent;
+    std::string localAugmentorsFile;
+    int localAugmentorThreads;
+    std::string shmAgentSocket;
+    int restApiPort;
+    bool adaptiveBidTimeouts;
+    bool binaryLogRecords;
     bool dableSlowMode;
     std::string enableJsonFiltersFile;
 
@@ -65,9 +73,11 @@ struct RouterRunner {
     std::shared_ptr<SlaveBanker> slaveBanker;
     std::shared_ptr<LocalBanker> localBanker;
     std::shared_ptr<Router> router;
+    std::unique_ptr<RouterRestApi> restApi;
     Json::Value exchangeConfig;
     Json::Value bidderConfig;
     Json::Value filtersConfig;
+    Json::Value localAugmentorsConfig;
 
     static Logging::Category print;
     static Logging::Category trace;
@@ -8,6 +8,7 @@
 #include "router_types.h"
 #include "rtbkit/core/agent_configuration/agent_config.h"
 #include "jml/db/persistent.h"
+#include "jml/arch/exception.h"
 
 using namespace std;
 using namespace ML;
@@ -113,37 +114,30 @@ toJson(bool includeConfig, bool includeStats) const
     return result;
 }
 
-const std::string &
-AgentInfo::
-encodeBidRequest(const BidRequest & br) const
-{
-    throw ML::Exception("encodeBidRequest not there yet");
-}
-
 const std::string &
 AgentInfo::
 encodeBidRequest(const Auction & auction) const
 {
-    return auction.requestStr;
+    return auction.encodedRequest(bidRequestFormat);
 }
 
 const std::string &
 AgentInfo::
 getBidRequestEncoding(const Auction & auction) const
 {
-    return auction.requestStrFormat;
+    return auction.encodedRequestFormat(bidRequestFormat);
 }
 
 void
 AgentInfo::
 setBidRequestFormat(const std::string & val)
 {
-    // TODO
+    bidRequestFormat = parseBidRequestFormat(val);
 }
 
 AgentStats::
 AgentStats()
-    : auctions(0), bids(0), wins(0), losses(0), tooLate(0),
+    : auctions(0), bids(0), wins(0), losses(0), tooLate(0), tooSlow(0),
       invalid(0), noBudget(0),
       tooManyInFlight(0), noSpots(0), skippedBidProbability(0),
       urlFiltered(0), hourOfWeekFiltered(0),
@@ -176,6 +170,7 @@ toJson() const
     result["wins"] = wins;
     result["losses"] = losses;
     result["tooLate"] = tooLate;
+    result["tooSlow"] = tooSlow;
     result["invalid"] = invalid;
     result["noBudget"] = noBudget;
     result["totalBid"] = totalBid.toJson();
@@ -219,6 +214,96 @@ toJson() const
     return result;
 }
 
+void
+AgentLatency::
+rotate(uint64_t minSamples)
+{
+    if (window.count() < minSamples)
+        return;
+
+    p99Ms = window.percentile(99) / 1000.0;
+    window.clear();
+}
+
+Json::Value
+AgentLatency::
+toJson() const
+{
+    Json::Value result = total.toJson();
+    result["window"] = window.toJson();
+    result["windowP99Ms"] = p99Ms.load();
+    return result;
+}
+
+const char *
+routerLoopStageName(RouterLoopStage stage)
+{
+    switch (stage) {
+    case RLS_SPIN_POLL:                   return "spinPoll";
+    case RLS_CHECK_EXPIRED_AUCTIONS:      return "checkExpiredAuctions";
+    case RLS_SLEEP:                       return "sleep";
+    case RLS_SLEEP_POLL:                  return "sleepPoll";
+    case RLS_START_BIDDING:               return "doStartBidding";
+    case RLS_BID:                         return "doBid";
+    case RLS_CONFIGURE_AGENT_ON_EXCHANGE: return "configureAgentOnExchange";
+    case RLS_CONFIG:                      return "doConfig";
+    case RLS_SUBMITTED:                   return "doSubmitted";
+    case RLS_AGENT_MESSAGE:               return "agentMessage";
+    case RLS_SHM_AGENT_MESSAGES:          return "shmAgentMessages";
+    case RLS_SEND_PINGS:                  return "sendPings";
+    case RLS_CHECKS:                      return "checks";
+    case RLS_LOG_BID_EVENTS:              return "logBidEvents";
+    default:
+        throw ML::Exception("unknown router loop stage %d", (int)stage);
+    }
+}
+
+void
+RouterLoopTimes::
+rotate()
+{
+    for (unsigned i = 0;  i < RLS_NUM_STAGES;  ++i) {
+        total[i].add(window[i]);
+        window[i].clear();
+    }
+}
+
+Json::Value
+RouterLoopTimes::
+toJson(const Datacratic::LatencyHistogram & times)
+{
+    auto us = [] (uint64_t ns) { return ns / 1000.0; };
+
+    Json::Value result;
+    result["count"] = times.count();
+    result["meanUs"] = times.mean() / 1000.0;
+    result["maxUs"] = us(times.max());
+    result["p50Us"] = us(times.percentile(50));
+    result["p90Us"] = us(times.percentile(90));
+    result["p99Us"] = us(times.percentile(99));
+    result["p999Us"] = us(times.percentile(99.9));
+    return result;
+}
+
+Json::Value
+RouterLoopTimes::
+toJson() const
+{
+    Json::Value result;
+    for (unsigned i = 0;  i < RLS_NUM_STAGES;  ++i) {
+        Json::Value & entry
+            = result[routerLoopStageName(RouterLoopStage(i))];
+
+        Datacratic::LatencyHistogram window(this->window[i]);
+        Datacratic::LatencyHistogram all(total[i]);
+        all.add(window);
+
+        entry = toJson(all);
+        entry["window"] = toJson(window);
+    }
+    return result;
+}
+
 Json::Value
 FormatInfo::
 toJson() const
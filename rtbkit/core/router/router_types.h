@@ -14,6 +14,8 @@
 #include <set>
 #include "rtbkit/common/currency.h"
 #include "rtbkit/common/bids.h"
+#include "soa/service/latency_histogram.h"
+#include "jml/arch/tick_counter.h"
 
 
 namespace RTBKIT {
@@ -21,6 +23,16 @@ namespace RTBKIT {
 struct AgentConfig;
 
 
+/** Dense integer identifier of a configured agent.  It is the slot that the
+    router's FilterPool gave to the agent's config, so the same id indexes
+    the filter results, the bidders of an auction and Router::agentsById.
+    An id stays the same across reconfigurations of the agent and is
+    recycled once the agent goes away.
+*/
+typedef unsigned AgentId;
+static const AgentId NoAgentId = (AgentId)-1;
+
+
 /*****************************************************************************/
 /* BIDDABLE SPOTS                                                            */
 /*****************************************************************************/
@@ -48,6 +60,7 @@ struct AgentStats {
     uint64_t wins;
     uint64_t losses;
     uint64_t tooLate;
+    uint64_t tooSlow;
     uint64_t invalid;
     uint64_t noBudget;
 
@@ -104,42 +117,157 @@ struct AgentStatus {
     size_t numBidsInFlight;
 };
 
+
+/** Time that an agent takes to answer its auctions, from the moment the
+    auction is sent to the moment its bid is received.  Auctions that
+    expire without an answer count as taking the time until they expired.
+
+    Written by the router's main loop; the histograms can be read from
+    other threads.
+*/
+struct AgentLatency {
+    /** One in this many of the auctions that an agent is too slow for is
+        still sent to it, so that it keeps on being measured.
+    */
+    enum { ProbeInterval = 50 };
+
+    AgentLatency()
+        : p99Ms(0.0), skipped(0)
+    {
+    }
+
+    void record(double seconds)
+    {
+        total.recordSeconds(seconds);
+        window.recordSeconds(seconds);
+    }
+
+    /** Take the p99 of the current window and start a new one, if the
+        window has at least the given number of samples.  Otherwise the
+        previous p99 is kept and the window goes on accumulating, so that an
+        agent that gets little traffic (for example because it was too
+        slow) doesn't go back to a p99 of 0.
+    */
+    void rotate(uint64_t minSamples);
+
+    /** Called for an auction that the agent is too slow for; returns true
+        if it should be sent anyway as a probe.
+    */
+    bool probe()
+    {
+        return skipped.fetch_add(1, std::memory_order_relaxed)
+            % ProbeInterval == 0;
+    }
+
+    Json::Value toJson() const;
+
+    Datacratic::LatencyHistogram total;   ///< Since the agent appeared
+    Datacratic::LatencyHistogram window;  ///< Since the last rotate()
+
+    /** p99 of the last complete window, in milliseconds. */
+    std::atomic<double> p99Ms;
+
+    std::atomic<uint64_t> skipped;
+};
+
+
+/** Stages of an iteration of the router's main loop. */
+enum RouterLoopStage {
+    RLS_SPIN_POLL,
+    RLS_CHECK_EXPIRED_AUCTIONS,
+    RLS_SLEEP,
+    RLS_SLEEP_POLL,
+    RLS_START_BIDDING,
+    RLS_BID,
+    RLS_CONFIGURE_AGENT_ON_EXCHANGE,
+    RLS_CONFIG,
+    RLS_SUBMITTED,
+    RLS_AGENT_MESSAGE,
+    RLS_SHM_AGENT_MESSAGES,
+    RLS_SEND_PINGS,
+    RLS_CHECKS,
+    RLS_LOG_BID_EVENTS,
+    RLS_NUM_STAGES
+};
+
+/** Name of the stage in the metrics and the REST API, eg "doBid". */
+const char * routerLoopStageName(RouterLoopStage stage);
+
+/** Time spent in each stage of the router's main loop, measured with the
+    tick counter.  The histograms are in nanoseconds.
+
+    Written by the router's main loop only, which records into the window
+    without any locked instruction and adds the window to the totals when it
+    rotates it.  The histograms can be read from other threads.
+*/
+struct RouterLoopTimes {
+
+    /** Record the time since startTicks (from ML::ticks()) for the stage. */
+    void record(RouterLoopStage stage, uint64_t startTicks)
+    {
+        uint64_t now = ML::ticks();
+        uint64_t ns = now > startTicks
+            ? (now - startTicks) * ML::seconds_per_tick * 1000000000.0
+            : 0;
+        window[stage].recordSingleWriter(ns);
+    }
+
+    /** Add the window to the totals and start a new one, for all of the
+        stages.  Called by the router's main loop.
+    */
+    void rotate();
+
+    /** Count, mean, max and percentiles of each stage, in microseconds, since
+        startup and in the current window.
+    */
+    Json::Value toJson() const;
+
+    /** Same for a single histogram. */
+    static Json::Value toJson(const Datacratic::LatencyHistogram & times);
+
+    /// Up to the last rotate(); toJson() adds the current window to them
+    Datacratic::LatencyHistogram total[RLS_NUM_STAGES];
+    Datacratic::LatencyHistogram window[RLS_NUM_STAGES];  ///< Since rotate()
+};
+
 /// Information about a agent
 struct AgentInfo {
     AgentInfo()
         : bidRequestFormat(BRF_JSON_RAW),
           configured(false),
+          filterIndex(NoAgentId),
           status(new AgentStatus()),
           stats(new AgentStats()),
+          latency(new AgentLatency()),
           throttleProbability(1.0)
     {
     }
 
-    enum BidRequestFormat {
-        BRF_JSON_RAW,  ///< Send raw exchangeJSON bid requests
-        BRF_JSON_NORM, ///< Send normalized JSON bid requests
-        BRF_BINARY_V1  ///< Send binary bid requests
-    } bidRequestFormat;
+    BidRequestFormat bidRequestFormat;
     
     bool configured;
-    unsigned filterIndex;
+    AgentId filterIndex;    ///< Agent id; NoAgentId until configured
     std::shared_ptr<AgentConfig> config;
     std::shared_ptr<AgentStatus> status;
     std::shared_ptr<AgentStats> stats;
+    std::shared_ptr<AgentLatency> latency;
     double throttleProbability;
 
     /** Address of the zeromq socket for this agent. */
     std::string address;
     
-    /** Encode the given bid request ready to be sent to the given
-        agent in its configured format.
+    /** Encode the auction's bid request ready to be sent to the given
+        agent in its configured format.  The encoding is cached in the
+        auction, so agents asking for the same format share it.
     */
-    const std::string & encodeBidRequest(const BidRequest & br) const;
-
     const std::string & encodeBidRequest(const Auction & auction) const;
+
+    /** Name of the format returned by encodeBidRequest(), as understood by
+        BidRequest::parse().
+    */
     const std::string & getBidRequestEncoding(const Auction & auction) const;
 
-    /** Set the bid request format. */
+    /** Set the bid request format ("jsonRaw", "jsonNorm" or "binary"). */
     void setBidRequestFormat(const std::string & val);
 
     /** Structure in which we record the information on ping timings. */
@@ -237,9 +365,10 @@ struct PotentialBidder {
     // If inFlightProp == NULL_PROP then the bidder has been filtered out.
     enum { NULL_PROP = 1000000 };
 
-    PotentialBidder() : inFlightProp(NULL_PROP) {}
+    PotentialBidder() : agentId(NoAgentId), inFlightProp(NULL_PROP) {}
 
     std::string agent;
+    AgentId agentId;
     float inFlightProp;
     BiddableSpots imp;
     std::shared_ptr<const AgentConfig> config;
@@ -280,11 +409,60 @@ struct AuctionInfoBase {
 };
 
 struct BidInfo {
+    BidInfo() : agentId(NoAgentId) {}
+
+    AgentId agentId;
     Date bidTime;
     BiddableSpots imp;
     std::shared_ptr<const AgentConfig> agentConfig;  //< config active at auction
 };
 
+/** The agents that an auction was sent to, along with their bid info.
+
+    An auction only goes out to a handful of agents, so rather than a tree
+    keyed on the agent name the bidders are kept in a flat vector and found
+    by agent id with integer compares.  The name is kept alongside for the
+    bidder interfaces and the logs.
+
+    Note that an agent id can be recycled while the auction is in flight;
+    callers that get the id from an untrusted source (eg, a bid message)
+    should check the name of the entry that they find.
+*/
+struct AuctionBidders
+    : public std::vector<std::pair<std::string, BidInfo> > {
+
+    iterator find(AgentId agentId)
+    {
+        for (auto it = begin(), e = end();  it != e;  ++it)
+            if (it->second.agentId == agentId) return it;
+        return end();
+    }
+
+    const_iterator find(AgentId agentId) const
+    {
+        for (auto it = begin(), e = end();  it != e;  ++it)
+            if (it->second.agentId == agentId) return it;
+        return end();
+    }
+
+    void insert(std::string agent, BidInfo info)
+    {
+        emplace_back(std::move(agent), std::move(info));
+    }
+
+    /** Remove the given agent.  The order of the remaining bidders is not
+        preserved.
+    */
+    bool erase(AgentId agentId)
+    {
+        auto it = find(agentId);
+        if (it == end()) return false;
+        if (it != end() - 1) *it = std::move(back());
+        pop_back();
+        return true;
+    }
+};
+
 // Information about an in-flight auction
 struct AuctionInfo : public AuctionInfoBase {
     AuctionInfo() {}
@@ -294,7 +472,7 @@ struct AuctionInfo : public AuctionInfoBase {
     {
     }
 
-    std::map<std::string, BidInfo> bidders;  ///< List of bidders
+    AuctionBidders bidders;  ///< List of bidders
 
 };
 
@@ -16,6 +16,8 @@ $(eval $(call library,static_filters,$(LIB_FILTERS_SOURCES),$(LIB_FILTERS_LINK))
 LIBRTB_ROUTER_SOURCES := \
 	augmentation_loop.cc \
 	router.cc \
+	router_rest_api.cc \
+	shm_agent_server.cc \
 	router_types.cc \
 	router_stack.cc \
 	filter_pool.cc
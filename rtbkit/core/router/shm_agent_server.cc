@@ -0,0 +1,405 @@
+/* shm_agent_server.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Shared memory transport between the router and co-located agents.
+*/
+
+#include "shm_agent_server.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+namespace RTBKIT {
+
+namespace {
+
+/** Random nonce, printed in hex. */
+string makeNonce()
+{
+    unsigned char bytes[16];
+
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throw ML::Exception(errno, "open /dev/urandom");
+    ssize_t res = ::read(fd, bytes, sizeof(bytes));
+    ::close(fd);
+    if (res != sizeof(bytes))
+        throw ML::Exception("couldn't read /dev/urandom");
+
+    string result;
+    for (unsigned char c: bytes)
+        result += ML::format("%02x", c);
+    return result;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SHM AGENT SERVER                                                          */
+/*****************************************************************************/
+
+ShmAgentServer::Agent::
+Agent()
+    : wakeupFd(-1)
+{
+}
+
+ShmAgentServer::Agent::
+~Agent()
+{
+    if (wakeupFd != -1)
+        ::close(wakeupFd);
+}
+
+ShmAgentServer::
+ShmAgentServer(const std::string & eventPrefix,
+               std::shared_ptr<ServiceProxies> services)
+    : EventRecorder(eventPrefix, services),
+      processingMessages(false),
+      handshakeTimeout(1.0),
+      listenFd(-1), routerWakeupFd(-1), channelCapacity(0), numChannels(0)
+{
+}
+
+ShmAgentServer::
+~ShmAgentServer()
+{
+    shutdown();
+}
+
+void
+ShmAgentServer::
+init(const std::string & socketPath, int routerWakeupFd,
+     size_t logCapacity, size_t channelCapacity,
+     double handshakeTimeout)
+{
+    struct sockaddr_un addr;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+        throw ML::Exception("socket path too long: " + socketPath);
+
+    this->socketPath_ = socketPath;
+    this->routerWakeupFd = routerWakeupFd;
+    this->channelCapacity = channelCapacity;
+    this->handshakeTimeout = handshakeTimeout;
+    prefix = ML::format("/rtb-router-%d", getpid());
+
+    logSegment.create(prefix + "-requests",
+                      ShmLog::bytesNeeded(logCapacity));
+    log.init(logSegment.data(), logCapacity);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd == -1)
+        throw ML::Exception(errno, "socket");
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath.c_str());
+
+    unlink(socketPath.c_str());
+    int res = ::bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
+    if (res == -1)
+        throw ML::Exception(errno, "bind " + socketPath);
+
+    // Only the agents running as the router's user may connect
+    res = chmod(socketPath.c_str(), 0600);
+    if (res == -1)
+        throw ML::Exception(errno, "chmod " + socketPath);
+
+    res = listen(listenFd, 16);
+    if (res == -1)
+        throw ML::Exception(errno, "listen " + socketPath);
+
+    // The listening socket has no handshake attached to it
+    epoller.init(64);
+    epoller.addFd(listenFd, nullptr);
+}
+
+void
+ShmAgentServer::
+shutdown()
+{
+    agents.clear();
+    expected.clear();
+
+    // Closing them also takes them out of the epoll set
+    for (auto & entry: handshakes)
+        ::close(entry.first);
+    handshakes.clear();
+
+    if (listenFd != -1) {
+        ::close(listenFd);
+        unlink(socketPath_.c_str());
+        listenFd = -1;
+    }
+
+    logSegment.close();
+    epoller.close();
+}
+
+void
+ShmAgentServer::
+handleEvents()
+{
+    // The handshakes are completed after the events were all seen, since
+    // that removes them from the set
+    vector<int> ready;
+
+    auto onEvent = [&] (epoll_event & event)
+        {
+            if (event.data.ptr)
+                ready.push_back(static_cast<Handshake *>(event.data.ptr)->fd);
+            else acceptConnections();
+            return Epoller::DONE;
+        };
+
+    epoller.handleEvents(0, -1, onEvent);
+
+    for (int fd: ready)
+        completeHandshake(fd);
+}
+
+void
+ShmAgentServer::
+acceptConnections()
+{
+    for (;;) {
+        int fd = accept4(listenFd, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                recordHit("shm.acceptError");
+            return;
+        }
+
+        // The agent sends its name and eventfd right after connecting; we
+        // wait for them to be there before reading them.
+        Handshake & handshake = handshakes[fd];
+        handshake.fd = fd;
+        handshake.deadline = Date::now().plusSeconds(handshakeTimeout);
+        epoller.addFd(fd, &handshake);
+    }
+}
+
+void
+ShmAgentServer::
+completeHandshake(int fd)
+{
+    try {
+        string payload;
+        vector<int> fds = recvFds(fd, payload, 1);
+
+        std::unique_ptr<Agent> entry(new Agent());
+        if (!fds.empty())
+            entry->wakeupFd = fds[0];
+        for (unsigned i = 1;  i < fds.size();  ++i)
+            ::close(fds[i]);
+
+        // The payload is the name of the agent and the nonce that it was
+        // sent with SHM_READY
+        auto pos = payload.rfind(' ');
+        if (pos == string::npos)
+            throw ML::Exception("invalid handshake");
+        string agent(payload, 0, pos);
+        string nonce(payload, pos + 1);
+
+        auto it = expected.find(agent);
+        if (it == expected.end() || it->second.nonce != nonce)
+            throw ML::Exception("agent %s sent an invalid nonce",
+                                agent.c_str());
+        expected.erase(it);
+
+        if (isConnected(agent))
+            throw ML::Exception("agent %s is already connected",
+                                agent.c_str());
+        if (fds.size() != 1)
+            throw ML::Exception("agent %s didn't send its eventfd",
+                                agent.c_str());
+
+        string channelName = prefix + "-" + to_string(numChannels++);
+        entry->channel.create(channelName, channelCapacity, channelCapacity);
+
+        sendFds(fd, channelName + " " + logSegment.name(),
+                { routerWakeupFd });
+
+        agents[agent] = std::move(entry);
+        recordHit("shm.agentConnected");
+    } catch (const std::exception &) {
+        recordHit("shm.handshakeError");
+    }
+
+    closeHandshake(fd);
+}
+
+void
+ShmAgentServer::
+closeHandshake(int fd)
+{
+    epoller.removeFd(fd);
+    handshakes.erase(fd);
+    ::close(fd);
+}
+
+void
+ShmAgentServer::
+expireHandshakes(Date now)
+{
+    vector<int> expired;
+    for (auto & entry: handshakes)
+        if (entry.second.deadline < now)
+            expired.push_back(entry.first);
+
+    for (int fd: expired) {
+        recordHit("shm.handshakeTimeout");
+        closeHandshake(fd);
+    }
+
+    for (auto it = expected.begin();  it != expected.end();) {
+        if (it->second.deadline < now)
+            it = expected.erase(it);
+        else ++it;
+    }
+}
+
+std::string
+ShmAgentServer::
+expectAgent(const std::string & agent)
+{
+    removeAgent(agent);
+
+    // The agent has to connect and then send its handshake
+    Expected & entry = expected[agent];
+    entry.nonce = makeNonce();
+    entry.deadline = Date::now().plusSeconds(2 * handshakeTimeout);
+    return entry.nonce;
+}
+
+bool
+ShmAgentServer::
+isConnected(const std::string & agent) const
+{
+    if (!agents.count(agent))
+        return false;
+    return std::find(removedAgents.begin(), removedAgents.end(), agent)
+        == removedAgents.end();
+}
+
+void
+ShmAgentServer::
+removeAgent(const std::string & agent)
+{
+    // The messages of its channel may be being read
+    if (processingMessages) {
+        if (isConnected(agent))
+            removedAgents.push_back(agent);
+        return;
+    }
+
+    agents.erase(agent);
+}
+
+uint64_t
+ShmAgentServer::
+writeRequest(const Id & auctionId,
+             const std::string & requestFormat,
+             const std::string & request)
+{
+    return log.write({ auctionId.toString(), requestFormat, request });
+}
+
+bool
+ShmAgentServer::
+sendAuction(const std::string & agent,
+            uint64_t requestPosition,
+            Date start,
+            const std::string & spots,
+            const std::string & timeLeftMs,
+            const std::string & augmentations,
+            const std::string & wcm)
+{
+    auto it = agents.find(agent);
+    if (it == agents.end())
+        return false;
+
+    static const string auction("AUCTION");
+    string position = to_string(requestPosition);
+    string startStr = ML::format("%.5f", start.secondsSinceEpoch());
+
+    bool written = it->second->channel.toClient.tryWrite(
+            { auction, position, startStr, spots, timeLeftMs,
+              augmentations, wcm });
+    if (!written)
+        return false;
+
+    uint64_t one = 1;
+    ssize_t res = ::write(it->second->wakeupFd, &one, sizeof(one));
+    (void) res;
+
+    return true;
+}
+
+size_t
+ShmAgentServer::
+processAgentMessages(const OnAgentMessage & onMessage)
+{
+    size_t numMessages = 0;
+    vector<string> message;
+
+    // The handler may remove agents, which we only do once we're done
+    // with their channels
+    processingMessages = true;
+
+    try {
+        for (auto & agent: agents) {
+            ShmRing & ring = agent.second->channel.toServer;
+
+            while (isConnected(agent.first)) {
+                message.clear();
+                message.push_back(agent.first);
+                if (!ring.tryRead(message))
+                    break;
+
+                if (message.size() < 2
+                    || (message[1] != "BID" && message[1] != "BIDS")) {
+                    recordHit("shm.unexpectedMessage");
+                    continue;
+                }
+
+                onMessage(message);
+                ++numMessages;
+            }
+        }
+    } catch (...) {
+        removeAgents();
+        throw;
+    }
+
+    removeAgents();
+    return numMessages;
+}
+
+void
+ShmAgentServer::
+removeAgents()
+{
+    processingMessages = false;
+    for (auto & agent: removedAgents)
+        agents.erase(agent);
+    removedAgents.clear();
+}
+
+} // namespace RTBKIT
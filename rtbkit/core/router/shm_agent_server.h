@@ -0,0 +1,178 @@
+/* shm_agent_server.h                                              -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Shared memory transport between the router and the bidding agents running
+   on the same host.
+*/
+
+#pragma once
+
+#include "soa/service/shm_ring.h"
+#include "soa/service/epoller.h"
+#include "soa/service/service_base.h"
+#include "soa/types/date.h"
+#include "soa/types/id.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* SHM AGENT SERVER                                                          */
+/*****************************************************************************/
+
+/** Router side of the shared memory transport for co-located agents.
+
+    Agents keep their zmq connection for everything but the auctions and
+    the bids.  An agent asks for the transport by sending SHM_CONNECT to the
+    router, which answers SHM_READY with the path of a unix socket and a
+    nonce that is only valid for that agent.  The agent then connects to
+    that socket and sends its name and the nonce along with the eventfd it
+    wants to be woken up with; it gets back the names of its channel and of
+    the request log, along with the eventfd of the router's main loop.  The
+    socket is only accessible to the router's user, and a handshake without
+    the nonce or for an agent that is already connected is refused, so that
+    a process can't take over the channel of another agent.  The handshake
+    never blocks the router: the connections are only read once the agent's
+    message is there, and are dropped if it doesn't come within
+    handshakeTimeout seconds.
+
+    Each bid request is written once to the request log, which every agent
+    maps, and each agent then receives a small AUCTION message on its
+    channel pointing into the log.  BID messages come back on the channel.
+
+    All of the methods must be called from the router's main loop thread.
+*/
+struct ShmAgentServer : public Datacratic::EventRecorder {
+
+    ShmAgentServer(const std::string & eventPrefix,
+                   std::shared_ptr<Datacratic::ServiceProxies> services);
+    ~ShmAgentServer();
+
+    /** Bind the unix socket at the given path and create the request log.
+        Agents wake up the router through the given eventfd.
+    */
+    void init(const std::string & socketPath, int routerWakeupFd,
+              size_t logCapacity = 64 * 1024 * 1024,
+              size_t channelCapacity = 4 * 1024 * 1024,
+              double handshakeTimeout = 1.0);
+
+    void shutdown();
+
+    const std::string & socketPath() const { return socketPath_; }
+
+    /** Fd to be polled for input by the router's main loop, which then
+        calls handleEvents().  It is ready when an agent connects to the
+        socket or when a connected agent sent its part of the handshake.
+    */
+    int selectFd() const { return epoller.selectFd(); }
+
+    /** Accept the new connections and complete the handshakes that are
+        ready, without blocking.
+    */
+    void handleEvents();
+
+    /** Drop the connections of the agents that didn't complete their
+        handshake in time.  Must be called periodically.
+    */
+    void expireHandshakes(Datacratic::Date now = Datacratic::Date::now());
+
+    /** Expect a handshake from the given agent, which it must authenticate
+        with the returned nonce.  The agent's existing channel, if any, is
+        dropped.
+    */
+    std::string expectAgent(const std::string & agent);
+
+    bool isConnected(const std::string & agent) const;
+
+    /** Drop the channel of the agent.  When called from within
+        processAgentMessages(), the channel is only dropped once all of the
+        messages were processed.
+    */
+    void removeAgent(const std::string & agent);
+
+    /** Write the encoded bid request to the request log and return the
+        position at which the agents will find it.
+    */
+    uint64_t writeRequest(const Datacratic::Id & auctionId,
+                          const std::string & requestFormat,
+                          const std::string & request);
+
+    /** Send an auction to the given agent.  Returns false if its channel is
+        full, in which case the auction should go through zmq instead.
+    */
+    bool sendAuction(const std::string & agent,
+                     uint64_t requestPosition,
+                     Datacratic::Date start,
+                     const std::string & spots,
+                     const std::string & timeLeftMs,
+                     const std::string & augmentations,
+                     const std::string & wcm);
+
+    typedef std::function<void (const std::vector<std::string> &)>
+        OnAgentMessage;
+
+    /** Pass every BID and BIDS message waiting in the agents' channels to
+        the given function, prefixed with the name of the agent as if it had
+        come from zmq.  Other messages are dropped, since the shared memory
+        transport only carries bids.  Returns the number of messages
+        handled.
+    */
+    size_t processAgentMessages(const OnAgentMessage & onMessage);
+
+private:
+    struct Agent {
+        Agent();
+        ~Agent();
+
+        Datacratic::ShmChannel channel;
+        int wakeupFd;
+    };
+
+    std::map<std::string, std::unique_ptr<Agent> > agents;
+
+    /** Agents removed while their messages were being processed. */
+    std::vector<std::string> removedAgents;
+    bool processingMessages;
+
+    /** Nonces of the agents that were sent SHM_READY. */
+    struct Expected {
+        std::string nonce;
+        Datacratic::Date deadline;
+    };
+    std::map<std::string, Expected> expected;
+
+    /** Connections of the agents whose handshake isn't done yet. */
+    struct Handshake {
+        int fd;
+        Datacratic::Date deadline;
+    };
+    std::map<int, Handshake> handshakes;
+    Datacratic::Epoller epoller;
+    double handshakeTimeout;
+
+    void acceptConnections();
+    void completeHandshake(int fd);
+    void closeHandshake(int fd);
+
+    /** Remove the agents that were removed while processing messages. */
+    void removeAgents();
+
+    std::string socketPath_;
+    std::string prefix;
+    int listenFd;
+    int routerWakeupFd;
+    size_t channelCapacity;
+    uint64_t numChannels;
+
+    Datacratic::ShmSegment logSegment;
+    Datacratic::ShmLog log;
+};
+
+} // namespace RTBKIT
@@ -0,0 +1,84 @@
+/* agent_id_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the agent ids handed out by the filter pool and for the flat
+   bidder set of an auction.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/filter_pool.h"
+#include "rtbkit/core/router/router_types.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+
+
+using namespace std;
+using namespace ML;
+using namespace RTBKIT;
+
+namespace {
+
+AgentInfo makeInfo()
+{
+    AgentInfo info;
+    info.config = std::make_shared<AgentConfig>();
+    return info;
+}
+
+BidInfo makeBid(AgentId agentId)
+{
+    BidInfo info;
+    info.agentId = agentId;
+    return info;
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_filter_pool_agent_ids )
+{
+    FilterPool filters;
+    filters.initWithDefaultFilters();
+
+    BOOST_CHECK_EQUAL(filters.addConfig("a", makeInfo()), 0);
+    BOOST_CHECK_EQUAL(filters.addConfig("b", makeInfo()), 1);
+    BOOST_CHECK_EQUAL(filters.addConfig("c", makeInfo()), 2);
+
+    // A reconfigured agent keeps its id even when a lower one is free
+    filters.removeConfig("a");
+    BOOST_CHECK_EQUAL(filters.addConfig("c", makeInfo()), 2);
+    BOOST_CHECK_EQUAL(filters.addConfig("b", makeInfo()), 1);
+
+    // Free ids get recycled for new agents
+    BOOST_CHECK_EQUAL(filters.addConfig("d", makeInfo()), 0);
+    BOOST_CHECK_EQUAL(filters.addConfig("e", makeInfo()), 3);
+}
+
+BOOST_AUTO_TEST_CASE( test_auction_bidders )
+{
+    AuctionBidders bidders;
+    BOOST_CHECK(bidders.find(0) == bidders.end());
+    BOOST_CHECK(!bidders.erase(0));
+
+    bidders.insert("a", makeBid(4));
+    bidders.insert("b", makeBid(0));
+    bidders.insert("c", makeBid(7));
+    BOOST_CHECK_EQUAL(bidders.size(), 3);
+
+    BOOST_CHECK_EQUAL(bidders.find(4)->first, "a");
+    BOOST_CHECK_EQUAL(bidders.find(0)->first, "b");
+    BOOST_CHECK_EQUAL(bidders.find(7)->first, "c");
+    BOOST_CHECK(bidders.find(1) == bidders.end());
+
+    BOOST_CHECK(bidders.erase(4));
+    BOOST_CHECK_EQUAL(bidders.size(), 2);
+    BOOST_CHECK(bidders.find(4) == bidders.end());
+    BOOST_CHECK_EQUAL(bidders.find(0)->first, "b");
+    BOOST_CHECK_EQUAL(bidders.find(7)->first, "c");
+    BOOST_CHECK_EQUAL(bidders.find(7)->second.agentId, 7);
+
+    BOOST_CHECK(bidders.erase(7));
+    BOOST_CHECK(bidders.erase(0));
+    BOOST_CHECK(bidders.empty());
+}
@@ -0,0 +1,399 @@
+/* augmentation_loop_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the augmentor instance selection and request hedging of the
+   augmentation loop, using local augmentors with injected delays.  Stuck
+   augmentors don't answer at all until they're released, so the tests only
+   check who answered and in which order things happened.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "jml/utils/testing/watchdog.h"
+#include "rtbkit/core/router/augmentation_loop.h"
+#include "rtbkit/core/agent_configuration/agent_config.h"
+#include "rtbkit/plugins/augmentor/augmentor_base.h"
+#include <future>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+const string sampleBr =
+    "{\"id\":\"85885bb0-b91b-11e2-c4cf-7fba90171555\",\"timestamp\":1368153863.008756,\"isTest\":false,\"url\":\"http://myonlinearcade.com/\",\"ipAddress\":\"166.13.20.21\",\"userAgent\":\"Mozilla/5.0\",\"language\":\"fr\",\"protocolVersion\":\"0.3\",\"exchange\":\"appnexus\",\"provider\":\"appnexus\",\"location\":{\"countryCode\":\"CA\",\"regionCode\":\"QC\",\"cityName\":\"Laval\",\"postalCode\":\"0\",\"dma\":0,\"timezoneOffsetMinutes\":-1},\"userIds\":{\"an\":\"5273283952213481305\",\"xchg\":\"5273283952213481305\"},\"imp\":[{\"id\":\"156331815539876686\",\"banner\":{\"w\":728,\"h\":90},\"formats\":[\"728x90\"]}]}";
+
+const string augmentorName = "test-aug";
+
+/** Event service that counts the hits recorded by the services, so that a
+    test can wait for one to happen.
+*/
+struct HitCounter : public EventService {
+
+    virtual void onEvent(const std::string & name,
+                         const char * event,
+                         StatEventType type,
+                         float value,
+                         std::initializer_list<int> extra)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        ++hits[name + "." + event];
+        changed.notify_all();
+    }
+
+    void waitFor(const string & hit)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] () { return hits[hit] > 0; });
+    }
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::map<string, int> hits;
+};
+
+std::shared_ptr<ServiceProxies>
+makeProxies()
+{
+    auto proxies = std::make_shared<ServiceProxies>();
+    proxies->events = std::make_shared<HitCounter>();
+    return proxies;
+}
+
+/** Blocks the threads that wait() on it until it's released. */
+struct Gate {
+    Gate() : open(false) {}
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        released.wait(guard, [&] () { return open; });
+    }
+
+    void release()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        open = true;
+        released.notify_all();
+    }
+
+    std::mutex lock;
+    std::condition_variable released;
+    bool open;
+};
+
+/** Instance of the test augmentor that takes the given time to answer and
+    tags its answers with its name.  A negative delay makes it stuck: it
+    doesn't answer anything until it's destroyed.
+*/
+struct FakeAugmentor {
+    FakeAugmentor(const string & name,
+                  std::shared_ptr<ServiceProxies> proxies,
+                  int delayMs)
+        : name(name), delayMs(delayMs), numRequests(0),
+          augmentor(augmentorName, name, proxies)
+    {
+        augmentor.doRequest = [=] (const AugmentationRequest &)
+            {
+                ++this->numRequests;
+                if (this->delayMs < 0)
+                    stuck.wait();
+                else this_thread::sleep_for(
+                        chrono::milliseconds(this->delayMs));
+
+                AugmentationList result;
+                result[AccountKey()].data = this->name;
+                return result;
+            };
+        augmentor.init();
+        augmentor.start();
+
+        // Wait until it's registered with the loop so that the instances
+        // are configured in a known order.
+        auto & hits = dynamic_cast<HitCounter &>(*proxies->events);
+        hits.waitFor(name + ".messages.CONFIGOK");
+    }
+
+    ~FakeAugmentor()
+    {
+        stuck.release();
+        augmentor.shutdown();
+    }
+
+    string name;
+    int delayMs;
+    std::atomic<int> numRequests;
+    Gate stuck;
+    SyncAugmentor augmentor;
+};
+
+struct Result {
+    string answeredBy;      ///< Instance whose augmentation we got, if any
+    bool beforeTimeout;     ///< Finished before the window was over
+};
+
+/** Run the given number of auctions one after the other through the loop
+    and return who augmented each of them.
+*/
+vector<Result>
+runAuctions(AugmentationLoop & loop, int numAuctions, double window)
+{
+    auto agentConfig = std::make_shared<AgentConfig>();
+    agentConfig->augmentations.push_back(AugmentationConfig(augmentorName));
+
+    PotentialBidder bidder;
+    bidder.agent = "test-agent";
+    bidder.config = agentConfig;
+
+    vector<Result> results;
+
+    for (int i = 0;  i < numAuctions;  ++i) {
+        Date start = Date::now();
+
+        std::shared_ptr<BidRequest> bidRequest
+            (BidRequest::parse("datacratic", sampleBr));
+        bidRequest->auctionId = Id(i + 1);
+
+        auto auction = std::make_shared<Auction>(
+                nullptr, [] (std::shared_ptr<Auction>) {},
+                bidRequest, sampleBr, "datacratic",
+                start, start.plusSeconds(1.0));
+
+        auto info = std::make_shared<AugmentationInfo>(auction, Date());
+        info->potentialGroups.resize(1);
+        info->potentialGroups[0].push_back(bidder);
+
+        Result result;
+        Date timeout = start.plusSeconds(window);
+
+        std::promise<void> finished;
+        loop.augment(info, timeout,
+                     [&] (const std::shared_ptr<AugmentationInfo> &)
+                     {
+                         result.beforeTimeout = Date::now() < timeout;
+                         finished.set_value();
+                     });
+        finished.get_future().wait();
+
+        auto it = auction->augmentations.find(augmentorName);
+        if (it != auction->augmentations.end()) {
+            auto augIt = it->second.find(AccountKey());
+            if (augIt != it->second.end())
+                result.answeredBy = augIt->second.data.asString();
+        }
+
+        results.push_back(result);
+    }
+
+    return results;
+}
+
+size_t countAnsweredBy(const vector<Result> & results, const string & name)
+{
+    size_t n = 0;
+    for (const auto & result: results)
+        if (result.answeredBy == name) ++n;
+    return n;
+}
+
+/** In-process augmentor that tags its answers with "local".  If it's
+    stuck, it doesn't answer anything until it's released.
+*/
+struct TestLocalAugmentor : public LocalAugmentor {
+    TestLocalAugmentor(std::string name,
+                       std::shared_ptr<ServiceProxies> const & proxies,
+                       Json::Value const & config)
+        : LocalAugmentor(std::move(name), proxies),
+          isStuck(config.get("stuck", false).asBool()),
+          numRequests(0), numAnswers(0)
+    {
+    }
+
+    void onRequest(const AugmentationRequest & request,
+                   SendResponseCB sendResponse)
+    {
+        ++numRequests;
+        ExcAssert(request.bidRequest);
+        ExcAssertEqual(request.agents.size(), 1);
+
+        if (isStuck)
+            stuck.wait();
+
+        AugmentationList result;
+        result[AccountKey()].data = "local";
+        ++numAnswers;
+        sendResponse(result);
+    }
+
+    bool isStuck;
+    Gate stuck;
+    std::atomic<int> numRequests;
+    std::atomic<int> numAnswers;
+};
+
+struct AtInit {
+    AtInit()
+    {
+        PluginInterface<LocalAugmentor>::registerPlugin("test",
+                [] (std::string name,
+                    std::shared_ptr<ServiceProxies> const & proxies,
+                    Json::Value const & config)
+                {
+                    return new TestLocalAugmentor(name, proxies, config);
+                });
+    }
+} atInit;
+
+std::shared_ptr<TestLocalAugmentor>
+makeLocalAugmentor(std::shared_ptr<ServiceProxies> proxies, bool stuck)
+{
+    Json::Value config;
+    config["name"] = augmentorName;
+    config["type"] = "test";
+    config["stuck"] = stuck;
+
+    auto augmentor = LocalAugmentor::create(proxies, config);
+    return std::dynamic_pointer_cast<TestLocalAugmentor>(augmentor);
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_latency_aware_instance_selection )
+{
+    Watchdog watchdog(30.0);
+
+    auto proxies = makeProxies();
+
+    AugmentationLoop loop(proxies, "augmentation-ewma");
+    loop.init();
+    loop.start();
+
+    // The slow instance registers first so that it gets picked whenever the
+    // instances look the same, as they do before any of them answered.
+    FakeAugmentor slow("slow", proxies, 30);
+    FakeAugmentor fast("fast", proxies, 1);
+
+    auto results = runAuctions(loop, 100, 0.1);
+
+    size_t numFast = countAnsweredBy(results, "fast");
+    size_t numSlow = countAnsweredBy(results, "slow");
+
+    cerr << "fast: " << numFast << " slow: " << numSlow << endl;
+
+    BOOST_CHECK_EQUAL(numFast + numSlow, results.size());
+    BOOST_CHECK_GE(numFast, 90);
+
+    loop.shutdown();
+}
+
+BOOST_AUTO_TEST_CASE( test_hedged_requests )
+{
+    Watchdog watchdog(30.0);
+
+    auto proxies = makeProxies();
+
+    AugmentationLoop loop(proxies, "augmentation-hedge");
+    loop.setHedging(0.2);
+    loop.init();
+    loop.start();
+
+    // The stuck instance gets the first request but never answers; the
+    // hedge to the other instance has to save it, without waiting for the
+    // end of the window.
+    FakeAugmentor stuck("stuck", proxies, -1);
+    FakeAugmentor fast("fast", proxies, 1);
+
+    auto results = runAuctions(loop, 20, 0.1);
+
+    BOOST_CHECK_GE(stuck.numRequests.load(), 1);
+    BOOST_CHECK_EQUAL(countAnsweredBy(results, "fast"), results.size());
+
+    for (const auto & result: results)
+        BOOST_CHECK(result.beforeTimeout);
+
+    loop.shutdown();
+}
+
+BOOST_AUTO_TEST_CASE( test_no_hedging )
+{
+    Watchdog watchdog(30.0);
+
+    auto proxies = makeProxies();
+
+    AugmentationLoop loop(proxies, "augmentation-nohedge");
+    loop.init();
+    loop.start();
+
+    FakeAugmentor stuck("stuck", proxies, -1);
+    FakeAugmentor fast("fast", proxies, 1);
+
+    // Without hedging the first request times out, and the timeout steers
+    // the following ones towards the other instance.
+    auto results = runAuctions(loop, 20, 0.1);
+
+    BOOST_CHECK_EQUAL(results[0].answeredBy, "");
+    BOOST_CHECK(!results[0].beforeTimeout);
+    BOOST_CHECK_EQUAL(countAnsweredBy(results, "fast"), results.size() - 1);
+
+    loop.shutdown();
+}
+
+BOOST_AUTO_TEST_CASE( test_local_augmentor )
+{
+    Watchdog watchdog(30.0);
+
+    auto proxies = makeProxies();
+
+    auto augmentor = makeLocalAugmentor(proxies, false);
+    BOOST_REQUIRE(augmentor);
+
+    AugmentationLoop loop(proxies, "augmentation-local");
+    loop.addLocalAugmentor(augmentor);
+    loop.init();
+    loop.start();
+
+    auto results = runAuctions(loop, 20, 0.1);
+
+    BOOST_CHECK_EQUAL(augmentor->numRequests.load(), 20);
+    BOOST_CHECK_EQUAL(countAnsweredBy(results, "local"), results.size());
+
+    loop.shutdown();
+}
+
+BOOST_AUTO_TEST_CASE( test_local_augmentor_timeout )
+{
+    Watchdog watchdog(30.0);
+
+    auto proxies = makeProxies();
+
+    auto augmentor = makeLocalAugmentor(proxies, true);
+
+    AugmentationLoop loop(proxies, "augmentation-local-timeout");
+    loop.addLocalAugmentor(augmentor);
+    loop.setLocalThreads(1);
+    loop.init();
+    loop.start();
+
+    // The loop doesn't wait for a local augmentor past the window: all of
+    // the auctions are done before it answered any of them.
+    auto results = runAuctions(loop, 5, 0.01);
+
+    BOOST_CHECK_EQUAL(countAnsweredBy(results, "local"), 0);
+    BOOST_CHECK_EQUAL(augmentor->numAnswers.load(), 0);
+    BOOST_CHECK_GE(augmentor->numRequests.load(), 1);
+
+    // Its late answers are dropped just like those of remote augmentors.
+    augmentor->stuck.release();
+    loop.shutdown();
+}
@@ -0,0 +1,168 @@
+/* router_bids_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Benchmark of the decoding of the bids that the router gets from the
+   agents: one BID message per bid against BIDS batches (see
+   BidResponseBatch).
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include "rtbkit/core/router/router_types.h"
+#include "rtbkit/common/bids.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include "soa/jsoncpp/json.h"
+#include <iostream>
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+const string agent = "bench-agent";
+
+/** Bids of the response to the auction with the given index, as an agent
+    would send them.
+*/
+Bids makeBids(int i)
+{
+    Bids bids;
+
+    Bid bid;
+    bid.spotIndex = 0;
+    bid.bid(i % 4, USD_CPM(1.0 + i % 100 / 100.0), 0.5);
+    bid.account = AccountKey("campaign:strategy");
+    bid.ext = Json::parse("{\"deal\":\"abc\"}");
+    bids.push_back(bid);
+
+    bids.dataSources.insert("segments");
+    return bids;
+}
+
+string toString(const Json::Value & value)
+{
+    string result = Json::FastWriter().write(value);
+    boost::trim(result);
+    return result;
+}
+
+/* The decoding below is the one of Router::doBid() and Router::doBids(), up
+   to the call to doBidImpl() which both of them share.
+*/
+
+void decodeBid(const vector<string> & message, BidMessage & bidMessage)
+{
+    const string & model = message[4];
+
+    bidMessage.agents.assign(1, message[0]);
+    bidMessage.auctionId = Id(message[2]);
+    bidMessage.wcm = WinCostModel::fromJson(
+            model.empty() ? Json::Value() : Json::parse(model));
+    bidMessage.meta = message[5];
+    bidMessage.bids = Bids::fromJson(message[3]);
+}
+
+void decodeBids(const vector<string> & message,
+                const std::function<void (BidMessage &)> & onBid)
+{
+    auto onResponse = [&] (BidResponseBatch::Response & response)
+        {
+            BidMessage bidMessage;
+            bidMessage.agents.push_back(message[0]);
+            bidMessage.auctionId = response.auctionId;
+            if (!response.wcm.empty())
+                bidMessage.wcm
+                    = WinCostModel::fromJson(Json::parse(response.wcm));
+            bidMessage.meta = std::move(response.meta);
+            bidMessage.bids = std::move(response.bids);
+            onBid(bidMessage);
+        };
+
+    BidResponseBatch::decode(message[2], onResponse);
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( bench_router_bids )
+{
+    int numBids = 100000;
+
+    // What the agents send for each bid
+    vector<vector<string> > bidMessages;
+    for (int i = 0;  i < numBids;  ++i) {
+        bidMessages.push_back({ agent, "BID", Id(i + 1).toString(),
+                                toString(makeBids(i).toJson()),
+                                toString(WinCostModel().toJson()),
+                                "null" });
+    }
+
+    // Sanity check: both paths decode the same bids
+    {
+        BidMessage single;
+        decodeBid(bidMessages[7], single);
+
+        BidResponseBatch batch;
+        batch.add(Id(8), makeBids(7), "", "null");
+        vector<string> message = { agent, "BIDS", batch.release() };
+
+        int numDecoded = 0;
+        decodeBids(message, [&] (BidMessage & batched)
+                   {
+                       BOOST_CHECK_EQUAL(batched.auctionId, single.auctionId);
+                       BOOST_CHECK_EQUAL(batched.bids.toJsonStr(),
+                                         single.bids.toJsonStr());
+                       ++numDecoded;
+                   });
+        BOOST_CHECK_EQUAL(numDecoded, 1);
+    }
+
+    ML::Timer timer;
+    size_t numDecoded = 0;
+    for (auto & message: bidMessages) {
+        BidMessage bidMessage;
+        decodeBid(message, bidMessage);
+        numDecoded += bidMessage.bids.size();
+    }
+    double bidSeconds = timer.elapsed_wall();
+    BOOST_CHECK_EQUAL(numDecoded, numBids);
+
+    cerr << ML::format("%12s %16s %16s %10s\n",
+                       "batch size", "BID us/bid", "BIDS us/bid", "speedup");
+
+    for (int batchSize = 1;  batchSize <= 256;  batchSize *= 4) {
+        vector<vector<string> > batchMessages;
+        BidResponseBatch batch;
+        for (int i = 0;  i < numBids;  ++i) {
+            // The agents leave out the default win cost model
+            batch.add(Id(i + 1), makeBids(i), "", "null");
+            if (batch.size() == size_t(batchSize) || i == numBids - 1)
+                batchMessages.push_back({ agent, "BIDS", batch.release() });
+        }
+
+        timer.restart();
+        numDecoded = 0;
+        for (auto & message: batchMessages) {
+            decodeBids(message, [&] (BidMessage & bidMessage)
+                       {
+                           numDecoded += bidMessage.bids.size();
+                       });
+        }
+        double batchSeconds = timer.elapsed_wall();
+        BOOST_CHECK_EQUAL(numDecoded, numBids);
+
+        cerr << ML::format("%12d %16.3f %16.3f %9.2fx\n",
+                           batchSize,
+                           bidSeconds * 1000000.0 / numBids,
+                           batchSeconds * 1000000.0 / numBids,
+                           bidSeconds / batchSeconds);
+    }
+}
@@ -0,0 +1,89 @@
+/* router_loop_times_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the time histograms of the stages of the router's main loop.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/core/router/router_types.h"
+#include "jml/arch/timers.h"
+
+
+using namespace std;
+using namespace ML;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_router_loop_times )
+{
+    RouterLoopTimes times;
+
+    for (unsigned i = 0;  i < 10;  ++i) {
+        uint64_t start = ML::ticks();
+        ML::sleep(0.002);
+        times.record(RLS_SLEEP, start);
+        times.record(RLS_BID, ML::ticks());
+    }
+
+    // Recorded into the window, which goes into the totals on rotate()
+    BOOST_CHECK_EQUAL(times.window[RLS_SLEEP].count(), 10);
+    BOOST_CHECK_EQUAL(times.total[RLS_SLEEP].count(), 0);
+    BOOST_CHECK_GE(times.window[RLS_SLEEP].percentile(50), 2000000);
+    BOOST_CHECK_LT(times.window[RLS_BID].percentile(50), 100000);
+
+    Json::Value json = times.toJson();
+    BOOST_CHECK_EQUAL(json.size(), (unsigned)RLS_NUM_STAGES);
+    BOOST_CHECK_EQUAL(json["sleep"]["count"].asInt(), 10);
+    BOOST_CHECK_GE(json["sleep"]["p50Us"].asDouble(), 2000.0);
+    BOOST_CHECK_EQUAL(json["sleep"]["window"]["count"].asInt(), 10);
+    BOOST_CHECK_EQUAL(json["spinPoll"]["count"].asInt(), 0);
+
+    // A new window starts from scratch but keeps the totals
+    times.rotate();
+    BOOST_CHECK_EQUAL(times.total[RLS_SLEEP].count(), 10);
+    BOOST_CHECK_GE(times.total[RLS_SLEEP].percentile(50), 2000000);
+    json = times.toJson();
+    BOOST_CHECK_EQUAL(json["sleep"]["count"].asInt(), 10);
+    BOOST_CHECK_EQUAL(json["sleep"]["window"]["count"].asInt(), 0);
+
+    times.record(RLS_SLEEP, ML::ticks());
+    json = times.toJson();
+    BOOST_CHECK_EQUAL(json["sleep"]["count"].asInt(), 11);
+    BOOST_CHECK_EQUAL(json["sleep"]["window"]["count"].asInt(), 1);
+
+    BOOST_CHECK_EQUAL(string(routerLoopStageName(RLS_START_BIDDING)),
+                      "doStartBidding");
+    BOOST_CHECK_THROW(routerLoopStageName(RLS_NUM_STAGES), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_agent_latency_rotate )
+{
+    AgentLatency latency;
+
+    for (unsigned i = 0;  i < 100;  ++i)
+        latency.record(0.050);
+    latency.rotate(100);
+    BOOST_CHECK_CLOSE(latency.p99Ms.load(), 50.0, 1.0 / 32 * 100);
+
+    // Too few samples: the p99 is kept and the window goes on
+    for (unsigned i = 0;  i < 60;  ++i)
+        latency.record(0.010);
+    latency.rotate(100);
+    BOOST_CHECK_CLOSE(latency.p99Ms.load(), 50.0, 1.0 / 32 * 100);
+    BOOST_CHECK_EQUAL(latency.window.count(), 60);
+
+    for (unsigned i = 0;  i < 60;  ++i)
+        latency.record(0.010);
+    latency.rotate(100);
+    BOOST_CHECK_CLOSE(latency.p99Ms.load(), 10.0, 1.0 / 32 * 100);
+    BOOST_CHECK_EQUAL(latency.window.count(), 0);
+
+    // One skipped auction in ProbeInterval is sent anyway
+    unsigned probes = 0;
+    for (unsigned i = 0;  i < 10 * AgentLatency::ProbeInterval;  ++i)
+        probes += latency.probe();
+    BOOST_CHECK_EQUAL(probes, 10);
+}
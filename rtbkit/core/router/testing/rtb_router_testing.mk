@@ -9,3 +9,7 @@ $(eval $(call nodejs_test,rtb_new_format_test,bid_request sync_utils))
 $(eval $(call test,pending_list_test,types,boost))
 #$(eval $(call test,router_banker_test,rtb_router dataflow bidding_agent,boost))
 #$(eval $(call test,augmentation_test,rtb_router bid_request augmentor_base,boost))
+$(eval $(call test,agent_id_test,rtb_router,boost))
+$(eval $(call test,router_loop_times_test,rtb_router,boost))
+$(eval $(call test,augmentation_loop_test,rtb_router augmentor_base bid_request,boost))
+$(eval $(call test,router_bids_bench,rtb_router,boost manual))
@@ -65,44 +65,30 @@ private:
 };
 
 /******************************************************************************/
-/* FREQUENCY CAP AUGMENTOR                                                    */
+/* FREQUENCY CAP                                                              */
 /******************************************************************************/
 
-/** Note that the serviceName and augmentorName are distinct because you may
-    have multiple instances of the service that provide the same
-    augmentation.
-*/
-FrequencyCapAugmentor::
-FrequencyCapAugmentor(
-        std::shared_ptr<Datacratic::ServiceProxies> services,
-        const string& serviceName,
-        const string& augmentorName) :
-    SyncAugmentor(augmentorName, serviceName, services),
-    storage(new FrequencyCapStorage()),
-    agentConfig(getZmqContext()),
-    palEvents(getZmqContext())
+FrequencyCap::
+FrequencyCap(Datacratic::ServiceBase& service) :
+    agentConfig(service.getZmqContext()),
+    palEvents(service.getZmqContext()),
+    service(service),
+    storage(new FrequencyCapStorage())
 {
-    recordHit("up");
 }
 
 
-/** Sets up the internal components of the augmentor.
-
-    Note that SyncAugmentorBase is a MessageLoop so we can attach all our
-    other service providers to our message loop to cut down on the number of
-    polling threads which in turns reduces the number of context switches.
+/** Sets up the connections to the agent configuration service and to the
+    post auction loop.
 */
 void
-FrequencyCapAugmentor::
+FrequencyCap::
 init()
 {
-    SyncAugmentor::init(2 /* numThreads */);
-
     /* Manages all the communications with the AgentConfigurationService. */
-    agentConfig.init(getServices()->config);
-    addSource("FrequencyCapAugmentor::agentConfig", agentConfig);
+    agentConfig.init(service.getServices()->config);
 
-    palEvents.init(getServices()->config);
+    palEvents.init(service.getServices()->config);
 
     /* This lambda will get called when the post auction loop receives a win
        on an auction.
@@ -114,12 +100,11 @@ init()
                 RTBKIT::UserIds::createFromString(msg[15].toString());
 
             storage->inc(account, uids);
-            recordHit("wins");
+            service.recordHit("wins");
         };
 
     palEvents.connectAllServiceProviders(
             "rtbPostAuctionService", "logger", {"MATCHEDWIN"});
-    addSource("FrequencyCapAugmentor::palEvents", palEvents);
 }
 
 
@@ -130,10 +115,10 @@ init()
     constraints are respected and any late responses will be ignored.
 */
 RTBKIT::AugmentationList
-FrequencyCapAugmentor::
-onRequest(const RTBKIT::AugmentationRequest& request)
+FrequencyCap::
+augment(const RTBKIT::AugmentationRequest& request)
 {
-    recordHit("requests");
+    service.recordHit("requests");
 
     RTBKIT::AugmentationList result;
 
@@ -148,7 +133,7 @@ onRequest(const RTBKIT::AugmentationRequest& request)
            its configuration. This check keeps us safe in that scenario.
         */
         if (!config.valid()) {
-            recordHit("unknownConfig");
+            service.recordHit("unknownConfig");
             continue;
         }
 
@@ -173,9 +158,9 @@ onRequest(const RTBKIT::AugmentationRequest& request)
         */
         if (count < getCap(request.augmentor, agent, config)) {
             result[account].tags.insert("pass-frequency-cap-ex");
-            recordHit("accounts." + account[0] + ".passed");
+            service.recordHit("accounts." + account[0] + ".passed");
         }
-        else recordHit("accounts." + account[0] + ".capped");
+        else service.recordHit("accounts." + account[0] + ".capped");
     }
 
     return result;
@@ -188,7 +173,7 @@ onRequest(const RTBKIT::AugmentationRequest& request)
     the configuration.
 */
 size_t
-FrequencyCapAugmentor::
+FrequencyCap::
 getCap( const string& augmentor,
         const string& agent,
         const RTBKIT::AgentConfigEntry& config) const
@@ -207,5 +192,50 @@ getCap( const string& augmentor,
     return 0;
 }
 
-} // namespace RTBKIT
 
+/******************************************************************************/
+/* FREQUENCY CAP AUGMENTOR                                                    */
+/******************************************************************************/
+
+/** Note that the serviceName and augmentorName are distinct because you may
+    have multiple instances of the service that provide the same
+    augmentation.
+*/
+FrequencyCapAugmentor::
+FrequencyCapAugmentor(
+        std::shared_ptr<Datacratic::ServiceProxies> services,
+        const string& serviceName,
+        const string& augmentorName) :
+    SyncAugmentor(augmentorName, serviceName, services),
+    cap(*this)
+{
+    recordHit("up");
+}
+
+
+/** Sets up the internal components of the augmentor.
+
+    Note that SyncAugmentorBase is a MessageLoop so we can attach all our
+    other service providers to our message loop to cut down on the number of
+    polling threads which in turns reduces the number of context switches.
+*/
+void
+FrequencyCapAugmentor::
+init()
+{
+    SyncAugmentor::init(2 /* numThreads */);
+
+    cap.init();
+    addSource("FrequencyCapAugmentor::agentConfig", cap.agentConfig);
+    addSource("FrequencyCapAugmentor::palEvents", cap.palEvents);
+}
+
+
+RTBKIT::AugmentationList
+FrequencyCapAugmentor::
+onRequest(const RTBKIT::AugmentationRequest& request)
+{
+    return cap.augment(request);
+}
+
+} // namespace RTBKIT
@@ -26,6 +26,39 @@ struct FrequencyCapStorage;
 
 struct AgentConfigEntry;
 
+/******************************************************************************/
+/* FREQUENCY CAP                                                              */
+/******************************************************************************/
+
+/** The frequency capping itself, shared by the augmentor that runs as a
+    service and the one that runs inside the router.
+
+    The agent configuration listener and the post auction loop subscriber
+    must be added as sources to a message loop of the owner after init().
+ */
+struct FrequencyCap
+{
+    FrequencyCap(Datacratic::ServiceBase& service);
+
+    void init();
+
+    RTBKIT::AugmentationList augment(const RTBKIT::AugmentationRequest& request);
+
+    RTBKIT::AgentConfigurationListener agentConfig;
+    Datacratic::ZmqNamedMultipleSubscriber palEvents;
+
+private:
+
+    size_t getCap(
+            const std::string& augmentor,
+            const std::string& agent,
+            const RTBKIT::AgentConfigEntry& config) const;
+
+    Datacratic::ServiceBase& service;
+    std::shared_ptr<FrequencyCapStorage> storage;
+};
+
+
 /******************************************************************************/
 /* FREQUENCY CAP AUGMENTOR                                                    */
 /******************************************************************************/
@@ -40,6 +73,8 @@ struct AgentConfigEntry;
       augmentor.
     - FrequencyCapStorage for its simplistic data repository.
 
+    The same augmentor can also run inside the router, as the local augmentor
+    plugin of type "frequency_cap_ex"; see frequency_cap_ex_augmentor.cc.
  */
 struct FrequencyCapAugmentor :
     public RTBKIT::SyncAugmentor
@@ -57,16 +92,7 @@ private:
     virtual RTBKIT::AugmentationList
     onRequest(const RTBKIT::AugmentationRequest& request);
 
-    size_t getCap(
-            const std::string& augmentor,
-            const std::string& agent,
-            const RTBKIT::AgentConfigEntry& config) const;
-
-
-    std::shared_ptr<FrequencyCapStorage> storage;
-
-    RTBKIT::AgentConfigurationListener agentConfig;
-    Datacratic::ZmqNamedMultipleSubscriber palEvents;
+    FrequencyCap cap;
 };
 
 
@@ -7,6 +7,7 @@
 #------------------------------------------------------------------------------#
 
 $(eval $(call library,augmentor_ex,augmentor_ex.cc,augmentor_base rtb bid_request agent_configuration))
+$(eval $(call library,frequency_cap_ex_augmentor,frequency_cap_ex_augmentor.cc,augmentor_ex rtb))
 $(eval $(call library,mock_exchange,mock_exchange_connector.cc,exchange))
 
 $(eval $(call program,augmentor_ex_runner,augmentor_ex boost_program_options))
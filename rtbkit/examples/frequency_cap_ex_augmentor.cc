@@ -0,0 +1,89 @@
+/** frequency_cap_ex_augmentor.cc                                 -*- C++ -*-
+    Copyright (c) 2014 Datacratic.  All rights reserved.
+
+    Our frequency cap augmentor example as a local augmentor plugin, which
+    runs inside the router instead of as a separate service.  It is loaded
+    by the router for a local augmentor config such as:
+
+        { "name": "frequency-cap-ex", "type": "frequency_cap_ex" }
+
+*/
+
+#include "augmentor_ex.h"
+#include "rtbkit/common/local_augmentor.h"
+#include "soa/service/message_loop.h"
+
+
+using namespace std;
+
+namespace RTBKIT {
+
+
+/******************************************************************************/
+/* LOCAL FREQUENCY CAP AUGMENTOR                                              */
+/******************************************************************************/
+
+/** Since a LocalAugmentor isn't a MessageLoop, the agent configuration and
+    the win notifications are polled by a loop of our own.  The requests are
+    answered right away on the worker threads of the augmentation loop.
+ */
+struct LocalFrequencyCapAugmentor : public LocalAugmentor
+{
+    LocalFrequencyCapAugmentor(
+            std::string augmentorName,
+            std::shared_ptr<Datacratic::ServiceProxies> proxies) :
+        LocalAugmentor(std::move(augmentorName), std::move(proxies)),
+        cap(*this)
+    {
+        recordHit("up");
+    }
+
+    virtual void init()
+    {
+        cap.init();
+        loop.addSource("LocalFrequencyCapAugmentor::agentConfig",
+                       cap.agentConfig);
+        loop.addSource("LocalFrequencyCapAugmentor::palEvents",
+                       cap.palEvents);
+    }
+
+    virtual void start()
+    {
+        loop.start();
+    }
+
+    virtual void shutdown()
+    {
+        loop.shutdown();
+    }
+
+    virtual void onRequest(const AugmentationRequest & request,
+                           SendResponseCB sendResponse)
+    {
+        sendResponse(cap.augment(request));
+    }
+
+private:
+    FrequencyCap cap;
+    Datacratic::MessageLoop loop;
+};
+
+
+namespace {
+
+struct AtInit {
+    AtInit()
+    {
+        PluginInterface<LocalAugmentor>::registerPlugin("frequency_cap_ex",
+            [](std::string augmentorName,
+               std::shared_ptr<Datacratic::ServiceProxies> const & proxies,
+               Json::Value const & config)
+            {
+                return new LocalFrequencyCapAugmentor(augmentorName, proxies);
+            });
+    }
+} atInit;
+
+} // file scope
+
+} // namespace RTBKIT
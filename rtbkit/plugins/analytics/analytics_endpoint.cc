@@ -80,6 +80,31 @@ init()
                     JsonParam<string>("event", "event to publish")
             );
 
+    RestRequestRouter::OnProcessRequest eventsRoute
+        = [=] (const RestServiceEndpoint::ConnectionId & connection,
+                const RestRequest & request,
+                const RestRequestParsingContext & context) {
+            size_t numEvents;
+            try {
+                numEvents = AnalyticsBatch::decode(request.payload,
+                        [&] (const string & channel, const string & event) {
+                            addEvent(channel, event);
+                        });
+            } catch (const std::exception & exc) {
+                connection.sendResponse(400, exc.what());
+                return RestRequestRouter::MR_YES;
+            }
+            recordHit("batches");
+            recordCount(numEvents, "batchedEvents");
+            connection.sendResponse(200, to_string(numEvents));
+            return RestRequestRouter::MR_YES;
+        };
+
+    versionNode.addRoute("/events", "POST",
+            "Add a batch of events to the logs, as sent by the "
+            "AnalyticsPublisher.",
+            eventsRoute, Json::Value());
+
     addRouteSyncReturn(versionNode,
                     "/channels",
                     {"GET"},
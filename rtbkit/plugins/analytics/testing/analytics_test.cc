@@ -13,6 +13,8 @@
 #include "rtbkit/plugins/analytics/analytics_endpoint.h"
 #include "rtbkit/common/analytics_publisher.h"
 
+#include <thread>
+
 using namespace std;
 using namespace ML;
 using namespace Datacratic;
@@ -109,3 +111,65 @@ BOOST_AUTO_TEST_CASE( analytics_filter_sync_test )
     analyticsEndpoint->shutdown();
 
 }
+
+BOOST_AUTO_TEST_CASE( analytics_batch_test )
+{
+    string batch;
+    AnalyticsBatch::init(batch);
+    AnalyticsBatch::add(batch, "BID", "agent 1234 [{}]");
+    AnalyticsBatch::add(batch, "AUCTION", string(300, 'x'));
+
+    vector<pair<string, string> > events;
+    auto onEvent = [&] (const string & channel, const string & event) {
+        events.emplace_back(channel, event);
+    };
+
+    BOOST_CHECK_EQUAL(AnalyticsBatch::decode(batch, onEvent), 2);
+    BOOST_REQUIRE_EQUAL(events.size(), 2);
+    BOOST_CHECK_EQUAL(events[0].first, "BID");
+    BOOST_CHECK_EQUAL(events[0].second, "agent 1234 [{}]");
+    BOOST_CHECK_EQUAL(events[1].first, "AUCTION");
+    BOOST_CHECK_EQUAL(events[1].second, string(300, 'x'));
+
+    BOOST_CHECK_THROW(AnalyticsBatch::decode(batch.substr(0, batch.size() - 1),
+                                             onEvent),
+                      ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( analytics_batched_publish_test )
+{
+    shared_ptr<AnalyticsRestEndpoint> analyticsEndpoint;
+    setUpEndpoint(analyticsEndpoint);
+    analyticsEndpoint->enableChannel("Test");
+
+    shared_ptr<AnalyticsPublisher> analyticsClient;
+    setUpClient(analyticsClient);
+
+    // heartbeat, then the filters.
+    ML::sleep(2.0);
+
+    auto channel = analyticsClient->channel("Test");
+    BOOST_CHECK(analyticsClient->isEnabled(channel));
+
+    // Every thread publishes in its own buffer.
+    vector<thread> threads;
+    for (int i = 0;  i < 4;  ++i) {
+        threads.emplace_back([&, i] () {
+                for (int j = 0;  j < 100;  ++j)
+                    analyticsClient->publish(channel, "thread", i, "event", j);
+            });
+    }
+    for (auto & t: threads)
+        t.join();
+
+    ML::sleep(1.0);
+
+    auto stats = analyticsClient->getStats();
+    BOOST_CHECK_EQUAL(stats.published, 400);
+    BOOST_CHECK_EQUAL(stats.dropped, 0);
+    BOOST_CHECK_EQUAL(stats.sent, 400);
+    BOOST_CHECK_EQUAL(stats.failed, 0);
+
+    analyticsClient->shutdown();
+    analyticsEndpoint->shutdown();
+}
@@ -30,6 +30,10 @@ namespace RTBKIT {
 // of requests.
 enum { QueueSize = 65536 };
 
+// The router only understands one version of the responses, whatever the
+// version of the request.
+static const char * ResponseVersion = "1.0";
+
 Augmentor::
 Augmentor(const std::string & augmentorName,
           const std::string & serviceName,
@@ -40,7 +44,9 @@ Augmentor(const std::string & augmentorName,
       responseQueue(QueueSize),
       requestQueue(QueueSize),
       loopMonitor(*this),
-      loadStabilizer(loopMonitor)
+      loadStabilizer(loopMonitor),
+      lazyBidRequests(false),
+      binaryRequests(true)
 {
 }
 
@@ -54,7 +60,9 @@ Augmentor(const std::string & augmentorName,
       responseQueue(QueueSize),
       requestQueue(QueueSize),
       loopMonitor(*this),
-      loadStabilizer(loopMonitor)
+      loadStabilizer(loopMonitor),
+      lazyBidRequests(false),
+      binaryRequests(true)
 {
 }
 
@@ -76,7 +84,7 @@ init(int numThreads)
             toRouters.sendMessage(
                     request.router,
                     "RESPONSE",
-                    "1.0",
+                    ResponseVersion,
                     request.startTime,
                     request.id.toString(),
                     request.augmentor,
@@ -91,7 +99,11 @@ init(int numThreads)
 
     toRouters.connectHandler = [=] (const std::string & newRouter)
         {
-            toRouters.sendMessage(newRouter, "CONFIG", "1.0", augmentorName);
+            // The version of our CONFIG is the one of the AUGMENT messages
+            // that the router will send us.
+            toRouters.sendMessage(newRouter, "CONFIG",
+                                  binaryRequests ? "2.0" : "1.0",
+                                  augmentorName);
             recordHit("messages.CONFIG");
         };
 
@@ -155,24 +167,45 @@ void
 Augmentor::
 parseMessage(AugmentationRequest& request, Message& message)
 {
-    const string & version = message.second.at(1);
-    ExcCheckEqual(version, "1.0", "unexpected version in augment");
+    auto & fields = message.second;
 
     request.router = message.first;
     request.timeAvailableMs = 0.05;
-    request.augmentor = std::move(message.second.at(2));
-    request.id = Id(std::move(message.second.at(3)));
+    request.augmentor = std::move(fields.at(2));
+
+    const string & version = fields.at(1);
+
+    if (version == "2.0") {
+        AugmentMessage::decodePayload(
+                fields.at(3),
+                request.id,
+                request.bidRequestStrFormat,
+                request.bidRequestStr);
+        AugmentMessage::decodeAgents(fields.at(4), request.agents);
+        request.startTime = AugmentMessage::decodeStartTime(fields.at(5));
+    }
+
+    else {
+        ExcCheckEqual(version, "1.0", "unexpected version in augment");
 
-    const string & brSource = std::move(message.second.at(4));
-    const string & brStr = std::move(message.second.at(5));
-    request.bidRequest.reset(BidRequest::parse(brSource, brStr));
+        request.id = Id(fields.at(3));
+        request.bidRequestStrFormat = std::move(fields.at(4));
+        request.bidRequestStr = std::move(fields.at(5));
 
-    istringstream agentsStr(message.second.at(6));
-    ML::DB::Store_Reader reader(agentsStr);
-    reader.load(request.agents);
+        istringstream agentsStr(fields.at(6));
+        ML::DB::Store_Reader reader(agentsStr);
+        reader.load(request.agents);
+
+        const string & startTimeStr = fields.at(7);
+        request.startTime =
+            Date::fromSecondsSinceEpoch(strtod(startTimeStr.c_str(), 0));
+    }
 
-    const string & startTimeStr = message.second.at(7);
-    request.startTime = Date::fromSecondsSinceEpoch(strtod(startTimeStr.c_str(), 0));
+    request.bidRequest.reset();
+    if (!lazyBidRequests) {
+        request.bidRequest.reset(BidRequest::parse(
+                        request.bidRequestStrFormat, request.bidRequestStr));
+    }
 }
 
 void
@@ -190,20 +223,13 @@ handleRouterMessage(const std::string & router, std::vector<std::string> & messa
 
         bool shedMessage = loadStabilizer.shedMessage();
 
-        if (!shedMessage) {
-            Message value = make_pair(router, std::move(message));
+        Message value = make_pair(router, std::move(message));
+        if (!shedMessage)
             shedMessage = !requestQueue.tryPush(std::move(value));
-        }
 
+        // A failed push leaves the value untouched.
         if (shedMessage) {
-            toRouters.sendMessage(
-                    router,
-                    "RESPONSE",
-                    message.at(1), // version
-                    message.at(7), // startTime
-                    message.at(3), // auctionId
-                    message.at(2), // augmentor
-                    "null");       // response
+            shedRequest(router, value.second);
             recordHit("shedMessages");
         }
     }
@@ -211,6 +237,35 @@ handleRouterMessage(const std::string & router, std::vector<std::string> & messa
     else cerr << "unknown router message type: " << type << endl;
 }
 
+void
+Augmentor::
+shedRequest(const std::string & router, const std::vector<std::string> & message)
+{
+    const string & version = message.at(1);
+
+    if (version == "2.0") {
+        toRouters.sendMessage(
+                router,
+                "RESPONSE",
+                ResponseVersion,
+                AugmentMessage::decodeStartTime(message.at(5)),
+                AugmentMessage::decodeAuctionId(message.at(3)).toString(),
+                message.at(2), // augmentor
+                "null");       // response
+    }
+
+    else {
+        toRouters.sendMessage(
+                router,
+                "RESPONSE",
+                ResponseVersion,
+                message.at(7), // startTime
+                message.at(3), // auctionId
+                message.at(2), // augmentor
+                "null");       // response
+    }
+}
+
 void
 Augmentor::
 runWorker()
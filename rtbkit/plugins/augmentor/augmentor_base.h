@@ -15,6 +15,7 @@
 #include "soa/types/id.h"
 #include "rtbkit/common/auction.h"
 #include "rtbkit/common/augmentation.h"
+#include "rtbkit/common/local_augmentor.h"
 #include "soa/service/service_base.h"
 #include "soa/service/zmq_utils.h"
 #include "soa/service/socket_per_thread.h"
@@ -30,28 +31,6 @@
 
 namespace RTBKIT {
 
-/******************************************************************************/
-/* AUGMENTATION REQUEST                                                       */
-/******************************************************************************/
-
-/** Regroups the various parameters for the augmentation request.
-
-    Note that this object must be relatively copy friendly because it must be
-    transfered to worker threads in the MultiThreadedAugmentor and the
-    AsyncAugmentor.
- */
-struct AugmentationRequest
-{
-    std::string augmentor;                    // Name of the augmentor
-    std::string router;                       // Router to respond to
-    Id id;                                    // Auction id
-    std::shared_ptr<BidRequest> bidRequest;   // Bid request to augment
-    std::vector<std::string> agents;          // Agents availble to bid
-    double timeAvailableMs;                   // Time to respond
-    Date startTime;                           // Start of the latency timer
-};
-
-
 /*****************************************************************************/
 /* AUGMENTOR BASE                                                            */
 /*****************************************************************************/
@@ -83,6 +62,23 @@ struct Augmentor : public ServiceBase, public MessageLoop {
     double sampleLoad() { return loopMonitor.sampleLoad().load; }
     double shedProbability() { return loadStabilizer.shedProbability(); }
 
+    /** When set, the bid request of an augmentation request isn't parsed
+        before it's handed to the augmentor and bidRequest is left null.
+        Augmentors that only need the auction id or the agents can then skip
+        parsing altogether; the others can call parseBidRequest().
+
+        Must be called before init().
+    */
+    void setLazyBidRequests(bool lazy) { lazyBidRequests = lazy; }
+
+    /** Whether the routers are asked for the binary (2.0) AUGMENT messages,
+        which is the default.  Routers that predate them only accept the 1.0
+        CONFIG message, so this must be turned off to talk to them.
+
+        Must be called before init().
+    */
+    void setBinaryRequests(bool binary) { binaryRequests = binary; }
+
 
 protected:
 
@@ -106,10 +102,17 @@ private:
     LoopMonitor loopMonitor;
     LoadStabilizer loadStabilizer;
 
+    bool lazyBidRequests;
+    bool binaryRequests;
+
     void runWorker();
     void handleRouterMessage(const std::string & router,
                              std::vector<std::string> & message);
 
+    /** Sends back an empty augmentation for a request we won't process. */
+    void shedRequest(const std::string & router,
+                     const std::vector<std::string> & message);
+
     void parseMessage(AugmentationRequest& req, Message& msg);
 };
 
@@ -9,18 +9,114 @@
 #include <iterator> // std::back_inserter
 #include <algorithm>// std::copy_if
 #include <boost/range/irange.hpp>
+#include <sys/timerfd.h>
+#include <unistd.h>
 #include "redis_augmentor.h"
+#include "soa/service/async_event_source.h"
 #include "jml/utils/exc_assert.h"
 using namespace std;
 
 namespace RTBKIT {
 
 
+/** One shot timerfd that calls onTimeout on the loop that polls it.  arm()
+ *  may be called from any thread and replaces the previous deadline.
+ */
+struct RedisAugmentor::BatchTimer : public AsyncEventSource {
+    BatchTimer(std::function<void ()> onTimeout)
+        : onTimeout(std::move(onTimeout))
+    {
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if (timerFd == -1)
+            throw ML::Exception(errno, "timerfd_create");
+    }
+
+    ~BatchTimer()
+    {
+        ::close(timerFd);
+    }
+
+    void arm(double seconds)
+    {
+        // A zero it_value would disarm the timer instead
+        uint64_t nanoseconds = std::max<uint64_t>(seconds * 1000000000, 1);
+
+        itimerspec spec;
+        spec.it_interval.tv_sec = spec.it_interval.tv_nsec = 0;
+        spec.it_value.tv_sec = nanoseconds / 1000000000;
+        spec.it_value.tv_nsec = nanoseconds % 1000000000;
+
+        int res = timerfd_settime(timerFd, 0, &spec, 0);
+        if (res == -1)
+            throw ML::Exception(errno, "timerfd_settime");
+    }
+
+    virtual int selectFd() const
+    {
+        return timerFd;
+    }
+
+    virtual bool processOne()
+    {
+        uint64_t numWakeups;
+        int res;
+        do {
+            res = ::read(timerFd, &numWakeups, sizeof(numWakeups));
+        } while (res == -1 && errno == EINTR);
+
+        if (res == sizeof(numWakeups))
+            onTimeout();
+        else if (res == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+            throw ML::Exception(errno, "timerfd read");
+        return false;
+    }
+
+private:
+    int timerFd;
+    std::function<void ()> onTimeout;
+};
+
+
 RedisAugmentor::
 ~RedisAugmentor()
 {
 }
 
+void
+RedisAugmentor::
+setDefaults()
+{
+    batchWindow_ = 0.0002;
+    batchMaxRequests_ = 64;
+    cacheTtl_ = 0.0;
+    cacheMaxEntries_ = 0;
+    numBatches_ = 0;
+    numBatchedLookups_ = 0;
+    numBatchedKeys_ = 0;
+    numCacheHits_ = 0;
+}
+
+void
+RedisAugmentor::
+setBatching(double window, size_t maxRequests)
+{
+    ExcCheckGreaterEqual(window, 0.0, "negative batching window");
+    ExcCheckGreater(maxRequests, 0, "batches need at least one request");
+    batchWindow_ = window;
+    batchMaxRequests_ = maxRequests;
+}
+
+void
+RedisAugmentor::
+setCaching(double ttl, size_t maxEntries)
+{
+    ExcCheckGreaterEqual(ttl, 0.0, "negative cache ttl");
+    std::lock_guard<std::mutex> guard(cacheLock_);
+    cacheTtl_ = ttl;
+    cacheMaxEntries_ = maxEntries;
+    cache_.clear();
+}
+
 /** Sets up the internal components of the augmentor.
 
     Note that AsyncAugmentorBase is a MessageLoop so we can attach all our
@@ -35,6 +131,11 @@ init(int nthreads)
     /* Manages all the communications with the AgentConfigurationService. */
     agent_config_.init(getServices()->config);
     addSource("RedisAugmentor::agentConfig", agent_config_);
+
+    if (batchWindow_ > 0.0) {
+        batchTimer_ = std::make_shared<BatchTimer>([=] () { checkBatch(); });
+        addSource("RedisAugmentor::batch", batchTimer_);
+    }
 }
 
 
@@ -99,37 +200,207 @@ onRequest(const AugmentationRequest & request, SendResponseCB sendResponse)
         return;
     }
 
-    auto doResponse = [=](const Redis::Results& results) {
-        ExcAssertEqual (results.size(), jobs.size());
+    // Serve what we can from the cache and look up the rest.
+    auto values = std::make_shared<Values>();
+    Lookup lookup;
+
+    Date now = Date::now();
+    for (const auto& ii: jobs)
+    {
+        string value;
+        if (findCached(ii.first, value, now))
+            (*values)[ii.first] = std::move(value);
+        else lookup.keys.push_back(ii.first);
+    }
+
+    auto finish = [=](const Values& found) {
         AugmentationList auglret;
-        if (results)
+        for (const auto& ii: jobs)
         {
-            auto i=0;
-            for (const auto& ii: jobs)
-            {
-                const auto& res = results.at(i).reply().asString();
-                if (!res.empty())
-                    for (const auto& jj: ii.second)
-                        auglret[jj].data.atStr(ii.first) = res;
-                ++i;
+            auto it = found.find(ii.first);
+            if (it == found.end() || it->second.empty()) continue;
+            for (const auto& jj: ii.second)
+                auglret[jj].data.atStr(ii.first) = it->second;
+        }
+        recordOutcome(tm.elapsed_wall() * 1000.0, "redisResponseMs");
+        sendResponse(auglret);
+    };
+
+    numCacheHits_ += values->size();
+    recordCount(values->size(), "cacheHits");
+    recordCount(lookup.keys.size(), "cacheMisses");
+
+    if (lookup.keys.empty())
+    {
+        finish(*values);
+        return;
+    }
+
+    lookup.onValues = [=](const Values& fetched, const string& error) {
+        if (!error.empty())
+        {
+            cerr << "RedisAugmentor::onRequest::lambda(onValues) error: " << error << endl ;
+            recordHit("redisError."+error);
+            sendResponse(AugmentationList());
+            return;
+        }
+
+        Values found = *values;
+        for (const auto& key: lookup.keys)
+        {
+            auto it = fetched.find(key);
+            if (it != fetched.end()) found[key] = it->second;
+        }
+        finish(found);
+    };
+
+    queueLookup(std::move(lookup));
+}
+
+void
+RedisAugmentor::
+queueLookup(Lookup && lookup)
+{
+    std::vector<Lookup> toSend;
+    {
+        std::lock_guard<std::mutex> guard(batchLock_);
+        bool first = batch_.empty();
+        batch_.push_back(std::move(lookup));
+
+        if (batchWindow_ > 0.0 && batch_.size() < batchMaxRequests_) {
+            if (first) {
+                batchStart_ = Date::now();
+                batchTimer_->arm(batchWindow_);
             }
+            return;
+        }
+        toSend.swap(batch_);
+    }
+
+    sendBatch(std::move(toSend));
+}
+
+void
+RedisAugmentor::
+checkBatch()
+{
+    std::vector<Lookup> toSend;
+    {
+        std::lock_guard<std::mutex> guard(batchLock_);
+        if (batch_.empty()) return;
+
+        // The batch that the timer went off for was already sent because
+        // it was full, and this one isn't due yet
+        Date due = batchStart_.plusSeconds(batchWindow_);
+        double remaining = Date::now().secondsUntil(due);
+        if (remaining > 0.0) {
+            batchTimer_->arm(remaining);
+            return;
         }
-        else
+        toSend.swap(batch_);
+    }
+
+    sendBatch(std::move(toSend));
+}
+
+/** Sends the keys of all the lookups as a single MGET and fans the values
+    back out to each of them.
+*/
+void
+RedisAugmentor::
+sendBatch(std::vector<Lookup> && lookups)
+{
+    auto batch = std::make_shared<std::vector<Lookup> >(std::move(lookups));
+
+    auto keys = std::make_shared<std::vector<string> >();
+    {
+        set<string> unique;
+        for (const auto& lookup: *batch)
+            unique.insert(lookup.keys.begin(), lookup.keys.end());
+        keys->assign(unique.begin(), unique.end());
+    }
+
+    numBatches_ += 1;
+    numBatchedLookups_ += batch->size();
+    numBatchedKeys_ += keys->size();
+
+    recordLevel(batch->size(), "batchRequests");
+    recordLevel(keys->size(), "batchKeys");
+
+    Redis::Command mget = Redis::MGET;
+    for (const auto& key: *keys)
+        mget.addArg(key);
+
+    auto onResult = [=](const Redis::Result& result) {
+        Values values;
+        if (result)
         {
-            cerr << "RedisAugmentor::onRequest::lambda(doResponse) error: " << results.error() << endl ;
-            recordHit("redisError."+results.error());
+            const auto& reply = result.reply();
+            ExcAssertEqual(reply.length(), keys->size());
+            for (size_t i = 0; i < keys->size(); ++i)
+                values[(*keys)[i]] = reply[i].asString();
+            cacheValues(values);
         }
-        recordOutcome(tm.elapsed_wall() * 1000.0, "redisResponseMs");
-        sendResponse(auglret);
+
+        for (const auto& lookup: *batch)
+            lookup.onValues(values, result.error());
     };
 
-    // build a vector of commands
-    vector<Redis::Command> cmds;
-    for (auto& ii: jobs)
-        cmds.emplace_back (Redis::GET(ii.first));
+    redis_->queue(mget, onResult, 0.004);
+}
 
-    // and post it
-    redis_->queueMulti(cmds, doResponse, 0.004);
+bool
+RedisAugmentor::
+findCached(const string& key, string& value, Date now)
+{
+    if (cacheTtl_ <= 0.0) return false;
 
+    std::lock_guard<std::mutex> guard(cacheLock_);
+    auto it = cache_.find(key);
+    if (it == cache_.end()) return false;
+
+    if (it->second.expiry <= now)
+    {
+        cache_.erase(it);
+        return false;
+    }
+
+    value = it->second.value;
+    return true;
 }
+
+void
+RedisAugmentor::
+cacheValues(const Values& values)
+{
+    if (cacheTtl_ <= 0.0) return;
+
+    std::lock_guard<std::mutex> guard(cacheLock_);
+
+    // The cache may have been reconfigured since the check above
+    double ttl = cacheTtl_;
+    if (ttl <= 0.0) return;
+
+    Date now = Date::now();
+    Date expiry = now.plusSeconds(ttl);
+
+    // Make room by dropping whatever has expired; if that isn't enough, the
+    // keys that are already cached are the hot ones so keep them.
+    if (cache_.size() + values.size() > cacheMaxEntries_)
+    {
+        for (auto it = cache_.begin(); it != cache_.end();)
+        {
+            if (it->second.expiry <= now) it = cache_.erase(it);
+            else ++it;
+        }
+    }
+
+    for (const auto& ii: values)
+    {
+        auto it = cache_.find(ii.first);
+        if (it == cache_.end() && cache_.size() >= cacheMaxEntries_) continue;
+        cache_[ii.first] = { ii.second, expiry };
+    }
+}
+
 } /* namespace RTBKIT */
@@ -8,7 +8,10 @@
 #ifndef REDIS_AUGMENTOR_H_
 #define REDIS_AUGMENTOR_H_
 
+#include <atomic>
 #include <string>
+#include <mutex>
+#include <unordered_map>
 #include "augmentor_base.h"
 #include "soa/service/redis.h"
 #include "rtbkit/core/agent_configuration/agent_configuration_listener.h"
@@ -28,6 +31,7 @@ public:
         , agent_config_ (proxies->zmqContext)
         , redis_(std::make_shared<Redis::AsyncConnection>(redis))
     {
+        setDefaults();
     }
 
     RedisAugmentor(const std::string& augmentorName,
@@ -38,6 +42,7 @@ public:
         , agent_config_ (proxies->zmqContext)
         , redis_(redis)
     {
+        setDefaults();
     }
 
     RedisAugmentor(const std::string& augmentorName,
@@ -48,6 +53,7 @@ public:
         , agent_config_ (parent.getZmqContext())
         , redis_(std::make_shared<Redis::AsyncConnection>(redis))
     {
+        setDefaults();
     }
 
     RedisAugmentor(const std::string& augmentorName,
@@ -58,14 +64,97 @@ public:
         , agent_config_ (parent.getZmqContext())
         , redis_ (redis)
     {
+        setDefaults();
     }
 
     void init(int nthreads);
     virtual ~RedisAugmentor() ;
+
+    /** The lookups of concurrent requests are held for up to window seconds
+     *  (200us by default), or until maxRequests of them are waiting, and
+     *  then go out together as a single MGET.  Keys shared by the requests
+     *  of a batch are only fetched once.  A window of 0 sends the lookups of
+     *  each request as soon as they're known.
+     *
+     *  Must be called before init().
+     */
+    void setBatching(double window, size_t maxRequests);
+
+    /** Keep the values read from redis in memory for ttl seconds, for at
+     *  most maxEntries keys.  Missing keys are cached as well.  A ttl of 0
+     *  (the default) disables the cache.  Can be called at any time; the
+     *  cache is emptied.
+     */
+    void setCaching(double ttl, size_t maxEntries);
+
+    /** Number of MGETs sent, of the lookups and distinct keys that went out
+     *  with them, and of the keys that were found in the cache instead.
+     */
+    uint64_t numBatches() const { return numBatches_; }
+    uint64_t numBatchedLookups() const { return numBatchedLookups_; }
+    uint64_t numBatchedKeys() const { return numBatchedKeys_; }
+    uint64_t numCacheHits() const { return numCacheHits_; }
+
 private:
     void onRequest(const AugmentationRequest & request, SendResponseCB sendResponse);
     RTBKIT::AgentConfigurationListener agent_config_;
     std::shared_ptr<Redis::AsyncConnection> redis_ ;
+
+    void setDefaults();
+
+    /** Values of a set of keys; missing keys have an empty value. */
+    typedef std::unordered_map<std::string, std::string> Values;
+
+    /** Called with the values of the keys of a lookup, or with the error
+     *  that prevented us from getting them.
+     */
+    typedef std::function<void (const Values &, const std::string & error)>
+        OnValues;
+
+    /** Keys of a request that weren't in the cache, waiting to be sent. */
+    struct Lookup {
+        std::vector<std::string> keys;
+        OnValues onValues;
+    };
+
+    double batchWindow_;
+    size_t batchMaxRequests_;
+
+    std::mutex batchLock_;
+    std::vector<Lookup> batch_;
+    Datacratic::Date batchStart_;
+
+    /** One shot timer armed when the first lookup of a batch is queued, so
+     *  that nothing wakes up the loop while there's nothing to send.
+     */
+    struct BatchTimer;
+    std::shared_ptr<BatchTimer> batchTimer_;
+
+    void queueLookup(Lookup && lookup);
+    void checkBatch();
+    void sendBatch(std::vector<Lookup> && lookups);
+
+    struct CacheEntry {
+        std::string value;
+        Datacratic::Date expiry;
+    };
+
+    /** Written under cacheLock_.  The ttl is atomic so that lookups can
+     *  skip the lock when the cache is disabled.
+     */
+    std::atomic<double> cacheTtl_;
+    size_t cacheMaxEntries_;
+
+    std::mutex cacheLock_;
+    std::unordered_map<std::string, CacheEntry> cache_;
+
+    bool findCached(const std::string & key, std::string & value, Datacratic::Date now);
+    void cacheValues(const Values & values);
+
+    std::atomic<uint64_t> numBatches_;
+    std::atomic<uint64_t> numBatchedLookups_;
+    std::atomic<uint64_t> numBatchedKeys_;
+    std::atomic<uint64_t> numCacheHits_;
 };
 
 } /* namespace RTBKIT */
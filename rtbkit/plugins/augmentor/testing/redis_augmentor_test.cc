@@ -109,14 +109,22 @@ struct MockAugmentationLoop : public ServiceBase, public MessageLoop
 
 
 
-BOOST_AUTO_TEST_CASE( redisAugmentorTest )
+/** Feeds requests to a redis augmentor set up by the given function and
+    checks that they all get the expected augmentation.
+*/
+void
+runRedisAugmentor(size_t numFeeders,
+                  const std::function<void (RedisAugmentor &)> & configure,
+                  const std::function<void (RedisAugmentor &)> & check
+                      = [] (RedisAugmentor &) {})
 {
     enum {
-        FeederThreads = 1,
         TestLength = 5,
         RedisThreads = 2
     };
 
+    aug_vec.clear();
+
     Redis::RedisTemporaryServer redis;
     {
         using namespace Redis;
@@ -184,7 +192,7 @@ BOOST_AUTO_TEST_CASE( redisAugmentorTest )
     cerr << "init feeders\n";
 
     vector< std::shared_ptr<MockAugmentationLoop> > feederThreads;
-    for (size_t i = 0; i < FeederThreads; ++i)
+    for (size_t i = 0; i < numFeeders; ++i)
     {
         feederThreads.emplace_back(new MockAugmentationLoop(proxies));
         feederThreads.back()->start();
@@ -193,6 +201,7 @@ BOOST_AUTO_TEST_CASE( redisAugmentorTest )
     cerr << "init aug\n";
 
     RedisAugmentor aug("redis-augmentation", "redis-augmentation", proxies, redis);
+    configure(aug);
     aug.init(RedisThreads);
     aug.start();
 
@@ -228,5 +237,42 @@ BOOST_AUTO_TEST_CASE( redisAugmentorTest )
     cerr << "sent: " << sent << endl
          << "recv: " << recv << endl;
 
+    check(aug);
+
     proxies->events->dump(cerr);
 }
+
+BOOST_AUTO_TEST_CASE( redisAugmentorTest )
+{
+    runRedisAugmentor(1, [] (RedisAugmentor & aug) {});
+}
+
+BOOST_AUTO_TEST_CASE( redisAugmentorBatchingTest )
+{
+    // Requests of both feeders wait for each other and share a single MGET,
+    // after which they're served from the cache.
+    runRedisAugmentor(2, [] (RedisAugmentor & aug) {
+                aug.setBatching(0.1, 2);
+                aug.setCaching(60.0, 1000);
+            },
+            [] (RedisAugmentor & aug) {
+                BOOST_CHECK_EQUAL(aug.numBatches(), 1);
+                BOOST_CHECK_EQUAL(aug.numBatchedLookups(), 2);
+
+                // Both requests look up the same 4 keys
+                BOOST_CHECK_EQUAL(aug.numBatchedKeys(), 4);
+                BOOST_CHECK_GT(aug.numCacheHits(), 0);
+            });
+}
+
+BOOST_AUTO_TEST_CASE( redisAugmentorNoBatchingTest )
+{
+    runRedisAugmentor(1, [] (RedisAugmentor & aug) {
+                aug.setBatching(0.0, 1);
+            },
+            [] (RedisAugmentor & aug) {
+                // Without the cache, every request has its own MGET
+                BOOST_CHECK_EQUAL(aug.numBatches(), aug.numBatchedLookups());
+                BOOST_CHECK_EQUAL(aug.numCacheHits(), 0);
+            });
+}
@@ -444,6 +444,66 @@ BOOST_AUTO_TEST_CASE( benchmark_canonical_parsing )
          << done / elapsed << "/s" << endl;
 }
 
+BOOST_AUTO_TEST_CASE( test_binary_round_trip )
+{
+    std::shared_ptr<OpenRTBBidRequestParser> p = OpenRTBBidRequestParser::openRTBBidRequestParserFactory("2.1");
+
+    for (auto s: samples) {
+        StreamingJsonParsingContext context;
+        context.init(s);
+        std::unique_ptr<BidRequest> br(p->parseBidRequest(*context.context, "openrtb", "openrtb"));
+
+        // Make sure that every JSON type makes it through the binary codec
+        br->meta["int"] = -12;
+        br->meta["uint"] = 12U;
+        br->meta["real"] = 1.5;
+        br->meta["string"] = "hello";
+        br->meta["bool"] = true;
+        br->meta["null"] = Json::Value();
+        br->meta["array"][0] = "one";
+        br->meta["array"][1]["nested"] = 2;
+
+        string serialized = br->serializeToString();
+        BidRequest br2 = BidRequest::createFromString(serialized);
+
+        BOOST_CHECK_EQUAL(br2.toJsonStr(), br->toJsonStr());
+        BOOST_CHECK_EQUAL(br2.meta.toString(), br->meta.toString());
+        BOOST_CHECK_EQUAL(br2.serializeToString(), serialized);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_binary_reconstitute )
+{
+    cerr << "benchmarking binary reconstitution of OpenRTB-derived bid requests" << endl;
+
+    vector<string> reqs;
+
+    std::shared_ptr<OpenRTBBidRequestParser> p = OpenRTBBidRequestParser::openRTBBidRequestParserFactory("2.1");
+
+    for (auto s: samples) {
+        StreamingJsonParsingContext context;
+        context.init(s);
+        std::unique_ptr<BidRequest> br(p->parseBidRequest(*context.context, "openrtb", "openrtb"));   
+        reqs.push_back(br->serializeToString());
+    }
+
+    int done = 0;
+    
+    Date before = Date::now();
+
+    for (unsigned i = 0;  i < 1000;  ++i) {
+        
+        for (unsigned i = 0;  i < reqs.size();  ++i, ++done) {
+            BidRequest br2 = BidRequest::createFromString(reqs[i]);
+        }
+    }
+
+    double elapsed = Date::now().secondsSince(before);
+    
+    cerr << "did " << done << " in " << elapsed << "s at "
+         << done / elapsed << "/s" << endl;
+}
+
 BOOST_AUTO_TEST_CASE( id_provider ) {
 
     cerr << "id provider test : making sure we parse it correctly and always set it" << endl;
@@ -22,14 +22,51 @@ AgentsBidderInterface::~AgentsBidderInterface() {
 
 void AgentsBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                                                double timeLeftMs,
-                                               std::map<std::string, BidInfo> const & bidders) {
+                                               AuctionBidders const & bidders) {
+
+    ShmAgentServer * shmAgents = router->shmAgents.get();
+
+    // Position in the shared memory request log of each encoding of the
+    // request, which is written there once for all of the local agents.
+    std::vector<std::pair<const std::string *, uint64_t> > shmRequests;
+
+    auto getShmRequest = [&] (const AgentInfo & info) {
+        const std::string & format = info.getBidRequestEncoding(*auction);
+        for (auto & request : shmRequests)
+            if (*request.first == format)
+                return request.second;
+
+        uint64_t position = shmAgents->writeRequest(
+                auction->id, format, info.encodeBidRequest(*auction));
+        shmRequests.emplace_back(&format, position);
+        return position;
+    };
 
     for(auto & item : bidders) {
         auto & agent = item.first;
         auto & spots = item.second.imp;
-        auto & info = router->agents[agent];
+        // The agent may have been removed, and its id reused, since it was
+        // picked for the auction; it won't get this one.
+        AgentInfo * agentInfo = router->findAgent(item.second.agentId, agent);
+        if (!agentInfo) {
+            recordHit("removedAgent");
+            continue;
+        }
+        auto & info = *agentInfo;
         WinCostModel wcm = auction->exchangeConnector->getWinCostModel(*auction, *info.config);
 
+        if (shmAgents && shmAgents->isConnected(agent)) {
+            bool sent = shmAgents->sendAuction(agent,
+                                               getShmRequest(info),
+                                               auction->start,
+                                               spots.toJsonStr(),
+                                               std::to_string(timeLeftMs),
+                                               auction->agentAugmentations[agent],
+                                               wcm.toJson().toStringNoNewLine());
+            // A full channel falls back to zmq.
+            if (sent) continue;
+        }
+
         bridge->sendAgentMessage(agent,
                                  "AUCTION",
                                  auction->start,
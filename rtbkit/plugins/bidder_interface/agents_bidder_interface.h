@@ -21,7 +21,7 @@ struct AgentsBidderInterface : public BidderInterface
 
     void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                             double timeLeftMs,
-                            std::map<std::string, BidInfo> const & bidders);
+                            AuctionBidders const & bidders);
 
     void sendWinLossMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
                             MatchedWinLoss const & event);
@@ -5,3 +5,5 @@ $(eval $(call library,multi_bidder,multi_bidder_interface.cc,agent_configuration
 bidder_interface_plugins: $(LIB)/libagents_bidder.so $(LIB)/libhttp_bidder.so $(LIB)/libmulti_bidder.so
 
 .PHONY: bidder_interface_plugins
+
+$(eval $(call include_sub_make,bidder_interface_testing,testing,bidder_interface_testing.mk))
@@ -11,6 +11,7 @@
 #include "rtbkit/plugins/bid_request/openrtb_bid_request_parser.h"
 #include "rtbkit/openrtb/openrtb_parsing.h"
 #include "rtbkit/core/router/router.h"
+#include <limits>
 
 using namespace Datacratic;
 using namespace RTBKIT;
@@ -60,6 +61,10 @@ HttpBidderInterface::HttpBidderInterface(std::string serviceName,
 
         routerHost = router["host"].asString();
         routerPath = router["path"].asString();
+        routerFormatName = router.get("format", "openrtb").asString();
+        routerRequestFormat = BRF_JSON_RAW;
+        if (routerFormatName != "openrtb")
+            routerRequestFormat = parseBidRequestFormat(routerFormatName);
         routerHttpActiveConnections = router.get("httpActiveConnections", 1024).asInt();
 
         adserverHost = adserver["host"].asString();
@@ -80,7 +85,7 @@ HttpBidderInterface::HttpBidderInterface(std::string serviceName,
                    << "{" << std::endl << "\t\"router\" : {" << std::endl
                    << "\t\t\"host\" : <string : hostname with port>" << std::endl  
                    << "\t\t\"path\" : <string : resource name>" << std::endl
-                   << "\t\t\"format\" : <string : message format>" << std::endl
+                   << "\t\t\"format\" : <string : openrtb (default), jsonRaw, jsonNorm or binary>" << std::endl
                    << "\t\t\"httpActiveConnections\" : <int : concurrent connections>"
                    << std::endl
                    << "\t\t"
@@ -146,21 +151,42 @@ void HttpBidderInterface::shutdown() {
 
 void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                                              double timeLeftMs,
-                                             std::map<std::string, BidInfo> const & bidders) {
+                                             AuctionBidders const & bidders) {
     using namespace std;
 
     BidRequest & originalRequest = *auction->request;
-    std::vector<Datacratic::Id> ids;
-    ids.reserve(originalRequest.imp.size());
-    for(auto & imp : originalRequest.imp) {
-        ids.push_back(imp.id);
-   }
+    auto index = std::make_shared<AuctionIndex>(originalRequest, bidders);
 
     std::string openRtbVersion;
     string requestStr;
     StructuredJsonPrintingContext context;
+    RestParams headers;
+    std::string contentType = "application/json";
 
-    parseFormat(originalRequest, auction, bidders, requestStr, context, openRtbVersion);
+    if (routerFormatName == "openrtb") {
+        parseFormat(originalRequest, auction, bidders, requestStr, context, openRtbVersion);
+        headers.push_back({ "x-openrtb-version", openRtbVersion });
+    }
+    else {
+        /* The encoding is shared with every other agent and bidder
+           interface that asked for the same format for this auction; the
+           bidders are passed out of band rather than by tagging the
+           request.
+        */
+        requestStr = auction->encodedRequest(routerRequestFormat);
+        if (routerRequestFormat == BRF_BINARY_V1)
+            contentType = "application/octet-stream";
+
+        std::string externalIds;
+        for (const auto & bidder: bidders) {
+            if (!externalIds.empty()) externalIds += ',';
+            externalIds += std::to_string(bidder.second.agentConfig->externalId);
+        }
+
+        headers.push_back({ "x-rtbkit-request-format",
+                            auction->encodedRequestFormat(routerRequestFormat) });
+        headers.push_back({ "x-rtbkit-external-ids", externalIds });
+    }
 
     Date sentResponseTime = Date::now();
     /* We need to capture by copy inside the lambda otherwise we might get
@@ -214,62 +240,9 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
                  }
 
                  else if (statusCode == 200) {
-                     OpenRTB::BidResponse response;
-                     ML::Parse_Context context("payload",
-                           body.c_str(), body.size());
-                     StreamingJsonParsingContext jsonContext(context);
-                     static DefaultDescription<OpenRTB::BidResponse> respDesc;
-                     respDesc.parseJson(&response, jsonContext);
-
-                     for (const auto &seatbid: response.seatbid) {
-
-                         for (const auto &bid: seatbid.bid) {
-                             Bid theBid;
-                             string agent;
-                             shared_ptr<const AgentConfig> config;
-
-                             routerFormat(bid, theBid, agent, config, body, bidders);
-
-                             ExcCheck(!agent.empty(), "Invalid agent");
-
-                             if (!bid.crid) {
-                                 LOG(error) << "crid not found in BidResponse: " << body << std::endl;
-                                 recordError("unknown");
-                                 return;
-                             }
-
-                             int crid = bid.crid.toInt();
-                             int creativeIndex = indexOf(config->creatives,
-                                 &Creative::id, crid);
-
-                             if (creativeIndex == -1) {
-                                 LOG(error) << "Unknown creative id: " << crid << std::endl;
-                                 recordError("unknown");
-                                 return;
-                             }
-
-                             theBid.creativeIndex = creativeIndex;
-                             theBid.price = USD_CPM(bid.price.val);
-
-                             int spotIndex = -1;
-                             for(size_t i = 0; i < ids.size(); i++) {
-                                if(bid.impid == ids[i]) {
-                                    spotIndex = i;
-                                    break;
-                                }
-                             }
-
-                             if (spotIndex == -1) {
-                                 LOG(error) <<"Unknown impression id: " << bid.impid.toString() << std::endl;
-                                 recordError("unknown");
-                                 return;
-                             }
-                             auto &bidInfo = bidsToSubmit[agent];
-                             theBid.spotIndex = spotIndex;
-                             bidInfo.bids.bidForSpot(spotIndex) = theBid;
-                         }
-                     }
-
+                     if (!decodeBidResponse(body, bidders, *index,
+                                            bidsToSubmit))
+                         recordHit("rejectedResponses");
                  }
                  else if (statusCode != 204) {
                      LOG(error) << "Invalid HTTP status code: " << statusCode << std::endl
@@ -281,9 +254,8 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
             }
     );
 
-    HttpRequest::Content reqContent { requestStr, "application/json" };
+    HttpRequest::Content reqContent { requestStr, contentType };
 
-    RestParams headers { { "x-openrtb-version", openRtbVersion } };
    // std::cerr << "Sending HTTP POST to: " << routerHost << " " << routerPath << std::endl;
    // std::cerr << "Content " << reqContent.str << std::endl;
 
@@ -293,7 +265,7 @@ void HttpBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & au
 
 void HttpBidderInterface::parseFormat (BidRequest & originalRequest,
        std::shared_ptr<Auction> const & auction,
-       std::map<std::string, BidInfo> const & bidders, std::string & requestStr,
+       AuctionBidders const & bidders, std::string & requestStr,
        StructuredJsonPrintingContext & context, std::string & openRtbVersion)
 {
     if (!originalRequest.protocolVersion.empty())
@@ -312,72 +284,235 @@ void HttpBidderInterface::parseFormat (BidRequest & originalRequest,
     requestStr = context.output.toString();
 }
 
-void HttpBidderInterface::routerFormat(OpenRTB::Bid const & bid, Bid & theBid,
-                             std::string & agent,
-                             shared_ptr<const AgentConfig> & config, std::string & body,
-                             std::map<std::string, BidInfo> const & bidders)
+HttpBidderInterface::AuctionIndex::
+AuctionIndex(const BidRequest & request,
+             const AuctionBidders & bidders)
 {
-    auto findAgent = [=](uint64_t externalId)
-        -> pair<string, shared_ptr<const AgentConfig>> {
+    impIndex.reserve(request.imp.size());
+    for (unsigned i = 0;  i < request.imp.size();  ++i)
+        impIndex.insert(std::make_pair(request.imp[i].id, i));
+
+    agentIndex.reserve(bidders.size());
+    for (unsigned i = 0;  i < bidders.size();  ++i)
+        agentIndex.insert(
+            std::make_pair(bidders[i].second.agentConfig->externalId, i));
+}
 
-        auto it =
-        find_if(begin(bidders), end(bidders),
-                [&](const pair<string, BidInfo> &bidder)
+bool HttpBidderInterface::decodeBidResponse(const std::string & body,
+                                            const AuctionBidders & bidders,
+                                            const AuctionIndex & index,
+                                            AgentBids & bidsToSubmit)
+{
+    /* Fields of one bid that we care about.  The strings are decoded into
+       fixed-size buffers so that walking the response allocates nothing.
+    */
+    struct BidFields {
+        BidFields()
+            : impidLen(-1), price(0.0), hasCrid(false), crid(-1),
+              hasExternalId(false), externalId(0),
+              hasPriority(false), priority(0.0)
         {
-            std::string agents = bidder.first;
-            /* Since it is possible to delete a configuration from the REST interface of
-             * the agent configuration service, the user might delete the configuration
-             * while some requests for this configuration are already in flight. When
-             * that happens, since we're capturing our context by copy in the closure,
-             * we hold a "private" copy of the current agents and & their configurations,
-             * which means that we might still hold configurations that have been deleted
-             * and erased in the router.
-             *
-             * This is why we are checking if the agent still exists. If not, we're skipping
-             * it. This is not ideal and introduces an extra check but this is the simplest way
-             * Note that this will be trigger the "couldn't fint configuration for
-             * externalId" error below. In other words, all requests that are "in flight"
-             * for a configuration that has been deleted will trigger a logging message.
-             * We will return a 204 for these requests
-             */
-            auto agentIt = router->agents.find(agents);
-            if (agentIt == std::end(router->agents)) {
-                return false;
+        }
+
+        char impid[128];
+        ssize_t impidLen;
+        double price;
+        bool hasCrid;
+        long long crid;
+        bool hasExternalId;
+        uint64_t externalId;
+        bool hasPriority;
+        double priority;
+    };
+
+    StreamingJsonParsingContext context("payload", body.c_str(), body.size());
+
+    /* A crid is either a number or a string holding one.  A string too
+       long for the buffer can't be a valid creative id, so it is consumed
+       (allocating, but only in that case) and left for the creative lookup
+       to reject.
+    */
+    auto expectId = [&] (long long & val) {
+        if (!context.isString()) {
+            val = context.expectLongLong();
+            return;
+        }
+
+        val = -1;
+        char buf[32];
+        ssize_t len;
+        {
+            ML::Parse_Context::Revert_Token token(*context.context);
+            len = context.expectStringAscii(buf, sizeof(buf));
+            if (len >= 0)
+                token.ignore();
+        }
+
+        if (len < 0) {
+            context.expectStringAscii();
+            return;
+        }
+
+        char * end = nullptr;
+        long long parsed = strtoll(buf, &end, 10);
+        if (len > 0 && end == buf + len)
+            val = parsed;
+    };
+
+    auto parseBid = [&] (BidFields & fields) {
+        context.forEachMember([&] () {
+            const char * field = context.fieldNamePtr();
+            if (!strcmp(field, "impid")) {
+                fields.impidLen = context.expectStringAscii(
+                        fields.impid, sizeof(fields.impid));
+                if (fields.impidLen < 0)
+                    context.exception("impid too long");
             }
-            const auto &info = agentIt->second;
-            ExcAssert(info.config);
-            return info.config->externalId == externalId;
+            else if (!strcmp(field, "price"))
+                fields.price = context.expectDouble();
+            else if (!strcmp(field, "crid")) {
+                expectId(fields.crid);
+                fields.hasCrid = true;
+            }
+            else if (!strcmp(field, "ext")) {
+                context.forEachMember([&] () {
+                    const char * extField = context.fieldNamePtr();
+                    if (!strcmp(extField, "external-id")) {
+                        fields.externalId = context.expectUnsignedLongLong();
+                        fields.hasExternalId = true;
+                    }
+                    else if (!strcmp(extField, "priority")) {
+                        fields.priority = context.expectDouble();
+                        fields.hasPriority = true;
+                    }
+                    else context.skip();
+                });
+            }
+            else context.skip();
         });
+    };
 
-        if (it == end(bidders)) {
-            return make_pair("", nullptr);
+    // Validates the bid and writes it into the bids to submit
+    auto submitBid = [&] (const BidFields & fields) {
+        if (!fields.hasExternalId) {
+            LOG(error) << "Missing external-id ext field in BidResponse: " << body << std::endl;
+            recordError("response");
+            return false;
         }
-        return make_pair(it->first, it->second.agentConfig);
-    };
 
+        if (!fields.hasPriority) {
+            LOG(error) << "Missing priority ext field in BidResponse: " << body << std::endl;
+            recordError("response");
+            return false;
+        }
 
-    if (!bid.ext.isMember("external-id")) {
-        LOG(error) << "Missing external-id ext field in BidResponse: " << body << std::endl;
-        recordError("response");
-        return;
-    }
-    uint64_t externalId = bid.ext["external-id"].asUInt();
+        /* The configuration may have been deleted from the router while the
+           request was in flight, in which case we skip it; see the comment
+           in AuctionIndex.
+        */
+        auto agentIt = index.agentIndex.find(fields.externalId);
+        if (agentIt == index.agentIndex.end()
+            || router->agents.find(bidders[agentIt->second].first)
+               == router->agents.end()) {
+            LOG(error) << "Couldn't find config for externalId: " << fields.externalId << std::endl;
+            recordError("unknown");
+            return false;
+        }
 
-    if (!bid.ext.isMember("priority")) {
-        LOG(error) << "Missing priority ext field in BidResponse: " << body << std::endl;
-        recordError("response");
-        return;
-    }
-    theBid.priority = bid.ext["priority"].asDouble();
+        const std::string & agent = bidders[agentIt->second].first;
+        const auto & config = bidders[agentIt->second].second.agentConfig;
 
+        if (!fields.hasCrid) {
+            LOG(error) << "crid not found in BidResponse: " << body << std::endl;
+            recordError("unknown");
+            return false;
+        }
 
-    tie(agent, config) = findAgent(externalId);
-    if (config == nullptr) {
-        LOG(error) << "Couldn't find config for externalId: " << externalId << std::endl;
-        recordError("unknown");
-        return;
+        // Creative ids are ints; don't let a larger one wrap onto one
+        int creativeIndex = -1;
+        if (fields.crid >= std::numeric_limits<int>::min()
+            && fields.crid <= std::numeric_limits<int>::max())
+            creativeIndex = config->creativeIndex(fields.crid);
+        if (creativeIndex == -1) {
+            LOG(error) << "Unknown creative id: " << fields.crid << std::endl;
+            recordError("unknown");
+            return false;
+        }
+
+        int spotIndex = -1;
+        if (fields.impidLen >= 0) {
+            auto impIt = index.impIndex.find(
+                    Id(fields.impid, fields.impidLen));
+            if (impIt != index.impIndex.end())
+                spotIndex = impIt->second;
+        }
+
+        // The agent can only bid on the impressions that it was offered
+        Bid * bid = nullptr;
+        if (spotIndex != -1) {
+            for (Bid & offered: bidsToSubmit[agent].bids) {
+                if (offered.spotIndex == spotIndex) {
+                    bid = &offered;
+                    break;
+                }
+            }
+        }
+
+        if (!bid) {
+            LOG(error) << "Unknown impression id: "
+                       << (fields.impidLen >= 0 ? fields.impid : "")
+                       << std::endl;
+            recordError("unknown");
+            return false;
+        }
+
+        // A later bid for the same impression replaces the earlier one
+        bid->creativeIndex = creativeIndex;
+        bid->price = USD_CPM(fields.price);
+        bid->priority = fields.priority;
+        return true;
+    };
+
+    // Once a bid has been rejected we ignore the rest of the response
+    bool ok = true;
+
+    try {
+        context.forEachMember([&] () {
+            if (!ok || strcmp(context.fieldNamePtr(), "seatbid")) {
+                context.skip();
+                return;
+            }
+
+            context.forEachElement([&] () {
+                if (!ok || !context.isObject()) {
+                    context.skip();
+                    return;
+                }
+                context.forEachMember([&] () {
+                    if (!ok || strcmp(context.fieldNamePtr(), "bid")) {
+                        context.skip();
+                        return;
+                    }
+                    context.forEachElement([&] () {
+                        if (!ok) {
+                            context.skip();
+                            return;
+                        }
+                        BidFields fields;
+                        parseBid(fields);
+                        ok = submitBid(fields);
+                    });
+                });
+            });
+        });
+    } catch (const std::exception & exc) {
+        LOG(error) << "Invalid BidResponse: " << exc.what() << std::endl
+                   << body << std::endl;
+        recordError("response");
+        return false;
     }
 
+    return ok;
 }
 
 void HttpBidderInterface::sendLossMessage(
@@ -557,7 +692,7 @@ void HttpBidderInterface::registerLoopMonitor(LoopMonitor *monitor) const {
 }
 
 void HttpBidderInterface::tagRequest(OpenRTB::BidRequest &request,
-                                     const std::map<std::string, BidInfo> &bidders) const
+                                     const AuctionBidders &bidders) const
 {
     static const Json::Value null(Json::nullValue);
 
@@ -602,7 +737,7 @@ void HttpBidderInterface::tagRequest(OpenRTB::BidRequest &request,
 bool HttpBidderInterface::prepareStandardRequest(OpenRTB::BidRequest &request,
                                          const RTBKIT::BidRequest &originalRequest,
                                          const std::shared_ptr<Auction> &auction,
-                                         const std::map<std::string, BidInfo> &bidders) const {
+                                         const AuctionBidders &bidders) const {
     tagRequest(request, bidders);
 
      request.ext["exchange"] = originalRequest.exchange;
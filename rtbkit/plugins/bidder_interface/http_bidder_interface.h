@@ -8,6 +8,7 @@
 #include "rtbkit/common/bidder_interface.h"
 #include "soa/service/http_client.h"
 #include "soa/service/logs.h"
+#include <unordered_map>
 
 namespace RTBKIT {
 
@@ -24,7 +25,7 @@ struct HttpBidderInterface : public BidderInterface
     void shutdown();
     void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                             double timeLeftMs,
-                            std::map<std::string, BidInfo> const & bidders);
+                            AuctionBidders const & bidders);
 
     virtual void sendWinLossMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
                             MatchedWinLoss const & event);
@@ -39,13 +40,9 @@ struct HttpBidderInterface : public BidderInterface
 
     virtual void  parseFormat(BidRequest & originalRequest,
             std::shared_ptr<Auction> const & auction,
-            std::map<std::string, BidInfo> const & bidders, std::string & requestStr,
+            AuctionBidders const & bidders, std::string & requestStr,
             StructuredJsonPrintingContext & context,  std::string & openRtbversion);
 
-    virtual void routerFormat(OpenRTB::Bid const & bid, Bid & theBid, std::string & agent,
-                             shared_ptr<const AgentConfig> & config, std::string & body,
-                             std::map<std::string, BidInfo> const & bidders);
-
 
     void sendBidLostMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
                             std::string const & agent,
@@ -84,7 +81,7 @@ struct HttpBidderInterface : public BidderInterface
     void registerLoopMonitor(LoopMonitor *monitor) const;
 
     virtual void tagRequest(OpenRTB::BidRequest &request,
-                            const std::map<std::string, BidInfo> &bidders) const;
+                            const AuctionBidders &bidders) const;
 
     static Logging::Category print;
     static Logging::Category error;
@@ -103,6 +100,39 @@ protected:
 
     typedef std::map<std::string, AgentBidsInfo> AgentBids;
 
+    /** Lookup tables built once per auction, when the request is sent, so
+        that every bid of the response is matched to its impression and
+        agent without a scan and without allocating.
+
+        Since it is possible to delete a configuration from the REST
+        interface of the agent configuration service while requests for it
+        are in flight, the agents found here must still be checked against
+        the router; bids for deleted agents are rejected.
+    */
+    struct AuctionIndex {
+        AuctionIndex(const BidRequest & request,
+                     const AuctionBidders & bidders);
+
+        /// Impression id -> spot index
+        std::unordered_map<Id, int> impIndex;
+
+        /// External id -> position of the agent in the bidders
+        std::unordered_map<uint64_t, int> agentIndex;
+    };
+
+    /** Decode an OpenRTB BidResponse, writing its bids directly into
+        bidsToSubmit.  No intermediate OpenRTB::BidResponse is built and,
+        apart from the bids themselves, nothing is allocated for the usual
+        numeric or short impression and creative ids.
+
+        Returns false if the response was invalid, in which case the
+        remaining bids are ignored.
+    */
+    bool decodeBidResponse(const std::string & body,
+                           const AuctionBidders & bidders,
+                           const AuctionIndex & index,
+                           AgentBids & bidsToSubmit);
+
     MessageLoop loop;
     std::shared_ptr<HttpClient> httpClientRouter;
     std::shared_ptr<HttpClient> httpClientAdserverWins;
@@ -112,6 +142,13 @@ protected:
     std::string routerHost;
     std::string routerPath;
 
+    /** Format of the bid requests sent to the router.  "openrtb" prints a
+        tagged OpenRTB request per auction; any other value is the name of
+        a BidRequestFormat whose per-auction encoding is shared.
+    */
+    std::string routerFormatName;
+    BidRequestFormat routerRequestFormat;
+
     std::string adserverHost;
 
     uint16_t adserverWinPort;
@@ -131,11 +168,11 @@ protected:
     bool prepareRequest(OpenRTB::BidRequest &request,
                         const RTBKIT::BidRequest &originalRequest,
                         const std::shared_ptr<Auction> &auction,
-                        const std::map<std::string, BidInfo> &bidders) const;
+                        const AuctionBidders &bidders) const;
     bool prepareStandardRequest(OpenRTB::BidRequest &request,
                                 const RTBKIT::BidRequest &originalRequest,
                                 const std::shared_ptr<Auction> &auction,
-                                const std::map<std::string, BidInfo> &bidders) const;
+                                const AuctionBidders &bidders) const;
     void sendBidErrorMessage(
             const std::shared_ptr<const AgentConfig>& agentConfig,
             std::string const & agent,
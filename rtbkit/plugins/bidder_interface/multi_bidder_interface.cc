@@ -66,9 +66,9 @@ void MultiBidderInterface::shutdown() {
 
 void MultiBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                                              double timeLeftMs,
-                                             std::map<std::string, BidInfo> const & bidders) {
+                                             AuctionBidders const & bidders) {
 
-    typedef std::map<std::string, BidInfo> Bidders;
+    typedef AuctionBidders Bidders;
 
     typedef std::map<std::shared_ptr<BidderInterface>, Bidders> Aggregate;
     Aggregate aggregate;
@@ -79,7 +79,7 @@ void MultiBidderInterface::sendAuctionMessage(std::shared_ptr<Auction> const & a
         auto iface = findInterface(agentConfig->bidderInterface, bidder.first);
         stats_.incr(iface, &InterfaceStats::auctions);
 
-        aggregate[iface].insert(bidder);
+        aggregate[iface].push_back(bidder);
     }
 
     for (const auto &iface: aggregate) {
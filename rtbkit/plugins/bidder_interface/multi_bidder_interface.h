@@ -100,7 +100,7 @@ struct MultiBidderInterface : public BidderInterface {
 
     void sendAuctionMessage(std::shared_ptr<Auction> const & auction,
                             double timeLeftMs,
-                            std::map<std::string, BidInfo> const & bidders);
+                            AuctionBidders const & bidders);
 
     void sendWinLossMessage(const std::shared_ptr<const AgentConfig>& agentConfig,
                             MatchedWinLoss const & event);
@@ -0,0 +1,3 @@
+# bidder_interface_testing.mk
+
+$(eval $(call test,http_bidder_interface_test,http_bidder rtb_router,boost))
@@ -0,0 +1,238 @@
+/* http_bidder_interface_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the decoding of the OpenRTB bid responses of the
+   HttpBidderInterface.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/plugins/bidder_interface/http_bidder_interface.h"
+#include "rtbkit/core/router/router.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+struct TestBidderInterface : public HttpBidderInterface {
+
+    TestBidderInterface(std::shared_ptr<ServiceProxies> proxies)
+        : HttpBidderInterface("bidder", proxies, config())
+    {
+    }
+
+    static Json::Value config()
+    {
+        Json::Value result;
+        result["router"]["host"] = "http://localhost:1";
+        result["router"]["path"] = "/";
+        result["adserver"]["host"] = "http://localhost";
+        result["adserver"]["winPort"] = 1;
+        result["adserver"]["eventPort"] = 2;
+        result["adserver"]["errorPort"] = 3;
+        return result;
+    }
+
+    using HttpBidderInterface::AuctionIndex;
+    using HttpBidderInterface::AgentBids;
+    using HttpBidderInterface::decodeBidResponse;
+};
+
+/** Auction with two impressions, "1" and "2", offered to agent1 (external
+    id 11) and agent2 (external id 12).  Only agent1 can bid on the second
+    impression.  Both have the creatives 5 and 7.
+*/
+struct Fixture {
+
+    Fixture()
+        : proxies(std::make_shared<ServiceProxies>()),
+          router(proxies, "router"),
+          bidder(proxies)
+    {
+        bidder.router = &router;
+
+        request.imp.resize(2);
+        request.imp[0].id = Id("1");
+        request.imp[1].id = Id("2");
+
+        addBidder("agent1", 11, { 0, 1 });
+        addBidder("agent2", 12, { 0 });
+    }
+
+    void addBidder(const string & name, uint64_t externalId,
+                   const vector<int> & spots)
+    {
+        auto config = std::make_shared<AgentConfig>();
+        config->externalId = externalId;
+        config->creatives.push_back(Creative(300, 250, "a", 5));
+        config->creatives.push_back(Creative(728, 90, "b", 7));
+        config->indexCreatives();
+
+        BidInfo info;
+        info.agentConfig = config;
+        for (int spot: spots)
+            info.imp.push_back(make_pair(spot, SmallIntVector()));
+
+        bidders.push_back(make_pair(name, info));
+        router.agents[name];
+    }
+
+    /** Decode the response the way sendAuctionMessage() does. */
+    bool decode(const string & body)
+    {
+        bids.clear();
+        for (auto & bidder: bidders) {
+            auto & info = bids[bidder.first];
+            info.agentName = bidder.first;
+            info.agentConfig = bidder.second.agentConfig;
+            for (auto & spot: bidder.second.imp) {
+                Bid bid;
+                bid.spotIndex = spot.first;
+                info.bids.push_back(bid);
+            }
+        }
+
+        TestBidderInterface::AuctionIndex index(request, bidders);
+        return bidder.decodeBidResponse(body, bidders, index, bids);
+    }
+
+    const Bid & bid(const string & agent, int spot)
+    {
+        return bids[agent].bids.bidForSpot(spot);
+    }
+
+    std::shared_ptr<ServiceProxies> proxies;
+    Router router;
+    TestBidderInterface bidder;
+    BidRequest request;
+    AuctionBidders bidders;
+    TestBidderInterface::AgentBids bids;
+};
+
+string bidJson(const string & impid, const string & crid,
+               const string & ext = "{\"external-id\":11,\"priority\":1.5}")
+{
+    string result = "{\"impid\":\"" + impid + "\",\"price\":2.5,\"crid\":"
+        + crid;
+    if (!ext.empty())
+        result += ",\"ext\":" + ext;
+    return result + "}";
+}
+
+string response(const vector<vector<string> > & seatbids)
+{
+    string result = "{\"id\":\"auction\",\"seatbid\":[";
+    for (unsigned i = 0;  i < seatbids.size();  ++i) {
+        if (i) result += ",";
+        result += "{\"bid\":[";
+        for (unsigned j = 0;  j < seatbids[i].size();  ++j) {
+            if (j) result += ",";
+            result += seatbids[i][j];
+        }
+        result += "]}";
+    }
+    return result + "]}";
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_decode_crids )
+{
+    Fixture fixture;
+
+    // A crid can be a number or a string holding one
+    string agent2 = "{\"external-id\":12,\"priority\":0.5}";
+    BOOST_CHECK(fixture.decode(response({ { bidJson("1", "7"),
+                                            bidJson("2", "\"5\"") },
+                                          { bidJson("1", "\"7\"", agent2) } })));
+
+    BOOST_CHECK_EQUAL(fixture.bid("agent1", 0).creativeIndex, 1);
+    BOOST_CHECK_EQUAL(fixture.bid("agent1", 0).price, USD_CPM(2.5));
+    BOOST_CHECK_EQUAL(fixture.bid("agent1", 0).priority, 1.5);
+    BOOST_CHECK_EQUAL(fixture.bid("agent1", 1).creativeIndex, 0);
+    BOOST_CHECK_EQUAL(fixture.bid("agent2", 0).creativeIndex, 1);
+    BOOST_CHECK_EQUAL(fixture.bid("agent2", 0).priority, 0.5);
+
+    // 64 bit ids don't wrap onto the 32 bit creative ids
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "4294967301") } })));
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "\"4294967301\"") } })));
+    BOOST_CHECK_EQUAL(fixture.bid("agent1", 0).creativeIndex, -1);
+
+    // Unknown, empty, non-numeric and overly long crids
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "6") } })));
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "\"\"") } })));
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "\"5a\"") } })));
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "\"" + string(100, '5') + "\"") } })));
+
+    // Missing crid
+    BOOST_CHECK(!fixture.decode("{\"seatbid\":[{\"bid\":[{\"impid\":\"1\",\"price\":1,\"ext\":{\"external-id\":11,\"priority\":1}}]}]}"));
+}
+
+BOOST_AUTO_TEST_CASE( test_decode_ext )
+{
+    Fixture fixture;
+
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "5", "") } })));
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "5", "{\"external-id\":11}") } })));
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "5", "{\"priority\":1}") } })));
+
+    // Unknown agents, and agents that were removed from the router since
+    // the request was sent
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "5", "{\"external-id\":13,\"priority\":1}") } })));
+    fixture.router.agents.erase("agent2");
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "5", "{\"external-id\":12,\"priority\":1}") } })));
+
+    // Other ext fields are ignored
+    BOOST_CHECK(fixture.decode(response({ { bidJson("1", "5", "{\"a\":[1,{}],\"external-id\":11,\"priority\":1}") } })));
+    BOOST_CHECK_EQUAL(fixture.bid("agent1", 0).creativeIndex, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_decode_impressions )
+{
+    Fixture fixture;
+
+    // Unknown impressions, and impressions that weren't offered to the agent
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("3", "5") } })));
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("2", "5", "{\"external-id\":12,\"priority\":1}") } })));
+    BOOST_CHECK_EQUAL(fixture.bid("agent2", 0).creativeIndex, -1);
+
+    // The bids before a rejected one are kept, and the later ones ignored
+    BOOST_CHECK(!fixture.decode(response({ { bidJson("1", "5"), bidJson("3", "5"),
+                                             bidJson("2", "5") } })));
+    BOOST_CHECK_EQUAL(fixture.bid("agent1", 0).creativeIndex, 0);
+    BOOST_CHECK_EQUAL(fixture.bid("agent1", 1).creativeIndex, -1);
+
+    // A later seatbid for the same impression replaces the earlier one
+    BOOST_CHECK(fixture.decode(response({ { bidJson("1", "5") },
+                                          { bidJson("1", "7") } })));
+    BOOST_CHECK_EQUAL(fixture.bid("agent1", 0).creativeIndex, 1);
+
+    // No bids at all
+    BOOST_CHECK(fixture.decode("{\"id\":\"auction\"}"));
+    BOOST_CHECK(fixture.decode(response({})));
+    BOOST_CHECK_EQUAL(fixture.bid("agent1", 0).creativeIndex, -1);
+}
+
+BOOST_AUTO_TEST_CASE( test_decode_malformed )
+{
+    Fixture fixture;
+
+    string valid = response({ { bidJson("1", "5") } });
+    BOOST_CHECK(fixture.decode(valid));
+
+    // Every truncation of a valid response is rejected
+    for (unsigned i = 0;  i < valid.size();  ++i)
+        BOOST_CHECK(!fixture.decode(valid.substr(0, i)));
+
+    BOOST_CHECK(!fixture.decode("[]"));
+    BOOST_CHECK(!fixture.decode("{\"seatbid\":{}}"));
+    BOOST_CHECK(!fixture.decode("{\"seatbid\":[{\"bid\":[{\"impid\":1}]}]}"));
+    BOOST_CHECK(!fixture.decode("{\"seatbid\":[{\"bid\":[{\"impid\":\"1\",\"price\":\"a\"}]}]}"));
+    BOOST_CHECK(!fixture.decode(response({ { bidJson(string(200, '1'), "5") } })));
+}
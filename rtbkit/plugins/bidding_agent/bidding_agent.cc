@@ -16,10 +16,17 @@
 #include "jml/arch/futex.h"
 #include "soa/service/zmq_utils.h"
 #include "soa/service/process_stats.h"
+#include "soa/service/shm_ring.h"
 
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
 
 using namespace std;
 using namespace Datacratic;
@@ -81,6 +88,82 @@ jsonParse(const std::string & str)
     return Json::parse(str);
 }
 
+/******************************************************************************/
+/* LAZY AUCTION                                                               */
+/******************************************************************************/
+
+std::shared_ptr<LazyAuction>
+LazyAuction::
+parse(const std::vector<std::string> & msg)
+{
+    auto auction = parseHeader(msg);
+    auction->bidRequestStr = msg[4];
+    auction->augmentationsStr = msg[7];
+    return auction;
+}
+
+std::shared_ptr<LazyAuction>
+LazyAuction::
+parse(std::vector<std::string> && msg)
+{
+    auto auction = parseHeader(msg);
+    auction->bidRequestStr = std::move(msg[4]);
+    auction->augmentationsStr = std::move(msg[7]);
+    return auction;
+}
+
+std::shared_ptr<LazyAuction>
+LazyAuction::
+parseHeader(const std::vector<std::string> & msg)
+{
+    auto auction = std::make_shared<LazyAuction>();
+
+    auction->timestamp = boost::lexical_cast<double>(msg.at(1));
+    auction->id = Id(msg.at(2));
+    auction->bidRequestSource = msg.at(3);
+
+    Json::Value imp = jsonParse(msg.at(5));
+    auction->timeLeftMs = boost::lexical_cast<double>(msg.at(6));
+    auction->wcm = WinCostModel::fromJson(jsonParse(msg.at(8)));
+
+    Bids & bids = auction->bids;
+    bids.reserve(imp.size());
+
+    for (size_t i = 0; i < imp.size(); ++i) {
+        Bid bid;
+
+        bid.spotIndex = imp[i]["spot"].asInt();
+        for (const auto& creative : imp[i]["creatives"])
+            bid.availableCreatives.push_back(creative.asInt());
+
+        bids.push_back(bid);
+    }
+
+    return auction;
+}
+
+const std::shared_ptr<BidRequest> &
+LazyAuction::
+bidRequest() const
+{
+    std::call_once(bidRequestOnce, [&] () {
+            bidRequest_.reset(BidRequest::parse(bidRequestSource,
+                                                bidRequestStr));
+        });
+    return bidRequest_;
+}
+
+const Json::Value &
+LazyAuction::
+augmentations() const
+{
+    std::call_once(augmentationsOnce, [&] () {
+            augmentations_ = jsonParse(augmentationsStr);
+        });
+    return augmentations_;
+}
+
+
 /******************************************************************************/
 /* ROUTER PROXY                                                               */
 /******************************************************************************/
@@ -96,7 +179,10 @@ BiddingAgent(std::shared_ptr<ServiceProxies> proxies,
       toPostAuctionServices(getZmqContext()),
       toConfigurationAgent(getZmqContext()),
       toRouterChannel(65536),
-      requiresAllCB(true)
+      requiresAllCB(true),
+      bidBatchSize(0),
+      bidBatchDelay(0.0),
+      shmEnabled(false)
 {
 }
 
@@ -111,7 +197,10 @@ BiddingAgent(ServiceBase& parent,
       toPostAuctionServices(getZmqContext()),
       toConfigurationAgent(getZmqContext()),
       toRouterChannel(65536),
-      requiresAllCB(true)
+      requiresAllCB(true),
+      bidBatchSize(0),
+      bidBatchDelay(0.0),
+      shmEnabled(false)
 {
 }
 
@@ -125,11 +214,14 @@ void
 BiddingAgent::
 init()
 {
+    // The message is ours, so that the auctions can take the bid request
+    // and augmentations out of it without copying them; handleBidRequest()
+    // puts them back if it fails, so that we can still log the message.
     auto messageHandler = [=] (
-            const string & service, const vector<string>& msg)
+            const string & service, vector<string> msg)
         {
             try {
-                handleRouterMessage(service, msg);
+                handleRouterMessage(service, std::move(msg));
             }
             catch (const std::exception& ex) {
                 recordHit("error");
@@ -160,6 +252,8 @@ init()
                  << connectedTo << endl;
             cerr << ss.str() ;
             toRouters.sendMessage(connectedTo, "CONFIG", agentName);
+            if (shmEnabled)
+                toRouters.sendMessage(connectedTo, "SHM_CONNECT", agentName);
         };
     toRouters.connectAllServiceProviders("rtbRequestRouter", "agents");
     toRouterChannel.onEvent = [=] (const RouterMessage & msg)
@@ -181,6 +275,14 @@ init()
     addSource("BiddingAgent::toConfigurationAgent", toConfigurationAgent);
     addSource("BiddingAgent::toRouterChannel", toRouterChannel);
 
+    if (bidBatchSize > 0) {
+        addPeriodic("BiddingAgent::flushBids", bidBatchDelay,
+                    [=] (uint64_t) { flushBids(); });
+    }
+
+    addPeriodic("BiddingAgent::releaseShmConnections", 1.0,
+                [=] (uint64_t) { releaseShmConnections(); });
+
     // No need to init() message loop; it was done in the constructor
 }
 
@@ -193,12 +295,16 @@ shutdown()
     toConfigurationAgent.shutdown();
     toRouters.shutdown();
     //toPostAuctionService.shutdown();
+
+    lock_guard<mutex> guard(shmLock);
+    shmConnections.clear();
+    oldShmConnections.clear();
 }
 
 void
 BiddingAgent::
 handleRouterMessage(const std::string & fromRouter,
-                    const std::vector<std::string> & message)
+                    std::vector<std::string> && message)
 {
     if (message.empty()) {
         cerr << "invalid empty message received" << endl;
@@ -213,14 +319,15 @@ handleRouterMessage(const std::string & fromRouter,
     }
 
 
+    // Only built for the messages that need it, since it copies them
     auto newMessage = [&] {
         auto msg(message);
         msg.insert(msg.begin(), "CAMPAIGN_EVENT");
         return msg;
-    }();
+    };
     
     switch (hash(message[0])) {
-        case hash_compile_time("AUCTION") : handleBidRequest(fromRouter, message, onBidRequest); break;
+        case hash_compile_time("AUCTION") : handleBidRequest(fromRouter, std::move(message)); break;
         case hash_compile_time("WIN") :     handleResult(message, onWin); break;
         case hash_compile_time("LOSS") :    handleResult(message, onLoss); break;
         case hash_compile_time("LATEWIN") : handleResult(message, onLateWin ); break;
@@ -261,6 +368,27 @@ handleRouterMessage(const std::string & fromRouter,
         }
         case hash_compile_time("DROPPEDBID") : handleResult(message, onDroppedBid); break;
         case hash_compile_time("GOTCONFIG") : /* no-op */ ; break;
+        case hash_compile_time("SHM_READY") : {
+            try {
+                connectSharedMemory(fromRouter, message.at(1),
+                                    message.at(2));
+            } catch (const std::exception & exc) {
+                // We keep on getting the auctions through zmq.
+                recordHit("shm.connectionError");
+                cerr << "shared memory connection to router " << fromRouter
+                     << " failed: " << exc.what() << endl;
+            }
+            break;
+        }
+        case hash_compile_time("SHM_CLOSED") : {
+            // The router dropped our channel; our bids go through zmq until
+            // we get a new one.
+            disconnectSharedMemory(fromRouter);
+            if (shmEnabled)
+                toRouterChannel.push(RouterMessage(fromRouter, "SHM_CONNECT",
+                                                   { agentName }));
+            break;
+        }
         case hash_compile_time("ERROR") : handleError(message, onError) ; break;
         case hash_compile_time("BYEBYE"): {
              if (onByebye) {
@@ -294,15 +422,15 @@ handleRouterMessage(const std::string & fromRouter,
              switch (hash(message[0])) {  
                  // Backward compatibility : replace by CAMPAIGN_EVENT
                  case hash_compile_time("VISIT") : {
-                     handleDelivery(newMessage, onVisit); 
+                     handleDelivery(newMessage(), onVisit); 
                      break;
                  }
                  case hash_compile_time("IMPRESSION") : {
-                     handleDelivery(newMessage, onImpression); 
+                     handleDelivery(newMessage(), onImpression); 
                      break;
                  }
                  case hash_compile_time("CLICK") : {
-                     handleDelivery(newMessage, onClick); 
+                     handleDelivery(newMessage(), onClick); 
                      break;
                  }
                  default : {
@@ -364,50 +492,53 @@ checkMessageSize(const std::vector<std::string>& msg, int expectedSize)
 void
 BiddingAgent::
 handleBidRequest(const std::string & fromRouter,
-                 const std::vector<std::string>& msg, BidRequestCbFn& callback)
+                 std::vector<std::string> && msg)
 {
-    ExcCheck(!requiresAllCB || callback, "Null callback for " + msg[0]);
-    if (!callback) return;
+    ExcCheck(!requiresAllCB || onBidRequest || onLazyBidRequest,
+             "Null callback for " + msg[0]);
+    if (!onBidRequest && !onLazyBidRequest) return;
 
     checkMessageSize(msg, 9);
 
-    double timestamp = boost::lexical_cast<double>(msg[1]);
-    Id id(msg[2]);
-
-    string bidRequestSource = msg[3];
+    auto auction = LazyAuction::parse(std::move(msg));
 
-    std::shared_ptr<BidRequest> br(
-            BidRequest::parse(bidRequestSource, msg[4]));
+    try {
+        // Without the lazy callback everything gets decoded up front, so
+        // that an invalid request is rejected before we start tracking it.
+        if (!onLazyBidRequest) {
+            auction->bidRequest();
+            auction->augmentations();
+        }
 
-    Json::Value imp = jsonParse(msg[5]);
-    double timeLeftMs = boost::lexical_cast<double>(msg[6]);
-    Json::Value augmentations = jsonParse(msg[7]);
-    WinCostModel wcm = WinCostModel::fromJson(jsonParse(msg[8]));
+        recordHit("requests");
 
-    Bids bids;
-    bids.reserve(imp.size());
+        {
+            lock_guard<mutex> guard (requestsLock);
+            ExcCheck(!requests.count(auction->id),
+                     "seen multiple requests with same ID");
 
-    for (size_t i = 0; i < imp.size(); ++i) {
-        Bid bid;
+            auto & status = requests[auction->id];
+            status.timestamp = Date::now();
+            status.fromRouter = fromRouter;
+        }
 
-        bid.spotIndex = imp[i]["spot"].asInt();
-        for (const auto& creative : imp[i]["creatives"])
-            bid.availableCreatives.push_back(creative.asInt());
+        if (onLazyBidRequest) {
+            onLazyBidRequest(auction);
+            return;
+        }
 
-        bids.push_back(bid);
+        onBidRequest(auction->timestamp, auction->id, auction->bidRequest(),
+                     auction->bids, auction->timeLeftMs,
+                     auction->augmentations(), auction->wcm);
     }
-
-    recordHit("requests");
-
-    {
-        lock_guard<mutex> guard (requestsLock);
-        ExcCheck(!requests.count(id), "seen multiple requests with same ID");
-
-        requests[id].timestamp = Date::now();
-        requests[id].fromRouter = fromRouter;
+    catch (...) {
+        // The auction took the strings out of the message; the caller logs
+        // the message that failed, so it gets a copy of them back.  The
+        // auction keeps its own since a callback may still hold it.
+        msg[4] = auction->bidRequestStr;
+        msg[7] = auction->augmentationsStr;
+        throw;
     }
-
-    callback(timestamp, id, br, bids, timeLeftMs, augmentations, wcm);
 }
 
 void
@@ -485,15 +616,9 @@ doBid(Id id, Bids bids, const Json::Value & jsonMeta, const WinCostModel & wcm)
 
     Json::FastWriter jsonWriter;
 
-    string response = jsonWriter.write(bids.toJson());
-    boost::trim(response);
-
     string meta = jsonWriter.write(jsonMeta);
     boost::trim(meta);
 
-    string model = jsonWriter.write(wcm.toJson());
-    boost::trim(model);
-
     Date afterSend = Date::now();
     Date beforeSend;
     string fromRouter;
@@ -519,8 +644,37 @@ doBid(Id id, Bids bids, const Json::Value & jsonMeta, const WinCostModel & wcm)
 
     recordLevel((afterSend - beforeSend) * 1000.0, "timeTakenMs");
 
-    toRouterChannel.push(RouterMessage(
-                    fromRouter, "BID", { id.toString(), response, model, meta }));
+    if (bidBatchSize > 0) {
+        // The router doesn't need to parse a model that isn't there.
+        string model;
+        if (!wcm.name.empty()) {
+            model = jsonWriter.write(wcm.toJson());
+            boost::trim(model);
+        }
+
+        string batch;
+        {
+            lock_guard<mutex> guard (bidBatchesLock);
+            auto & bidBatch = bidBatches[fromRouter];
+            bidBatch.add(id, bids, model, meta);
+            if (bidBatch.size() >= bidBatchSize)
+                batch = bidBatch.release();
+        }
+
+        if (!batch.empty())
+            sendBids(fromRouter, std::move(batch));
+    }
+    else {
+        string response = jsonWriter.write(bids.toJson());
+        boost::trim(response);
+
+        string model = jsonWriter.write(wcm.toJson());
+        boost::trim(model);
+
+        vector<string> payload = { id.toString(), response, model, meta };
+        if (!sendShmMessage(fromRouter, "BID", payload))
+            toRouterChannel.push(RouterMessage(fromRouter, "BID", payload));
+    }
 
     /** Gather some stats */
     for (const Bid& bid : bids) {
@@ -532,6 +686,265 @@ doBid(Id id, Bids bids, const Json::Value & jsonMeta, const WinCostModel & wcm)
     }
 }
 
+
+
+/******************************************************************************/
+/* SHARED MEMORY TRANSPORT                                                    */
+/******************************************************************************/
+
+struct BiddingAgent::ShmConnection {
+    ShmConnection()
+        : routerWakeupFd(-1)
+    {
+    }
+
+    ~ShmConnection()
+    {
+        if (routerWakeupFd != -1)
+            ::close(routerWakeupFd);
+    }
+
+    ShmChannel channel;
+    ShmSegment logSegment;
+    ShmLog log;
+    std::shared_ptr<ShmRingSource> source;
+    int routerWakeupFd;
+
+    /** When its source was removed from the message loop. */
+    Date retired;
+};
+
+void
+BiddingAgent::
+connectSharedMemory(const std::string & fromRouter,
+                    const std::string & socketPath,
+                    const std::string & nonce)
+{
+    struct sockaddr_un addr;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+        throw ML::Exception("socket path too long: " + socketPath);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath.c_str());
+
+    int wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeupFd == -1)
+        throw ML::Exception(errno, "eventfd");
+
+    auto connection = std::make_shared<ShmConnection>();
+    connection->source
+        = std::make_shared<ShmRingSource>(connection->channel.toClient,
+                                          wakeupFd);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1)
+        throw ML::Exception(errno, "socket");
+
+    vector<int> fds;
+    string names;
+
+    try {
+        // The router answers from its main loop; don't wait forever on one
+        // that is stuck.
+        struct timeval timeout = { 1, 0 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        int res = connect(sock, (struct sockaddr *)&addr, sizeof(addr));
+        if (res == -1)
+            throw ML::Exception(errno, "connect " + socketPath);
+
+        // The nonce proves that the router sent us SHM_READY
+        sendFds(sock, agentName + " " + nonce, { wakeupFd });
+        fds = recvFds(sock, names, 1);
+    } catch (...) {
+        ::close(sock);
+        throw;
+    }
+    ::close(sock);
+
+    if (fds.size() != 1) {
+        for (int fd: fds) ::close(fd);
+        throw ML::Exception("router didn't send its eventfd");
+    }
+    connection->routerWakeupFd = fds[0];
+
+    // The router sends the name of our channel and of its request log.
+    vector<string> segments;
+    boost::split(segments, names, boost::is_any_of(" "));
+    if (segments.size() != 2)
+        throw ML::Exception("invalid shared memory segments: " + names);
+
+    connection->channel.open(segments[0]);
+    connection->logSegment.open(segments[1]);
+    connection->log.attach(connection->logSegment.data());
+
+    ShmConnection * rawConnection = connection.get();
+    connection->source->onMessage = [=] (vector<string> && msg)
+        {
+            handleShmMessage(fromRouter, *rawConnection, msg);
+        };
+
+    {
+        lock_guard<mutex> guard(shmLock);
+        auto & entry = shmConnections[fromRouter];
+        if (entry)
+            retireShmConnection(entry);
+        entry = connection;
+    }
+
+    addSource("BiddingAgent::shm::" + fromRouter, connection->source);
+
+    cerr << "BiddingAgent is connected to router " << fromRouter
+         << " through shared memory" << endl;
+}
+
+void
+BiddingAgent::
+disconnectSharedMemory(const std::string & fromRouter)
+{
+    lock_guard<mutex> guard(shmLock);
+
+    auto it = shmConnections.find(fromRouter);
+    if (it == shmConnections.end())
+        return;
+
+    retireShmConnection(it->second);
+    shmConnections.erase(it);
+}
+
+void
+BiddingAgent::
+retireShmConnection(std::shared_ptr<ShmConnection> connection)
+{
+    // Called with shmLock held
+    removeSource(connection->source.get());
+    connection->retired = Date::now();
+    oldShmConnections.push_back(connection);
+}
+
+void
+BiddingAgent::
+releaseShmConnections()
+{
+    lock_guard<mutex> guard(shmLock);
+
+    // The removal of the sources is deferred to the message loop, which
+    // handles it within its next iteration; we give it a second before
+    // checking that it's done.
+    Date before = Date::now().plusSeconds(-1.0);
+
+    auto isReleased = [&] (const std::shared_ptr<ShmConnection> & connection)
+        {
+            return connection->retired < before
+                && connection->source->connectionState_
+                   == AsyncEventSource::DISCONNECTED;
+        };
+
+    oldShmConnections.erase(std::remove_if(oldShmConnections.begin(),
+                                           oldShmConnections.end(),
+                                           isReleased),
+                            oldShmConnections.end());
+}
+
+void
+BiddingAgent::
+handleShmMessage(const std::string & fromRouter,
+                 ShmConnection & connection,
+                 const std::vector<std::string> & msg)
+{
+    // Auctions come as AUCTION, position of the request in the log, start
+    // time, imp, time left, augmentations and win cost model.  We put them
+    // back in the shape of the zmq message.
+    try {
+        checkMessageSize(msg, 7);
+        ExcCheckEqual(msg[0], "AUCTION", "unexpected shared memory message");
+
+        vector<string> request;
+        if (!connection.log.read(boost::lexical_cast<uint64_t>(msg[1]),
+                                 request)) {
+            recordHit("shm.requestOverwritten");
+            return;
+        }
+        checkMessageSize(request, 3);
+
+        vector<string> message = {
+            msg[0], msg[2],
+            std::move(request[0]), std::move(request[1]),
+            std::move(request[2]),
+            msg[3], msg[4], msg[5], msg[6]
+        };
+
+        handleRouterMessage(fromRouter, std::move(message));
+    }
+    catch (const std::exception& ex) {
+        recordHit("error");
+        cerr << "Error handling shared memory auction message " << ex.what()
+             << endl;
+    }
+}
+
+bool
+BiddingAgent::
+sendShmMessage(const std::string & toRouter,
+               const std::string & type,
+               const std::vector<std::string> & payload)
+{
+    if (!shmEnabled) return false;
+
+    lock_guard<mutex> guard(shmLock);
+
+    auto it = shmConnections.find(toRouter);
+    if (it == shmConnections.end())
+        return false;
+
+    vector<ShmFrame> frames;
+    frames.reserve(payload.size() + 1);
+    frames.emplace_back(type);
+    for (const string & part: payload)
+        frames.emplace_back(part);
+
+    ShmConnection & connection = *it->second;
+    if (!connection.channel.toServer.tryWrite(frames.data(), frames.size())) {
+        recordHit("shm.channelFull");
+        return false;
+    }
+
+    uint64_t one = 1;
+    ssize_t res = ::write(connection.routerWakeupFd, &one, sizeof(one));
+    (void) res;
+
+    return true;
+}
+
+void
+BiddingAgent::
+flushBids()
+{
+    vector<pair<string, string> > batches;
+
+    {
+        lock_guard<mutex> guard (bidBatchesLock);
+        for (auto & entry : bidBatches) {
+            if (!entry.second.empty())
+                batches.emplace_back(entry.first, entry.second.release());
+        }
+    }
+
+    for (auto & batch : batches)
+        sendBids(batch.first, std::move(batch.second));
+}
+
+void
+BiddingAgent::
+sendBids(const std::string & toRouter, std::string batch)
+{
+    vector<string> payload = { std::move(batch) };
+    if (!sendShmMessage(toRouter, "BIDS", payload))
+        toRouterChannel.push(RouterMessage(toRouter, "BIDS", std::move(payload)));
+}
+
 void
 BiddingAgent::
 handlePing(const std::string & fromRouter,
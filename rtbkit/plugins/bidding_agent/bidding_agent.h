@@ -31,10 +31,61 @@
 #include <vector>
 #include <thread>
 #include <map>
+#include <mutex>
 
 
 namespace RTBKIT {
 
+/******************************************************************************/
+/* LAZY AUCTION                                                               */
+/******************************************************************************/
+
+/** Auction as received from the router, where the bid request and the
+    augmentations are only decoded the first time they're asked for.  Agents
+    that only look at a few things can skip most of the decoding, and those
+    that configure bidRequestFormat to "binary" get the bid request in the
+    router's canonical binary serialization, which is much cheaper to decode
+    than the exchange's JSON.
+*/
+struct LazyAuction {
+
+    /** Decode the cheap parts of an AUCTION message from the router. */
+    static std::shared_ptr<LazyAuction>
+    parse(const std::vector<std::string> & msg);
+
+    /** Same, but the encoded bid request and augmentations, which are the
+        bulk of the message, are moved out of it instead of being copied.
+    */
+    static std::shared_ptr<LazyAuction>
+    parse(std::vector<std::string> && msg);
+
+    double timestamp;           ///< Start time of the auction.
+    Id id;                      ///< Auction id
+    Bids bids;                  ///< Impressions available for bidding
+    double timeLeftMs;          ///< Time left of the bid request.
+    WinCostModel wcm;           ///< Win cost model.
+
+    std::string bidRequestSource;   ///< Format of bidRequestStr
+    std::string bidRequestStr;      ///< Encoded bid request
+    std::string augmentationsStr;   ///< JSON encoded augmentations
+
+    /** Bid request, decoded on the first call.  Thread safe. */
+    const std::shared_ptr<BidRequest> & bidRequest() const;
+
+    /** Data from the augmentors, decoded on the first call.  Thread safe. */
+    const Json::Value & augmentations() const;
+
+private:
+    static std::shared_ptr<LazyAuction>
+    parseHeader(const std::vector<std::string> & msg);
+
+    mutable std::once_flag bidRequestOnce;
+    mutable std::shared_ptr<BidRequest> bidRequest_;
+    mutable std::once_flag augmentationsOnce;
+    mutable Json::Value augmentations_;
+};
+
+
 /******************************************************************************/
 /* BIDDING AGENT                                                              */
 /******************************************************************************/
@@ -72,6 +123,25 @@ struct BiddingAgent : public ServiceBase, public MessageLoop {
     */
     void strictMode(bool strict) { requiresAllCB = strict; }
 
+    /** If set to true then auctions and bids are exchanged through shared
+        memory with the routers running on the same host, if they allow it.
+        Everything else still goes through zmq.  This should be set before
+        calling init().  Defaults to false.
+    */
+    void useSharedMemory(bool enable) { shmEnabled = enable; }
+
+    /** Send the bids to the routers in batches of up to maxBids responses
+        in a compact binary encoding (see BidResponseBatch) instead of one
+        JSON message per response.  Incomplete batches are sent after at
+        most maxDelay seconds.  This should be set before calling init().
+        Disabled by default.
+    */
+    void batchBids(size_t maxBids, double maxDelay = 0.0002)
+    {
+        bidBatchSize = maxBids;
+        bidBatchDelay = maxDelay;
+    }
+
     void init();
     void shutdown();
 
@@ -158,6 +228,15 @@ struct BiddingAgent : public ServiceBase, public MessageLoop {
      */
     BidRequestCbFn onBidRequest;
 
+    typedef void (LazyBidRequestCb) (const std::shared_ptr<LazyAuction> &);
+    typedef boost::function<LazyBidRequestCb> LazyBidRequestCbFn;
+
+    /** Alternative to onBidRequest where decoding the bid request and the
+        augmentations is left to the callback, which only pays for what it
+        uses.  Takes precedence over onBidRequest when set.
+     */
+    LazyBidRequestCbFn onLazyBidRequest;
+
 
     typedef void (ResultCb) (const BidResult & args);
     typedef boost::function<ResultCb> ResultCbFn;
@@ -278,6 +357,42 @@ private:
 
     bool requiresAllCB;
 
+    /** Bids waiting to be sent to each router when batching. */
+    size_t bidBatchSize;
+    double bidBatchDelay;
+    std::map<std::string, BidResponseBatch> bidBatches;
+    std::mutex bidBatchesLock;
+
+    void flushBids();
+    void sendBids(const std::string & toRouter, std::string batch);
+
+    /** Shared memory connections to the routers, indexed by router.
+        Replaced connections are kept until the message loop removed their
+        source, and then released by releaseShmConnections().
+    */
+    struct ShmConnection;
+    bool shmEnabled;
+    std::map<std::string, std::shared_ptr<ShmConnection> > shmConnections;
+    std::vector<std::shared_ptr<ShmConnection> > oldShmConnections;
+    std::mutex shmLock;
+
+    void connectSharedMemory(const std::string & fromRouter,
+                             const std::string & socketPath,
+                             const std::string & nonce);
+    void disconnectSharedMemory(const std::string & fromRouter);
+    void retireShmConnection(std::shared_ptr<ShmConnection> connection);
+    void releaseShmConnections();
+    void handleShmMessage(const std::string & fromRouter,
+                          ShmConnection & connection,
+                          const std::vector<std::string> & msg);
+
+    /** Send the message through shared memory if we can, returning false
+        if it needs to go through zmq.
+    */
+    bool sendShmMessage(const std::string & toRouter,
+                        const std::string & type,
+                        const std::vector<std::string> & payload);
+
 
     /** Ensures that we can set the config and send it atomically. Prevents a
         situation where a call to the toConfigurationAgent's connectHandler
@@ -295,10 +410,10 @@ private:
     // void doHeartbeat();
 
     void handleRouterMessage(const std::string & fromRouter,
-                             const std::vector<std::string>& msg);
+                             std::vector<std::string> && msg);
     void handleError(const std::vector<std::string>& msg, ErrorCbFn& callback);
     void handleBidRequest(const std::string & fromRouter,
-            const std::vector<std::string>& msg, BidRequestCbFn& callback);
+            std::vector<std::string> && msg);
     void handleWin(
             const std::vector<std::string>& msg, ResultCbFn& callback);
     void handleResult(
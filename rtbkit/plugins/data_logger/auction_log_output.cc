@@ -0,0 +1,314 @@
+/* auction_log_output.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Output that writes the auction events to columnar files.
+*/
+
+#include "auction_log_output.h"
+#include "soa/types/date.h"
+#include "jml/arch/exception.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace RTBKIT {
+
+
+namespace {
+
+/** Tab separated fields of a message. */
+struct Fields {
+    Fields(const string & message)
+        : message(message)
+    {
+        size_t start = 0;
+        for (;;) {
+            size_t end = message.find('\t', start);
+            if (end == string::npos) {
+                bounds.emplace_back(start, message.size());
+                break;
+            }
+            bounds.emplace_back(start, end);
+            start = end + 1;
+        }
+    }
+
+    size_t size() const { return bounds.size(); }
+
+    void get(size_t index, string & field) const
+    {
+        if (index >= bounds.size()) {
+            field.clear();
+            return;
+        }
+        field.assign(message, bounds[index].first,
+                     bounds[index].second - bounds[index].first);
+    }
+
+    string operator [] (size_t index) const
+    {
+        string result;
+        get(index, result);
+        return result;
+    }
+
+    const string & message;
+    vector<pair<size_t, size_t> > bounds;
+};
+
+/** The exchange is only in the bid request, which we don't want to parse
+    for every message.
+*/
+void findExchange(const string & request, string & exchange)
+{
+    exchange.clear();
+
+    static const char Key[] = "\"exchange\"";
+    size_t pos = request.find(Key);
+    if (pos == string::npos)
+        return;
+
+    pos += sizeof(Key) - 1;
+    while (pos < request.size()
+           && (request[pos] == ' ' || request[pos] == ':'))
+        ++pos;
+    if (pos == request.size() || request[pos] != '"')
+        return;
+
+    size_t end = request.find('"', ++pos);
+    if (end != string::npos)
+        exchange.assign(request, pos, end - pos);
+}
+
+/** Split an amount as printed by Amount::toString() (eg 1000USD/1M) in its
+    value and its currency.
+*/
+void parseAmount(const string & amount, int64_t & value, string & currency)
+{
+    const char * p = amount.c_str();
+    char * ep = 0;
+    value = strtoll(p, &ep, 10);
+    currency.assign(ep);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* AUCTION LOG ROW                                                           */
+/*****************************************************************************/
+
+const std::vector<ColumnSpec> &
+AuctionLogRow::
+columns()
+{
+    static const vector<ColumnSpec> result = {
+        { "timestamp", COL_INT64 },
+        { "event",     COL_STRING },
+        { "auctionId", COL_STRING },
+        { "exchange",  COL_STRING },
+        { "agent",     COL_STRING },
+        { "account",   COL_STRING },
+        { "price",     COL_INT64 },
+        { "currency",  COL_STRING }
+    };
+    return result;
+}
+
+bool
+AuctionLogRow::
+parse(const std::string & channel,
+      const std::string & message,
+      AuctionLogRow & row)
+{
+    int auctionIdField, exchangeField, agentField, accountField, priceField;
+
+    // The indexes of the fields are those of the messages of the router
+    // and of the post auction loop, without the channel.
+    if (channel == "AUCTION") {
+        auctionIdField = 1;  exchangeField = 2;
+        agentField = accountField = priceField = -1;
+    }
+    else if (channel == "BID") {
+        auctionIdField = 2;  agentField = 1;
+        exchangeField = accountField = priceField = -1;
+    }
+    else if (channel == "MATCHEDWIN" || channel == "MATCHEDLOSS") {
+        auctionIdField = 1;  agentField = 3;  priceField = 5;
+        exchangeField = 8;  accountField = 18;
+    }
+    else if (channel.compare(0, 7, "MATCHED") == 0) {
+        auctionIdField = 1;  exchangeField = 3;  accountField = 10;
+        agentField = priceField = -1;
+    }
+    else return false;
+
+    Fields fields(message);
+
+    Date timestamp = Date::parseDefaultUtc(fields[0]);
+    row.timestamp = int64_t(timestamp.secondsSinceEpoch() * 1000000.0);
+    row.event = channel;
+
+    fields.get(auctionIdField, row.auctionId);
+
+    row.exchange.clear();
+    if (exchangeField != -1)
+        findExchange(fields[exchangeField], row.exchange);
+
+    row.agent.clear();
+    if (agentField != -1)
+        fields.get(agentField, row.agent);
+
+    row.account.clear();
+    if (accountField != -1)
+        fields.get(accountField, row.account);
+
+    row.price = 0;
+    row.currency.clear();
+    if (priceField != -1)
+        parseAmount(fields[priceField], row.price, row.currency);
+
+    return true;
+}
+
+
+/*****************************************************************************/
+/* AUCTION LOG OUTPUT                                                        */
+/*****************************************************************************/
+
+AuctionLogOutput::
+AuctionLogOutput(const std::string & filename,
+                 size_t rowGroupSize,
+                 size_t ringBufferSize)
+    : WorkerThreadOutput(ringBufferSize),
+      rowGroupSize(rowGroupSize),
+      numRows(0), numSkipped(0)
+{
+    if (filename != "")
+        open(filename);
+}
+
+AuctionLogOutput::
+~AuctionLogOutput()
+{
+    try {
+        close();
+    } catch (const std::exception & exc) {
+        cerr << "warning: error closing auction log: " << exc.what() << endl;
+    }
+}
+
+void
+AuctionLogOutput::
+open(const std::string & filename)
+{
+    close();
+    writer.reset(new ColumnarWriter(filename, AuctionLogRow::columns(),
+                                    rowGroupSize));
+    startWorkerThread();
+}
+
+void
+AuctionLogOutput::
+close()
+{
+    stopWorkerThread();
+    if (writer) {
+        std::unique_ptr<ColumnarWriter> toClose(std::move(writer));
+        toClose->close();
+    }
+}
+
+void
+AuctionLogOutput::
+implementLogMessage(const std::string & channel,
+                    const std::string & message)
+{
+    try {
+        if (!AuctionLogRow::parse(channel, message, row)) {
+            ++numSkipped;
+            return;
+        }
+    } catch (const std::exception & exc) {
+        cerr << "auction log: can't parse " << channel << " message: "
+             << exc.what() << endl;
+        ++numSkipped;
+        return;
+    }
+
+    writer->addRow();
+    writer->setInt(AuctionLogRow::TIMESTAMP, row.timestamp);
+    writer->setString(AuctionLogRow::EVENT, row.event);
+    writer->setString(AuctionLogRow::AUCTION_ID, row.auctionId);
+    writer->setString(AuctionLogRow::EXCHANGE, row.exchange);
+    writer->setString(AuctionLogRow::AGENT, row.agent);
+    writer->setString(AuctionLogRow::ACCOUNT, row.account);
+    writer->setInt(AuctionLogRow::PRICE, row.price);
+    writer->setString(AuctionLogRow::CURRENCY, row.currency);
+
+    ++numRows;
+}
+
+Json::Value
+AuctionLogOutput::
+stats() const
+{
+    Json::Value result = WorkerThreadOutput::stats();
+    result["rows"] = (Json::UInt)numRows;
+    result["skipped"] = (Json::UInt)numSkipped;
+    return result;
+}
+
+void
+AuctionLogOutput::
+clearStats()
+{
+    WorkerThreadOutput::clearStats();
+    numRows = 0;
+    numSkipped = 0;
+}
+
+
+/*****************************************************************************/
+/* ROTATING AUCTION LOG OUTPUT                                               */
+/*****************************************************************************/
+
+RotatingAuctionLogOutput::
+RotatingAuctionLogOutput()
+    : RotatingOutputAdaptor(std::bind(&RotatingAuctionLogOutput::createFile,
+                                      this,
+                                      std::placeholders::_1)),
+      rowGroupSize(65536)
+{
+}
+
+RotatingAuctionLogOutput::
+~RotatingAuctionLogOutput()
+{
+    close();
+}
+
+void
+RotatingAuctionLogOutput::
+open(const std::string & filenamePattern,
+     const std::string & periodPattern,
+     size_t rowGroupSize)
+{
+    this->rowGroupSize = rowGroupSize;
+    RotatingOutputAdaptor::open(filenamePattern, periodPattern);
+}
+
+AuctionLogOutput *
+RotatingAuctionLogOutput::
+createFile(const std::string & filename)
+{
+    return new AuctionLogOutput(filename, rowGroupSize);
+}
+
+} // namespace RTBKIT
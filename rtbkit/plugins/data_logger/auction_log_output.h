@@ -0,0 +1,134 @@
+/* auction_log_output.h                                            -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Output that writes the auction events to columnar files.
+*/
+
+#pragma once
+
+#include "soa/logger/compressing_output.h"
+#include "soa/logger/rotating_output.h"
+#include "soa/logger/columnar_file.h"
+
+#include <atomic>
+#include <memory>
+
+
+namespace RTBKIT {
+
+
+/*****************************************************************************/
+/* AUCTION LOG ROW                                                           */
+/*****************************************************************************/
+
+/** The fields of an auction event that are kept in an auction log. */
+
+struct AuctionLogRow {
+
+    AuctionLogRow()
+        : timestamp(0), price(0)
+    {
+    }
+
+    int64_t timestamp;          ///< Microseconds since the epoch
+    std::string event;          ///< Channel of the message
+    std::string auctionId;
+    std::string exchange;
+    std::string agent;
+    std::string account;
+    int64_t price;              ///< Micro units of the currency
+    std::string currency;
+
+    /** Columns of an auction log, in the order of the fields above. */
+    enum Column {
+        TIMESTAMP,
+        EVENT,
+        AUCTION_ID,
+        EXCHANGE,
+        AGENT,
+        ACCOUNT,
+        PRICE,
+        CURRENCY
+    };
+
+    static const std::vector<Datacratic::ColumnSpec> & columns();
+
+    /** Extract the row from a message of the router or the post auction
+        loop as the DataLogger sees it.  Returns false if the channel isn't
+        one of the auction events (AUCTION, BID, MATCHEDWIN, MATCHEDLOSS and
+        the other MATCHED campaign events).
+    */
+    static bool parse(const std::string & channel,
+                      const std::string & message,
+                      AuctionLogRow & row);
+};
+
+
+/*****************************************************************************/
+/* AUCTION LOG OUTPUT                                                        */
+/*****************************************************************************/
+
+/** Output that writes the auction events to a columnar file, which can be
+    scanned by row group in parallel and without parsing any text.  See
+    auction_log_tool for a reader.
+
+    Messages of the other channels are skipped.
+*/
+
+struct AuctionLogOutput : public Datacratic::WorkerThreadOutput {
+
+    AuctionLogOutput(const std::string & filename = "",
+                     size_t rowGroupSize = 65536,
+                     size_t ringBufferSize = 65536);
+
+    virtual ~AuctionLogOutput();
+
+    void open(const std::string & filename);
+
+    virtual void close();
+
+    virtual Json::Value stats() const;
+
+    virtual void clearStats();
+
+private:
+    size_t rowGroupSize;
+    std::unique_ptr<Datacratic::ColumnarWriter> writer;
+
+    AuctionLogRow row;
+
+    std::atomic<uint64_t> numRows;
+    std::atomic<uint64_t> numSkipped;
+
+    virtual void implementLogMessage(const std::string & channel,
+                                     const std::string & message);
+};
+
+
+/*****************************************************************************/
+/* ROTATING AUCTION LOG OUTPUT                                               */
+/*****************************************************************************/
+
+/** Auction log that starts a new file at every period.  A file can only be
+    read once it's been rotated out, since the index of its row groups is
+    written when it's closed.
+*/
+
+struct RotatingAuctionLogOutput : public Datacratic::RotatingOutputAdaptor {
+
+    RotatingAuctionLogOutput();
+
+    virtual ~RotatingAuctionLogOutput();
+
+    /** Open the file for rotation. */
+    void open(const std::string & filenamePattern,
+              const std::string & periodPattern,
+              size_t rowGroupSize = 65536);
+
+private:
+    AuctionLogOutput * createFile(const std::string & filename);
+
+    size_t rowGroupSize;
+};
+
+} // namespace RTBKIT
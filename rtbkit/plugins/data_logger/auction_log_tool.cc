@@ -0,0 +1,225 @@
+/* auction_log_tool.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Scans auction logs written by AuctionLogOutput and aggregates them.
+*/
+
+#include "auction_log_output.h"
+#include "soa/logger/columnar_file.h"
+#include "soa/types/date.h"
+#include "jml/arch/exception.h"
+
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/positional_options.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+struct Aggregate {
+    Aggregate()
+        : count(0), sum(0)
+    {
+    }
+
+    uint64_t count;
+    int64_t sum;
+};
+
+int main(int argc, char ** argv)
+{
+    using namespace boost::program_options;
+
+    vector<string> files;
+    int numThreads = std::thread::hardware_concurrency();
+    string event;
+    string from, to;
+    string groupBy = "event";
+    string sumColumn;
+
+    options_description options("Auction log tool options");
+    options.add_options()
+        ("file", value<vector<string> >(&files),
+         "auction log files to scan")
+        ("threads,t", value<int>(&numThreads),
+         "number of threads decoding the row groups")
+        ("event,e", value<string>(&event),
+         "only keep the rows of this event (eg MATCHEDWIN)")
+        ("from", value<string>(&from),
+         "only keep the rows from this date (eg 2014-10-22T12:00:00Z)")
+        ("to", value<string>(&to),
+         "only keep the rows before this date")
+        ("group-by,g", value<string>(&groupBy),
+         "column to group the rows by")
+        ("sum,s", value<string>(&sumColumn),
+         "integer column to sum in each group (eg price); the groups are "
+         "split by currency, so that amounts in different currencies "
+         "aren't added together")
+        ("help,h", "print this message");
+
+    positional_options_description positional;
+    positional.add("file", -1);
+
+    variables_map vm;
+    store(command_line_parser(argc, argv)
+          .options(options)
+          .positional(positional)
+          .run(),
+          vm);
+    notify(vm);
+
+    if (vm.count("help") || files.empty()) {
+        cerr << "usage: " << argv[0] << " [options] file..." << endl
+             << options << endl;
+        return files.empty();
+    }
+
+    int64_t fromMicros = numeric_limits<int64_t>::min();
+    int64_t toMicros = numeric_limits<int64_t>::max();
+    if (!from.empty())
+        fromMicros = Date::parseIso8601DateTime(from).secondsSinceEpoch()
+            * 1000000.0;
+    if (!to.empty())
+        toMicros = Date::parseIso8601DateTime(to).secondsSinceEpoch()
+            * 1000000.0;
+
+    // When summing, the amounts of each currency go to their own group,
+    // whose key is the group value and the currency separated by a tab.
+    bool byCurrency = !sumColumn.empty() && groupBy != "currency";
+
+    std::mutex lock;
+    map<string, Aggregate> results;
+    uint64_t rowGroupsRead = 0, rowGroupsSkipped = 0;
+
+    for (auto & file: files) {
+        ColumnarReader reader(file);
+
+        int groupCol = reader.columnIndex(groupBy);
+        if (groupCol == -1)
+            throw ML::Exception("no column " + groupBy + " in " + file);
+
+        int sumCol = -1;
+        if (!sumColumn.empty()) {
+            sumCol = reader.columnIndex(sumColumn);
+            if (sumCol == -1 || reader.columns()[sumCol].type != COL_INT64)
+                throw ML::Exception("no integer column " + sumColumn
+                                    + " in " + file);
+        }
+
+        int timestampCol = reader.columnIndex("timestamp");
+        int eventCol = reader.columnIndex("event");
+        int currencyCol = reader.columnIndex("currency");
+        if (timestampCol == -1 || eventCol == -1 || currencyCol == -1)
+            throw ML::Exception(file + " isn't an auction log");
+
+        // Only decode the columns that we need
+        vector<int> columns = { groupCol, timestampCol, eventCol };
+        if (sumCol != -1)
+            columns.push_back(sumCol);
+        if (byCurrency)
+            columns.push_back(currencyCol);
+
+        auto filter = [&] (const RowGroupInfo & info)
+            {
+                const ColumnChunk & chunk = info.chunks[timestampCol];
+                bool keep = chunk.maxValue >= fromMicros
+                    && chunk.minValue < toMicros;
+
+                std::unique_lock<std::mutex> guard(lock);
+                ++(keep ? rowGroupsRead : rowGroupsSkipped);
+                return keep;
+            };
+
+        auto onRowGroup = [&] (const ColumnarRowGroup & group)
+            {
+                bool intKey = reader.columns()[groupCol].type == COL_INT64;
+
+                // Aggregate by dictionary entry (and currency entry), which
+                // is much cheaper than by string
+                map<string, Aggregate> local;
+                vector<Aggregate> byEntry;
+                size_t numCurrencies = 1;
+                if (byCurrency)
+                    numCurrencies
+                        = group.columns[currencyCol].dictionary.size();
+                if (!intKey)
+                    byEntry.resize(group.columns[groupCol].dictionary.size()
+                                   * numCurrencies);
+
+                for (size_t i = 0;  i < group.numRows;  ++i) {
+                    int64_t ts = group.getInt(timestampCol, i);
+                    if (ts < fromMicros || ts >= toMicros)
+                        continue;
+                    if (!event.empty() && group.getString(eventCol, i) != event)
+                        continue;
+
+                    size_t currency = 0;
+                    if (byCurrency)
+                        currency = group.columns[currencyCol].indices[i];
+
+                    Aggregate * agg;
+                    if (intKey) {
+                        string key = to_string(group.getInt(groupCol, i));
+                        if (byCurrency)
+                            key += "\t" + group.getString(currencyCol, i);
+                        agg = &local[key];
+                    }
+                    else agg = &byEntry[group.columns[groupCol].indices[i]
+                                        * numCurrencies + currency];
+
+                    ++agg->count;
+                    if (sumCol != -1)
+                        agg->sum += group.getInt(sumCol, i);
+                }
+
+                for (unsigned i = 0;  i < byEntry.size();  ++i) {
+                    if (byEntry[i].count == 0) continue;
+                    string key = group.columns[groupCol]
+                        .dictionary[i / numCurrencies];
+                    if (byCurrency)
+                        key += "\t" + group.columns[currencyCol]
+                            .dictionary[i % numCurrencies];
+                    local[key] = byEntry[i];
+                }
+
+                std::unique_lock<std::mutex> guard(lock);
+                for (auto & entry: local) {
+                    Aggregate & agg = results[entry.first];
+                    agg.count += entry.second.count;
+                    agg.sum += entry.second.sum;
+                }
+            };
+
+        reader.forEachRowGroup(onRowGroup, numThreads, columns, filter);
+    }
+
+    cerr << "read " << rowGroupsRead << " row groups, skipped "
+         << rowGroupsSkipped << endl;
+
+    cout << groupBy;
+    if (byCurrency)
+        cout << "\tcurrency";
+    cout << "\tcount";
+    if (!sumColumn.empty())
+        cout << "\t" << sumColumn;
+    cout << endl;
+
+    for (auto & entry: results) {
+        cout << entry.first << "\t" << entry.second.count;
+        if (!sumColumn.empty())
+            cout << "\t" << entry.second.sum;
+        cout << endl;
+    }
+
+    return 0;
+}
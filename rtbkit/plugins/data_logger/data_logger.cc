@@ -8,22 +8,80 @@
 
 
 #include "data_logger.h"
+#include "soa/logger/callback_output.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
 
 
 using namespace std;
 using namespace Datacratic;
 using namespace RTBKIT;
 
+namespace {
+
+/** Output shared by several partitions, whose calls are serialized. */
+struct SerializedOutput : public LogOutput {
+    SerializedOutput(std::shared_ptr<LogOutput> output)
+        : output(output)
+    {
+    }
+
+    virtual void logMessage(const std::string & channel,
+                            const std::string & message)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        output->logMessage(channel, message);
+    }
+
+    virtual void close()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        output->close();
+    }
+
+    virtual Json::Value stats() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return output->stats();
+    }
+
+    virtual void clearStats()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        output->clearStats();
+    }
+
+    mutable std::mutex lock;
+    std::shared_ptr<LogOutput> output;
+};
+
+} // file scope
+
+
+DataLogger::Partition::
+Partition(std::shared_ptr<zmq::context_t> context, size_t bufferSize)
+    : logger(context, bufferSize),
+      subscriber(context)
+{
+}
+
 DataLogger::
 DataLogger(const string & serviceName, std::shared_ptr<ServiceProxies> proxies,
-           bool monitor, size_t bufferSize)
+           bool monitor, size_t bufferSize, unsigned numPartitions)
     : ServiceBase(serviceName, proxies),
       Logger(proxies->zmqContext, bufferSize),
       multipleSubscriber(proxies->zmqContext),
       monitorProviderClient(proxies->zmqContext),
       monitor_(monitor),
-      loopMonitor_(*this)
+      loopMonitor_(*this),
+      numServices(numPartitions, 0)
 {
+    if (numPartitions == 0)
+        throw ML::Exception("DataLogger needs at least one partition");
+
+    for (unsigned i = 1;  i < numPartitions;  ++i)
+        partitions.emplace_back(new Partition(proxies->zmqContext, bufferSize));
+
     monitorProviderClient.addProvider(this);
 }
 
@@ -44,15 +102,24 @@ init()
     multipleSubscriber.init(getServices()->config);
     multipleSubscriber.messageHandler
         = [&] (vector<zmq::message_t> && msg) {
-        // forward to logger class
-        vector<string> s;
-        s.reserve(msg.size());
-        for (auto & m: msg)
-            s.push_back(m.toString());
-        this->logMessageNoTimestamp(s);
+        forwardMessage(*this, std::move(msg));
     };
+
+    for (auto & partition: partitions) {
+        Logger & logger = partition->logger;
+        logger.init();
+        partition->subscriber.init(getServices()->config);
+        partition->subscriber.messageHandler
+            = [&] (vector<zmq::message_t> && msg) {
+            forwardMessage(logger, std::move(msg));
+        };
+    }
+
     loopMonitor_.init();
     loopMonitor_.addMessageLoop("logger", &messageLoop);
+    for (unsigned i = 0;  i < partitions.size();  ++i)
+        loopMonitor_.addMessageLoop(ML::format("logger%d", i + 1),
+                                    &partitions[i]->logger.messageLoop);
     //messageLoop.addSource("DataLogger::multipleSubscriber",
     //                      multipleSubscriber);
 }
@@ -63,6 +130,10 @@ start(std::function<void ()> onStop)
 {
     Logger::start(onStop);
     multipleSubscriber.start();
+    for (auto & partition: partitions) {
+        partition->logger.start();
+        partition->subscriber.start();
+    }
     if(monitor_)
       monitorProviderClient.start();
 
@@ -77,14 +148,192 @@ shutdown()
     monitorProviderClient.shutdown();
     Logger::shutdown();
     multipleSubscriber.shutdown();
-    
+    for (auto & partition: partitions) {
+        partition->logger.shutdown();
+        partition->subscriber.shutdown();
+    }
 }
 
 void
 DataLogger::
 connectAllServiceProviders(const string & serviceClass, const string & epName)
 {
-    multipleSubscriber.connectAllServiceProviders(serviceClass, epName);
+    if (partitions.empty()) {
+        multipleSubscriber.connectAllServiceProviders(serviceClass, epName);
+        return;
+    }
+
+    // Each partition only connects to its own share of the services
+    auto filterFor = [=] (unsigned partition)
+        {
+            return [=] (std::string service)
+                {
+                    return this->partitionOf(service) == partition;
+                };
+        };
+
+    multipleSubscriber.connectAllServiceProviders(
+            serviceClass, epName, {}, filterFor(0));
+    for (unsigned i = 0;  i < partitions.size();  ++i)
+        partitions[i]->subscriber.connectAllServiceProviders(
+                serviceClass, epName, {}, filterFor(i + 1));
+}
+
+void
+DataLogger::
+forwardMessage(Logger & logger, std::vector<zmq::message_t> && msg)
+{
+    // binary records come as the channel and the record
+    if (msg.size() == 2) {
+        auto & record = msg[1];
+        if (LogRecord::isRecord((const char *)record.data(),
+                                record.size())) {
+            logger.logRecord((const char *)record.data(), record.size());
+            return;
+        }
+    }
+
+    // forward to logger class
+    vector<string> s;
+    s.reserve(msg.size());
+    for (auto & m: msg)
+        s.push_back(m.toString());
+    logger.logMessageNoTimestamp(s);
+}
+
+Logger &
+DataLogger::
+partitionLogger(unsigned partition)
+{
+    if (partition == 0)
+        return *this;
+    if (partition > partitions.size())
+        throw ML::Exception("DataLogger has no partition %d", partition);
+    return partitions[partition - 1]->logger;
+}
+
+unsigned
+DataLogger::
+partitionOf(const std::string & service)
+{
+    std::lock_guard<std::mutex> guard(partitionsLock);
+
+    auto it = servicePartitions.find(service);
+    if (it != servicePartitions.end())
+        return it->second;
+
+    // New services go to the partition that has the fewest of them, which
+    // spreads them more evenly than hashing their names
+    unsigned partition
+        = std::min_element(numServices.begin(), numServices.end())
+        - numServices.begin();
+    ++numServices[partition];
+    servicePartitions[service] = partition;
+    return partition;
+}
+
+void
+DataLogger::
+addOutput(std::shared_ptr<LogOutput> output,
+          const boost::regex & allowChannels,
+          const boost::regex & denyChannels,
+          double logProbability)
+{
+    if (partitions.empty()) {
+        Logger::addOutput(output, allowChannels, denyChannels, logProbability);
+        return;
+    }
+
+    // The calls are qualified so that partition 0, which is this object,
+    // doesn't dispatch back into this override
+    auto shared = std::make_shared<SerializedOutput>(output);
+    for (unsigned i = 0;  i < numPartitions();  ++i)
+        partitionLogger(i).Logger::addOutput(shared, allowChannels,
+                                             denyChannels, logProbability);
+}
+
+void
+DataLogger::
+addPartitionedOutput(const OutputFactory & factory,
+                     const boost::regex & allowChannels,
+                     const boost::regex & denyChannels,
+                     double logProbability)
+{
+    for (unsigned i = 0;  i < numPartitions();  ++i)
+        partitionLogger(i).Logger::addOutput(factory(i), allowChannels,
+                                             denyChannels, logProbability);
+}
+
+void
+DataLogger::
+addCallback(boost::function<void (std::string, std::string)> callback,
+            const boost::regex & allowChannels,
+            const boost::regex & denyChannels,
+            double logProbability)
+{
+    addOutput(std::make_shared<CallbackOutput>(callback),
+              allowChannels, denyChannels, logProbability);
+}
+
+void
+DataLogger::
+logTo(const std::string & uri,
+      const boost::regex & allowChannels,
+      const boost::regex & denyChannels,
+      double logProbability)
+{
+    if (!partitions.empty())
+        throw ML::Exception("DataLogger::logTo() needs a single partition; "
+                            "use addOutput() or addPartitionedOutput()");
+    Logger::logTo(uri, allowChannels, denyChannels, logProbability);
+}
+
+void
+DataLogger::
+clearOutputs()
+{
+    for (unsigned i = 0;  i < numPartitions();  ++i)
+        partitionLogger(i).Logger::clearOutputs();
+}
+
+uint64_t
+DataLogger::
+numMessagesSent() const
+{
+    uint64_t result = Logger::numMessagesSent();
+    for (auto & partition: partitions)
+        result += partition->logger.numMessagesSent();
+    return result;
+}
+
+uint64_t
+DataLogger::
+numMessagesDone() const
+{
+    uint64_t result = Logger::numMessagesDone();
+    for (auto & partition: partitions)
+        result += partition->logger.numMessagesDone();
+    return result;
+}
+
+void
+DataLogger::
+waitUntilFinished()
+{
+    Logger::waitUntilFinished();
+    for (auto & partition: partitions)
+        partition->logger.waitUntilFinished();
+}
+
+std::map<std::string, size_t>
+DataLogger::
+getStats()
+{
+    auto result = Logger::getStats();
+    for (auto & partition: partitions)
+        for (auto & stat: partition->logger.getStats())
+            result[stat.first] += stat.second;
+    return result;
 }
 
 /** MonitorProvider interface */
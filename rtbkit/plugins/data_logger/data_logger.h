@@ -9,6 +9,10 @@
 #pragma once
 
 #include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -21,23 +25,106 @@
 
 namespace RTBKIT {
 
+/** Logger that subscribes to the logger endpoints of the services of the
+    stack.
+
+    Its subscriptions can be partitioned across several independent ingest
+    partitions, each of which has its own subscriber thread, its own logging
+    thread and its own set of outputs.  Each service that is connected to
+    is handled by a single partition, so the messages of a service stay in
+    order.  Partition 0 is the DataLogger itself.
+
+    The Logger methods that set up outputs and report on progress are
+    overridden to apply to all of the partitions, so the DataLogger can be
+    used through a Logger &.  Messages logged directly on it go to partition
+    0.
+
+    Outputs added with addOutput() see the messages of all of the partitions:
+    the calls to them are serialized, which is where the partitions merge
+    back.  For the ingest rate to scale with the number of partitions, use
+    addPartitionedOutput() instead so that each partition writes to its own
+    output (for example files that have the partition number in their name
+    and that rotate independently).
+*/
 struct DataLogger : public Datacratic::ServiceBase,
                     public MonitorProvider,
                     public Datacratic::Logger {
   DataLogger(const std::string & serviceName, 
              std::shared_ptr<Datacratic::ServiceProxies> proxies,
              bool monitor = true,
-             size_t bufferSize = 65536);
+             size_t bufferSize = 65536,
+             unsigned numPartitions = 1);
     ~DataLogger();
 
-    void init();
-    void shutdown();
+    virtual void init();
+    virtual void shutdown();
 
-    void start(std::function<void ()> onStop = 0);
+    virtual void start(std::function<void ()> onStop = 0);
 
     void connectAllServiceProviders(const std::string & serviceClass,
                                     const std::string & epName);
 
+    unsigned numPartitions() const { return partitions.size() + 1; }
+
+    /** Logger of the given partition; partition 0 is this object. */
+    Datacratic::Logger & partitionLogger(unsigned partition);
+
+    /** Partition that handles the messages of the given service. */
+    unsigned partitionOf(const std::string & service);
+
+    /** Forward a message received from a service to the given logger.  A
+        channel followed by a binary LogRecord is logged as a record; any
+        other message is logged as text.
+    */
+    static void forwardMessage(Datacratic::Logger & logger,
+                               std::vector<zmq::message_t> && message);
+
+    /** Add the output to all of the partitions.  When there is more than
+        one, the calls to the output are serialized with a lock.
+    */
+    virtual void addOutput(std::shared_ptr<Datacratic::LogOutput> output,
+                           const boost::regex & allowChannels = boost::regex(),
+                           const boost::regex & denyChannels = boost::regex(),
+                           double logProbability = 1.0);
+
+    typedef std::function<std::shared_ptr<Datacratic::LogOutput>
+                          (unsigned partition)> OutputFactory;
+
+    /** Add an output to each partition, created by calling the factory
+        with the number of the partition.
+    */
+    void addPartitionedOutput(const OutputFactory & factory,
+                              const boost::regex & allowChannels
+                                  = boost::regex(),
+                              const boost::regex & denyChannels
+                                  = boost::regex(),
+                              double logProbability = 1.0);
+
+    virtual void addCallback(boost::function<void (std::string, std::string)> callback,
+                             const boost::regex & allowChannels = boost::regex(),
+                             const boost::regex & denyChannels = boost::regex(),
+                             double logProbability = 1.0);
+
+    /** Only supported with a single partition; use addOutput() otherwise. */
+    virtual void logTo(const std::string & uri,
+                       const boost::regex & allowChannels = boost::regex(),
+                       const boost::regex & denyChannels = boost::regex(),
+                       double logProbability = 1.0);
+
+    virtual void clearOutputs();
+
+    /** Messages that were handed to the partitions and messages that they
+        finished logging, over all of the partitions.
+    */
+    virtual uint64_t numMessagesSent() const;
+    virtual uint64_t numMessagesDone() const;
+
+    /** Wait until all of the partitions have logged their messages. */
+    virtual void waitUntilFinished();
+
+    /** Stats summed over all of the partitions. */
+    virtual std::map<std::string, size_t> getStats();
+
     void unsafeDisableMonitor() {
         monitorProviderClient.disable();
     }
@@ -58,6 +145,25 @@ struct DataLogger : public Datacratic::ServiceBase,
 
     bool monitor_;
     LoopMonitor loopMonitor_;
+
+private:
+    /** Partitions after the first one, which is the DataLogger itself. */
+    struct Partition {
+        Partition(std::shared_ptr<zmq::context_t> context, size_t bufferSize);
+
+        Datacratic::Logger logger;
+        Datacratic::ZmqNamedMultipleSubscriber subscriber;
+    };
+
+    std::vector<std::unique_ptr<Partition> > partitions;
+
+    /** Partition of each service seen so far, and number of services
+        handled by each partition.
+    */
+    std::mutex partitionsLock;
+    std::map<std::string, unsigned> servicePartitions;
+    std::vector<unsigned> numServices;
+
 };
 
 } // namespace RTKBIT
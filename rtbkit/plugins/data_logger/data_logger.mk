@@ -2,9 +2,15 @@
 # Sunil Rottoo 
 
 LIBRTBKIT_DATA_LOGGER_SOURCES := \
-	data_logger.cc
+	data_logger.cc auction_log_output.cc
 
 LIBRTBKIT_DATA_LOGGER_LINK := \
 	ACE arch utils logger boost_thread zmq opstats services monitor
 
 $(eval $(call library,data_logger,$(LIBRTBKIT_DATA_LOGGER_SOURCES),$(LIBRTBKIT_DATA_LOGGER_LINK)))
+
+$(eval $(call program,auction_log_tool,data_logger logger types boost_program_options))
+
+$(eval $(call program,data_logger_replay_bench,data_logger logger services boost_program_options boost_thread))
+
+$(eval $(call include_sub_make,data_logger_testing,testing,data_logger_testing.mk))
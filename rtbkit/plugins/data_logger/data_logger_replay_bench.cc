@@ -0,0 +1,218 @@
+/* data_logger_replay_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Replays captured logs through a DataLogger with a varying number of
+   partitions to measure how its ingest rate scales.  The messages are
+   published on the logger endpoints of a set of services and reach the
+   DataLogger through its zeromq subscribers, like in the stack.
+*/
+
+#include "data_logger.h"
+#include "soa/service/zmq_named_pub_sub.h"
+#include "soa/logger/callback_output.h"
+#include "soa/logger/file_output.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+#include "jml/arch/timers.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/positional_options.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+/** Service that publishes its share of the messages on its logger
+    endpoint, like the services of the stack do.
+*/
+struct ReplayService : public ServiceBase, public ZmqNamedPublisher {
+
+    ReplayService(const std::string & name,
+                  std::shared_ptr<ServiceProxies> proxies)
+        : ServiceBase(name, proxies),
+          ZmqNamedPublisher(proxies->zmqContext)
+    {
+    }
+
+    ~ReplayService()
+    {
+        unregisterServiceProvider(serviceName(), { "rtbLogReplay" });
+        shutdown();
+    }
+
+    void init()
+    {
+        ZmqNamedPublisher::init(getServices()->config,
+                                serviceName() + "/logger");
+        bindTcp();
+        registerServiceProvider(serviceName(), { "rtbLogReplay" });
+    }
+};
+
+
+int main(int argc, char ** argv)
+{
+    using namespace boost::program_options;
+
+    string file;
+    string partitionCounts = "1,2,4,8";
+    int repeat = 1;
+    int numServices = 8;
+    string outputDir;
+
+    options_description options("DataLogger replay benchmark options");
+    options.add_options()
+        ("file", value<string>(&file),
+         "captured log file, one message per line (channel\\tfields...)")
+        ("partitions,p", value<string>(&partitionCounts),
+         "comma separated numbers of partitions to benchmark")
+        ("repeat,r", value<int>(&repeat),
+         "number of times that the messages are replayed in each run")
+        ("services,s", value<int>(&numServices),
+         "number of services that publish the messages; each one is "
+         "handled by a single partition")
+        ("output-dir,o", value<string>(&outputDir),
+         "write each partition to its own file in this directory "
+         "(messages are discarded otherwise)")
+        ("help,h", "print this message");
+
+    positional_options_description positional;
+    positional.add("file", 1);
+
+    variables_map vm;
+    store(command_line_parser(argc, argv)
+          .options(options)
+          .positional(positional)
+          .run(),
+          vm);
+    notify(vm);
+
+    if (vm.count("help") || file.empty()) {
+        cerr << "usage: " << argv[0] << " [options] file" << endl
+             << options << endl;
+        return file.empty();
+    }
+
+    // Keep the split messages in memory so that only the logger is measured
+    struct Message {
+        string channel;
+        vector<string> fields;
+    };
+    vector<Message> messages;
+    {
+        std::ifstream stream(file.c_str());
+        if (!stream)
+            throw ML::Exception("couldn't open " + file);
+
+        string line;
+        while (getline(stream, line)) {
+            if (line.empty())
+                continue;
+            vector<string> fields;
+            boost::split(fields, line, boost::is_any_of("\t"));
+            messages.emplace_back();
+            messages.back().channel = fields[0];
+            messages.back().fields.assign(fields.begin() + 1, fields.end());
+        }
+    }
+    if (messages.empty())
+        throw ML::Exception(file + " has no messages");
+
+    cerr << "replaying " << messages.size() << " messages " << repeat
+         << " time(s)" << endl;
+
+    vector<string> counts;
+    boost::split(counts, partitionCounts, boost::is_any_of(","));
+
+    for (auto & count: counts) {
+        unsigned numPartitions = stoi(count);
+
+        auto proxies = std::make_shared<ServiceProxies>();
+        DataLogger logger("data_logger_bench", proxies, false, 65536,
+                          numPartitions);
+        logger.unsafeDisableMonitor();
+        logger.init();
+
+        auto createOutput = [&] (unsigned partition)
+            -> std::shared_ptr<LogOutput>
+            {
+                if (!outputDir.empty())
+                    return std::make_shared<FileOutput>
+                        (ML::format("%s/replay-p%d.log",
+                                    outputDir.c_str(), partition));
+
+                return std::make_shared<CallbackOutput>
+                    ([] (string channel, string message) {});
+            };
+        logger.addPartitionedOutput(createOutput);
+        logger.start();
+        logger.connectAllServiceProviders("rtbLogReplay", "logger");
+
+        vector<std::unique_ptr<ReplayService> > services;
+        for (int i = 0;  i < numServices;  ++i) {
+            services.emplace_back(new ReplayService(ML::format("replay%d", i),
+                                                    proxies));
+            services.back()->init();
+            services.back()->start();
+        }
+
+        // Publishers drop what they send before the subscribers connect
+        ML::sleep(1.0);
+
+        // One feeder thread per service
+        ML::Timer timer;
+        vector<std::thread> feeders;
+        for (int s = 0;  s < numServices;  ++s) {
+            auto feed = [&, s] ()
+                {
+                    ReplayService & service = *services[s];
+                    for (int r = 0;  r < repeat;  ++r)
+                        for (size_t i = s;  i < messages.size();
+                             i += numServices)
+                            service.publish(messages[i].channel,
+                                            messages[i].fields);
+                };
+            feeders.emplace_back(feed);
+        }
+        for (auto & feeder: feeders)
+            feeder.join();
+
+        uint64_t published = (uint64_t)messages.size() * repeat;
+
+        // zeromq drops messages when a subscriber falls too far behind, so
+        // stop waiting once nothing more arrives
+        uint64_t done = 0;
+        double elapsed = timer.elapsed_wall();
+        for (Date lastProgress = Date::now();
+             done < published
+                 && Date::now().secondsSince(lastProgress) < 1.0;) {
+            ML::sleep(0.001);
+            uint64_t nowDone = logger.numMessagesDone();
+            if (nowDone != done) {
+                done = nowDone;
+                elapsed = timer.elapsed_wall();
+                lastProgress = Date::now();
+            }
+        }
+
+        services.clear();
+        logger.shutdown();
+
+        cout << numPartitions << " partition(s): " << done << " messages in "
+             << ML::format("%.3fs", elapsed) << ", "
+             << ML::format("%.0f", done / elapsed) << " messages/s, "
+             << published - done << " dropped" << endl;
+    }
+
+    return 0;
+}
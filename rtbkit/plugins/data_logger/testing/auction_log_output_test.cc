@@ -0,0 +1,205 @@
+/* auction_log_output_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests that AuctionLogRow::parse finds its fields in the messages that the
+   router and the post auction loop actually publish.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/plugins/data_logger/auction_log_output.h"
+#include "rtbkit/plugins/data_logger/data_logger.h"
+#include "rtbkit/core/router/router.h"
+#include "rtbkit/core/post_auction/events.h"
+#include "soa/logger/logger.h"
+#include "jml/utils/testing/watchdog.h"
+#include "jml/arch/timers.h"
+#include <mutex>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+const string auctionId = "f4bd4b6e-b91b-11e2-c4cf-7fba90171555";
+
+const string bidRequest =
+    "{\"id\":\"f4bd4b6e-b91b-11e2-c4cf-7fba90171555\",\"timestamp\":1368153863.008756,\"isTest\":false,\"url\":\"http://myonlinearcade.com/\",\"ipAddress\":\"166.13.20.21\",\"exchange\":\"appnexus\",\"provider\":\"appnexus\",\"imp\":[{\"id\":\"1\",\"banner\":{\"w\":728,\"h\":90},\"formats\":[\"728x90\"]}]}";
+
+/** Subscribes to a logger endpoint and logs what it receives like the
+    DataLogger does.
+*/
+struct Capture {
+
+    Capture(std::shared_ptr<ServiceProxies> proxies,
+            const string & endpoint)
+        : subscriber(*proxies->zmqContext)
+    {
+        logger.init();
+        logger.addCallback([&] (string channel, string message)
+                           {
+                               std::unique_lock<std::mutex> guard(lock);
+                               messages.emplace_back(channel, message);
+                           });
+        logger.start();
+
+        subscriber.init(proxies->config);
+        subscriber.messageHandler
+            = [&] (std::vector<zmq::message_t> && message)
+            {
+                DataLogger::forwardMessage(logger, std::move(message));
+            };
+        subscriber.connectToEndpoint(endpoint);
+        subscriber.start();
+        subscriber.subscribe("");
+    }
+
+    ~Capture()
+    {
+        subscriber.shutdown();
+        logger.shutdown();
+    }
+
+    /** Publishers drop what they send before the subscription reaches
+        them, so publish until every channel was received.
+    */
+    void waitFor(const vector<string> & channels,
+                 const std::function<void ()> & publish)
+    {
+        for (;;) {
+            publish();
+            ML::sleep(0.05);
+
+            std::unique_lock<std::mutex> guard(lock);
+            bool done = true;
+            for (auto & channel: channels)
+                done = done && find(channel);
+            if (done)
+                return;
+        }
+    }
+
+    AuctionLogRow parse(const string & channel)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        auto message = find(channel);
+        if (!message)
+            throw ML::Exception("no message on channel " + channel);
+
+        AuctionLogRow row;
+        BOOST_REQUIRE(AuctionLogRow::parse(message->first, message->second,
+                                           row));
+        return row;
+    }
+
+    const pair<string, string> * find(const string & channel) const
+    {
+        for (auto & message: messages)
+            if (message.first == channel)
+                return &message;
+        return nullptr;
+    }
+
+    Logger logger;
+    ZmqNamedSubscriber subscriber;
+    std::mutex lock;
+    vector<pair<string, string> > messages;
+};
+
+FinishedInfo finishedInfo()
+{
+    FinishedInfo info;
+    info.auctionTime = Date::now();
+    info.auctionId = Id(auctionId);
+    info.adSpotId = Id("1");
+    info.spotIndex = 0;
+    info.bidRequestStr = bidRequest;
+    info.bidRequestStrFormat = "datacratic";
+    info.bidTime = Date::now();
+    info.bid.agent = "test_agent";
+    info.bid.account = AccountKey("hello:world");
+    info.setWin(Date::now(), BS_WIN, MicroUSD(1200), MicroUSD(1500), "");
+    return info;
+}
+
+void testRouterMessages(bool binaryLogRecords)
+{
+    auto proxies = std::make_shared<ServiceProxies>();
+    Router router(proxies, "router");
+    router.setBinaryLogRecords(binaryLogRecords);
+    router.logger.init(proxies->config, "router/logger");
+    router.logger.bindTcp();
+    router.logger.start();
+
+    Capture capture(proxies, "router/logger");
+    capture.waitFor({ "AUCTION", "BID" }, [&] ()
+        {
+            router.logMessage("AUCTION", Id(auctionId), bidRequest);
+            router.logMessage("BID", "test_agent", Id(auctionId),
+                              "[{\"price\":\"1000USD/1M\"}]", "{}");
+        });
+
+    AuctionLogRow row = capture.parse("AUCTION");
+    BOOST_CHECK_EQUAL(row.auctionId, auctionId);
+    BOOST_CHECK_EQUAL(row.exchange, "appnexus");
+    BOOST_CHECK(row.timestamp > 0);
+
+    row = capture.parse("BID");
+    BOOST_CHECK_EQUAL(row.auctionId, auctionId);
+    BOOST_CHECK_EQUAL(row.agent, "test_agent");
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_parse_router_messages )
+{
+    ML::Watchdog watchdog(30.0);
+
+    testRouterMessages(false);
+    testRouterMessages(true);
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_post_auction_messages )
+{
+    ML::Watchdog watchdog(30.0);
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    ZmqNamedPublisher publisher(proxies->zmqContext);
+    publisher.init(proxies->config, "postAuction/logger");
+    publisher.bindTcp();
+    publisher.start();
+
+    FinishedInfo info = finishedInfo();
+
+    Capture capture(proxies, "postAuction/logger");
+    capture.waitFor({ "MATCHEDWIN", "MATCHEDCLICK" }, [&] ()
+        {
+            MatchedWinLoss(MatchedWinLoss::Win, MatchedWinLoss::Guaranteed,
+                           info, Date::now(), UserIds()).publish(publisher);
+            MatchedCampaignEvent("CLICK", info).publish(publisher);
+        });
+
+    AuctionLogRow row = capture.parse("MATCHEDWIN");
+    BOOST_CHECK_EQUAL(row.auctionId, auctionId);
+    BOOST_CHECK_EQUAL(row.exchange, "appnexus");
+    BOOST_CHECK_EQUAL(row.agent, "test_agent");
+    BOOST_CHECK_EQUAL(row.account, "hello:world");
+    BOOST_CHECK_EQUAL(row.price, 1200);
+    BOOST_CHECK_EQUAL(row.currency, "USD/1M");
+
+    row = capture.parse("MATCHEDCLICK");
+    BOOST_CHECK_EQUAL(row.auctionId, auctionId);
+    BOOST_CHECK_EQUAL(row.exchange, "appnexus");
+    BOOST_CHECK_EQUAL(row.account, "hello:world");
+    BOOST_CHECK(row.agent.empty());
+    BOOST_CHECK_EQUAL(row.price, 0);
+
+    // Other channels aren't auction events
+    AuctionLogRow other;
+    BOOST_CHECK(!AuctionLogRow::parse("CONFIG", "2014-01-01\tx", other));
+}
@@ -0,0 +1,174 @@
+/* data_logger_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the partitions of the DataLogger.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/plugins/data_logger/data_logger.h"
+#include "soa/logger/log_record.h"
+#include "soa/logger/callback_output.h"
+#include "jml/arch/format.h"
+#include "jml/utils/testing/watchdog.h"
+#include <algorithm>
+#include <mutex>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+BOOST_AUTO_TEST_CASE( test_partition_of )
+{
+    auto proxies = std::make_shared<ServiceProxies>();
+    DataLogger logger("data_logger_test", proxies, false, 65536, 3);
+    logger.unsafeDisableMonitor();
+
+    BOOST_CHECK_EQUAL(logger.numPartitions(), 3);
+
+    // New services go to the least loaded partition
+    BOOST_CHECK_EQUAL(logger.partitionOf("router1"), 0);
+    BOOST_CHECK_EQUAL(logger.partitionOf("router2"), 1);
+    BOOST_CHECK_EQUAL(logger.partitionOf("postAuction"), 2);
+    BOOST_CHECK_EQUAL(logger.partitionOf("adserver"), 0);
+
+    // And stay there
+    for (unsigned i = 0;  i < 10;  ++i) {
+        BOOST_CHECK_EQUAL(logger.partitionOf("router1"), 0);
+        BOOST_CHECK_EQUAL(logger.partitionOf("router2"), 1);
+        BOOST_CHECK_EQUAL(logger.partitionOf("postAuction"), 2);
+        BOOST_CHECK_EQUAL(logger.partitionOf("adserver"), 0);
+    }
+
+    BOOST_CHECK_EQUAL(logger.partitionOf("agent"), 1);
+
+    BOOST_CHECK_EQUAL(&logger.partitionLogger(0), &logger);
+    BOOST_CHECK_THROW(logger.partitionLogger(3), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_forward_message )
+{
+    ML::Watchdog watchdog(10.0);
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    DataLogger logger("data_logger_test", proxies, false, 65536, 2);
+    logger.unsafeDisableMonitor();
+    logger.init();
+
+    // Set up through the base class, which must reach every partition
+    Logger & base = logger;
+
+    std::mutex lock;
+    vector<pair<string, string> > messages;
+    base.addCallback([&] (string channel, string message)
+                     {
+                         std::unique_lock<std::mutex> guard(lock);
+                         messages.emplace_back(channel, message);
+                     });
+    base.start();
+
+    auto send = [&] (unsigned partition, vector<string> parts)
+        {
+            vector<zmq::message_t> msg;
+            for (auto & part: parts)
+                msg.emplace_back(part);
+            DataLogger::forwardMessage(logger.partitionLogger(partition),
+                                       std::move(msg));
+        };
+
+    // Text messages are forwarded as they are
+    send(1, { "AUCTION", "2014-01-01", "hello" });
+
+    // A channel followed by a record is logged as a record
+    string record;
+    LogRecord::init(record, "RECORD");
+    LogRecord::append(record, "a", 1);
+    send(1, { "RECORD", record });
+
+    // Two parts that aren't a record are logged as text
+    send(0, { "TEXT", "not a record" });
+
+    base.waitUntilFinished();
+    BOOST_CHECK_EQUAL(base.numMessagesSent(), 3);
+    BOOST_CHECK_EQUAL(base.numMessagesDone(), 3);
+    BOOST_CHECK_EQUAL(base.getStats()["messagesDone"], 3);
+
+    base.shutdown();
+
+    std::sort(messages.begin(), messages.end());
+    BOOST_REQUIRE_EQUAL(messages.size(), 3);
+    BOOST_CHECK_EQUAL(messages[0].first, "AUCTION");
+    BOOST_CHECK_EQUAL(messages[0].second, "2014-01-01\thello");
+    BOOST_CHECK_EQUAL(messages[1].first, "RECORD");
+    BOOST_CHECK_EQUAL(messages[1].second, "a\t1");
+    BOOST_CHECK_EQUAL(messages[2].first, "TEXT");
+    BOOST_CHECK_EQUAL(messages[2].second, "not a record");
+}
+
+BOOST_AUTO_TEST_CASE( test_outputs_of_partitions )
+{
+    ML::Watchdog watchdog(10.0);
+
+    auto proxies = std::make_shared<ServiceProxies>();
+    DataLogger logger("data_logger_test", proxies, false, 65536, 3);
+    logger.unsafeDisableMonitor();
+    logger.init();
+
+    std::mutex lock;
+    vector<string> shared;
+    vector<unsigned> partitioned;
+
+    logger.addOutput(std::make_shared<CallbackOutput>(
+                             [&] (string channel, string message)
+                             {
+                                 std::unique_lock<std::mutex> guard(lock);
+                                 shared.push_back(channel);
+                             }));
+    logger.addPartitionedOutput([&] (unsigned partition)
+        {
+            return std::make_shared<CallbackOutput>(
+                    [&,partition] (string channel, string message)
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        partitioned.push_back(partition);
+                    });
+        });
+    logger.start();
+
+    auto send = [&] ()
+        {
+            for (unsigned i = 0;  i < logger.numPartitions();  ++i) {
+                vector<zmq::message_t> msg;
+                msg.emplace_back(ML::format("P%d", i));
+                msg.emplace_back(string("hello"));
+                DataLogger::forwardMessage(logger.partitionLogger(i),
+                                           std::move(msg));
+            }
+            logger.waitUntilFinished();
+        };
+
+    // Each partition logs to the shared output and to its own
+    send();
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        std::sort(shared.begin(), shared.end());
+        std::sort(partitioned.begin(), partitioned.end());
+        BOOST_CHECK(shared == vector<string>({ "P0", "P1", "P2" }));
+        BOOST_CHECK(partitioned == vector<unsigned>({ 0, 1, 2 }));
+    }
+
+    // After clearing, none of the partitions log anywhere
+    logger.clearOutputs();
+    send();
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        BOOST_CHECK_EQUAL(shared.size(), 3);
+        BOOST_CHECK_EQUAL(partitioned.size(), 3);
+    }
+
+    logger.shutdown();
+}
@@ -0,0 +1,4 @@
+# data_logger_testing.mk
+
+$(eval $(call test,data_logger_test,data_logger logger services,boost))
+$(eval $(call test,auction_log_output_test,data_logger rtb_router post_auction logger services,boost))
@@ -7,6 +7,7 @@
 
 #include "http_auction_handler.h"
 #include "http_exchange_connector.h"
+#include "rtbkit/common/auction_tracer.h"
 
 #include "jml/arch/exception.h"
 #include "jml/arch/format.h"
@@ -293,6 +294,9 @@ handleHttpPayload(const HttpHeader & header,
         return;
     }
 
+    // The auction id is only known once it's parsed
+    uint64_t receivedTicks = ML::ticks();
+
     if(logger) {
         logger->recordRequest(header, payload);
     }
@@ -405,6 +409,9 @@ handleHttpPayload(const HttpHeader & header,
         auction->requestOriginal = payload;
         endpoint->adjustAuction(auction);
 
+        traceAuctionStage(AS_EXCHANGE_RECEIVE, auction->id, receivedTicks);
+        traceAuctionStage(AS_PARSE, auction->id);
+
 
 #if 0
         static std::mutex lock;
@@ -557,6 +564,8 @@ sendResponse()
     response.extraHeaders
         .push_back({"X-Processing-Time-Ms", to_string(timeTaken)});
 
+    traceAuctionStage(AS_RESPOND, auction->id);
+
     putResponseOnWire(response, onSendFinished);
 }
 
@@ -10,6 +10,7 @@
 #define BOOST_TEST_DYN_LINK
 
 #include "rtbkit/common/augmentation.h"
+#include "rtbkit/common/auction.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -186,3 +187,88 @@ BOOST_FIXTURE_TEST_CASE( test_merge, AugmentationFixture )
 
 }
 
+
+
+BOOST_FIXTURE_TEST_CASE( test_auction_augmentations_for_account, AugmentationFixture )
+{
+    Auction auction;
+
+    AugmentationList & list0 = auction.augmentations["aug0"];
+    list0[AccountKey()] = { { tag0 }, data0 };
+    list0[accBB] = { { tag2 }, data2 };
+
+    AugmentationList & list1 = auction.augmentations["aug1"];
+    list1[accA] = { { tag1 }, data1 };
+
+    auto expected = [&] (const AccountKey & account)
+        {
+            Json::Value result;
+            for (const auto & aug: auction.augmentations)
+                result[aug.first] = aug.second.filterForAccount(account).toJson();
+            return result;
+        };
+
+    vector<AccountKey> accounts = {
+        {}, accA, accBB, accBC, accBBA, { "A", "B" }, { "C" }
+    };
+
+    for (const auto & account: accounts) {
+        const string & encoded = auction.augmentationsForAccount(account);
+        BOOST_CHECK_EQUAL(Json::parse(encoded), expected(account));
+        BOOST_CHECK(encoded.empty() || encoded[encoded.size() - 1] != '\n');
+    }
+
+    // Accounts that match the same prefixes share the same encoding
+    BOOST_CHECK_EQUAL(&auction.augmentationsForAccount(accBB),
+                      &auction.augmentationsForAccount(accBBA));
+    BOOST_CHECK_EQUAL(&auction.augmentationsForAccount(accA),
+                      &auction.augmentationsForAccount({ "A", "B" }));
+    BOOST_CHECK_EQUAL(&auction.augmentationsForAccount(accBC),
+                      &auction.augmentationsForAccount({ "C" }));
+    BOOST_CHECK_NE(&auction.augmentationsForAccount(accA),
+                   &auction.augmentationsForAccount(accBB));
+}
+
+BOOST_AUTO_TEST_CASE( test_augment_message_encoding )
+{
+    Id auctionId("85885bb0-b91b-11e2-c4cf-7fba90171555");
+    string format = "datacratic";
+    string request(300, 'x');
+    request[10] = '\0';
+
+    string payload = AugmentMessage::encodePayload(auctionId, format, request);
+
+    Id decodedId;
+    string decodedFormat, decodedRequest;
+    AugmentMessage::decodePayload(
+            payload, decodedId, decodedFormat, decodedRequest);
+
+    BOOST_CHECK_EQUAL(decodedId, auctionId);
+    BOOST_CHECK_EQUAL(decodedFormat, format);
+    BOOST_CHECK_EQUAL(decodedRequest, request);
+    BOOST_CHECK_EQUAL(AugmentMessage::decodeAuctionId(payload), auctionId);
+
+    BOOST_CHECK_THROW(
+            AugmentMessage::decodePayload(
+                    payload.substr(0, payload.size() - 1),
+                    decodedId, decodedFormat, decodedRequest),
+            ML::Exception);
+
+    vector<string> agents = { "bob", "", string(200, 'a') };
+    vector<string> decodedAgents = { "stale" };
+    AugmentMessage::decodeAgents(
+            AugmentMessage::encodeAgents(agents), decodedAgents);
+    BOOST_CHECK_EQUAL_COLLECTIONS(
+            decodedAgents.begin(), decodedAgents.end(),
+            agents.begin(), agents.end());
+
+    AugmentMessage::decodeAgents(
+            AugmentMessage::encodeAgents({}), decodedAgents);
+    BOOST_CHECK(decodedAgents.empty());
+
+    Date startTime = Date::fromSecondsSinceEpoch(1368153863.008756);
+    BOOST_CHECK_EQUAL(
+            AugmentMessage::decodeStartTime(
+                    AugmentMessage::encodeStartTime(startTime)),
+            startTime);
+}
@@ -0,0 +1,135 @@
+/* bidding_agent_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Measures how many auctions per second a single core of a bidding agent
+   can decode, depending on the bid request format and on whether the
+   agent uses the lazy bid request callback.
+*/
+
+#include "rtbkit/plugins/bidding_agent/bidding_agent.h"
+#include "rtbkit/common/bid_request.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <iostream>
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+const string sampleBr =
+    "{\"id\":\"85885bb0-b91b-11e2-c4cf-7fba90171555\",\"timestamp\":1368153863.008756,\"isTest\":false,\"url\":\"http://myonlinearcade.com/\",\"ipAddress\":\"166.13.20.21\",\"userAgent\":\"Mozilla/5.0 (Windows NT 6.1; WOW64) AppleWebKit/537.31 (KHTML, like Gecko) Chrome/26.0.1410.64 Safari/537.31\",\"language\":\"fr\",\"protocolVersion\":\"0.3\",\"exchange\":\"appnexus\",\"provider\":\"appnexus\",\"location\":{\"countryCode\":\"CA\",\"regionCode\":\"QC\",\"cityName\":\"Laval\",\"postalCode\":\"0\",\"dma\":0,\"timezoneOffsetMinutes\":-1},\"userIds\":{\"an\":\"5273283952213481305\",\"xchg\":\"5273283952213481305\"},\"imp\":[{\"id\":\"156331815539876686\",\"banner\":{\"w\":728,\"h\":90},\"formats\":[\"728x90\"],\"position\":\"ABOVE_FOLD\"},{\"id\":\"156331815539876687\",\"banner\":{\"w\":300,\"h\":250},\"formats\":[\"300x250\"]}],\"segments\":{\"appnexus\":[\"1\",\"2\",\"3\",\"4\",\"5\",\"6\",\"7\",\"8\"]}}";
+
+const string sampleAugmentations =
+    "{\"frequency-cap\":{\"tags\":[\"pass-frequency-cap\"],\"data\":{\"hour\":3,\"day\":12}},\"segments\":{\"tags\":[\"sports\",\"autos\",\"travel\"],\"data\":{\"scores\":[0.1,0.4,0.9,0.2,0.7]}}}";
+
+const string sampleImp =
+    "[{\"spot\":0,\"creatives\":[0,1]},{\"spot\":1,\"creatives\":[2]}]";
+
+const string sampleWcm = "{\"name\":\"none\",\"data\":null}";
+
+vector<string> auctionMessage(const string & format, const string & request)
+{
+    return {
+        "AUCTION", "1368153863.00876", "85885bb0-b91b-11e2-c4cf-7fba90171555",
+        format, request, sampleImp, "50", sampleAugmentations, sampleWcm
+    };
+}
+
+/** Run the given function on the message for the given number of
+    iterations and return the number of auctions per second.
+*/
+template<typename Fn>
+double bench(const vector<string> & msg, size_t iterations, Fn fn)
+{
+    size_t checksum = 0;
+
+    Timer timer;
+    for (size_t i = 0;  i < iterations;  ++i) {
+        auto auction = LazyAuction::parse(msg);
+        checksum += fn(*auction);
+    }
+    double elapsed = timer.elapsed_wall();
+
+    // Keep the work from being optimized out.
+    static volatile size_t sink;
+    sink = checksum;
+
+    return iterations / elapsed;
+}
+
+} // file scope
+
+
+int main(int argc, char ** argv)
+{
+    using namespace boost::program_options;
+
+    size_t iterations = 100000;
+
+    options_description options("Bench options");
+    options.add_options()
+        ("iterations,n", value<size_t>(&iterations),
+         "number of auctions to decode for each case")
+        ("help,h", "print this message");
+
+    variables_map vm;
+    store(command_line_parser(argc, argv).options(options).run(), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        cerr << options << endl;
+        return 1;
+    }
+
+    std::unique_ptr<BidRequest> br(BidRequest::parse("datacratic", sampleBr));
+    string binary = br->serializeToString();
+
+    auto json = auctionMessage("datacratic", sampleBr);
+    auto bin = auctionMessage("datacratic-binary", binary);
+
+    // What the agent pays before onBidRequest is called.
+    auto decodeAll = [] (const LazyAuction & auction) -> size_t
+        {
+            return auction.bidRequest()->imp.size()
+                + auction.augmentations().size();
+        };
+
+    // Agent that only looks at the exchange and the formats.
+    auto decodeRequest = [] (const LazyAuction & auction) -> size_t
+        {
+            const auto & br = *auction.bidRequest();
+            return br.exchange.size() + br.imp.at(0).formats.size();
+        };
+
+    // Agent that decides on the spots alone.
+    auto decodeNothing = [] (const LazyAuction & auction) -> size_t
+        {
+            return auction.bids.size();
+        };
+
+    auto report = [&] (const string & name, double rate)
+        {
+            cerr << ML::format("%-32s %10.0f auctions/s/core", name.c_str(), rate)
+                 << endl;
+        };
+
+    cerr << "json request: " << sampleBr.size() << " bytes, "
+         << "binary request: " << binary.size() << " bytes" << endl;
+
+    report("json, eager", bench(json, iterations, decodeAll));
+    report("binary, eager", bench(bin, iterations, decodeAll));
+    report("json, lazy request only", bench(json, iterations, decodeRequest));
+    report("binary, lazy request only", bench(bin, iterations, decodeRequest));
+    report("lazy, nothing decoded", bench(bin, iterations, decodeNothing));
+
+    return 0;
+}
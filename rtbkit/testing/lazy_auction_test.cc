@@ -0,0 +1,113 @@
+/* lazy_auction_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the decoding of the AUCTION messages in the bidding agent.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "rtbkit/plugins/bidding_agent/bidding_agent.h"
+#include "rtbkit/common/bid_request.h"
+
+using namespace std;
+using namespace Datacratic;
+using namespace RTBKIT;
+
+
+namespace {
+
+const string sampleBr =
+    "{\"id\":\"85885bb0-b91b-11e2-c4cf-7fba90171555\",\"timestamp\":1368153863.008756,\"isTest\":false,\"url\":\"http://myonlinearcade.com/\",\"ipAddress\":\"166.13.20.21\",\"exchange\":\"appnexus\",\"provider\":\"appnexus\",\"imp\":[{\"id\":\"156331815539876686\",\"banner\":{\"w\":728,\"h\":90},\"formats\":[\"728x90\"]},{\"id\":\"156331815539876687\",\"banner\":{\"w\":300,\"h\":250},\"formats\":[\"300x250\"]}]}";
+
+const string sampleAugmentations =
+    "{\"frequency-cap\":{\"tags\":[\"pass-frequency-cap\"],\"data\":{\"hour\":3,\"day\":12}}}";
+
+vector<string> auctionMessage()
+{
+    return {
+        "AUCTION", "1368153863.00876", "85885bb0-b91b-11e2-c4cf-7fba90171555",
+        "datacratic", sampleBr,
+        "[{\"spot\":0,\"creatives\":[0,1]},{\"spot\":1,\"creatives\":[2]}]",
+        "50", sampleAugmentations, "{\"name\":\"none\",\"data\":null}"
+    };
+}
+
+void checkAuction(const LazyAuction & auction)
+{
+    BOOST_CHECK_EQUAL(auction.timestamp, 1368153863.00876);
+    BOOST_CHECK_EQUAL(auction.id, Id("85885bb0-b91b-11e2-c4cf-7fba90171555"));
+    BOOST_CHECK_EQUAL(auction.timeLeftMs, 50.0);
+    BOOST_CHECK_EQUAL(auction.wcm.name, "none");
+
+    BOOST_REQUIRE_EQUAL(auction.bids.size(), 2);
+    BOOST_CHECK_EQUAL(auction.bids[0].spotIndex, 0);
+    BOOST_CHECK_EQUAL(auction.bids[0].availableCreatives.size(), 2);
+    BOOST_CHECK_EQUAL(auction.bids[0].availableCreatives[1], 1);
+    BOOST_CHECK_EQUAL(auction.bids[1].spotIndex, 1);
+    BOOST_REQUIRE_EQUAL(auction.bids[1].availableCreatives.size(), 1);
+    BOOST_CHECK_EQUAL(auction.bids[1].availableCreatives[0], 2);
+
+    BOOST_CHECK_EQUAL(auction.bidRequestSource, "datacratic");
+    BOOST_CHECK_EQUAL(auction.bidRequestStr, sampleBr);
+    BOOST_CHECK_EQUAL(auction.augmentationsStr, sampleAugmentations);
+
+    const auto & br = auction.bidRequest();
+    BOOST_REQUIRE(br);
+    BOOST_CHECK_EQUAL(br->exchange, "appnexus");
+    BOOST_CHECK_EQUAL(br->imp.size(), 2);
+
+    // Decoded once only
+    BOOST_CHECK_EQUAL(auction.bidRequest().get(), br.get());
+
+    const auto & augmentations = auction.augmentations();
+    BOOST_CHECK_EQUAL(augmentations["frequency-cap"]["data"]["day"].asInt(),
+                      12);
+}
+
+} // file scope
+
+BOOST_AUTO_TEST_CASE( test_lazy_auction_copy )
+{
+    const vector<string> msg = auctionMessage();
+    auto auction = LazyAuction::parse(msg);
+    checkAuction(*auction);
+
+    BOOST_CHECK_EQUAL(msg[4], sampleBr);
+    BOOST_CHECK_EQUAL(msg[7], sampleAugmentations);
+}
+
+BOOST_AUTO_TEST_CASE( test_lazy_auction_move )
+{
+    vector<string> msg = auctionMessage();
+    const char * requestData = msg[4].data();
+    const char * augmentationsData = msg[7].data();
+
+    auto auction = LazyAuction::parse(std::move(msg));
+    checkAuction(*auction);
+
+    // The strings were taken out of the message rather than copied
+    BOOST_CHECK_EQUAL((const void *)auction->bidRequestStr.data(),
+                      (const void *)requestData);
+    BOOST_CHECK_EQUAL((const void *)auction->augmentationsStr.data(),
+                      (const void *)augmentationsData);
+}
+
+BOOST_AUTO_TEST_CASE( test_lazy_auction_errors )
+{
+    vector<string> msg = auctionMessage();
+    msg.pop_back();
+    BOOST_CHECK_THROW(LazyAuction::parse(msg), std::exception);
+
+    msg = auctionMessage();
+    msg[6] = "not a number";
+    BOOST_CHECK_THROW(LazyAuction::parse(std::move(msg)), std::exception);
+
+    // The request is only decoded when asked for
+    msg = auctionMessage();
+    msg[4] = "{";
+    auto auction = LazyAuction::parse(std::move(msg));
+    BOOST_CHECK_EQUAL(auction->bids.size(), 2);
+    BOOST_CHECK_THROW(auction->bidRequest(), std::exception);
+}
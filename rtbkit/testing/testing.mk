@@ -26,3 +26,6 @@ $(eval $(call test,creative_configuration_test,rtb_router, boost))
 $(eval $(call test,exchange_parsing_from_file_test,openrtb_bid_request rtb_router openrtb_exchange,boost))
 
 $(eval $(call test,agent_context_switch_test,rtb_router bidding_agent,boost))
+
+$(eval $(call program,bidding_agent_bench,bidding_agent bid_request boost_program_options))
+$(eval $(call test,lazy_auction_test,bidding_agent bid_request,boost))
@@ -14,7 +14,7 @@
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/filesystem.hpp>
 #include "soa/types/periodic_utils.h"
-#include "compressor.h"
+#include "soa/service/compressor.h"
 
 
 namespace Datacratic {
@@ -0,0 +1,539 @@
+/* columnar_file.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Columnar files of typed log records.
+*/
+
+#include "columnar_file.h"
+#include "soa/types/varint.h"
+#include "jml/arch/exception.h"
+#include "jml/utils/lz4.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+namespace {
+
+/** Magic number at the start and the end of the file. */
+const char Magic[8] = { 'R', 'T', 'B', 'C', 'O', 'L', '1', '\0' };
+
+const char * const Data = "columnar data";
+
+/** Bounds checked decoding of the buffers written above. */
+struct Decoder {
+    Decoder(const char * p, const char * e)
+        : p(p), e(e)
+    {
+    }
+
+    uint64_t varint()
+    {
+        return readVarint(p, e, Data);
+    }
+
+    int64_t signedVarint()
+    {
+        return readSignedVarint(p, e, Data);
+    }
+
+    string str()
+    {
+        string result;
+        readVarintString(p, e, result, Data);
+        return result;
+    }
+
+    void bytes(void * data, size_t len)
+    {
+        if (len > size_t(e - p))
+            throw ML::Exception("truncated columnar data");
+        memcpy(data, p, len);
+        p += len;
+    }
+
+    const char * p;
+    const char * e;
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COLUMNAR WRITER                                                           */
+/*****************************************************************************/
+
+ColumnarWriter::
+ColumnarWriter(const std::string & filename,
+               const std::vector<ColumnSpec> & columns,
+               size_t rowGroupSize)
+    : filename_(filename), fd(-1), offset(0),
+      rowGroupSize(rowGroupSize), numRows_(0), groupRows(0),
+      specs(columns), columns(columns.size())
+{
+    if (rowGroupSize == 0)
+        throw ML::Exception("columnar file needs a row group size");
+
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+        throw ML::Exception(errno, "opening columnar file " + filename);
+
+    write(Magic, sizeof(Magic));
+}
+
+ColumnarWriter::
+~ColumnarWriter()
+{
+    try {
+        close();
+    } catch (const std::exception & exc) {
+        cerr << "warning: error closing columnar file " << filename_
+             << ": " << exc.what() << endl;
+    }
+}
+
+void
+ColumnarWriter::
+write(const char * data, size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        ssize_t res = ::write(fd, data + done, len - done);
+        if (res == -1) {
+            if (errno == EINTR) continue;
+            throw ML::Exception(errno, "writing columnar file " + filename_);
+        }
+        done += res;
+    }
+    offset += len;
+}
+
+void
+ColumnarWriter::
+addRow()
+{
+    if (fd == -1)
+        throw ML::Exception("adding a row to a closed columnar file");
+
+    if (groupRows == rowGroupSize)
+        flushRowGroup();
+
+    for (unsigned i = 0;  i < specs.size();  ++i) {
+        Column & column = columns[i];
+        switch (specs[i].type) {
+        case COL_INT64:   column.ints.push_back(0);  break;
+        case COL_DOUBLE:  column.doubles.push_back(0.0);  break;
+        case COL_STRING: {
+            // Index 0 of each dictionary is the empty string
+            if (column.entries.empty()) {
+                column.entries.push_back("");
+                column.dictionary[""] = 0;
+            }
+            column.indices.push_back(0);
+            break;
+        }
+        }
+    }
+
+    ++groupRows;
+    ++numRows_;
+}
+
+ColumnarWriter::Column &
+ColumnarWriter::
+lastRow(unsigned column, ColumnType type)
+{
+    if (column >= specs.size())
+        throw ML::Exception("unknown column %d", column);
+    if (specs[column].type != type)
+        throw ML::Exception("column " + specs[column].name
+                            + " doesn't have that type");
+    if (groupRows == 0)
+        throw ML::Exception("setting a value without a row");
+    return columns[column];
+}
+
+void
+ColumnarWriter::
+setInt(unsigned column, int64_t value)
+{
+    lastRow(column, COL_INT64).ints.back() = value;
+}
+
+void
+ColumnarWriter::
+setDouble(unsigned column, double value)
+{
+    lastRow(column, COL_DOUBLE).doubles.back() = value;
+}
+
+void
+ColumnarWriter::
+setString(unsigned column, const std::string & value)
+{
+    Column & col = lastRow(column, COL_STRING);
+
+    auto it = col.dictionary.find(value);
+    if (it == col.dictionary.end()) {
+        it = col.dictionary.insert(make_pair(value, col.entries.size())).first;
+        col.entries.push_back(value);
+    }
+    col.indices.back() = it->second;
+}
+
+void
+ColumnarWriter::
+flushRowGroup()
+{
+    if (groupRows == 0)
+        return;
+
+    RowGroupInfo info;
+    info.numRows = groupRows;
+
+    string raw, compressed;
+
+    for (unsigned i = 0;  i < specs.size();  ++i) {
+        Column & column = columns[i];
+        ColumnChunk chunk;
+        chunk.minValue = chunk.maxValue = 0;
+
+        raw.clear();
+        switch (specs[i].type) {
+        case COL_INT64: {
+            int64_t last = 0;
+            for (int64_t val: column.ints) {
+                appendSignedVarint(raw, val - last);
+                last = val;
+            }
+            auto minMax = std::minmax_element(column.ints.begin(),
+                                              column.ints.end());
+            chunk.minValue = *minMax.first;
+            chunk.maxValue = *minMax.second;
+            column.ints.clear();
+            break;
+        }
+        case COL_DOUBLE:
+            raw.append((const char *)column.doubles.data(),
+                       column.doubles.size() * sizeof(double));
+            column.doubles.clear();
+            break;
+        case COL_STRING:
+            appendVarint(raw, column.entries.size());
+            for (auto & entry: column.entries)
+                appendVarintString(raw, entry);
+            for (uint32_t index: column.indices)
+                appendVarint(raw, index);
+            column.dictionary.clear();
+            column.entries.clear();
+            column.indices.clear();
+            break;
+        }
+
+        if (raw.size() > size_t(LZ4_MAX_INPUT_SIZE))
+            throw ML::Exception("row group too large for column "
+                                + specs[i].name);
+
+        compressed.resize(LZ4_compressBound(raw.size()));
+        int size = LZ4_compress(raw.data(), &compressed[0], raw.size());
+        if (size <= 0)
+            throw ML::Exception("lz4 compression of column " + specs[i].name
+                                + " failed");
+
+        chunk.offset = offset;
+        chunk.compressedSize = size;
+        chunk.rawSize = raw.size();
+        write(compressed.data(), size);
+
+        info.chunks.push_back(chunk);
+    }
+
+    rowGroups.push_back(std::move(info));
+    groupRows = 0;
+}
+
+void
+ColumnarWriter::
+close()
+{
+    if (fd == -1)
+        return;
+
+    try {
+        flushRowGroup();
+
+        string footer;
+        appendVarint(footer, specs.size());
+        for (auto & spec: specs) {
+            footer.push_back(char(spec.type));
+            appendVarintString(footer, spec.name);
+        }
+
+        appendVarint(footer, rowGroups.size());
+        for (auto & group: rowGroups) {
+            appendVarint(footer, group.numRows);
+            for (auto & chunk: group.chunks) {
+                appendVarint(footer, chunk.offset);
+                appendVarint(footer, chunk.compressedSize);
+                appendVarint(footer, chunk.rawSize);
+                appendSignedVarint(footer, chunk.minValue);
+                appendSignedVarint(footer, chunk.maxValue);
+            }
+        }
+
+        uint64_t footerSize = footer.size();
+        footer.append((const char *)&footerSize, sizeof(footerSize));
+        footer.append(Magic, sizeof(Magic));
+        write(footer.data(), footer.size());
+    } catch (...) {
+        // The file is incomplete; don't try to finish it a second time
+        ::close(fd);
+        fd = -1;
+        throw;
+    }
+
+    int res = ::close(fd);
+    fd = -1;
+    if (res == -1)
+        throw ML::Exception(errno, "closing columnar file " + filename_);
+}
+
+
+/*****************************************************************************/
+/* COLUMNAR READER                                                           */
+/*****************************************************************************/
+
+ColumnarReader::
+ColumnarReader(const std::string & filename)
+    : filename(filename), fd(-1)
+{
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw ML::Exception(errno, "opening columnar file " + filename);
+
+    try {
+        off_t size = lseek(fd, 0, SEEK_END);
+        if (size < off_t(2 * sizeof(Magic) + sizeof(uint64_t)))
+            throw ML::Exception("columnar file " + filename + " is truncated");
+
+        char trailer[sizeof(uint64_t) + sizeof(Magic)];
+        readAt(size - sizeof(trailer), trailer, sizeof(trailer));
+        if (memcmp(trailer + sizeof(uint64_t), Magic, sizeof(Magic)) != 0)
+            throw ML::Exception("columnar file " + filename
+                                + " has no footer; was it closed?");
+
+        uint64_t footerSize;
+        memcpy(&footerSize, trailer, sizeof(footerSize));
+        if (footerSize > uint64_t(size) - sizeof(trailer) - sizeof(Magic))
+            throw ML::Exception("columnar file " + filename
+                                + " has a corrupt footer");
+
+        string footer(footerSize, '\0');
+        readAt(size - sizeof(trailer) - footerSize, &footer[0], footerSize);
+
+        Decoder decoder(footer.data(), footer.data() + footer.size());
+
+        size_t numColumns = decoder.varint();
+        for (unsigned i = 0;  i < numColumns;  ++i) {
+            char type;
+            decoder.bytes(&type, 1);
+            if (type < COL_INT64 || type > COL_STRING)
+                throw ML::Exception("unknown column type %d", type);
+            string name = decoder.str();
+            specs.emplace_back(name, ColumnType(type));
+        }
+
+        size_t numGroups = decoder.varint();
+        rowGroups.resize(numGroups);
+        for (auto & group: rowGroups) {
+            group.numRows = decoder.varint();
+            group.chunks.resize(numColumns);
+            for (auto & chunk: group.chunks) {
+                chunk.offset = decoder.varint();
+                chunk.compressedSize = decoder.varint();
+                chunk.rawSize = decoder.varint();
+                chunk.minValue = decoder.signedVarint();
+                chunk.maxValue = decoder.signedVarint();
+            }
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+ColumnarReader::
+~ColumnarReader()
+{
+    ::close(fd);
+}
+
+void
+ColumnarReader::
+readAt(uint64_t offset, char * data, size_t len) const
+{
+    while (len > 0) {
+        ssize_t res = ::pread(fd, data, len, offset);
+        if (res == -1) {
+            if (errno == EINTR) continue;
+            throw ML::Exception(errno, "reading columnar file " + filename);
+        }
+        if (res == 0)
+            throw ML::Exception("columnar file " + filename + " is truncated");
+        data += res;
+        len -= res;
+        offset += res;
+    }
+}
+
+int
+ColumnarReader::
+columnIndex(const std::string & name) const
+{
+    for (unsigned i = 0;  i < specs.size();  ++i)
+        if (specs[i].name == name)
+            return i;
+    return -1;
+}
+
+uint64_t
+ColumnarReader::
+numRows() const
+{
+    uint64_t result = 0;
+    for (auto & group: rowGroups)
+        result += group.numRows;
+    return result;
+}
+
+ColumnarRowGroup
+ColumnarReader::
+read(size_t index, const std::vector<int> & columns) const
+{
+    const RowGroupInfo & info = rowGroups.at(index);
+
+    ColumnarRowGroup result;
+    result.index = index;
+    result.numRows = info.numRows;
+    result.columns.resize(specs.size());
+
+    vector<int> toLoad = columns;
+    if (toLoad.empty()) {
+        for (unsigned i = 0;  i < specs.size();  ++i)
+            toLoad.push_back(i);
+    }
+
+    string compressed, raw;
+
+    for (int i: toLoad) {
+        if (i < 0 || i >= specs.size())
+            throw ML::Exception("unknown column %d", i);
+
+        const ColumnChunk & chunk = info.chunks[i];
+        ColumnarRowGroup::Column & column = result.columns[i];
+        column.type = specs[i].type;
+        column.loaded = true;
+
+        compressed.resize(chunk.compressedSize);
+        readAt(chunk.offset, &compressed[0], chunk.compressedSize);
+
+        raw.resize(chunk.rawSize);
+        int size = LZ4_decompress_safe(compressed.data(), &raw[0],
+                                       chunk.compressedSize, chunk.rawSize);
+        if (size < 0 || size != chunk.rawSize)
+            throw ML::Exception("corrupt column " + specs[i].name
+                                + " in " + filename);
+
+        Decoder decoder(raw.data(), raw.data() + raw.size());
+
+        switch (column.type) {
+        case COL_INT64: {
+            column.ints.resize(info.numRows);
+            int64_t last = 0;
+            for (auto & val: column.ints)
+                val = last += decoder.signedVarint();
+            break;
+        }
+        case COL_DOUBLE:
+            column.doubles.resize(info.numRows);
+            decoder.bytes(column.doubles.data(),
+                          info.numRows * sizeof(double));
+            break;
+        case COL_STRING: {
+            column.dictionary.resize(decoder.varint());
+            for (auto & entry: column.dictionary)
+                entry = decoder.str();
+            column.indices.resize(info.numRows);
+            for (auto & index: column.indices) {
+                index = decoder.varint();
+                if (index >= column.dictionary.size())
+                    throw ML::Exception("corrupt column " + specs[i].name
+                                        + " in " + filename);
+            }
+            break;
+        }
+        }
+    }
+
+    return result;
+}
+
+void
+ColumnarReader::
+forEachRowGroup(const OnRowGroup & onRowGroup,
+                int numThreads,
+                const std::vector<int> & columns,
+                const RowGroupFilter & filter) const
+{
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorLock;
+
+    auto runThread = [&] ()
+        {
+            for (;;) {
+                size_t index = next++;
+                if (index >= rowGroups.size())
+                    return;
+
+                try {
+                    if (filter && !filter(rowGroups[index]))
+                        continue;
+                    onRowGroup(read(index, columns));
+                } catch (...) {
+                    std::unique_lock<std::mutex> guard(errorLock);
+                    if (!error)
+                        error = std::current_exception();
+                    next = rowGroups.size();
+                }
+            }
+        };
+
+    numThreads = std::max(1, std::min<int>(numThreads, rowGroups.size()));
+
+    vector<std::thread> threads;
+    for (int i = 1;  i < numThreads;  ++i)
+        threads.emplace_back(runThread);
+    runThread();
+
+    for (auto & thread: threads)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+} // namespace Datacratic
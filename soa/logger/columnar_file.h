@@ -0,0 +1,223 @@
+/* columnar_file.h                                                 -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Columnar files of typed log records, split in independently compressed
+   row groups.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+enum ColumnType {
+    COL_INT64,      ///< Signed integers, delta encoded
+    COL_DOUBLE,     ///< Doubles, stored as is
+    COL_STRING      ///< Strings, dictionary encoded per row group
+};
+
+struct ColumnSpec {
+    ColumnSpec(const std::string & name = "", ColumnType type = COL_STRING)
+        : name(name), type(type)
+    {
+    }
+
+    std::string name;
+    ColumnType type;
+};
+
+/** Where a column of a row group is stored in the file. */
+struct ColumnChunk {
+    uint64_t offset;
+    uint32_t compressedSize;
+    uint32_t rawSize;
+    int64_t minValue;       ///< Smallest value of an integer column
+    int64_t maxValue;       ///< Largest value of an integer column
+};
+
+/** Entry of the index of the row groups in the footer of the file. */
+struct RowGroupInfo {
+    uint64_t numRows;
+    std::vector<ColumnChunk> chunks;
+};
+
+
+/*****************************************************************************/
+/* COLUMNAR WRITER                                                           */
+/*****************************************************************************/
+
+/** Writes a columnar file.
+
+    The rows are buffered by column until there are rowGroupSize of them,
+    at which point each column is encoded and compressed with lz4 on its
+    own.  The footer, written by close(), holds the schema and the index of
+    the row groups, with the range of values of the integer columns, so
+    that a reader can skip the row groups that it doesn't need and decode
+    the others in parallel.
+
+    A file that wasn't closed has no footer and can't be read.
+*/
+
+struct ColumnarWriter {
+
+    ColumnarWriter(const std::string & filename,
+                   const std::vector<ColumnSpec> & columns,
+                   size_t rowGroupSize = 65536);
+
+    ~ColumnarWriter();
+
+    /** Add a row where each column is 0 or empty until set. */
+    void addRow();
+
+    void setInt(unsigned column, int64_t value);
+    void setDouble(unsigned column, double value);
+    void setString(unsigned column, const std::string & value);
+
+    /** Write the pending rows and the footer, and close the file. */
+    void close();
+
+    const std::string & filename() const { return filename_; }
+
+    size_t numRows() const { return numRows_; }
+
+private:
+    /** Values of a column for the rows of the current row group. */
+    struct Column {
+        std::vector<int64_t> ints;
+        std::vector<double> doubles;
+        std::unordered_map<std::string, uint32_t> dictionary;
+        std::vector<std::string> entries;
+        std::vector<uint32_t> indices;
+    };
+
+    std::string filename_;
+    int fd;
+    uint64_t offset;
+    size_t rowGroupSize;
+    size_t numRows_;
+    size_t groupRows;
+
+    std::vector<ColumnSpec> specs;
+    std::vector<Column> columns;
+    std::vector<RowGroupInfo> rowGroups;
+
+    Column & lastRow(unsigned column, ColumnType type);
+    void flushRowGroup();
+    void write(const char * data, size_t len);
+};
+
+
+/*****************************************************************************/
+/* COLUMNAR ROW GROUP                                                        */
+/*****************************************************************************/
+
+/** Decoded columns of a row group.  Only the columns that were asked for
+    are loaded.
+*/
+
+struct ColumnarRowGroup {
+
+    struct Column {
+        Column()
+            : type(COL_STRING), loaded(false)
+        {
+        }
+
+        ColumnType type;
+        bool loaded;
+        std::vector<int64_t> ints;
+        std::vector<double> doubles;
+        std::vector<std::string> dictionary;
+        std::vector<uint32_t> indices;
+    };
+
+    size_t index;           ///< Number of the row group in its file
+    size_t numRows;
+    std::vector<Column> columns;
+
+    int64_t getInt(unsigned column, size_t row) const
+    {
+        return columns[column].ints[row];
+    }
+
+    double getDouble(unsigned column, size_t row) const
+    {
+        return columns[column].doubles[row];
+    }
+
+    const std::string & getString(unsigned column, size_t row) const
+    {
+        const Column & col = columns[column];
+        return col.dictionary[col.indices[row]];
+    }
+};
+
+
+/*****************************************************************************/
+/* COLUMNAR READER                                                           */
+/*****************************************************************************/
+
+/** Reads a columnar file.  All of the methods are const and can be called
+    from several threads at once.
+*/
+
+struct ColumnarReader {
+
+    ColumnarReader(const std::string & filename);
+
+    ~ColumnarReader();
+
+    const std::vector<ColumnSpec> & columns() const { return specs; }
+
+    /** Index of the column with the given name, or -1. */
+    int columnIndex(const std::string & name) const;
+
+    uint64_t numRows() const;
+
+    size_t numRowGroups() const { return rowGroups.size(); }
+
+    const RowGroupInfo & rowGroup(size_t index) const
+    {
+        return rowGroups.at(index);
+    }
+
+    /** Decode the given columns of a row group; all of them if the list is
+        empty.
+    */
+    ColumnarRowGroup read(size_t index,
+                          const std::vector<int> & columns
+                              = std::vector<int>()) const;
+
+    typedef std::function<bool (const RowGroupInfo &)> RowGroupFilter;
+    typedef std::function<void (const ColumnarRowGroup &)> OnRowGroup;
+
+    /** Decode the given columns of each row group that passes the filter,
+        on numThreads threads, and call onRowGroup with them.  onRowGroup is
+        called from several threads at once, in no particular order.
+    */
+    void forEachRowGroup(const OnRowGroup & onRowGroup,
+                         int numThreads,
+                         const std::vector<int> & columns
+                             = std::vector<int>(),
+                         const RowGroupFilter & filter
+                             = RowGroupFilter()) const;
+
+private:
+    std::string filename;
+    int fd;
+
+    std::vector<ColumnSpec> specs;
+    std::vector<RowGroupInfo> rowGroups;
+
+    void readAt(uint64_t offset, char * data, size_t len) const;
+};
+
+} // namespace Datacratic
@@ -7,6 +7,9 @@
 
 #include "compressing_output.h"
 #include "jml/utils/parse_context.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 
 using namespace std;
@@ -143,8 +146,10 @@ runLogThread()
         bool found = ringBuffer.tryPop(msg, 0.5);
         duty.notifyAfterSleep();
 
-        if (!found)
+        if (!found) {
+            implementIdle();
             continue;
+        }
 
         switch (msg.type) {
 
@@ -175,6 +180,74 @@ runLogThread()
 }
 
 
+/*****************************************************************************/
+/* BLOCK POOL                                                                */
+/*****************************************************************************/
+
+/** Threads compressing the blocks of a CompressingOutput. */
+
+struct CompressingOutput::BlockPool {
+
+    BlockPool(int numThreads)
+        : numThreads(numThreads), shutdown(false)
+    {
+        for (int i = 0;  i < numThreads;  ++i)
+            threads.emplace_back([=] () { this->runThread(); });
+    }
+
+    ~BlockPool()
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            shutdown = true;
+        }
+        cond.notify_all();
+
+        for (auto & thread: threads)
+            thread.join();
+    }
+
+    std::future<std::string> submit(const std::function<std::string ()> & fn)
+    {
+        std::packaged_task<std::string ()> task(fn);
+        std::future<std::string> result = task.get_future();
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            tasks.push_back(std::move(task));
+        }
+        cond.notify_one();
+        return result;
+    }
+
+    void runThread()
+    {
+        for (;;) {
+            std::packaged_task<std::string ()> task;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                cond.wait(guard, [&] () { return shutdown || !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            // Exceptions end up in the future
+            task();
+        }
+    }
+
+    int numThreads;
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<std::packaged_task<std::string ()> > tasks;
+    bool shutdown;
+
+    std::vector<std::thread> threads;
+};
+
+
 /*****************************************************************************/
 /* COMPRESSING OUTPUT                                                        */
 /*****************************************************************************/
@@ -187,7 +260,9 @@ CompressingOutput::
 CompressingOutput(size_t ringBufferSize,
                   Compressor::FlushLevel flushLevel)
     : WorkerThreadOutput(ringBufferSize),
-      compressorFlushLevel(flushLevel)
+      compressorFlushLevel(flushLevel),
+      blockSize(4 * 1024 * 1024),
+      maxBlockAge(1.0)
 {
 }
 
@@ -196,16 +271,58 @@ CompressingOutput::
 {
 }
 
+std::shared_ptr<CompressingOutput::BlockPool>
+CompressingOutput::
+createBlockPool(int numThreads)
+{
+    if (numThreads <= 0)
+        return nullptr;
+    return std::make_shared<BlockPool>(numThreads);
+}
+
+void
+CompressingOutput::
+setParallelCompression(int numThreads,
+                       size_t blockSize,
+                       double maxBlockAge)
+{
+    setParallelCompression(createBlockPool(numThreads), blockSize,
+                           maxBlockAge);
+}
+
+void
+CompressingOutput::
+setParallelCompression(std::shared_ptr<BlockPool> pool,
+                       size_t blockSize,
+                       double maxBlockAge)
+{
+    if (compressor || blockCompressor)
+        throw ML::Exception("parallel compression must be set up before "
+                            "opening the compressor");
+    if (pool && blockSize == 0)
+        throw ML::Exception("parallel compression needs a block size");
+
+    blockPool = std::move(pool);
+    this->blockSize = blockSize;
+    this->maxBlockAge = maxBlockAge;
+}
+
 void
 CompressingOutput::
 open(std::shared_ptr<Sink> sink,
      const std::string & compression,
      int compressionLevel)
 {
-    if (compressor)
+    if (compressor || blockCompressor)
         throw ML::Exception("can't open compressor without closing the "
                             "previous one");
-    compressor.reset(Compressor::create(compression, compressionLevel));
+
+    if (blockPool && BlockCompressor::supports(compression)) {
+        blockCompressor.reset(BlockCompressor::create(compression,
+                                                      compressionLevel));
+        block.reserve(blockSize);
+    }
+    else compressor.reset(Compressor::create(compression, compressionLevel));
 
     this->sink = sink;
 
@@ -219,23 +336,100 @@ void
 CompressingOutput::
 closeCompressor()
 {
+    if (blockCompressor) {
+        cutBlock();
+        writeBlocks(0);
+        blockCompressor.reset();
+        return;
+    }
+
     if (!compressor)
         return;
     compressor->finish(onData);
     compressor.reset();
 }
 
+void
+CompressingOutput::
+cutBlock()
+{
+    if (block.empty())
+        return;
+
+    auto data = std::make_shared<std::string>();
+    data->swap(block);
+    block.reserve(blockSize);
+
+    std::shared_ptr<BlockCompressor> compressor = blockCompressor;
+
+    auto compressBlock = [=] ()
+        {
+            std::string result;
+            compressor->compressBlock(data->data(), data->size(), result);
+            return result;
+        };
+
+    pendingBlocks.push_back(blockPool->submit(compressBlock));
+
+    // Don't let the blocks pile up if the pool can't keep up
+    writeBlocks(2 * blockPool->numThreads);
+}
+
+void
+CompressingOutput::
+writeBlocks(size_t maxPending)
+{
+    while (!pendingBlocks.empty()) {
+        std::future<std::string> & next = pendingBlocks.front();
+
+        if (pendingBlocks.size() <= maxPending
+            && next.wait_for(std::chrono::seconds(0))
+               != std::future_status::ready)
+            break;
+
+        // Rethrows the exception if the compression failed
+        std::string data = next.get();
+        pendingBlocks.pop_front();
+
+        size_t done = 0;
+        while (done < data.size()) {
+            size_t written = onData(data.data() + done, data.size() - done);
+            if (written == 0)
+                throw ML::Exception("sink of %s is stuck",
+                                    sink->currentUri.c_str());
+            done += written;
+        }
+    }
+}
+
 void
 CompressingOutput::
 implementLogMessage(const std::string & channel,
                     const std::string & message)
 {
-    if (!compressor)
+    if (!compressor && !blockCompressor)
         throw ML::Exception("implementLogMessage without compressor");
 
     if (onFileWrite) 
         onFileWrite(channel, channel.size() + message.size() + 2);
 
+    if (blockCompressor) {
+        if (block.empty())
+            blockStarted = Date::now();
+
+        block.append(channel);
+        block.push_back('\t');
+        block.append(message);
+        block.push_back('\n');
+
+        if (block.size() >= blockSize
+            || Date::now().secondsSince(blockStarted) >= maxBlockAge)
+            cutBlock();
+        else writeBlocks(2 * blockPool->numThreads);
+
+        return;
+    }
+
     char buf[channel.size() + message.size() + 2];
     memcpy(buf, channel.c_str(), channel.size());
     buf[channel.size()] = '\t';
@@ -249,4 +443,17 @@ implementLogMessage(const std::string & channel,
     compressor->flush(compressorFlushLevel, onData);
 }
 
+void
+CompressingOutput::
+implementIdle()
+{
+    if (!blockCompressor)
+        return;
+
+    if (!block.empty()
+        && Date::now().secondsSince(blockStarted) >= maxBlockAge)
+        cutBlock();
+    else writeBlocks(2 * blockPool->numThreads);
+}
+
 } // namespace Datacratic
@@ -8,9 +8,12 @@
 #define __logger__compressing_output_h__
 
 #include "logger.h"
-#include "compressor.h"
+#include "soa/service/compressor.h"
 #include "jml/utils/ring_buffer.h"
 #include "jml/arch/timers.h"
+#include "soa/types/date.h"
+#include <deque>
+#include <future>
 
 
 namespace Datacratic {
@@ -73,6 +76,11 @@ protected:
     virtual void implementLogMessage(const std::string & channel,
                                      const std::string & message) = 0;
 
+    /** Called in the worker thread when no message arrived for a while. */
+    virtual void implementIdle()
+    {
+    }
+
     /// Thread to do the logging
     boost::scoped_ptr<boost::thread> logThread;
 
@@ -130,6 +138,36 @@ struct CompressingOutput : public WorkerThreadOutput {
 
     void closeCompressor();
 
+    /** Compress the stream in independent blocks of blockSize bytes, on a
+        pool of numThreads threads, instead of in the worker thread.  The
+        blocks are written in order as they finish, so that the output is
+        still a valid gzip, xz or lz4 file.
+
+        A block is cut once it's full, or when a message arrives or the
+        worker thread is idle and the block is older than maxBlockAge
+        seconds; this bounds how much data a crash can lose.
+
+        Only compressions for which BlockCompressor::supports() is true
+        are done in blocks; the others stay serial.  Must be called before
+        open().
+    */
+    void setParallelCompression(int numThreads,
+                                size_t blockSize = 4 * 1024 * 1024,
+                                double maxBlockAge = 1.0);
+
+    /// Pool of threads compressing the blocks, if compressing in parallel
+    struct BlockPool;
+
+    static std::shared_ptr<BlockPool> createBlockPool(int numThreads);
+
+    /** Same as above, but compressing on the given pool, which can be
+        shared between outputs (eg the successive files of a rotating
+        output).  A null pool makes the compression serial.
+    */
+    void setParallelCompression(std::shared_ptr<BlockPool> pool,
+                                size_t blockSize = 4 * 1024 * 1024,
+                                double maxBlockAge = 1.0);
+
     boost::function<void (std::string, std::size_t)> onFileWrite;
 
 protected:
@@ -138,10 +176,32 @@ protected:
     std::shared_ptr<Compressor> compressor;
     std::function<size_t (const char *, size_t)> onData;
 
+    std::shared_ptr<BlockPool> blockPool;
+    std::shared_ptr<BlockCompressor> blockCompressor;
+    size_t blockSize;
+    double maxBlockAge;
+
+    /// Block being filled, and when its first message was written
+    std::string block;
+    Date blockStarted;
+
+    /// Blocks being compressed, in the order in which to write them
+    std::deque<std::future<std::string> > pendingBlocks;
+
+    /** Hand the current block over to the pool. */
+    void cutBlock();
+
+    /** Write the compressed blocks that are ready, in order, waiting for
+        the oldest ones while more than maxPending are left.
+    */
+    void writeBlocks(size_t maxPending);
+
     // Overrides
 
     virtual void implementLogMessage(const std::string & channel,
                                      const std::string & message);
+
+    virtual void implementIdle();
 };
 
 
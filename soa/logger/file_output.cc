@@ -291,7 +291,9 @@ RotatingFileOutput::
 RotatingFileOutput()
     : RotatingOutputAdaptor(std::bind(&RotatingFileOutput::createFile,
                                       this,
-                                      std::placeholders::_1))
+                                      std::placeholders::_1)),
+      compressionBlockSize(4 * 1024 * 1024),
+      maxBlockAge(1.0)
 {
 }
 
@@ -314,6 +316,18 @@ open(const std::string & filenamePattern,
     RotatingOutputAdaptor::open(filenamePattern, periodPattern);
 }
 
+void
+RotatingFileOutput::
+setParallelCompression(int numThreads,
+                       size_t blockSize,
+                       double maxBlockAge)
+{
+    // All of the files share the same threads
+    compressionPool = CompressingOutput::createBlockPool(numThreads);
+    this->compressionBlockSize = blockSize;
+    this->maxBlockAge = maxBlockAge;
+}
+
 FileOutput *
 RotatingFileOutput::
 createFile(const std::string & filename)
@@ -331,6 +345,10 @@ createFile(const std::string & filename)
     result->onFileWrite = [=] (const string& channel, const std::size_t bytes)
 	{ if (this->onFileWrite) this->onFileWrite(channel, bytes); };
 
+    if (compressionPool)
+        result->setParallelCompression(compressionPool,
+                                       compressionBlockSize, maxBlockAge);
+
     result->open(filename, compression, level);
 
     return result.release();
@@ -136,12 +136,23 @@ struct RotatingFileOutput : public RotatingOutputAdaptor {
               const std::string & periodPattern,
               const std::string & compression = "",
               int level = -1);
+
+    /** Compress each of the files in parallel blocks.  See
+        CompressingOutput::setParallelCompression().
+    */
+    void setParallelCompression(int numThreads,
+                                size_t blockSize = 4 * 1024 * 1024,
+                                double maxBlockAge = 1.0);
     
 private:
     FileOutput * createFile(const std::string & filename);
 
     std::string compression;
     int level;
+
+    std::shared_ptr<CompressingOutput::BlockPool> compressionPool;
+    size_t compressionBlockSize;
+    double maxBlockAge;
 };
 
 } // namespace Datacratic
@@ -0,0 +1,100 @@
+/* log_record.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Binary encoding of log messages.
+*/
+
+#include "log_record.h"
+#include "jml/arch/format.h"
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* LOG RECORD                                                                */
+/*****************************************************************************/
+
+namespace {
+
+const char * const Record = "log record";
+
+uint64_t readFixed(const char * & p, const char * e)
+{
+    if (e - p < 8)
+        throw ML::Exception("truncated log record");
+    uint64_t result;
+    memcpy(&result, p, 8);
+    p += 8;
+    return result;
+}
+
+void appendDate(string & text, int64_t micros)
+{
+    text += Date::fromSecondsSinceEpoch(micros / 1000000.0).print(5);
+}
+
+} // file scope
+
+void
+LogRecord::
+format(const char * data, size_t len,
+       std::string & channel, std::string & text)
+{
+    if (!isRecord(data, len))
+        throw ML::Exception("not a log record");
+
+    const char * p = data + 2, * e = data + len;
+    int flags = *p++;
+
+    readVarintString(p, e, channel, Record);
+
+    text.clear();
+    bool first = true;
+
+    if (flags & HasTimestamp) {
+        appendDate(text, readFixed(p, e));
+        first = false;
+    }
+
+    while (p != e) {
+        if (!first) text += '\t';
+        first = false;
+
+        char tag = *p++;
+        switch (tag) {
+        case 's': {
+            uint64_t size = readVarint(p, e, Record);
+            if (size > uint64_t(e - p))
+                throw ML::Exception("truncated log record");
+            text.append(p, size);
+            p += size;
+            break;
+        }
+        case 'i':
+            text += to_string(readSignedVarint(p, e, Record));
+            break;
+        case 'u':
+            text += to_string(readVarint(p, e, Record));
+            break;
+        case 'd': {
+            uint64_t bits = readFixed(p, e);
+            double val;
+            memcpy(&val, &bits, sizeof(val));
+            text += ML::format("%f", val);
+            break;
+        }
+        case 't':
+            // Same as encodeMessage(Date) for messages sent as text
+            text += ML::format("%.5f", int64_t(readFixed(p, e)) / 1000000.0);
+            break;
+        default:
+            throw ML::Exception("unknown log record field type %d", tag);
+        }
+    }
+}
+
+} // namespace Datacratic
@@ -0,0 +1,204 @@
+/* log_record.h                                                    -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Binary encoding of log messages.
+*/
+
+#pragma once
+
+#include "soa/types/date.h"
+#include "soa/jsoncpp/value.h"
+#include "soa/types/varint.h"
+#include "jml/arch/exception.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* LOG RECORD                                                                */
+/*****************************************************************************/
+
+/** Log message serialized in binary form, so that it can be written by the
+    thread that logs without any text formatting.  The text line that the
+    outputs see is only produced by format(), in the logging thread or
+    offline.
+
+    A record is a zero byte (which can't appear in a text message), a
+    version byte, a flags byte, the varint length of the channel and the
+    channel, the timestamp in microseconds since the epoch as 8 bytes if
+    the record has one, and then the fields.  Each field is a one byte tag
+    followed by its value:
+
+    - 's': varint length and bytes of a string;
+    - 'i': zigzag varint of a signed integer;
+    - 'u': varint of an unsigned integer;
+    - 'd': the 8 bytes of a double;
+    - 't': a date, as 8 bytes of microseconds since the epoch.  It's
+      formatted as seconds since the epoch, like encodeMessage() does for
+      the dates of zeromq messages; the timestamp of the header is
+      formatted like Date::print(5) instead.
+
+    Appending to a string whose capacity is large enough doesn't allocate.
+    Writing records only needs this header; decoding them needs the logger
+    library.
+*/
+
+struct LogRecord {
+
+    enum {
+        Version = 1,
+        HasTimestamp = 1
+    };
+
+    /** Start a record for the given channel, clearing the buffer. */
+    static void init(std::string & record, const std::string & channel)
+    {
+        record.clear();
+        record.push_back('\0');
+        record.push_back(char(Version));
+        record.push_back('\0');
+        appendVarint(record, channel.size());
+        record.append(channel);
+    }
+
+    /** Start a record for the given channel, timestamped with the given
+        date, clearing the buffer.
+    */
+    static void init(std::string & record, const std::string & channel,
+                     Date timestamp)
+    {
+        init(record, channel);
+        record[2] = char(HasTimestamp);
+        appendFixed(record, toMicros(timestamp));
+    }
+
+    /** Is the given message a binary record? */
+    static bool isRecord(const char * data, size_t len)
+    {
+        return len >= 3 && data[0] == '\0' && data[1] == char(Version);
+    }
+
+    static void append(std::string & record)
+    {
+    }
+
+    template<typename Head, typename... Tail>
+    static void append(std::string & record,
+                       const Head & head, const Tail & ... tail)
+    {
+        appendField(record, head);
+        append(record, tail...);
+    }
+
+    static void appendField(std::string & record, const std::string & field)
+    {
+        appendString(record, field.data(), field.size());
+    }
+
+    static void appendField(std::string & record, const char * field)
+    {
+        appendString(record, field, std::strlen(field));
+    }
+
+    static void appendField(std::string & record, Date field)
+    {
+        record.push_back('t');
+        appendFixed(record, toMicros(field));
+    }
+
+    static void appendField(std::string & record, double field)
+    {
+        record.push_back('d');
+        uint64_t bits;
+        std::memcpy(&bits, &field, sizeof(bits));
+        appendFixed(record, bits);
+    }
+
+    static void appendField(std::string & record, float field)
+    {
+        appendField(record, double(field));
+    }
+
+    template<typename T>
+    static void appendField(std::string & record, const T & field,
+                            typename std::enable_if<std::is_integral<T>::value
+                                                    && std::is_signed<T>::value>::type * = 0)
+    {
+        record.push_back('i');
+        int64_t val = field;
+        appendSignedVarint(record, val);
+    }
+
+    template<typename T>
+    static void appendField(std::string & record, const T & field,
+                            typename std::enable_if<std::is_integral<T>::value
+                                                    && !std::is_signed<T>::value>::type * = 0)
+    {
+        record.push_back('u');
+        appendVarint(record, field);
+    }
+
+    /** Vectors of strings give one field per element, like they do when
+        they are published.
+    */
+    static void appendField(std::string & record,
+                            const std::vector<std::string> & fields)
+    {
+        for (auto & field: fields)
+            appendField(record, field);
+    }
+
+    static void appendField(std::string & record, const Json::Value & field)
+    {
+        // toString() finishes with a newline
+        std::string str = field.toString();
+        while (!str.empty() && str[str.size() - 1] == '\n')
+            str.erase(str.size() - 1);
+        appendField(record, str);
+    }
+
+    /** Anything else that knows how to print itself, such as an Id. */
+    template<typename T>
+    static auto appendField(std::string & record, const T & field)
+        -> decltype(field.toString(), void())
+    {
+        appendField(record, field.toString());
+    }
+
+    /** Decode the record into its channel and the tab separated text of its
+        timestamp and fields, as the Logger would have produced from the
+        same message.  Throws if the record is malformed.
+    */
+    static void format(const char * data, size_t len,
+                       std::string & channel, std::string & text);
+
+private:
+    static int64_t toMicros(Date date)
+    {
+        return int64_t(date.secondsSinceEpoch() * 1000000.0);
+    }
+
+    static void appendFixed(std::string & record, uint64_t val)
+    {
+        char bytes[8];
+        std::memcpy(bytes, &val, 8);
+        record.append(bytes, 8);
+    }
+
+    static void appendString(std::string & record,
+                             const char * data, size_t len)
+    {
+        record.push_back('s');
+        appendVarint(record, len);
+        record.append(data, len);
+    }
+};
+
+} // namespace Datacratic
@@ -42,6 +42,18 @@ clearStats()
 }
 
 
+namespace {
+
+ML::Thread_Specific<std::string> recordScratches;
+
+/** Slots that grew past this are freed once their record is logged, so
+    that a few large records don't pin memory in every slot.
+*/
+enum { MaxSlotCapacity = 1024 };
+
+} // file scope
+
+
 /*****************************************************************************/
 /* LOGGER                                                                    */
 /*****************************************************************************/
@@ -51,9 +63,10 @@ Logger(size_t bufferSize)
     : context(std::make_shared<zmq::context_t>(1)),
       messages(bufferSize),
       outputs(0),
-      messagesSent(0), messagesDone(0)
+      messagesSent(0), messagesDone(0), recordsMalformed(0)
 {
     doShutdown = false;
+    recordBufferCapacity = 16384;
 }
 
 Logger::
@@ -61,9 +74,10 @@ Logger(zmq::context_t & contextRef, size_t bufferSize)
     : context(ML::make_unowned_std_sp(contextRef)),
       messages(bufferSize),
       outputs(0),
-      messagesSent(0), messagesDone(0)
+      messagesSent(0), messagesDone(0), recordsMalformed(0)
 {
     doShutdown = false;
+    recordBufferCapacity = 16384;
 }
 
 Logger::
@@ -71,9 +85,10 @@ Logger(std::shared_ptr<zmq::context_t> & context, size_t bufferSize)
     : context(context),
       messages(bufferSize),
       outputs(0),
-      messagesSent(0), messagesDone(0)
+      messagesSent(0), messagesDone(0), recordsMalformed(0)
 {
     doShutdown = false;
+    recordBufferCapacity = 16384;
 }
 
 Logger::
@@ -93,6 +108,34 @@ init()
     };
 
     messageLoop.addSource("Logger::messages", messages);
+
+    messageLoop.addPeriodic("Logger::records", 0.005,
+                            [=] (uint64_t) { this->drainRecords(); });
+}
+
+std::string &
+Logger::
+recordScratch()
+{
+    return *recordScratches;
+}
+
+void
+Logger::
+logRecord(const char * data, size_t len)
+{
+    if (!outputs) return;
+
+    auto fill = [&] (std::string & slot) { slot.assign(data, len); };
+    if (recordBuffers.local(recordBufferCapacity).push(fill))
+        ML::atomic_add(messagesSent, 1);
+}
+
+uint64_t
+Logger::
+numRecordsDropped() const
+{
+    return recordBuffers.numDropped();
 }
 
 void
@@ -331,6 +374,18 @@ waitUntilFinished()
     //     << messagesDone << endl;
 }
 
+std::map<std::string, size_t>
+Logger::
+getStats()
+{
+    std::map<std::string, size_t> result;
+    result["messagesSent"] = messagesSent;
+    result["messagesDone"] = messagesDone;
+    result["recordsDropped"] = numRecordsDropped();
+    result["recordsMalformed"] = recordsMalformed;
+    return result;
+}
+
 void
 Logger::
 shutdown()
@@ -400,6 +455,41 @@ replayDirect(const std::string & filename, ssize_t maxEvents) const
          << messagesDone << endl;
 }
 
+void
+Logger::
+drainRecords()
+{
+    auto onRecord = [&] (std::string & record)
+        {
+            drainRecord(record);
+            if (record.capacity() > MaxSlotCapacity)
+                std::string().swap(record);
+            return true;
+        };
+
+    recordBuffers.drain(onRecord);
+}
+
+void
+Logger::
+drainRecord(const std::string & record)
+{
+    atomic_add(messagesDone, 1);
+
+    Outputs * current = outputs;
+    if (!current || current->empty()) return;
+
+    try {
+        LogRecord::format(record.data(), record.size(),
+                          recordChannel, recordText);
+    } catch (const std::exception &) {
+        atomic_add(recordsMalformed, 1);
+        return;
+    }
+
+    current->logMessage(recordChannel, recordText);
+}
+
 void
 Logger::
 handleListenerMessage(std::vector<std::string> const & message)
@@ -9,6 +9,7 @@
 #include "soa/service/zmq_named_pub_sub.h"
 #include "soa/service/zmq_utils.h"
 #include "soa/service/socket_per_thread.h"
+#include "soa/service/thread_buffers.h"
 #include <sstream>
 #include "jml/utils/filter_streams.h"
 #include <boost/thread/thread.hpp>
@@ -20,6 +21,9 @@
 #include <boost/regex.hpp>
 #include <boost/shared_ptr.hpp>
 #include "soa/jsoncpp/json.h"
+#include "jml/arch/thread_specific.h"
+#include "log_record.h"
+#include <mutex>
 
 
 namespace Datacratic {
@@ -76,6 +80,10 @@ struct LogOutput {
     Everything is entirely thread-safe and in normal operation, logging a
     message will not block.  This allows it to be used in contexts where
     logging happens in a time-critical loop, for example.
+
+    The methods that set up the outputs and report on progress are virtual
+    so that a logger that spreads its messages over several others (see
+    RTBKIT::DataLogger) behaves the same when used through a Logger &.
 */
 
 struct Logger {
@@ -87,9 +95,9 @@ struct Logger {
 
     Logger(std::shared_ptr<zmq::context_t> & context, size_t bufferSize = 65536);
 
-    ~Logger();
+    virtual ~Logger();
 
-    void init();
+    virtual void init();
 
     /** Subscribe to the given stream to get log messages from.  Optionally,
         a filter can also be set up to limit the messages to a given
@@ -110,10 +118,10 @@ struct Logger {
         - ipc://path: publish to the given zeromq socket;
         - tcp://hostname: send over tcp/ip
     */
-    void logTo(const std::string & uri,
-               const boost::regex & allowChannels = boost::regex(),
-               const boost::regex & denyChannels = boost::regex(),
-               double logProbability = 1.0);
+    virtual void logTo(const std::string & uri,
+                       const boost::regex & allowChannels = boost::regex(),
+                       const boost::regex & denyChannels = boost::regex(),
+                       double logProbability = 1.0);
 
     /** Set the output to the given object.  Note that this is complicated
         by the necessity to stop the logging thread until the operation
@@ -123,21 +131,21 @@ struct Logger {
         There is no locking to avoid them causing problems for each other,
         just enough locking to stop them interfering with the event loop.
     */
-    void addOutput(std::shared_ptr<LogOutput> output,
-                   const boost::regex & allowChannels = boost::regex(),
-                   const boost::regex & denyChannels = boost::regex(),
-                   double logProbability = 1.0);
+    virtual void addOutput(std::shared_ptr<LogOutput> output,
+                           const boost::regex & allowChannels = boost::regex(),
+                           const boost::regex & denyChannels = boost::regex(),
+                           double logProbability = 1.0);
 
     /** Set up a callback that will call the given function when a message
         matching the filter is obtained.
     */
-    void addCallback(boost::function<void (std::string, std::string)> callback,
-                     const boost::regex & allowChannels = boost::regex(),
-                     const boost::regex & denyChannels = boost::regex(),
-                     double logProbability = 1.0);
+    virtual void addCallback(boost::function<void (std::string, std::string)> callback,
+                             const boost::regex & allowChannels = boost::regex(),
+                             const boost::regex & denyChannels = boost::regex(),
+                             double logProbability = 1.0);
 
     /** Clear all outputs. */
-    void clearOutputs();
+    virtual void clearOutputs();
 
     /** Log a given message to the given channel.  Each of the arguments will
         be converted to a string and logged like that.
@@ -196,13 +204,54 @@ struct Logger {
         messages.push(message);
     }
 
-    void start(std::function<void ()> onStop = 0);
+    /** Log a message to the given channel, like logMessage(), but without
+        converting the arguments to strings nor allocating memory once the
+        calling thread has logged a few messages.  The arguments are written
+        as a binary LogRecord into a buffer owned by the calling thread,
+        which the logging thread drains and formats every few milliseconds.
+
+        If the logging thread can't keep up and the buffer of the thread is
+        full, the message is dropped and counted in numRecordsDropped().
+    */
+    template<typename... Args>
+    void publish(const std::string & channel, const Args & ... args)
+    {
+        if (!outputs) return;
+        std::string & record = recordScratch();
+        LogRecord::init(record, channel, Date::now());
+        LogRecord::append(record, args...);
+        logRecord(record.data(), record.size());
+    }
+
+    template<typename... Args>
+    void publishNoTimestamp(const std::string & channel,
+                            const Args & ... args)
+    {
+        if (!outputs) return;
+        std::string & record = recordScratch();
+        LogRecord::init(record, channel);
+        LogRecord::append(record, args...);
+        logRecord(record.data(), record.size());
+    }
+
+    /** Log a record that was already serialized with LogRecord, for example
+        by another process.
+    */
+    void logRecord(const char * data, size_t len);
+
+    /** Size of the record buffer of each thread that publishes. */
+    size_t recordBufferCapacity;
+
+    uint64_t numRecordsDropped() const;
+
+    virtual void start(std::function<void ()> onStop = 0);
 
-    void waitUntilFinished();
+    virtual void waitUntilFinished();
 
-    void shutdown();
+    virtual void shutdown();
     
-    std::map<std::string, size_t> getStats();
+    /** Number of messages sent, done and of records dropped. */
+    virtual std::map<std::string, size_t> getStats();
     void resetStats();
 
     /// Replay the events in the given filename through the logger
@@ -214,8 +263,8 @@ struct Logger {
     void replayDirect(const std::string & filename,
                       ssize_t maxEvents = -1) const;
     
-    uint64_t numMessagesSent() const { return messagesSent; }
-    uint64_t numMessagesDone() const { return messagesDone; }
+    virtual uint64_t numMessagesSent() const { return messagesSent; }
+    virtual uint64_t numMessagesDone() const { return messagesDone; }
 
     void handleListenerMessage(std::vector<std::string> const & message);
     void handleRawListenerMessage(std::vector<std::string> const & message);
@@ -244,6 +293,19 @@ private:
     struct Output;
     struct Outputs;
 
+    /** Records published by each thread, waiting for the logging thread. */
+    ThreadBuffers<std::string> recordBuffers;
+
+    /** Thread local string in which records are serialized. */
+    static std::string & recordScratch();
+
+    /** Format and log the records waiting in the buffers. */
+    void drainRecords();
+    void drainRecord(const std::string & record);
+
+    /// Decoded channel and text of the record being logged
+    std::string recordChannel, recordText;
+
     /// Current list of outputs.  Must be swapped atomically.
     Outputs * outputs;
 
@@ -259,6 +321,9 @@ private:
     /// Number of messages that have actually been processed
     uint64_t messagesDone;
 
+    /// Number of records that couldn't be decoded and were skipped
+    uint64_t recordsMalformed;
+
 };
 
 
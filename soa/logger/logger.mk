@@ -6,11 +6,11 @@ LIBLOGGER_SOURCES := \
 	logger.cc remote_output.cc remote_input.cc \
 	file_output.cc publish_output.cc \
 	filter.cc json_filter.cc stats_output.cc callback_output.cc \
-	rotating_output.cc cloud_output.cc compressor.cc compressing_output.cc \
-	multi_output.cc 
+	rotating_output.cc cloud_output.cc compressing_output.cc \
+	multi_output.cc log_record.cc columnar_file.cc
 
 LIBLOGGER_LINK := \
-	ACE arch utils boost_thread boost_regex zeromq endpoint lzma boost_filesystem opstats cloud gc
+	ACE arch utils boost_thread boost_regex zeromq endpoint lzma boost_filesystem opstats cloud gc compressor
 
 $(eval $(call library,logger,$(LIBLOGGER_SOURCES),$(LIBLOGGER_LINK)))
 
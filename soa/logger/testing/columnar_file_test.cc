@@ -0,0 +1,162 @@
+/* columnar_file_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the columnar files.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/logger/columnar_file.h"
+#include "jml/arch/exception.h"
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <unistd.h>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+namespace {
+
+const vector<ColumnSpec> columns = {
+    { "timestamp", COL_INT64 },
+    { "name",      COL_STRING },
+    { "value",     COL_DOUBLE }
+};
+
+void writeFile(const string & filename, size_t numRows, size_t rowGroupSize)
+{
+    ColumnarWriter writer(filename, columns, rowGroupSize);
+    for (size_t i = 0;  i < numRows;  ++i) {
+        writer.addRow();
+        writer.setInt(0, 1000000 + i * 10);
+        if (i % 7 != 0)
+            writer.setString(1, "name" + to_string(i % 5));
+        writer.setDouble(2, i * 0.5);
+    }
+    writer.close();
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( test_columnar_round_trip )
+{
+    string filename = "tmp/columnar_file_test.col";
+    writeFile(filename, 1000, 64);
+
+    ColumnarReader reader(filename);
+    BOOST_REQUIRE_EQUAL(reader.columns().size(), 3);
+    BOOST_CHECK_EQUAL(reader.columns()[1].name, "name");
+    BOOST_CHECK_EQUAL(reader.columns()[1].type, COL_STRING);
+    BOOST_CHECK_EQUAL(reader.columnIndex("value"), 2);
+    BOOST_CHECK_EQUAL(reader.columnIndex("nothing"), -1);
+    BOOST_CHECK_EQUAL(reader.numRows(), 1000);
+    BOOST_CHECK_EQUAL(reader.numRowGroups(), 16);
+
+    size_t row = 0;
+    for (size_t i = 0;  i < reader.numRowGroups();  ++i) {
+        const RowGroupInfo & info = reader.rowGroup(i);
+        BOOST_CHECK_EQUAL(info.chunks[0].minValue, 1000000 + row * 10);
+        BOOST_CHECK_EQUAL(info.chunks[0].maxValue,
+                          1000000 + (row + info.numRows - 1) * 10);
+
+        ColumnarRowGroup group = reader.read(i);
+        BOOST_REQUIRE_EQUAL(group.numRows, info.numRows);
+        for (size_t j = 0;  j < group.numRows;  ++j, ++row) {
+            BOOST_CHECK_EQUAL(group.getInt(0, j), 1000000 + row * 10);
+            BOOST_CHECK_EQUAL(group.getString(1, j),
+                              row % 7 ? "name" + to_string(row % 5) : "");
+            BOOST_CHECK_EQUAL(group.getDouble(2, j), row * 0.5);
+        }
+    }
+    BOOST_CHECK_EQUAL(row, 1000);
+
+    // Only the asked columns are decoded
+    ColumnarRowGroup group = reader.read(1, { 2 });
+    BOOST_CHECK(!group.columns[0].loaded);
+    BOOST_CHECK(!group.columns[1].loaded);
+    BOOST_CHECK(group.columns[2].loaded);
+
+    unlink(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_columnar_parallel_scan )
+{
+    string filename = "tmp/columnar_file_test_scan.col";
+    writeFile(filename, 10000, 100);
+
+    ColumnarReader reader(filename);
+
+    std::mutex lock;
+    set<size_t> seen;
+    std::atomic<uint64_t> numRows(0);
+    double total = 0.0;
+
+    auto onRowGroup = [&] (const ColumnarRowGroup & group)
+        {
+            double sum = 0.0;
+            for (size_t i = 0;  i < group.numRows;  ++i)
+                sum += group.getDouble(2, i);
+            numRows += group.numRows;
+
+            std::unique_lock<std::mutex> guard(lock);
+            BOOST_CHECK(seen.insert(group.index).second);
+            total += sum;
+        };
+
+    reader.forEachRowGroup(onRowGroup, 8, { 2 });
+    BOOST_CHECK_EQUAL(numRows, 10000);
+    BOOST_CHECK_EQUAL(seen.size(), 100);
+    BOOST_CHECK_EQUAL(total, 0.5 * 9999 * 10000 / 2);
+
+    // Skip the row groups outside of a range of timestamps using the index
+    int64_t from = 1000000 + 2500 * 10, to = 1000000 + 5000 * 10;
+    auto filter = [&] (const RowGroupInfo & info)
+        {
+            return info.chunks[0].maxValue >= from
+                && info.chunks[0].minValue < to;
+        };
+
+    seen.clear();
+    numRows = 0;
+    total = 0.0;
+    reader.forEachRowGroup(onRowGroup, 4, { 2 }, filter);
+    BOOST_CHECK_EQUAL(numRows, 2500);
+    BOOST_CHECK_EQUAL(seen.size(), 25);
+
+    // Errors in the callback are rethrown to the caller
+    auto fail = [&] (const ColumnarRowGroup & group)
+        {
+            throw ML::Exception("expected error");
+        };
+    BOOST_CHECK_THROW(reader.forEachRowGroup(fail, 4), ML::Exception);
+
+    unlink(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_columnar_unclosed_file )
+{
+    string filename = "tmp/columnar_file_test_unclosed.col";
+
+    {
+        ColumnarWriter writer(filename, columns, 10);
+        writer.addRow();
+        writer.setInt(0, 1);
+        BOOST_CHECK_THROW(writer.setString(0, "wrong type"), ML::Exception);
+        BOOST_CHECK_THROW(writer.setInt(3, 1), ML::Exception);
+
+        // Not closed yet, so there is no footer
+        BOOST_CHECK_THROW(ColumnarReader reader(filename), ML::Exception);
+    }
+
+    // The destructor closes it
+    ColumnarReader reader(filename);
+    BOOST_CHECK_EQUAL(reader.numRows(), 1);
+
+    unlink(filename.c_str());
+}
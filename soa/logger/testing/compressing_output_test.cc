@@ -0,0 +1,127 @@
+/* compressing_output_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the parallel block compression of the CompressingOutput.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/logger/file_output.h"
+#include "jml/utils/filter_streams.h"
+#include "jml/utils/guard.h"
+#include "jml/utils/testing/watchdog.h"
+#include <fstream>
+#include <iterator>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_block_compressor_frames_are_independent )
+{
+    for (string extension: { ".gz", ".xz", ".lz4" }) {
+        string compression = extension.substr(1);
+        BOOST_REQUIRE(BlockCompressor::supports(compression));
+        std::unique_ptr<BlockCompressor> compressor
+            (BlockCompressor::create(compression, 1));
+
+        // The middle block repeats the first one, which a compressor that
+        // kept its state from one block to the next would refer to.
+        string block1(100000, 'a');
+        string block2 = string(1000, 'a') + "hello\tworld\n";
+        string block3 = "bye\n";
+        string frame1, frame2, frame3;
+        compressor->compressBlock(block1.data(), block1.size(), frame1);
+        compressor->compressBlock(block2.data(), block2.size(), frame2);
+        compressor->compressBlock(block3.data(), block3.size(), frame3);
+
+        BOOST_CHECK_LT(frame1.size(), block1.size());
+
+        // The middle frame is a whole file on its own
+        string filename = "tmp/compressing_output_test.frame" + extension;
+        ML::Call_Guard guard([&] () { unlink(filename.c_str()); });
+        {
+            ofstream file(filename);
+            file.write(frame2.data(), frame2.size());
+        }
+
+        filter_istream stream(filename);
+        string decoded((istreambuf_iterator<char>(stream)),
+                       istreambuf_iterator<char>());
+        BOOST_CHECK_EQUAL(decoded, block2);
+    }
+
+    BOOST_CHECK(!BlockCompressor::supports("bzip2"));
+    BOOST_CHECK(!BlockCompressor::supports("none"));
+}
+
+BOOST_AUTO_TEST_CASE( test_parallel_compression_round_trip )
+{
+    ML::Watchdog watchdog(30.0);
+
+    for (string extension: { ".gz", ".xz", ".lz4" }) {
+        string filename = "tmp/compressing_output_test.log" + extension;
+        ML::Call_Guard guard([&] () { unlink(filename.c_str()); });
+
+        cerr << "testing " << filename << endl;
+
+        vector<string> expected;
+        {
+            FileOutput output;
+            // Small blocks so that many frames are in flight at once
+            output.setParallelCompression(3, 1000, 1000.0);
+            output.open(filename);
+
+            for (unsigned i = 0;  i < 10000;  ++i) {
+                string message = "message " + to_string(i);
+                output.logMessage("channel", message);
+                expected.push_back("channel\t" + message);
+            }
+
+            output.close();
+        }
+
+        filter_istream stream(filename);
+        vector<string> lines;
+        string line;
+        while (getline(stream, line))
+            lines.push_back(line);
+
+        BOOST_CHECK_EQUAL(lines.size(), expected.size());
+        BOOST_CHECK(lines == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_serial_lz4_output )
+{
+    ML::Watchdog watchdog(30.0);
+
+    // Without parallel compression, .lz4 files are compressed serially
+    string filename = "tmp/compressing_output_test_serial.log.lz4";
+    ML::Call_Guard guard([&] () { unlink(filename.c_str()); });
+
+    vector<string> expected;
+    {
+        FileOutput output;
+        output.open(filename);
+
+        for (unsigned i = 0;  i < 1000;  ++i) {
+            string message = "message " + to_string(i);
+            output.logMessage("channel", message);
+            expected.push_back("channel\t" + message);
+        }
+
+        output.close();
+    }
+
+    filter_istream stream(filename);
+    vector<string> lines;
+    string line;
+    while (getline(stream, line))
+        lines.push_back(line);
+
+    BOOST_CHECK(lines == expected);
+}
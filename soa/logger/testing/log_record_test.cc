@@ -0,0 +1,98 @@
+/* log_record_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the binary log records and Logger::publish().
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/logger/logger.h"
+#include "soa/logger/log_record.h"
+#include "jml/utils/testing/watchdog.h"
+#include <mutex>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_log_record_format )
+{
+    Date now = Date::fromSecondsSinceEpoch(1400000000.25);
+
+    string record;
+    LogRecord::init(record, "AUCTION", now);
+    LogRecord::append(record, "hello", string("world"), 42, -3, 1234567890123ULL,
+                      1.5, vector<string>{ "a", "b" }, now);
+    BOOST_CHECK(LogRecord::isRecord(record.data(), record.size()));
+
+    string channel, text;
+    LogRecord::format(record.data(), record.size(), channel, text);
+    BOOST_CHECK_EQUAL(channel, "AUCTION");
+    BOOST_CHECK_EQUAL(text,
+                      now.print(5) + "\thello\tworld\t42\t-3\t1234567890123"
+                      + "\t1.500000\ta\tb\t1400000000.25000");
+
+    LogRecord::init(record, "RAW");
+    LogRecord::append(record, "x");
+    LogRecord::format(record.data(), record.size(), channel, text);
+    BOOST_CHECK_EQUAL(channel, "RAW");
+    BOOST_CHECK_EQUAL(text, "x");
+
+    // Text messages are never mistaken for records
+    BOOST_CHECK(!LogRecord::isRecord("hello", 5));
+
+    // Neither are truncated records decoded
+    LogRecord::init(record, "AUCTION", now);
+    LogRecord::append(record, "hello");
+    BOOST_CHECK_THROW(LogRecord::format(record.data(), record.size() - 1,
+                                        channel, text),
+                      ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_logger_publish )
+{
+    ML::Watchdog watchdog(10.0);
+
+    Logger logger;
+    logger.init();
+
+    std::mutex lock;
+    vector<pair<string, string> > messages;
+    logger.addCallback([&] (string channel, string message)
+                       {
+                           std::unique_lock<std::mutex> guard(lock);
+                           messages.emplace_back(channel, message);
+                       });
+    logger.start();
+
+    for (unsigned i = 0;  i < 100;  ++i)
+        logger.publish("CHANNEL", "message", i);
+    logger.publishNoTimestamp("RAW", "a", "b");
+
+    // Records that can't be decoded are counted and skipped
+    string record;
+    LogRecord::init(record, "BAD");
+    LogRecord::append(record, "truncated");
+    logger.logRecord(record.data(), record.size() - 1);
+
+    logger.waitUntilFinished();
+    logger.shutdown();
+
+    BOOST_CHECK_EQUAL(logger.numRecordsDropped(), 0);
+    BOOST_CHECK_EQUAL(logger.getStats()["recordsMalformed"], 1);
+    BOOST_REQUIRE_EQUAL(messages.size(), 101);
+
+    for (unsigned i = 0;  i < 100;  ++i) {
+        BOOST_CHECK_EQUAL(messages[i].first, "CHANNEL");
+        string text = messages[i].second;
+        string::size_type tab = text.find('\t');
+        BOOST_REQUIRE(tab != string::npos);
+        BOOST_CHECK_EQUAL(text.substr(tab + 1), "message\t" + to_string(i));
+    }
+
+    BOOST_CHECK_EQUAL(messages[100].first, "RAW");
+    BOOST_CHECK_EQUAL(messages[100].second, "a\tb");
+}
@@ -202,9 +202,7 @@ void
 MultiAggregator::
 dumpSync(std::ostream & stream) const
 {
-    std::unique_lock<Lock> guard(this->lock);
-
-    for (auto & s: stats) {
+    for (auto & s: mergeShards()) {
         auto vals = s.second->read(s.first);
         for (auto v: vals) {
             stream << v.name << ":\t" << v.value << endl;
@@ -212,6 +210,58 @@ dumpSync(std::ostream & stream) const
     }
 }
 
+std::vector<std::pair<std::string, std::shared_ptr<StatAggregator> > >
+MultiAggregator::
+mergeShards() const
+{
+    // Take a snapshot of the stats and their shards, so that the lock isn't
+    // held while merging
+    vector<pair<string, shared_ptr<Stat> > > snapshot;
+    vector<vector<shared_ptr<Shard> > > shards;
+    {
+        std::unique_lock<Lock> guard(this->lock);
+        snapshot.reserve(stats.size());
+        shards.reserve(stats.size());
+        for (auto & entry: stats) {
+            snapshot.emplace_back(entry.first, entry.second);
+            shards.push_back(entry.second->shards);
+        }
+    }
+
+    vector<pair<string, shared_ptr<StatAggregator> > > result;
+    result.reserve(snapshot.size());
+
+    // Shards whose thread had exited before they were merged
+    vector<pair<Stat *, Shard *> > orphans;
+
+    for (unsigned i = 0;  i < snapshot.size();  ++i) {
+        Stat & stat = *snapshot[i].second;
+        for (auto & shard: shards[i]) {
+            // Check before merging, so that the last values recorded by
+            // an exiting thread are merged before its shard is dropped
+            if (shard->orphaned)
+                orphans.emplace_back(&stat, shard.get());
+            stat.merged->merge(*shard->aggregator);
+        }
+        result.emplace_back(snapshot[i].first, stat.merged);
+    }
+
+    if (!orphans.empty()) {
+        std::unique_lock<Lock> guard(this->lock);
+        for (auto & orphan: orphans) {
+            auto & statShards = orphan.first->shards;
+            for (auto it = statShards.begin();  it != statShards.end();  ++it) {
+                if (it->get() == orphan.second) {
+                    statShards.erase(it);
+                    break;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
 void
 MultiAggregator::
 shutdown()
@@ -249,35 +299,43 @@ runDumpingThread()
         if (cond.wait_until(lock, nextWakeup.toStd(), [&] { return doShutdown.load(); }))
             break;
 
-        // Get the read lock to extract a list of stats to dump
-        vector<Stats::iterator> toDump;
-        {
-            std::unique_lock<Lock> guard(this->lock);
-            toDump.reserve(stats.size());
-            for (auto it = stats.begin(), end = stats.end(); it != end;  ++it)
-                toDump.push_back(it);
-        }
+        auto toDump = mergeShards();
 
         ++current;
         bool dumpNow = doDump.exchange(false) ||
                        (current % static_cast<size_t>(dumpInterval)) == 0;
 
         // Now dump them without the lock held. Note that we still need to call
-        // read every second even if we're not flushing to carbon.
+        // read every second even if we're not flushing to carbon.  All of
+        // the readings go out in a single batch.
+        vector<StatReading> readings;
+
         for (auto it = toDump.begin(), end = toDump.end(); it != end;  ++it) {
 
             try {
-                auto stat = (*it)->second->read((*it)->first);
+                auto stat = it->second->read(it->first);
 
                 // Hack: ensures that all timestamps are consistent and that we
                 // will not have any gaps within carbon.
                 for (auto& s : stat) s.timestamp = nextWakeup;
 
-                if (dumpNow) doStat(std::move(stat));
+                if (dumpNow)
+                    readings.insert(readings.end(),
+                                    std::make_move_iterator(stat.begin()),
+                                    std::make_move_iterator(stat.end()));
             } catch (const std::exception & exc) {
-                cerr << "error writing stat: " << exc.what() << endl;
+                cerr << "error reading stat: " << exc.what() << endl;
             }
         }
+
+        if (readings.empty())
+            continue;
+
+        try {
+            doStat(readings);
+        } catch (const std::exception & exc) {
+            cerr << "error writing stats: " << exc.what() << endl;
+        }
     }
 }
 
@@ -125,20 +125,47 @@ protected:
     std::function<void ()> onPreShutdown, onPostShutdown;
 
 private:
-    // This map can only have things removed from it, never added to
-    typedef std::map<std::string, std::shared_ptr<StatAggregator> > Stats;
+    /** Part of a stat that only one thread records to, so that recording
+        never contends with the other threads.  The dumping thread merges
+        the shards of each stat before reading it.
+    */
+    struct Shard {
+        Shard(StatAggregator * aggregator)
+            : aggregator(aggregator), orphaned(false)
+        {
+        }
+
+        std::unique_ptr<StatAggregator> aggregator;
+        std::atomic<bool> orphaned;   ///< Its thread has exited
+    };
+
+    struct Stat {
+        std::shared_ptr<StatAggregator> merged;  ///< What is read
+        std::vector<std::shared_ptr<Shard> > shards;
+    };
+
+    // Stats are only ever added to this map
+    typedef std::map<std::string, std::shared_ptr<Stat> > Stats;
     Stats stats;
 
-    // R/W mutex for reading/writing stats.  Read to look up, write to
-    // add a new stat.
+    // Mutex to add a new stat or shard.  Recording only takes it the first
+    // time each thread records to each stat.
     typedef std::mutex Lock;
     mutable Lock lock;
 
-    typedef std::unordered_map<std::string, Stats::iterator> LookupCache;
+    /** Shards of a thread, by stat.  They are marked as orphaned when the
+        thread exits so that the dumping thread can drop them.
+    */
+    struct ThreadShards
+        : public std::unordered_map<std::string, std::shared_ptr<Shard> > {
+        ~ThreadShards()
+        {
+            for (auto & entry: *this)
+                entry.second->orphaned = true;
+        }
+    };
 
-    // Cache of lookups for each thread to avoid needing to acquire a lock
-    // very much.
-    boost::thread_specific_ptr<LookupCache> lookupCache;
+    boost::thread_specific_ptr<ThreadShards> threadShards;
 
     /** Thread that's started up to start dumping. */
     void runDumpingThread();
@@ -146,46 +173,45 @@ private:
     /** Shutdown everything. */
     void shutdown();
 
-    /** Look for the aggregator for this given stat.  If it doesn't exist,
-        then initialize it from the given function.
+    /** Merge the shards of each stat into it and drop the orphaned ones.
+        Returns the stats to be read.
+    */
+    std::vector<std::pair<std::string, std::shared_ptr<StatAggregator> > >
+    mergeShards() const;
+
+    /** Look for this thread's shard of the given stat.  If it doesn't exist,
+        then create it (and the stat) from the given function.
     */
     template<typename... Args>
     StatAggregator & getAggregator(const std::string & stat,
                                    StatAggregator * (*createFn) (Args...),
                                    Args&&... args)
     {
-        if (!lookupCache.get())
-            lookupCache.reset(new LookupCache());
-
-        auto found = lookupCache->find(stat);
-        if (found != lookupCache->end())
-            return *found->second->second;
-
-        // Get the read lock to look for the aggregator
-        std::unique_lock<Lock> guard(lock);
+        ThreadShards * shards = threadShards.get();
+        if (!shards) {
+            shards = new ThreadShards();
+            threadShards.reset(shards);
+        }
 
-        auto found2 = stats.find(stat);
+        auto found = shards->find(stat);
+        if (found != shards->end())
+            return *found->second->aggregator;
 
-        if (found2 != stats.end()) {
-            guard.unlock();
+        auto shard = std::make_shared<Shard>(createFn(args...));
 
-            (*lookupCache)[stat] = found2;
+        std::unique_lock<Lock> guard(lock);
 
-            return *found2->second;
+        std::shared_ptr<Stat> & entry = stats[stat];
+        if (!entry) {
+            entry.reset(new Stat());
+            entry->merged.reset(createFn(args...));
         }
+        entry->shards.push_back(shard);
 
         guard.unlock();
 
-        // Get the write lock to add it to the aggregator
-        std::unique_lock<Lock> guard2(lock);
-
-        // Add it in
-        found2 = stats.insert(
-                make_pair(stat, std::shared_ptr<StatAggregator>(createFn(std::forward<Args>(args)...)))).first;
-
-        guard2.unlock();
-        (*lookupCache)[stat] = found2;
-        return *found2->second;
+        (*shards)[stat] = shard;
+        return *shard->aggregator;
     }
     
     std::unique_ptr<std::thread> dumpingThread;
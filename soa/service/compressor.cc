@@ -0,0 +1,475 @@
+/* compressor.cc
+   Jeremy Barnes, 19 September 2012
+   Copyright (c) 2012 Datacratic Inc.  All rights reserved.
+
+   Implementation of compressor abstraction.
+*/
+
+#include "compressor.h"
+#include "jml/utils/exc_assert.h"
+#include "jml/utils/lz4_filter.h"
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <zlib.h>
+#include <lzma.h>
+#include <iostream>
+
+using namespace std;
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* COMPRESSOR                                                                */
+/*****************************************************************************/
+
+Compressor::
+~Compressor()
+{
+}
+
+namespace {
+
+bool ends_with(const std::string & str, const std::string & what)
+{
+    string::size_type result = str.rfind(what);
+    return result != string::npos
+        && result == str.size() - what.size();
+}
+
+} // file scope
+
+std::string
+Compressor::
+filenameToCompression(const std::string & filename)
+{
+    if (ends_with(filename, ".gz") || ends_with(filename, ".gz~"))
+        return "gzip";
+    if (ends_with(filename, ".bz2") || ends_with(filename, ".bz2~"))
+        return "bzip2";
+    if (ends_with(filename, ".xz") || ends_with(filename, ".xz~"))
+        return "lzma";
+    if (ends_with(filename, ".lz4") || ends_with(filename, ".lz4~"))
+        return "lz4";
+    return "none";
+}
+
+Compressor *
+Compressor::
+create(const std::string & compression,
+       int level)
+{
+    if (compression == "gzip" || compression == "gz")
+        return new GzipCompressor(level);
+    else if (compression == "lz4")
+        return new Lz4Compressor(level);
+    else if (compression == "" || compression == "none")
+        return new NullCompressor();
+    else throw ML::Exception("unknown compression %s:%d", compression.c_str(),
+                             level);
+}
+
+
+/*****************************************************************************/
+/* NULL COMPRESSOR                                                           */
+/*****************************************************************************/
+
+NullCompressor::
+NullCompressor()
+{
+}
+
+NullCompressor::
+~NullCompressor()
+{
+}
+
+size_t
+NullCompressor::
+compress(const char * data, size_t len, const OnData & onData)
+{
+    size_t done = 0;
+
+    while (done < len)
+        done += onData(data + done, len - done);
+    
+    ExcAssertEqual(done, len);
+
+    return done;
+}
+    
+size_t
+NullCompressor::
+flush(FlushLevel flushLevel, const OnData & onData)
+{
+    return 0;
+}
+
+size_t
+NullCompressor::
+finish(const OnData & onData)
+{
+    return 0;
+}
+
+
+/*****************************************************************************/
+/* GZIP COMPRESSOR                                                           */
+/*****************************************************************************/
+
+struct GzipCompressor::Itl : public z_stream {
+
+    Itl(int compressionLevel, Format format)
+    {
+        zalloc = 0;
+        zfree = 0;
+        opaque = 0;
+        int windowBits = format == FORMAT_GZIP ? 15 + 16 : 15;
+        int res = deflateInit2(this, compressionLevel, Z_DEFLATED, windowBits,
+                               9, Z_DEFAULT_STRATEGY);
+        if (res != Z_OK)
+            throw ML::Exception("deflateInit2 failed");
+    }
+
+    ~Itl()
+    {
+        deflateEnd(this);
+    }
+
+    size_t pump(const char * data, size_t len, const OnData & onData,
+                int flushLevel)
+    {
+        size_t bufSize = 131072;
+        char output[bufSize];
+        next_in = (Bytef *)data;
+        avail_in = len;
+        size_t result = 0;
+
+        do {
+            next_out = (Bytef *)output;
+            avail_out = bufSize;
+
+            int res = deflate(this, flushLevel);
+
+            
+            //cerr << "pumping " << len << " bytes through with flushLevel "
+            //     << flushLevel << " returned " << res << endl;
+
+            size_t bytesWritten = (const char *)next_out - output;
+
+            switch (res) {
+            case Z_OK:
+                if (bytesWritten)
+                    onData(output, bytesWritten);
+                result += bytesWritten;
+                break;
+
+            case Z_STREAM_ERROR:
+                throw ML::Exception("Stream error on zlib");
+
+            case Z_STREAM_END:
+                if (bytesWritten)
+                    onData(output, bytesWritten);
+                result += bytesWritten;
+                return result;
+
+            default:
+                throw ML::Exception("unknown output from deflate");
+            };
+        } while (avail_in != 0);
+
+        if (flushLevel == Z_FINISH)
+            throw ML::Exception("finished without getting to Z_STREAM_END");
+
+        return result;
+    }
+
+
+    size_t compress(const char * data, size_t len, const OnData & onData)
+    {
+        return pump(data, len, onData, Z_NO_FLUSH);
+    }
+
+    size_t flush(FlushLevel flushLevel, const OnData & onData)
+    {
+        int zlibFlushLevel;
+        switch (flushLevel) {
+        case FLUSH_NONE:       zlibFlushLevel = Z_NO_FLUSH;       break;
+        case FLUSH_AVAILABLE:  zlibFlushLevel = Z_PARTIAL_FLUSH;  break;
+        case FLUSH_SYNC:       zlibFlushLevel = Z_SYNC_FLUSH;     break;
+        case FLUSH_RESTART:    zlibFlushLevel = Z_FULL_FLUSH;     break;
+        default:
+            throw ML::Exception("bad flush level");
+        }
+
+        return pump(0, 0, onData, zlibFlushLevel);
+    }
+
+    size_t finish(const OnData & onData)
+    {
+        return pump(0, 0, onData, Z_FINISH);
+    }
+};
+
+GzipCompressor::
+GzipCompressor(int compressionLevel, Format format)
+    : format(format)
+{
+    itl.reset(new Itl(compressionLevel, format));
+}
+
+GzipCompressor::
+~GzipCompressor()
+{
+}
+
+void
+GzipCompressor::
+open(int compressionLevel)
+{
+    itl.reset(new Itl(compressionLevel, format));
+}
+
+void
+GzipCompressor::
+reset()
+{
+    int res = deflateReset(itl.get());
+    if (res != Z_OK)
+        throw ML::Exception("deflateReset failed");
+}
+
+size_t
+GzipCompressor::
+compress(const char * data, size_t len, const OnData & onData)
+{
+    return itl->compress(data, len, onData);
+}
+    
+size_t
+GzipCompressor::
+flush(FlushLevel flushLevel, const OnData & onData)
+{
+    return itl->flush(flushLevel, onData);
+}
+
+size_t
+GzipCompressor::
+finish(const OnData & onData)
+{
+    return itl->finish(onData);
+}
+
+
+/*****************************************************************************/
+/* LZ4 COMPRESSOR                                                            */
+/*****************************************************************************/
+
+struct Lz4Compressor::Itl {
+
+    /** Sink for the lz4 filter that passes the data on to onData. */
+    struct DataSink {
+        typedef char char_type;
+        typedef boost::iostreams::sink_tag category;
+
+        DataSink(const OnData & onData)
+            : onData(onData), written(0)
+        {
+        }
+
+        std::streamsize write(const char * data, std::streamsize len)
+        {
+            size_t done = 0;
+            while (done < len) {
+                size_t res = onData(data + done, len - done);
+                if (res == 0)
+                    throw ML::Exception("lz4 compressor output is stuck");
+                done += res;
+            }
+            written += done;
+            return len;
+        }
+
+        const OnData & onData;
+        size_t written;
+    };
+
+    Itl(int level)
+        : compressor(level < 0 ? 0 : level)
+    {
+    }
+
+    ML::lz4_compressor compressor;
+};
+
+Lz4Compressor::
+Lz4Compressor(int level)
+    : itl(new Itl(level))
+{
+}
+
+Lz4Compressor::
+~Lz4Compressor()
+{
+}
+
+size_t
+Lz4Compressor::
+compress(const char * data, size_t len, const OnData & onData)
+{
+    Itl::DataSink sink(onData);
+    itl->compressor.write(sink, data, len);
+    return sink.written;
+}
+    
+size_t
+Lz4Compressor::
+flush(FlushLevel flushLevel, const OnData & onData)
+{
+    if (flushLevel == FLUSH_NONE)
+        return 0;
+
+    Itl::DataSink sink(onData);
+    itl->compressor.flushBlock(sink);
+    return sink.written;
+}
+
+size_t
+Lz4Compressor::
+finish(const OnData & onData)
+{
+    Itl::DataSink sink(onData);
+    itl->compressor.close(sink);
+    return sink.written;
+}
+
+
+/*****************************************************************************/
+/* LZMA COMPRESSOR                                                           */
+/*****************************************************************************/
+
+
+/*****************************************************************************/
+/* BLOCK COMPRESSOR                                                          */
+/*****************************************************************************/
+
+BlockCompressor::
+~BlockCompressor()
+{
+}
+
+namespace {
+
+struct GzipBlockCompressor : public BlockCompressor {
+
+    GzipBlockCompressor(int level)
+        : level(level)
+    {
+    }
+
+    virtual void compressBlock(const char * data, size_t len,
+                               std::string & output) const
+    {
+        z_stream stream;
+        stream.zalloc = 0;
+        stream.zfree = 0;
+        stream.opaque = 0;
+        int res = deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 9,
+                               Z_DEFAULT_STRATEGY);
+        if (res != Z_OK)
+            throw ML::Exception("deflateInit2 failed");
+
+        // The header and trailer of the member are a few tens of bytes
+        output.resize(deflateBound(&stream, len) + 64);
+
+        stream.next_in = (Bytef *)data;
+        stream.avail_in = len;
+        stream.next_out = (Bytef *)&output[0];
+        stream.avail_out = output.size();
+
+        res = deflate(&stream, Z_FINISH);
+        size_t written = output.size() - stream.avail_out;
+        deflateEnd(&stream);
+
+        if (res != Z_STREAM_END)
+            throw ML::Exception("deflate didn't finish the block: %d", res);
+
+        output.resize(written);
+    }
+
+    int level;
+};
+
+struct LzmaBlockCompressor : public BlockCompressor {
+
+    LzmaBlockCompressor(int level)
+        : level(level < 0 ? 6 : std::min(level, 9))
+    {
+    }
+
+    virtual void compressBlock(const char * data, size_t len,
+                               std::string & output) const
+    {
+        output.resize(lzma_stream_buffer_bound(len));
+
+        size_t written = 0;
+        lzma_ret res = lzma_easy_buffer_encode(level, LZMA_CHECK_CRC64, 0,
+                                               (const uint8_t *)data, len,
+                                               (uint8_t *)&output[0],
+                                               &written, output.size());
+        if (res != LZMA_OK)
+            throw ML::Exception("lzma_easy_buffer_encode failed: %d", res);
+
+        output.resize(written);
+    }
+
+    uint32_t level;
+};
+
+struct Lz4BlockCompressor : public BlockCompressor {
+
+    Lz4BlockCompressor(int level)
+        : level(level)
+    {
+    }
+
+    virtual void compressBlock(const char * data, size_t len,
+                               std::string & output) const
+    {
+        output.clear();
+        boost::iostreams::back_insert_device<std::string> sink(output);
+
+        ML::lz4_compressor compressor(level);
+        compressor.write(sink, data, len);
+        compressor.close(sink);
+    }
+
+    int level;
+};
+
+} // file scope
+
+bool
+BlockCompressor::
+supports(const std::string & compression)
+{
+    return compression == "gzip" || compression == "gz"
+        || compression == "lzma" || compression == "xz"
+        || compression == "lz4";
+}
+
+BlockCompressor *
+BlockCompressor::
+create(const std::string & compression,
+       int level)
+{
+    if (compression == "gzip" || compression == "gz")
+        return new GzipBlockCompressor(level);
+    else if (compression == "lzma" || compression == "xz")
+        return new LzmaBlockCompressor(level);
+    else if (compression == "lz4")
+        return new Lz4BlockCompressor(level);
+    else throw ML::Exception("no block compression for %s:%d",
+                             compression.c_str(), level);
+}
+
+} // namespace Datacratic
@@ -12,8 +12,8 @@
    buggy and there is no way to have precise control over flushing.
 */
 
-#ifndef __logger__compressor_h__
-#define __logger__compressor_h__
+#ifndef __service__compressor_h__
+#define __service__compressor_h__
 
 
 #include <memory>
@@ -95,12 +95,51 @@ struct NullCompressor : public Compressor {
 
 struct GzipCompressor : public Compressor {
 
-    GzipCompressor(int level);
+    /** The zlib format is what HTTP calls the "deflate" content encoding. */
+    enum Format {
+        FORMAT_GZIP,
+        FORMAT_ZLIB
+    };
+
+    GzipCompressor(int level, Format format = FORMAT_GZIP);
 
     virtual ~GzipCompressor();
 
     void open(int level);
 
+    /** Start a new stream with the same settings, without reallocating the
+        compressor's state.
+    */
+    void reset();
+
+    virtual size_t compress(const char * data, size_t len,
+                            const OnData & onData);
+    
+    virtual size_t flush(FlushLevel flushLevel, const OnData & onData);
+
+    virtual size_t finish(const OnData & onData);
+
+private:
+    Format format;
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+/*****************************************************************************/
+/* LZ4 COMPRESSOR                                                            */
+/*****************************************************************************/
+
+/** Writes an lz4 frame.  Any flush level other than FLUSH_NONE writes the
+    data buffered so far as a block of its own, which costs compression
+    ratio when it is done after every message.
+*/
+
+struct Lz4Compressor : public Compressor {
+
+    Lz4Compressor(int level);
+
+    virtual ~Lz4Compressor();
+
     virtual size_t compress(const char * data, size_t len,
                             const OnData & onData);
     
@@ -135,6 +174,36 @@ private:
     std::unique_ptr<Itl> itl;
 };
 
+
+/*****************************************************************************/
+/* BLOCK COMPRESSOR                                                          */
+/*****************************************************************************/
+
+/** Compresses a block of data on its own into a complete frame: a gzip
+    member, an xz stream or an lz4 frame.  A file made of such frames one
+    after the other is still a valid file for the usual tools, and each of
+    the frames can be decompressed without looking at the others.
+
+    The compressor keeps no state, so compressBlock() can be called from
+    several threads at once.
+*/
+
+struct BlockCompressor {
+
+    virtual ~BlockCompressor();
+
+    /** Replace the contents of output with the frame for the given data. */
+    virtual void compressBlock(const char * data, size_t len,
+                               std::string & output) const = 0;
+
+    /** Can we compress in independent frames with the given scheme? */
+    static bool supports(const std::string & compression);
+
+    /** Create a block compressor with the given scheme. */
+    static BlockCompressor * create(const std::string & compression,
+                                    int level);
+};
+
 } // namespace Datacratic
 
-#endif /* __logger__compressor_h__ */
+#endif /* __service__compressor_h__ */
@@ -0,0 +1,196 @@
+/* event_tracer.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Low-overhead tracing of the stages that requests go through.
+*/
+
+#include "event_tracer.h"
+#include "latency_histogram.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+#include <algorithm>
+#include <sys/time.h>
+#include <unordered_map>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* EVENT TRACER                                                              */
+/*****************************************************************************/
+
+EventTracer::Ring::
+Ring(size_t size, uint16_t thread)
+    : written(0), cleared(0), thread(thread), events(new Event[size])
+{
+}
+
+EventTracer::
+EventTracer(std::vector<std::string> stageNames, size_t ringSize)
+    : stageNames(std::move(stageNames)),
+      enabled(true),
+      // The rings are owned by the tracer, not by the threads
+      threadRing([] (Ring *) {})
+{
+    if (ringSize < 2)
+        throw ML::Exception("EventTracer ring size must be at least 2");
+
+    size_t size = 1;
+    while (size < ringSize)
+        size *= 2;
+    mask = size - 1;
+
+    timeval tv;
+    gettimeofday(&tv, 0);
+    startTicks = ML::ticks();
+    startSeconds = tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+EventTracer::
+~EventTracer()
+{
+}
+
+EventTracer::Ring *
+EventTracer::
+createRing()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    rings.emplace_back(new Ring(mask + 1, rings.size()));
+    Ring * ring = rings.back().get();
+    threadRing.reset(ring);
+    return ring;
+}
+
+std::vector<EventTracer::Event>
+EventTracer::
+events() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    uint64_t size = mask + 1;
+    std::vector<Event> result;
+
+    for (auto & ring: rings) {
+        uint64_t end = ring->written.load(std::memory_order_acquire);
+        // The slot after the last event is the one that the writer will
+        // overwrite next, so it's not read
+        uint64_t begin = std::max(ring->cleared,
+                                  end >= size ? end - size + 1 : 0);
+
+        size_t first = result.size();
+        for (uint64_t pos = begin;  pos < end;  ++pos)
+            result.push_back(ring->events[pos & mask]);
+
+        // The writer may have overwritten the oldest ones while we were
+        // copying them, including the one that it is writing now
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t now = ring->written.load(std::memory_order_relaxed);
+        if (now + 1 > begin + size) {
+            uint64_t stale = std::min(now + 1 - size - begin, end - begin);
+            result.erase(result.begin() + first,
+                         result.begin() + first + stale);
+        }
+    }
+
+    std::stable_sort(result.begin(), result.end(),
+                     [] (const Event & e1, const Event & e2)
+                     {
+                         return e1.ticks < e2.ticks;
+                     });
+
+    return result;
+}
+
+double
+EventTracer::
+toSeconds(uint64_t ticks) const
+{
+    return startSeconds
+        + (double(int64_t(ticks - startTicks)) * ML::seconds_per_tick);
+}
+
+Json::Value
+EventTracer::
+eventsJson(size_t maxEvents) const
+{
+    auto all = events();
+    size_t first = all.size() > maxEvents ? all.size() - maxEvents : 0;
+
+    Json::Value result(Json::arrayValue);
+    for (size_t i = first;  i < all.size();  ++i) {
+        const Event & event = all[i];
+        Json::Value & entry = result[result.size()];
+        entry["time"] = toSeconds(event.ticks);
+        entry["stage"] = event.stage < stageNames.size()
+            ? stageNames[event.stage] : to_string(event.stage);
+        entry["id"] = ML::format("%016llx", (unsigned long long)event.id);
+        entry["thread"] = event.thread;
+    }
+
+    return result;
+}
+
+Json::Value
+EventTracer::
+breakdown() const
+{
+    auto all = events();
+
+    std::vector<std::unique_ptr<LatencyHistogram> > stageLatencies;
+    for (unsigned i = 0;  i < stageNames.size();  ++i)
+        stageLatencies.emplace_back(new LatencyHistogram());
+
+    // The tick counters of the cores can be slightly out of step
+    auto toMicros = [] (uint64_t start, uint64_t end) -> uint64_t
+        {
+            if (end <= start)
+                return 0;
+            return (end - start) * ML::seconds_per_tick * 1000000.0;
+        };
+
+    // First and last tick count of each request
+    std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t> > requests;
+
+    for (const Event & event: all) {
+        auto res = requests.insert(make_pair(event.id,
+                                             make_pair(event.ticks,
+                                                       event.ticks)));
+        if (res.second || event.stage >= stageNames.size())
+            continue;
+
+        uint64_t & last = res.first->second.second;
+        stageLatencies[event.stage]->record(toMicros(last, event.ticks));
+        last = event.ticks;
+    }
+
+    LatencyHistogram total;
+    for (auto & entry: requests) {
+        if (entry.second.second != entry.second.first)
+            total.record(toMicros(entry.second.first, entry.second.second));
+    }
+
+    Json::Value result;
+    result["events"] = (Json::UInt)all.size();
+    result["requests"] = (Json::UInt)requests.size();
+    for (unsigned i = 0;  i < stageNames.size();  ++i)
+        result["stages"][stageNames[i]] = stageLatencies[i]->toJson();
+    result["total"] = total.toJson();
+
+    return result;
+}
+
+void
+EventTracer::
+clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto & ring: rings)
+        ring->cleared = ring->written.load(std::memory_order_acquire);
+}
+
+} // namespace Datacratic
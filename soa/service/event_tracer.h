@@ -0,0 +1,147 @@
+/* event_tracer.h                                                  -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Low-overhead tracing of the stages that requests go through.
+*/
+
+#pragma once
+
+#include "soa/jsoncpp/value.h"
+#include "jml/arch/tick_counter.h"
+#include "jml/compiler/compiler.h"
+#include <boost/thread/tss.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* EVENT TRACER                                                              */
+/*****************************************************************************/
+
+/** Records fixed-size binary events (stage, id of the request, tick count)
+    into a ring buffer per thread, which keeps the last events of each
+    thread (one less than the size of the ring).
+
+    Recording an event is a thread-local lookup and a store into the ring,
+    with no lock, allocation or formatting, so tracing can stay on in
+    production.  The rings are only read when they are dumped, which
+    copies them and discards the events that were overwritten in the
+    meantime.
+
+    The rings of threads that exit are kept so that their events can still
+    be dumped; the tracer is meant for long-lived threads.
+*/
+
+struct EventTracer {
+
+    struct Event {
+        uint64_t ticks;        ///< ML::ticks() when it was recorded
+        uint64_t id;           ///< hash of the request
+        uint16_t stage;        ///< index in the stage names
+        uint16_t thread;       ///< number of the recording thread
+        uint32_t unused;
+    };
+
+    /** Create a tracer for the given stages, with a ring of ringSize events
+        per thread (rounded up to a power of two).
+    */
+    EventTracer(std::vector<std::string> stageNames,
+                size_t ringSize = 65536);
+
+    ~EventTracer();
+
+    EventTracer(const EventTracer & other) = delete;
+    EventTracer & operator = (const EventTracer & other) = delete;
+
+    void record(unsigned stage, uint64_t id)
+    {
+        if (JML_UNLIKELY(!enabled.load(std::memory_order_relaxed)))
+            return;
+        record(stage, id, ML::ticks());
+    }
+
+    /** Record an event that happened at the given tick count, for when the
+        id of the request is only known later.
+    */
+    void record(unsigned stage, uint64_t id, uint64_t ticks)
+    {
+        if (JML_UNLIKELY(!enabled.load(std::memory_order_relaxed)))
+            return;
+
+        Ring * ring = threadRing.get();
+        if (JML_UNLIKELY(!ring))
+            ring = createRing();
+
+        uint64_t pos = ring->written.load(std::memory_order_relaxed);
+        Event & event = ring->events[pos & mask];
+        event.ticks = ticks;
+        event.id = id;
+        event.stage = stage;
+        event.thread = ring->thread;
+        ring->written.store(pos + 1, std::memory_order_release);
+    }
+
+    void enable(bool enabled = true) { this->enabled = enabled; }
+    bool isEnabled() const { return enabled; }
+
+    const std::vector<std::string> & stages() const { return stageNames; }
+
+    /** Events of all of the threads that are still in their rings, in the
+        order in which they were recorded.
+    */
+    std::vector<Event> events() const;
+
+    /** Convert a tick count of an event to a time in seconds since the
+        epoch.
+    */
+    double toSeconds(uint64_t ticks) const;
+
+    /** The last maxEvents events, with their stage names and times. */
+    Json::Value eventsJson(size_t maxEvents = 1000) const;
+
+    /** Latency histograms of each stage over the events that are in the
+        rings.  The latency of a stage is the time since the previous
+        event with the same id, which is the time that it took for the
+        request to get from the previous stage to this one.  The time
+        between the first and the last event of each request is under
+        "total".
+    */
+    Json::Value breakdown() const;
+
+    /** Forget all of the events recorded so far. */
+    void clear();
+
+private:
+    struct Ring {
+        Ring(size_t size, uint16_t thread);
+
+        std::atomic<uint64_t> written;
+        uint64_t cleared;              ///< position of the last clear()
+        uint16_t thread;
+        std::unique_ptr<Event[]> events;
+    };
+
+    Ring * createRing();
+
+    std::vector<std::string> stageNames;
+    uint64_t mask;
+    std::atomic<bool> enabled;
+
+    boost::thread_specific_ptr<Ring> threadRing;
+
+    mutable std::mutex lock;
+    std::vector<std::unique_ptr<Ring> > rings;
+
+    // Time reference to convert ticks to dates
+    uint64_t startTicks;
+    double startSeconds;
+};
+
+} // namespace Datacratic
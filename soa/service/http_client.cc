@@ -3,6 +3,9 @@
    Copyright (c) 2014 Datacratic.  All rights reserved.
 */
 
+#include <cmath>
+#include <cstring>
+
 #include "http_client.h"
 #include "http_client_v1.h"
 #include "http_client_v2.h"
@@ -41,6 +44,126 @@ struct AtInit {
 } // file scope
 
 
+/****************************************************************************/
+/* HTTP CLIENT STATS                                                        */
+/****************************************************************************/
+
+HttpClientStats::
+HttpClientStats()
+    : requests(0), responses(0), errors(0), timeouts(0),
+      connections(0), reaped(0), queueDepth(0), inFlight(0)
+{
+}
+
+void
+HttpClientStats::
+recordLatency(uint64_t micros)
+{
+    latency.record(micros);
+}
+
+double
+HttpClientStats::
+latencyPercentile(double pct)
+    const
+{
+    return latency.percentile(pct) / 1000.0;
+}
+
+Json::Value
+HttpClientStats::
+toJson()
+    const
+{
+    Json::Value result;
+
+    result["requests"] = (Json::UInt) requests;
+    result["responses"] = (Json::UInt) responses;
+    result["errors"] = (Json::UInt) errors;
+    result["timeouts"] = (Json::UInt) timeouts;
+    result["connections"] = (Json::UInt) connections;
+    result["reaped"] = (Json::UInt) reaped;
+    result["queueDepth"] = (Json::UInt) queueDepth;
+    result["inFlight"] = (Json::UInt) inFlight;
+
+    Json::Value & latencyMs = result["latencyMs"];
+    latencyMs["samples"] = (Json::UInt) latency.count();
+    latencyMs["p50"] = latencyPercentile(50);
+    latencyMs["p90"] = latencyPercentile(90);
+    latencyMs["p99"] = latencyPercentile(99);
+    latencyMs["p999"] = latencyPercentile(99.9);
+
+    return result;
+}
+
+
+/****************************************************************************/
+/* HTTP CLIENT IMPL                                                         */
+/****************************************************************************/
+
+void
+HttpClientImpl::
+setPipelineDepth(size_t depth)
+{
+    if (depth > 1) {
+        throw ML::Exception("pipeline depth is not supported by this"
+                            " implementation");
+    }
+}
+
+void
+HttpClientImpl::
+setConnectTimeout(double seconds)
+{
+    throw ML::Exception("connect timeouts are not supported by this"
+                        " implementation");
+}
+
+void
+HttpClientImpl::
+setActivityTimeout(double seconds)
+{
+    throw ML::Exception("activity timeouts are not supported by this"
+                        " implementation");
+}
+
+void
+HttpClientImpl::
+setIdleTimeout(double seconds)
+{
+    throw ML::Exception("idle timeouts are not supported by this"
+                        " implementation");
+}
+
+void
+HttpClientImpl::
+enableCompressedResponses(bool value)
+{
+    if (value) {
+        throw ML::Exception("compressed responses are not supported by this"
+                            " implementation");
+    }
+}
+
+void
+HttpClientImpl::
+setRequestCompression(HttpContentEncoding encoding, size_t threshold)
+{
+    if (encoding != CE_IDENTITY) {
+        throw ML::Exception("request compression is not supported by this"
+                            " implementation");
+    }
+}
+
+HttpClientStats
+HttpClientImpl::
+stats()
+    const
+{
+    return HttpClientStats();
+}
+
+
 /****************************************************************************/
 /* HTTP CLIENT ERROR                                                        */
 /****************************************************************************/
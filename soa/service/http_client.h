@@ -26,7 +26,9 @@
 
 #include "soa/jsoncpp/value.h"
 #include "soa/service/async_event_source.h"
+#include "soa/service/http_compression.h"
 #include "soa/service/http_header.h"
+#include "soa/service/latency_histogram.h"
 
 
 namespace Datacratic {
@@ -104,6 +106,39 @@ struct HttpRequest {
 };
 
 
+/****************************************************************************/
+/* HTTP CLIENT STATS                                                        */
+/****************************************************************************/
+
+/* Snapshot of the activity of an HttpClient towards its host. Latencies are
+ * recorded in microseconds into a LatencyHistogram. */
+
+struct HttpClientStats {
+    HttpClientStats();
+
+    /* record the time elapsed between the sending of a request and the
+     * reception of the last byte of its response */
+    void recordLatency(uint64_t micros);
+
+    /* latency below which "pct" percent of the requests were completed, in
+     * milliseconds */
+    double latencyPercentile(double pct) const;
+
+    Json::Value toJson() const;
+
+    uint64_t requests;      /* requests sent to the host */
+    uint64_t responses;     /* requests completed successfully */
+    uint64_t errors;        /* requests completed with an error */
+    uint64_t timeouts;      /* requests that timed out (included in errors) */
+    uint64_t connections;   /* connection attempts */
+    uint64_t reaped;        /* idle connections closed by the client */
+    size_t queueDepth;      /* requests waiting for a connection */
+    size_t inFlight;        /* requests sent and waiting for a response */
+
+    LatencyHistogram latency;
+};
+
+
 /****************************************************************************/
 /* HTTP CLIENT IMPL                                                         */
 /****************************************************************************/
@@ -143,6 +178,40 @@ struct HttpClientImpl : public AsyncEventSource {
 
     /* Returns the number of requests in the queue */
     virtual size_t queuedRequests() const = 0;
+
+    /* The methods below are optional and throw when not supported by the
+       implementation. They must be invoked before the first request is
+       enqueued. */
+
+    /** Maximum number of requests sent on a connection before the response
+     * to the first one is received. Implies "enablePipelining" when > 1. */
+    virtual void setPipelineDepth(size_t depth);
+
+    /** Number of seconds after which a connection attempt is aborted.  As
+     * with curl, the timeout given to a request also counts from the moment
+     * it is sent, so it includes the time spent connecting for it. */
+    virtual void setConnectTimeout(double seconds);
+
+    /** Number of seconds without any byte received after which a connection
+     * with pending requests is closed and its requests failed */
+    virtual void setActivityTimeout(double seconds);
+
+    /** Number of seconds after which an unused connection is closed */
+    virtual void setIdleTimeout(double seconds);
+
+    /** Advertise the support of compressed responses via the
+     * "Accept-Encoding" header. Such responses are decompressed before
+     * being passed to the callbacks. */
+    virtual void enableCompressedResponses(bool value);
+
+    /** Compress the request bodies of at least "threshold" bytes with
+     * "encoding", which must be supported by the server. */
+    virtual void setRequestCompression(HttpContentEncoding encoding,
+                                       size_t threshold
+                                       = DefaultCompressionThreshold);
+
+    /** Returns a snapshot of the activity statistics of the client */
+    virtual HttpClientStats stats() const;
 };
 
 
@@ -312,6 +381,44 @@ struct HttpClient : public AsyncEventSource {
         return impl->queuedRequests();
     }
 
+    /** See HttpClientImpl */
+    void setPipelineDepth(size_t depth)
+    {
+        impl->setPipelineDepth(depth);
+    }
+
+    void setConnectTimeout(double seconds)
+    {
+        impl->setConnectTimeout(seconds);
+    }
+
+    void setActivityTimeout(double seconds)
+    {
+        impl->setActivityTimeout(seconds);
+    }
+
+    void setIdleTimeout(double seconds)
+    {
+        impl->setIdleTimeout(seconds);
+    }
+
+    void enableCompressedResponses(bool value)
+    {
+        impl->enableCompressedResponses(value);
+    }
+
+    void setRequestCompression(HttpContentEncoding encoding,
+                               size_t threshold = DefaultCompressionThreshold)
+    {
+        impl->setRequestCompression(encoding, threshold);
+    }
+
+    HttpClientStats stats()
+        const
+    {
+        return impl->stats();
+    }
+
     HttpClient & operator = (HttpClient && other) noexcept
     {
         if (&other != this) {
@@ -13,6 +13,7 @@
 #include "message_loop.h"
 #include "http_header.h"
 #include "http_parsers.h"
+#include "http_compression.h"
 
 #include "http_client_v2.h"
 
@@ -42,6 +43,7 @@ translateError(TcpConnectionCode code)
         error = HttpClientError::CouldNotConnect;
         break;
     case ConnectionEnded:
+    case UnknownError:
         error = HttpClientError::Unknown;
         break;
     default:
@@ -52,13 +54,19 @@ translateError(TcpConnectionCode code)
     return error;
 }
 
+/* Each pipelined request requires up to two messages in the queue of
+   TcpClient, which is sized accordingly. */
+constexpr size_t MaxPipelineDepth(16);
+constexpr size_t DefaultPipelineDepth(4);
+
 bool getExpectResponseBody(const HttpRequest & request)
 {
     return (request.verb_ != "HEAD");
 }
 
 string
-makeRequestStr(const HttpRequest & request)
+makeRequestStr(const HttpRequest & request, size_t contentSize,
+               HttpContentEncoding contentEncoding, bool acceptCompression)
 {
     string requestStr;
     requestStr.reserve(10000);
@@ -76,20 +84,93 @@ makeRequestStr(const HttpRequest & request)
         requestStr += ":" + to_string(port);
     }
     requestStr += "\r\nAccept: */*\r\n";
+    if (acceptCompression) {
+        requestStr += "Accept-Encoding: gzip, deflate\r\n";
+    }
     for (const auto & header: request.headers_) {
         requestStr += header.first + ":" + header.second + "\r\n";
     }
-    const auto & content = request.content_;
-    if (!content.str.empty()) {
+    if (contentSize > 0) {
         requestStr += ("Content-Length: "
-                       + to_string(content.str.size()) + "\r\n");
-        requestStr += "Content-Type: " + content.contentType + "\r\n";
+                       + to_string(contentSize) + "\r\n");
+        requestStr += ("Content-Type: " + request.content_.contentType
+                       + "\r\n");
+        if (contentEncoding != CE_IDENTITY) {
+            requestStr += ("Content-Encoding: " + print(contentEncoding)
+                           + "\r\n");
+        }
     }
     requestStr += "\r\n";
 
     return requestStr;
 }
 
+/* Returns the encoding specified by a "Content-Encoding" header line, or -1
+   when "data" contains another header. */
+int
+getContentEncoding(const char * data, size_t size)
+{
+    static const char header[] = "content-encoding:";
+    static constexpr size_t headerLen = sizeof(header) - 1;
+
+    if (size <= headerLen || ::strncasecmp(data, header, headerLen) != 0) {
+        return -1;
+    }
+
+    /* the line ends with "\r\n" */
+    size_t valueSize = size - headerLen;
+    while (valueSize > 0 && ::isspace(data[headerLen + valueSize - 1])) {
+        valueSize--;
+    }
+
+    /* unsupported encodings are passed through */
+    try {
+        return parseContentEncoding(string(data + headerLen, valueSize));
+    }
+    catch (const ML::Exception & exc) {
+        return CE_IDENTITY;
+    }
+}
+
+/* Returns whether "data" is a "Content-Length" header line. */
+bool
+isContentLength(const char * data, size_t size)
+{
+    static const char header[] = "content-length:";
+    static constexpr size_t headerLen = sizeof(header) - 1;
+
+    return size > headerLen && ::strncasecmp(data, header, headerLen) == 0;
+}
+
+/* Returns the compression applied before the chunked encoding that is
+   specified by a "Transfer-Encoding" header line (as in "gzip, chunked"), or
+   -1 when "data" contains another header or no supported compression. */
+int
+getTransferCompression(const char * data, size_t size)
+{
+    static const char header[] = "transfer-encoding:";
+    static constexpr size_t headerLen = sizeof(header) - 1;
+
+    if (size <= headerLen || ::strncasecmp(data, header, headerLen) != 0) {
+        return -1;
+    }
+
+    string value(data + headerLen, size - headerLen);
+    size_t comma = value.find(',');
+    if (comma == string::npos) {
+        return -1;
+    }
+
+    try {
+        HttpContentEncoding encoding
+            = parseContentEncoding(value.substr(0, comma));
+        return encoding == CE_IDENTITY ? -1 : encoding;
+    }
+    catch (const ML::Exception & exc) {
+        return -1;
+    }
+}
+
 } // file scope
 
 
@@ -99,8 +180,12 @@ makeRequestStr(const HttpRequest & request)
 
 HttpConnection::
 HttpConnection()
-    : responseState_(IDLE), requestEnded_(false), lastCode_(Success),
-      timeoutFd_(-1)
+    : TcpClient(nullptr, nullptr, nullptr, 2 * MaxPipelineDepth + 1),
+      connectTimeout(-1), activityTimeout(-1),
+      acceptCompression(false), requestEncoding(CE_IDENTITY),
+      compressionThreshold(DefaultCompressionThreshold),
+      responseEncoding_(CE_IDENTITY),
+      closeRequested_(false), notifyOnClose_(false), timeoutFd_(-1)
 {
     // cerr << "HttpConnection(): " << this << "\n";
 
@@ -128,11 +213,16 @@ HttpConnection::
 ~HttpConnection()
 {
     // cerr << "~HttpConnection: " << this << "\n";
-    cancelRequestTimer();
-    if (responseState_ != IDLE) {
+    if (timeoutFd_ != -1) {
+        removeFd(timeoutFd_);
+        unregisterFdCallback(timeoutFd_, true);
+        ::close(timeoutFd_);
+        timeoutFd_ = -1;
+    }
+    if (!requests_.empty()) {
         ::fprintf(stderr,
-                  "destroying non-idle connection: %d",
-                  responseState_);
+                  "destroying connection with %zu pending requests\n",
+                  requests_.size());
         abort();
     }
 }
@@ -141,10 +231,11 @@ void
 HttpConnection::
 clear()
 {
-    responseState_ = IDLE;
-    requestEnded_ = false;
-    request_.clear();
-    lastCode_ = Success;
+    parser_.clear();
+    responseEncoding_ = CE_IDENTITY;
+    compressedBody_.clear();
+    closeRequested_ = false;
+    notifyOnClose_ = false;
 }
 
 void
@@ -153,32 +244,54 @@ perform(HttpRequest && request)
 {
     // cerr << "perform: " << this << endl;
 
-    if (responseState_ != IDLE) {
-        throw ML::Exception("%p: cannot process a request when state is not"
-                            " idle: %d", this, responseState_);
+    if (closeRequested_) {
+        throw ML::Exception("%p: cannot process a request while the"
+                            " connection is closing", this);
     }
 
-    request_ = move(request);
+    requests_.emplace_back(move(request));
+    const HttpRequest & newRequest = requests_.back().request;
+    if (requests_.size() == 1) {
+        lastActivity_ = requests_.back().sent;
+        parser_.setExpectBody(getExpectResponseBody(newRequest));
+    }
 
     if (queueEnabled()) {
-        startSendingRequest();
+        startSendingRequest(newRequest);
     }
     else {
+        ExcAssertEqual(requests_.size(), 1);
         auto onConnectionResult = [&] (TcpConnectionResult result) {
-            if (result.code == TcpConnectionCode::Success) {
-                startSendingRequest();
-            }
-            else {
-                handleEndOfRq(result.code, false);
-            }
+            this->handleConnectionResult(result);
         };
+        connectStart_ = lastActivity_;
         connect(onConnectionResult);
     }
+
+    armTimer();
+}
+
+void
+HttpConnection::
+handleConnectionResult(const TcpConnectionResult & result)
+{
+    if (result.code == TcpConnectionCode::Success) {
+        /* no request is pipelined until the connection is established */
+        startSendingRequest(requests_.front().request);
+    }
+    else {
+        while (!requests_.empty()) {
+            finalizeRequest(result.code);
+        }
+        clear();
+        armTimer();
+        onDone(result.code);
+    }
 }
 
 void
 HttpConnection::
-startSendingRequest()
+startSendingRequest(const HttpRequest & request)
 {
     /* This controls the maximum body size from which the body will be written
        separately from the request headers. This tend to improve performance
@@ -187,51 +300,60 @@ startSendingRequest()
        tested on different setups. */
     static constexpr size_t TwoStepsThreshold(65536);
 
-    parser_.setExpectBody(getExpectResponseBody(request_));
-    string rqData = makeRequestStr(request_);
+    /* Bodies are compressed with the zlib streams of the loop thread. */
+    const string * body = &request.content_.str;
+    HttpContentEncoding encoding(CE_IDENTITY);
+    string compressed;
+    if (requestEncoding != CE_IDENTITY
+        && body->size() >= compressionThreshold) {
+        compressContent(requestEncoding, body->c_str(), body->size(),
+                        compressed);
+        body = &compressed;
+        encoding = requestEncoding;
+    }
+
+    string rqData = makeRequestStr(request, body->size(), encoding,
+                                   acceptCompression);
 
     bool twoSteps(false);
 
-    const HttpRequest::Content & content = request_.content_;
-    if (content.str.size() > 0) {
-        if (content.str.size() < TwoStepsThreshold) {
-            rqData.append(content.str);
+    if (body->size() > 0) {
+        if (body->size() < TwoStepsThreshold) {
+            rqData.append(*body);
         }
         else {
             twoSteps = true;
         }
     }
-    responseState_ = PENDING;
-
-    auto onWriteResultFinal = [&] (AsyncWriteResult result) {
-        if (result.error == 0) {
-            ExcAssertEqual(responseState_, PENDING);
-            responseState_ = IDLE;
-        }
-        else {
-            throw ML::Exception("unhandled error");
-        }
-    };
 
-    if (twoSteps) {
-        auto onWriteResultFirst
-            = [this, onWriteResultFinal] (AsyncWriteResult result) {
-            if (result.error == 0) {
-                ExcAssertEqual(responseState_, PENDING);
-                const HttpRequest::Content & content = request_.content_;
-                write(move(content.str), onWriteResultFinal);
-            }
-            else {
-                throw ML::Exception("unhandled error");
-            }
-        };
-        write(move(rqData), onWriteResultFirst);
+    /* Write errors are always followed by the closing of the connection,
+       where the pending requests are failed. The writes of a pipelined
+       request are queued behind those of the previous ones, which ensures
+       they are sent in order. */
+    bool queued = write(move(rqData), nullptr);
+    if (queued && twoSteps) {
+        queued = write(*body, nullptr);
     }
-    else {
-        write(move(rqData), onWriteResultFinal);
+    if (!queued) {
+        throw ML::Exception("%p: message queue is full", this);
+    }
+}
+
+bool
+HttpConnection::
+reap()
+{
+    ExcAssert(requests_.empty());
+
+    if (closeRequested_ || !queueEnabled()) {
+        return false;
     }
 
-    armRequestTimer();
+    closeRequested_ = true;
+    notifyOnClose_ = true;
+    requestClose();
+
+    return true;
 }
 
 void
@@ -239,6 +361,7 @@ HttpConnection::
 onReceivedData(const char * data, size_t size)
 {
     // cerr << "onReceivedData: " + string(data, size) + "\n";
+    lastActivity_ = Date::now();
     parser_.feed(data, size);
 }
 
@@ -255,7 +378,16 @@ HttpConnection::
 onParserResponseStart(const string & httpVersion, int code)
 {
     // ::fprintf(stderr, "%p: onParserResponseStart\n", this);
-    request_.callbacks_->onResponseStart(request_, httpVersion, code);
+    if (requests_.empty()) {
+        throw ML::Exception("%p: received a response without a request",
+                            this);
+    }
+    responseEncoding_ = CE_IDENTITY;
+    compressedBody_.clear();
+    contentLength_.clear();
+
+    const HttpRequest & request = requests_.front().request;
+    request.callbacks_->onResponseStart(request, httpVersion, code);
 }
 
 void
@@ -263,7 +395,58 @@ HttpConnection::
 onParserHeader(const char * data, size_t size)
 {
     // cerr << "onParserHeader: " << this << endl;
-    request_.callbacks_->onHeader(request_, data, size);
+    const HttpRequest & request = requests_.front().request;
+
+    /* The callbacks receive the decoded body, so the headers describing
+       the compression are not passed along. */
+    int transferCompression = getTransferCompression(data, size);
+    if (transferCompression != -1) {
+        responseEncoding_ = HttpContentEncoding(transferCompression);
+        static const char chunked[] = "Transfer-Encoding: chunked\r\n";
+        request.callbacks_->onHeader(request, chunked, sizeof(chunked) - 1);
+        return;
+    }
+
+    if (acceptCompression) {
+        int encoding = getContentEncoding(data, size);
+        if (encoding != -1) {
+            responseEncoding_ = HttpContentEncoding(encoding);
+            if (encoding != CE_IDENTITY) {
+                return;
+            }
+        }
+
+        /* The length of a compressed body is only known once it has been
+           decoded, and the "Content-Encoding" header may come after this
+           one, so it is held until the body; see sendContentLength(). */
+        if (isContentLength(data, size)) {
+            contentLength_.assign(data, size);
+            return;
+        }
+    }
+
+    request.callbacks_->onHeader(request, data, size);
+}
+
+/* Passes on the "Content-Length" header held by onParserHeader, with the
+   length of the decoded body when it was compressed. */
+void
+HttpConnection::
+sendContentLength(size_t decodedSize)
+{
+    if (contentLength_.empty()) {
+        return;
+    }
+
+    if (responseEncoding_ != CE_IDENTITY) {
+        contentLength_ = ("Content-Length: " + to_string(decodedSize)
+                          + "\r\n");
+    }
+
+    const HttpRequest & request = requests_.front().request;
+    request.callbacks_->onHeader(request,
+                                 contentLength_.c_str(), contentLength_.size());
+    contentLength_.clear();
 }
 
 void
@@ -271,113 +454,207 @@ HttpConnection::
 onParserData(const char * data, size_t size)
 {
     // cerr << "onParserData: " << this << endl;
-    request_.callbacks_->onData(request_, data, size);
+    if (responseEncoding_ != CE_IDENTITY) {
+        compressedBody_.append(data, size);
+        return;
+    }
+
+    sendContentLength(0);
+
+    const HttpRequest & request = requests_.front().request;
+    request.callbacks_->onData(request, data, size);
 }
 
 void
 HttpConnection::
 onParserDone(bool doClose)
 {
-    handleEndOfRq(Success, doClose);
+    TcpConnectionCode code(Success);
+
+    if (responseEncoding_ != CE_IDENTITY) {
+        string body;
+        try {
+            decompressContent(responseEncoding_,
+                              compressedBody_.c_str(), compressedBody_.size(),
+                              body);
+        }
+        catch (const std::exception & exc) {
+            cerr << "http client: " << exc.what() << endl;
+            code = UnknownError;
+        }
+
+        if (code == Success) {
+            sendContentLength(body.size());
+        }
+        responseEncoding_ = CE_IDENTITY;
+        compressedBody_.clear();
+        contentLength_.clear();
+
+        if (code == Success && body.size() > 0) {
+            const HttpRequest & request = requests_.front().request;
+            request.callbacks_->onData(request, body.c_str(), body.size());
+        }
+    }
+    else {
+        /* bodies without any data */
+        sendContentLength(0);
+    }
+
+    handleEndOfRq(code, doClose);
 }
 
-/* This method handles end of requests: callback invocation, timer
- * cancellation etc. It may request the closing of the connection, in which
- * case the HttpConnection will be ready for a new request only after
- * finalizeEndOfRq is invoked. */
+/* This method handles the end of the oldest pending request: callback
+ * invocation, timer rearming etc. It may request the closing of the
+ * connection, in which case the remaining pipelined requests are failed and
+ * the HttpConnection will be ready for a new request only after "onClosed"
+ * is invoked. */
 void
 HttpConnection::
 handleEndOfRq(TcpConnectionCode code, bool requireClose)
 {
-    if (requestEnded_) {
+    if (requests_.empty() || closeRequested_) {
         // cerr << "ignoring extraneous end of request\n";
-        ;
+        return;
+    }
+
+    finalizeRequest(code);
+    if (requireClose) {
+        closeRequested_ = true;
+        notifyOnClose_ = true;
+        disarmTimer();
+        requestClose();
     }
     else {
-        requestEnded_ = true;
-        cancelRequestTimer();
-        if (requireClose) {
-            lastCode_ = code;
-            requestClose();
-        }
-        else {
-            finalizeEndOfRq(code);
+        if (!requests_.empty()) {
+            const HttpRequest & next = requests_.front().request;
+            parser_.setExpectBody(getExpectResponseBody(next));
         }
+        armTimer();
+        onDone(code);
     }
 }
 
 void
 HttpConnection::
-finalizeEndOfRq(TcpConnectionCode code)
+finalizeRequest(TcpConnectionCode code)
 {
-    request_.callbacks_->onDone(request_, translateError(code));
-    clear();
-    onDone(code);
+    PendingRequest pending(move(requests_.front()));
+    requests_.pop_front();
+
+    lastActivity_ = Date::now();
+    if (onRequestDone) {
+        onRequestDone(pending.request, code,
+                      lastActivity_.secondsSince(pending.sent));
+    }
+    pending.request.callbacks_->onDone(pending.request, translateError(code));
 }
 
 void
 HttpConnection::
 onClosed(bool fromPeer, const std::vector<std::string> & msgs)
 {
-    if (fromPeer) {
-        handleEndOfRq(ConnectionEnded, false);
+    handleClosed();
+}
+
+void
+HttpConnection::
+handleClosed()
+{
+    bool notify = notifyOnClose_ || !requests_.empty();
+
+    disarmTimer();
+    while (!requests_.empty()) {
+        finalizeRequest(ConnectionEnded);
     }
-    else {
-        finalizeEndOfRq(lastCode_);
+    clear();
+
+    /* idle connections closed by the peer are still available and must not
+       be reported */
+    if (notify) {
+        onDone(ConnectionEnded);
     }
 }
 
+/* The timer is armed to the closest of the connect deadline, the deadline
+   of the oldest pending request and the activity deadline. The request
+   deadline counts from the moment the request was handed to the connection,
+   so that it includes the time spent connecting, as with curl; the activity
+   deadline only applies once connected. Since expiries are always verified
+   in handleTimeoutEvent, the timer does not need to be rearmed whenever
+   data is received. */
 void
 HttpConnection::
-armRequestTimer()
+armTimer()
 {
-    if (request_.timeout_ > 0) {
-        if (timeoutFd_ == -1) {
-            timeoutFd_ = timerfd_create(CLOCK_MONOTONIC,
-                                        TFD_NONBLOCK | TFD_CLOEXEC);
-            if (timeoutFd_ == -1) {
-                throw ML::Exception(errno, "timerfd_create");
-            }
-            auto handleTimeoutEventCb = [&] (const struct epoll_event & event) {
-                this->handleTimeoutEvent(event);
-            };
-            registerFdCallback(timeoutFd_, handleTimeoutEventCb);
-            // cerr << " timeoutFd_: "  + to_string(timeoutFd_) + "\n";
-            addFdOneShot(timeoutFd_, true, false);
-            // cerr << "timer armed\n";
-        }
-        else {
-            // cerr << "timer rearmed\n";
-            modifyFdOneShot(timeoutFd_, true, false);
+    if (requests_.empty()) {
+        disarmTimer();
+        return;
+    }
+
+    Date deadline;
+    auto setDeadline = [&] (Date newDeadline) {
+        if (deadline == Date() || newDeadline < deadline) {
+            deadline = newDeadline;
         }
+    };
 
-        itimerspec spec;
-        ::memset(&spec, 0, sizeof(itimerspec));
+    if (state() == TcpClientState::Connecting && connectTimeout > 0) {
+        setDeadline(connectStart_.plusSeconds(connectTimeout));
+    }
+    const PendingRequest & oldest = requests_.front();
+    if (oldest.request.timeout_ > 0) {
+        setDeadline(oldest.sent.plusSeconds(oldest.request.timeout_));
+    }
+    if (state() != TcpClientState::Connecting && activityTimeout > 0) {
+        setDeadline(lastActivity_.plusSeconds(activityTimeout));
+    }
+    if (deadline == Date()) {
+        disarmTimer();
+        return;
+    }
 
-        spec.it_interval.tv_sec = 0;
-        spec.it_value.tv_sec = request_.timeout_;
-        int res = timerfd_settime(timeoutFd_, 0, &spec, nullptr);
-        if (res == -1) {
-            throw ML::Exception(errno, "timerfd_settime");
+    if (timeoutFd_ == -1) {
+        timeoutFd_ = timerfd_create(CLOCK_MONOTONIC,
+                                    TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timeoutFd_ == -1) {
+            throw ML::Exception(errno, "timerfd_create");
         }
+        auto handleTimeoutEventCb = [&] (const struct epoll_event & event) {
+            this->handleTimeoutEvent(event);
+        };
+        registerFdCallback(timeoutFd_, handleTimeoutEventCb);
+        addFdOneShot(timeoutFd_, true, false);
+    }
+    else {
+        modifyFdOneShot(timeoutFd_, true, false);
+    }
+
+    /* a zero value would disarm the timer */
+    double delay = std::max(deadline.secondsSince(Date::now()), 0.001);
+
+    itimerspec spec;
+    ::memset(&spec, 0, sizeof(itimerspec));
+
+    spec.it_value.tv_sec = delay;
+    spec.it_value.tv_nsec = (delay - spec.it_value.tv_sec) * 1000000000;
+    int res = timerfd_settime(timeoutFd_, 0, &spec, nullptr);
+    if (res == -1) {
+        throw ML::Exception(errno, "timerfd_settime");
     }
 }
 
 void
 HttpConnection::
-cancelRequestTimer()
+disarmTimer()
 {
-    // cerr << "cancel request timer " << this << "\n";
     if (timeoutFd_ != -1) {
-        // cerr << "  was active\n";
-        removeFd(timeoutFd_);
-        unregisterFdCallback(timeoutFd_, true);
-        ::close(timeoutFd_);
-        timeoutFd_ = -1;
+        itimerspec spec;
+        ::memset(&spec, 0, sizeof(itimerspec));
+        int res = timerfd_settime(timeoutFd_, 0, &spec, nullptr);
+        if (res == -1) {
+            throw ML::Exception(errno, "timerfd_settime");
+        }
     }
-    // else {
-    //     cerr << "  was not active\n";
-    // }
 }
 
 void
@@ -400,8 +677,36 @@ handleTimeoutEvent(const ::epoll_event & event)
                 throw ML::Exception(errno, "read");
             }
         }
-        handleEndOfRq(Timeout, true);
     }
+
+    if (requests_.empty() || closeRequested_) {
+        return;
+    }
+
+    Date now = Date::now();
+    const PendingRequest & oldest = requests_.front();
+    bool requestExpired = (oldest.request.timeout_ > 0
+                           && (oldest.sent.plusSeconds(oldest.request.timeout_)
+                               <= now));
+    if (state() == TcpClientState::Connecting) {
+        if (requestExpired
+            || (connectTimeout > 0
+                && connectStart_.plusSeconds(connectTimeout) <= now)) {
+            /* reported via handleConnectionResult */
+            abortConnect();
+            return;
+        }
+    }
+    else {
+        if (requestExpired
+            || (activityTimeout > 0
+                && lastActivity_.plusSeconds(activityTimeout) <= now)) {
+            handleEndOfRq(Timeout, true);
+            return;
+        }
+    }
+
+    armTimer();
 }
 
 
@@ -414,8 +719,12 @@ HttpClientV2(const string & baseUrl, int numParallel, size_t queueSize)
     : HttpClientImpl(baseUrl, numParallel, queueSize),
       loop_(1, 0, -1),
       baseUrl_(baseUrl),
+      connections_(numParallel),
       avlConnections_(numParallel),
       nextAvail_(0),
+      nextPipelined_(0),
+      pipelineDepth_(1),
+      idleTimeout_(-1),
       queue_([&]() { this->handleQueueEvent(); return false; }, queueSize)
 {
     ExcAssert(baseUrl.compare(0, 8, "https://") != 0);
@@ -428,7 +737,13 @@ HttpClientV2(const string & baseUrl, int numParallel, size_t queueSize)
         connection->onDone = [&, connPtr] (TcpConnectionCode result) {
             handleHttpConnectionDone(connPtr, result);
         };
+        connection->onRequestDone = [&] (const HttpRequest & request,
+                                         TcpConnectionCode result,
+                                         double latency) {
+            handleRequestDone(request, result, latency);
+        };
         loop_.addSource("connection" + to_string(i), connection);
+        connections_[i] = connPtr;
         avlConnections_[i] = connPtr;
     }
     loop_.addSource("queue", queue_);
@@ -478,11 +793,82 @@ void
 HttpClientV2::
 enablePipelining(bool value)
 {
-    if (value) {
-        throw ML::Exception("pipeline is not supported");
+    pipelineDepth_ = value ? DefaultPipelineDepth : 1;
+}
+
+void
+HttpClientV2::
+setPipelineDepth(size_t depth)
+{
+    if (depth < 1 || depth > MaxPipelineDepth) {
+        throw ML::Exception("pipeline depth must be between 1 and "
+                            + to_string(MaxPipelineDepth));
+    }
+    pipelineDepth_ = depth;
+}
+
+void
+HttpClientV2::
+setConnectTimeout(double seconds)
+{
+    for (HttpConnection * connection: connections_) {
+        connection->connectTimeout = seconds;
+    }
+}
+
+void
+HttpClientV2::
+setActivityTimeout(double seconds)
+{
+    for (HttpConnection * connection: connections_) {
+        connection->activityTimeout = seconds;
+    }
+}
+
+void
+HttpClientV2::
+setIdleTimeout(double seconds)
+{
+    if (idleTimeout_ <= 0 && seconds > 0) {
+        auto onReap = [&] (uint64_t) {
+            this->reapIdleConnections();
+        };
+        loop_.addPeriodic("reaper", std::min(seconds / 2, 1.0), onReap);
+    }
+    idleTimeout_ = seconds;
+}
+
+void
+HttpClientV2::
+enableCompressedResponses(bool value)
+{
+    for (HttpConnection * connection: connections_) {
+        connection->acceptCompression = value;
+    }
+}
+
+void
+HttpClientV2::
+setRequestCompression(HttpContentEncoding encoding, size_t threshold)
+{
+    for (HttpConnection * connection: connections_) {
+        connection->requestEncoding = encoding;
+        connection->compressionThreshold = threshold;
     }
 }
 
+HttpClientStats
+HttpClientV2::
+stats()
+    const
+{
+    std::unique_lock<std::mutex> guard(statsLock_);
+    HttpClientStats result(stats_);
+    result.queueDepth = queue_.size();
+
+    return result;
+}
+
 bool
 HttpClientV2::
 enqueueRequest(const string & verb, const string & resource,
@@ -505,7 +891,7 @@ handleQueueEvent()
     if (numConnections > 0) {
         /* "0" has a special meaning for pop_front and must be avoided here */
         auto requests = queue_.pop_front(numConnections);
-        for (auto request: requests) {
+        for (auto & request: requests) {
             HttpConnection * conn = getConnection();
             if (!conn) {
                 cerr << ("nextAvail_: "  + to_string(nextAvail_)
@@ -515,8 +901,53 @@ handleQueueEvent()
                 throw ML::Exception("inconsistency in count of available"
                                     " connections");
             }
-            conn->perform(move(request));
+            performRequest(conn, move(request));
+        }
+    }
+
+    /* all connections are busy: the remaining requests are pipelined */
+    if (pipelineDepth_ > 1) {
+        while (queue_.size() > 0) {
+            HttpConnection * conn = getPipelinedConnection();
+            if (!conn) {
+                break;
+            }
+            auto requests = queue_.pop_front(1);
+            if (requests.size() == 0) {
+                break;
+            }
+            performRequest(conn, move(requests[0]));
+        }
+    }
+}
+
+void
+HttpClientV2::
+performRequest(HttpConnection * connection, HttpRequest && request)
+{
+    /* A failed connection attempt can complete the request from within
+       perform(), so it must be counted beforehand; the counts are undone if
+       perform() throws instead. */
+    bool newConnection = !connection->queueEnabled();
+    {
+        std::unique_lock<std::mutex> guard(statsLock_);
+        stats_.requests++;
+        stats_.inFlight++;
+        if (newConnection) {
+            stats_.connections++;
+        }
+    }
+    try {
+        connection->perform(move(request));
+    }
+    catch (...) {
+        std::unique_lock<std::mutex> guard(statsLock_);
+        stats_.requests--;
+        stats_.inFlight--;
+        if (newConnection) {
+            stats_.connections--;
         }
+        throw;
     }
 }
 
@@ -528,13 +959,59 @@ handleHttpConnectionDone(HttpConnection * connection,
     auto requests = queue_.pop_front(1);
     if (requests.size() > 0) {
         // cerr << "emptying queue...\n";
-        connection->perform(move(requests[0]));
+        performRequest(connection, move(requests[0]));
     }
-    else {
+    else if (connection->inFlight() == 0) {
         releaseConnection(connection);
     }
 }
 
+void
+HttpClientV2::
+handleRequestDone(const HttpRequest & request, TcpConnectionCode result,
+                  double latency)
+{
+    std::unique_lock<std::mutex> guard(statsLock_);
+    stats_.inFlight--;
+    if (result == Success) {
+        stats_.responses++;
+    }
+    else {
+        stats_.errors++;
+        if (result == Timeout) {
+            stats_.timeouts++;
+        }
+    }
+    stats_.recordLatency(latency * 1000000);
+}
+
+void
+HttpClientV2::
+reapIdleConnections()
+{
+    if (idleTimeout_ <= 0) {
+        return;
+    }
+
+    Date limit = Date::now().plusSeconds(-idleTimeout_);
+    size_t numReaped(0);
+    for (size_t i = nextAvail_; i < avlConnections_.size(); i++) {
+        HttpConnection * conn = avlConnections_[i];
+        if (conn->lastActivity() < limit && conn->reap()) {
+            /* The connection is taken out of the available ones until it is
+               closed, where it is released via handleHttpConnectionDone. */
+            std::swap(avlConnections_[i], avlConnections_[nextAvail_]);
+            nextAvail_++;
+            numReaped++;
+        }
+    }
+
+    if (numReaped > 0) {
+        std::unique_lock<std::mutex> guard(statsLock_);
+        stats_.reaped += numReaped;
+    }
+}
+
 HttpConnection *
 HttpClientV2::
 getConnection()
@@ -554,6 +1031,22 @@ getConnection()
     return conn;
 }
 
+HttpConnection *
+HttpClientV2::
+getPipelinedConnection()
+{
+    size_t numConnections = connections_.size();
+    for (size_t i = 0; i < numConnections; i++) {
+        HttpConnection * conn = connections_[nextPipelined_];
+        nextPipelined_ = (nextPipelined_ + 1) % numConnections;
+        if (conn->canPipeline(pipelineDepth_)) {
+            return conn;
+        }
+    }
+
+    return nullptr;
+}
+
 void
 HttpClientV2::
 releaseConnection(HttpConnection * oldConnection)
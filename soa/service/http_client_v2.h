@@ -11,20 +11,18 @@
 
 /* TODO:
    nice to have:
-   - connect timeout
-   - activity timeout
    - parser:
      - needs better validation (header key size, ...)
-   - compression
-   - auto disconnect (keep-alive)
    - SSL support
-   - pipelining
  */
 
+#include <deque>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "soa/jsoncpp/value.h"
+#include "soa/types/date.h"
 #include "soa/service/http_client.h"
 #include "soa/service/http_header.h"
 #include "soa/service/http_parsers.h"
@@ -39,13 +37,15 @@ namespace Datacratic {
 /* HTTP CONNECTION                                                          */
 /****************************************************************************/
 
+/* A persistent connection to an HTTP server, on which requests can be
+ * pipelined. Responses are matched to the requests in the order in which
+ * the latter were sent. "onDone" is invoked each time a request has
+ * completed and the connection is able to accept a new one. */
+
 struct HttpConnection : TcpClient {
     typedef std::function<void (TcpConnectionCode)> OnDone;
-
-    enum HttpState {
-        IDLE,
-        PENDING
-    };
+    typedef std::function<void (const HttpRequest &, TcpConnectionCode,
+                                double)> OnRequestDone;
 
     HttpConnection();
 
@@ -56,14 +56,54 @@ struct HttpConnection : TcpClient {
     void clear();
     void perform(HttpRequest && request);
 
-    const HttpRequest & request() const
+    /* number of requests sent and waiting for a response */
+    size_t inFlight() const
+    {
+        return requests_.size();
+    }
+
+    /* whether another request can be pipelined on this connection without
+       waiting for the response to the previous ones */
+    bool canPipeline(size_t maxDepth) const
     {
-        return request_;
+        return (!requests_.empty() && requests_.size() < maxDepth
+                && !closeRequested_ && queueEnabled()
+                && state() == TcpClientState::Connected);
     }
 
+    /* close the connection while it is not in use, "onDone" being invoked
+       once it is closed. Returns false when the connection was not open. */
+    bool reap();
+
+    /* time at which the last request completed or the last byte was
+       received */
+    Date lastActivity() const
+    {
+        return lastActivity_;
+    }
+
+    double connectTimeout;
+    double activityTimeout;
+
+    /* content encoding */
+    bool acceptCompression;
+    HttpContentEncoding requestEncoding;
+    size_t compressionThreshold;
+
     OnDone onDone;
+    OnRequestDone onRequestDone;
 
 private:
+    struct PendingRequest {
+        PendingRequest(HttpRequest && newRequest)
+            : request(std::move(newRequest)), sent(Date::now())
+        {
+        }
+
+        HttpRequest request;
+        Date sent;
+    };
+
     /* tcp_socket overrides */
     virtual void onClosed(bool fromPeer,
                           const std::vector<std::string> & msgs);
@@ -75,23 +115,34 @@ private:
     void onParserData(const char * data, size_t size);
     void onParserDone(bool onClose);
 
-    void startSendingRequest();
+    void startSendingRequest(const HttpRequest & request);
 
+    void handleConnectionResult(const TcpConnectionResult & result);
     void handleEndOfRq(TcpConnectionCode code, bool requireClose);
-    void finalizeEndOfRq(TcpConnectionCode code);
+    void finalizeRequest(TcpConnectionCode code);
+    void handleClosed();
+    void sendContentLength(size_t decodedSize);
 
     HttpResponseParser parser_;
 
-    HttpState responseState_;
-    HttpRequest request_;
-    bool requestEnded_;
+    /* compressed responses are decoded once complete */
+    HttpContentEncoding responseEncoding_;
+    std::string compressedBody_;
+    std::string contentLength_;
+
+    /* pending requests, in the order they were sent */
+    std::deque<PendingRequest> requests_;
+
+    Date connectStart_;
+    Date lastActivity_;
 
     /* Connection: close */
-    TcpConnectionCode lastCode_;
+    bool closeRequested_;
+    bool notifyOnClose_;
 
-    /* request timeouts */
-    void armRequestTimer();
-    void cancelRequestTimer();
+    /* request, connect and activity timeouts */
+    void armTimer();
+    void disarmTimer();
     void handleTimeoutEvent(const ::epoll_event & event);
 
     int timeoutFd_;
@@ -102,6 +153,11 @@ private:
 /* HTTP CLIENT V2                                                           */
 /****************************************************************************/
 
+/* The client keeps "numParallel" persistent connections to its host, which
+ * are opened on demand and closed after "idleTimeout" seconds without
+ * activity. When a pipeline depth greater than one is set, requests are
+ * pipelined on busy connections when all the connections are in use. */
+
 struct HttpClientV2 : public HttpClientImpl {
     HttpClientV2(const std::string & baseUrl,
                  int numParallel, size_t queueSize);
@@ -132,6 +188,16 @@ struct HttpClientV2 : public HttpClientImpl {
         return queue_.size();
     }
 
+    void setPipelineDepth(size_t depth);
+    void setConnectTimeout(double seconds);
+    void setActivityTimeout(double seconds);
+    void setIdleTimeout(double seconds);
+    void enableCompressedResponses(bool value);
+    void setRequestCompression(HttpContentEncoding encoding,
+                               size_t threshold);
+
+    HttpClientStats stats() const;
+
     HttpClient & operator = (HttpClient && other) = delete;
     HttpClient & operator = (const HttpClient & other) = delete;
 
@@ -140,20 +206,36 @@ private:
 
     void handleHttpConnectionDone(HttpConnection * connection,
                                   TcpConnectionCode result);
+    void handleRequestDone(const HttpRequest & request,
+                           TcpConnectionCode result, double latency);
+    void reapIdleConnections();
+
+    void performRequest(HttpConnection * connection, HttpRequest && request);
 
     HttpConnection * getConnection();
+    HttpConnection * getPipelinedConnection();
     void releaseConnection(HttpConnection * connection);
 
     MessageLoop loop_;
 
     std::string baseUrl_;
 
+    std::vector<HttpConnection *> connections_;
+
+    /* idle connections, from "nextAvail_" to the end of the vector, the most
+       recently used connections being placed first */
     std::vector<HttpConnection *> avlConnections_;
     size_t nextAvail_;
 
+    /* round-robin cursor among "connections_" for pipelining */
+    size_t nextPipelined_;
+    size_t pipelineDepth_;
+    double idleTimeout_;
+
     TypedMessageQueue<HttpRequest> queue_; /* queued requests */
 
-    HttpConnection::OnDone onHttpConnectionDone_;
+    mutable std::mutex statsLock_;
+    HttpClientStats stats_;
 };
 
 } // namespace Datacratic
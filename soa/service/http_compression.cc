@@ -0,0 +1,274 @@
+/* http_compression.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+*/
+
+#include <zlib.h>
+#include <boost/algorithm/string/trim.hpp>
+
+#include "jml/arch/exception.h"
+#include "jml/arch/thread_specific.h"
+#include "jml/utils/string_functions.h"
+
+#include "compressor.h"
+#include "http_compression.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+namespace {
+
+/* Compressors and zlib streams of the current thread, created on first
+   use */
+struct ZlibStreams {
+    ZlibStreams()
+        : inflateReady(false), rawInflateReady(false)
+    {
+    }
+
+    ~ZlibStreams()
+    {
+        if (inflateReady) {
+            ::inflateEnd(&inflate);
+        }
+        if (rawInflateReady) {
+            ::inflateEnd(&rawInflate);
+        }
+    }
+
+    GzipCompressor & compressor(HttpContentEncoding encoding)
+    {
+        std::unique_ptr<GzipCompressor> * compressor;
+        GzipCompressor::Format format;
+
+        if (encoding == CE_GZIP) {
+            compressor = &gzip;
+            format = GzipCompressor::FORMAT_GZIP;
+        }
+        else if (encoding == CE_DEFLATE) {
+            compressor = &deflate;
+            format = GzipCompressor::FORMAT_ZLIB;
+        }
+        else {
+            throw ML::Exception("no compressor for encoding %d", encoding);
+        }
+
+        if (*compressor) {
+            (*compressor)->reset();
+        }
+        else {
+            compressor->reset(new GzipCompressor(Z_DEFAULT_COMPRESSION,
+                                                 format));
+        }
+
+        return **compressor;
+    }
+
+    /* "raw" streams handle the servers that send raw deflate data instead
+       of the zlib format mandated by RFC 2616 */
+    z_stream * inflater(bool raw)
+    {
+        z_stream * strm = raw ? &rawInflate : &inflate;
+        bool & initialized = raw ? rawInflateReady : inflateReady;
+
+        if (initialized) {
+            ::inflateReset(strm);
+        }
+        else {
+            ::memset(strm, 0, sizeof(z_stream));
+            /* 15 + 32: automatic detection of the gzip and zlib headers */
+            int res = ::inflateInit2(strm, raw ? -15 : 15 + 32);
+            if (res != Z_OK) {
+                throw ML::Exception("inflateInit2 failed");
+            }
+            initialized = true;
+        }
+
+        return strm;
+    }
+
+    std::unique_ptr<GzipCompressor> gzip;
+    std::unique_ptr<GzipCompressor> deflate;
+    z_stream inflate;
+    bool inflateReady;
+    z_stream rawInflate;
+    bool rawInflateReady;
+};
+
+ML::Thread_Specific<ZlibStreams> zlibStreams;
+
+/* returns false when the data is not in the format expected by "strm" */
+bool
+inflateContent(z_stream * strm, const char * data, size_t size,
+               string & output, size_t maxSize)
+{
+    size_t start = output.size();
+    size_t capacity = std::max<size_t>(size * 4, 4096);
+
+    strm->next_in = (Bytef *) data;
+    strm->avail_in = size;
+
+    while (true) {
+        size_t produced = strm->total_out;
+        if (capacity - produced == 0) {
+            if (capacity >= maxSize) {
+                throw ML::Exception("decompressed content exceeds %zu bytes",
+                                    maxSize);
+            }
+            capacity = std::min(capacity * 2, maxSize);
+        }
+        output.resize(start + capacity);
+        strm->next_out = (Bytef *) &output[start + produced];
+        strm->avail_out = capacity - produced;
+
+        int res = ::inflate(strm, Z_NO_FLUSH);
+        if (res == Z_STREAM_END) {
+            break;
+        }
+        else if (res == Z_DATA_ERROR && strm->total_out == 0) {
+            output.resize(start);
+            return false;
+        }
+        else if (res == Z_BUF_ERROR && strm->avail_in == 0) {
+            throw ML::Exception("truncated compressed content");
+        }
+        else if (res != Z_OK && res != Z_BUF_ERROR) {
+            throw ML::Exception("inflate error %d: %s",
+                                res, strm->msg ? strm->msg : "");
+        }
+    }
+    output.resize(start + strm->total_out);
+
+    return true;
+}
+
+} // file scope
+
+
+/****************************************************************************/
+/* HTTP CONTENT ENCODING                                                    */
+/****************************************************************************/
+
+namespace Datacratic {
+
+const string &
+print(HttpContentEncoding encoding)
+{
+    static const string identity("identity");
+    static const string gzip("gzip");
+    static const string deflate("deflate");
+
+    switch (encoding) {
+    case CE_IDENTITY: return identity;
+    case CE_GZIP: return gzip;
+    case CE_DEFLATE: return deflate;
+    default:
+        throw ML::Exception("unknown content encoding %d", encoding);
+    }
+}
+
+HttpContentEncoding
+parseContentEncoding(const string & value)
+{
+    string encoding = ML::lowercase(boost::trim_copy(value));
+    if (encoding.empty() || encoding == "identity") {
+        return CE_IDENTITY;
+    }
+    else if (encoding == "gzip" || encoding == "x-gzip") {
+        return CE_GZIP;
+    }
+    else if (encoding == "deflate") {
+        return CE_DEFLATE;
+    }
+
+    throw ML::Exception("unsupported content encoding: " + value);
+}
+
+HttpContentEncoding
+negotiateContentEncoding(const string & value)
+{
+    bool acceptGzip(false), acceptDeflate(false);
+
+    for (const string & item: ML::split(ML::lowercase(value), ',')) {
+        string coding = item;
+        double quality(1.0);
+        size_t semicolon = item.find(';');
+        if (semicolon != string::npos) {
+            coding = item.substr(0, semicolon);
+            size_t qPos = item.find("q=", semicolon);
+            if (qPos != string::npos) {
+                quality = atof(item.c_str() + qPos + 2);
+            }
+        }
+        coding = boost::trim_copy(coding);
+        if (quality <= 0.0) {
+            continue;
+        }
+        if (coding == "gzip" || coding == "x-gzip" || coding == "*") {
+            acceptGzip = true;
+        }
+        else if (coding == "deflate") {
+            acceptDeflate = true;
+        }
+    }
+
+    /* gzip is preferred since "deflate" is ambiguously implemented */
+    if (acceptGzip) {
+        return CE_GZIP;
+    }
+    if (acceptDeflate) {
+        return CE_DEFLATE;
+    }
+
+    return CE_IDENTITY;
+}
+
+void
+compressContent(HttpContentEncoding encoding,
+                const char * data, size_t size, string & output)
+{
+    if (encoding == CE_IDENTITY) {
+        output.append(data, size);
+        return;
+    }
+
+    GzipCompressor & compressor = zlibStreams->compressor(encoding);
+
+    size_t start = output.size();
+    auto onData = [&] (const char * compressed, size_t len)
+        {
+            output.append(compressed, len);
+            return len;
+        };
+
+    try {
+        compressor.compress(data, size, onData);
+        compressor.finish(onData);
+    } catch (...) {
+        output.resize(start);
+        throw;
+    }
+}
+
+void
+decompressContent(HttpContentEncoding encoding,
+                  const char * data, size_t size, string & output,
+                  size_t maxSize)
+{
+    if (encoding == CE_IDENTITY) {
+        output.append(data, size);
+        return;
+    }
+
+    if (!inflateContent(zlibStreams->inflater(false),
+                        data, size, output, maxSize)) {
+        if (encoding != CE_DEFLATE
+            || !inflateContent(zlibStreams->inflater(true),
+                               data, size, output, maxSize)) {
+            throw ML::Exception("invalid " + print(encoding) + " content");
+        }
+    }
+}
+
+} // namespace Datacratic
@@ -0,0 +1,57 @@
+/* http_compression.h                                              -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Support for the "gzip" and "deflate" content encodings of HTTP/1.1 bodies.
+
+   Compression and decompression operate on whole bodies and make use of
+   GzipCompressors and zlib streams that are allocated once per thread and
+   reset between messages, which avoids paying for their setup (several
+   hundreds of kilobytes of allocations for a deflate stream) with each
+   message.
+*/
+
+#pragma once
+
+#include <string>
+
+
+namespace Datacratic {
+
+/****************************************************************************/
+/* HTTP CONTENT ENCODING                                                    */
+/****************************************************************************/
+
+enum HttpContentEncoding {
+    CE_IDENTITY,
+    CE_GZIP,
+    CE_DEFLATE
+};
+
+/* Name of the encoding, as used in the "Content-Encoding" header */
+const std::string & print(HttpContentEncoding encoding);
+
+/* Parse the value of a "Content-Encoding" header. Throws when the encoding
+   is not supported. */
+HttpContentEncoding parseContentEncoding(const std::string & value);
+
+/* Returns the preferred encoding among those accepted in the value of an
+   "Accept-Encoding" header, or CE_IDENTITY. */
+HttpContentEncoding negotiateContentEncoding(const std::string & value);
+
+/* Below this size, a body is not worth compressing. */
+static constexpr size_t DefaultCompressionThreshold = 1024;
+
+/* Compress "size" bytes from "data" and append the result to "output". */
+void compressContent(HttpContentEncoding encoding,
+                     const char * data, size_t size,
+                     std::string & output);
+
+/* Decompress "size" bytes from "data" and append the result to "output".
+   Throws on corrupted data or when the decompressed body would exceed
+   "maxSize" bytes. */
+void decompressContent(HttpContentEncoding encoding,
+                       const char * data, size_t size,
+                       std::string & output,
+                       size_t maxSize = 64 * 1024 * 1024);
+
+} // namespace Datacratic
@@ -157,6 +157,42 @@ handleHttpHeader(const HttpHeader & header)
     //cerr << "GOT HTTP HEADER[" << header << "]" << endl;
 }
 
+bool
+HttpConnectionHandler::
+decodeHttpPayload()
+{
+    auto it = header.headers.find("content-encoding");
+    if (it == header.headers.end()) {
+        return true;
+    }
+
+    HttpContentEncoding encoding;
+    try {
+        encoding = parseContentEncoding(it->second);
+    } catch (const std::exception & exc) {
+        putResponseOnWire(HttpResponse(415, "text/plain", exc.what()),
+                          [] () {}, NEXT_CLOSE);
+        return false;
+    }
+
+    if (encoding != CE_IDENTITY) {
+        std::string decoded;
+        try {
+            decompressContent(encoding, payload.c_str(), payload.size(),
+                              decoded);
+        } catch (const std::exception & exc) {
+            putResponseOnWire(HttpResponse(400, "text/plain", exc.what()),
+                              [] () {}, NEXT_CLOSE);
+            return false;
+        }
+        payload = std::move(decoded);
+        header.contentLength = payload.size();
+    }
+    header.headers.erase(it);
+
+    return true;
+}
+
 void
 HttpConnectionHandler::
 handleHttpData(const std::string & data)
@@ -185,6 +221,10 @@ handleHttpData(const std::string & data)
 
         if (payload.length() == header.contentLength) {
             addActivityS("got HTTP payload");
+            if (!decodeHttpPayload()) {
+                readState = DONE;
+                return;
+            }
             handleHttpPayload(header, payload);
 
             //cerr << this << " switching to DONE" << endl;
@@ -349,6 +389,29 @@ putResponseOnWire(HttpResponse response,
             else onSendFinished();
         };
 
+    if (response.sendBody && httpEndpoint
+        && httpEndpoint->compressionThreshold > 0
+        && response.body.length() >= httpEndpoint->compressionThreshold) {
+        bool encoded(false);
+        for (auto & h: response.extraHeaders) {
+            if (strcasecmp(h.first.c_str(), "Content-Encoding") == 0) {
+                encoded = true;
+            }
+        }
+        HttpContentEncoding encoding
+            = negotiateContentEncoding(header.tryGetHeader("accept-encoding"));
+        if (!encoded && encoding != CE_IDENTITY) {
+            std::string compressed;
+            compressContent(encoding,
+                            response.body.c_str(), response.body.length(),
+                            compressed);
+            response.body = std::move(compressed);
+            response.extraHeaders.emplace_back("Content-Encoding",
+                                               print(encoding));
+            response.extraHeaders.emplace_back("Vary", "Accept-Encoding");
+        }
+    }
+
     std::string responseStr;
     responseStr.reserve(1024 + response.body.length());
 
@@ -395,7 +458,8 @@ putResponseOnWire(HttpResponse response,
 
 HttpEndpoint::
 HttpEndpoint(const std::string & name)
-    : PassiveEndpointT<SocketTransport>(name)
+    : PassiveEndpointT<SocketTransport>(name),
+      compressionThreshold(0)
 {
     handlerFactory = [] ()
         {
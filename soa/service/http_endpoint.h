@@ -10,6 +10,7 @@
 #include "soa/service/passive_endpoint.h"
 #include "soa/types/date.h"
 #include "http_header.h"
+#include "http_compression.h"
 #include <boost/make_shared.hpp>
 #include <boost/algorithm/string.hpp>
 
@@ -146,6 +147,11 @@ struct HttpConnectionHandler : public PassiveConnectionHandler {
     */
     virtual void handleHttpData(const std::string & data);
 
+    /** Decode the payload according to its "Content-Encoding" header.
+        Replies with an error and returns false when that fails.
+    */
+    bool decodeHttpPayload();
+
     /** Called once the entire payload has come through.  Default will
         throw.  Will be called multiple times for chunked encoding.
     */
@@ -194,6 +200,11 @@ struct HttpEndpoint: public PassiveEndpointT<SocketTransport> {
 
     HandlerFactory handlerFactory;
 
+    /** Minimum size of the response bodies to compress, when the client
+        accepts it via "Accept-Encoding". 0 disables the compression of
+        responses. Compressed requests are always accepted. */
+    size_t compressionThreshold;
+
     virtual std::shared_ptr<ConnectionHandler>
     makeNewHandler()
     {
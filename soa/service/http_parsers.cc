@@ -4,6 +4,7 @@
 
 */
 
+#include <ctype.h>
 #include <string.h>
 
 #include <iostream>
@@ -304,9 +305,16 @@ handleHeader(const char * data, size_t dataSize)
         skipToValue();
         remainingBody_ = ML::antoi(data + ptr, data + dataSize - 2);
     }
-    else if (matchString("Transfer-Encoding", 15)) {
+    else if (matchString("Transfer-Encoding", 17)) {
         skipToValue();
-        if (matchString("chunked", 7)) {
+        /* "chunked" comes last when the body has other transfer codings, as
+           in "gzip, chunked" */
+        size_t end(dataSize);
+        while (end > ptr && ::isspace(data[end - 1])) {
+            end--;
+        }
+        if (end - ptr >= 7
+            && ::strncasecmp(data + end - 7, "chunked", 7) == 0) {
             useChunkedEncoding_ = true;
         }
     }
@@ -390,8 +398,15 @@ void
 HttpResponseParser::
 finalizeParsing()
 {
+    /* The buffer is left untouched since it may contain the beginning of
+       the next response. */
+    bool requireClose(requireClose_);
+    expectBody_ = true;
+    remainingBody_ = 0;
+    useChunkedEncoding_ = false;
+    requireClose_ = false;
+
     if (onDone) {
-        onDone(requireClose_);
+        onDone(requireClose);
     }
-    clear();
 }
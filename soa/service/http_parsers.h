@@ -43,7 +43,9 @@ struct HttpResponseParser {
     }
 
     /* Indicates whether to expect a body during the parsing of the next
-       response. */
+       response. This flag is reset after each response, before "onDone" is
+       invoked, which enables the setting of the right value for pipelined
+       responses. */
     void setExpectBody(bool expBody)
     { expectBody_ = expBody; }
 
@@ -62,13 +64,16 @@ struct HttpResponseParser {
         return remainingBody_;
     }
 
+    /* Discard any partially parsed response, such as when the underlying
+       connection is reset. */
+    void clear() noexcept;
+
     OnResponseStart onResponseStart;
     OnHeader onHeader;
     OnData onData;
     OnDone onDone;
 
 private:
-    void clear() noexcept;
 
     /* structure to hold the temporary state of the parser used when "feed" is
        invoked */
@@ -0,0 +1,138 @@
+/* latency_histogram.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Fixed-size log-linear histogram of latencies.
+*/
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+LatencyHistogram::
+LatencyHistogram()
+{
+    clear();
+}
+
+LatencyHistogram::
+LatencyHistogram(const LatencyHistogram & other)
+{
+    clear();
+    add(other);
+}
+
+LatencyHistogram &
+LatencyHistogram::
+operator = (const LatencyHistogram & other)
+{
+    if (this != &other) {
+        clear();
+        add(other);
+    }
+    return *this;
+}
+
+double
+LatencyHistogram::
+mean() const
+{
+    uint64_t n = count();
+    if (!n) return 0.0;
+    return double(sum.load(std::memory_order_relaxed)) / n;
+}
+
+uint64_t
+LatencyHistogram::
+highestEquivalentValue(unsigned bucket)
+{
+    if (bucket < LinearBuckets)
+        return bucket;
+
+    unsigned index = bucket - LinearBuckets;
+    int shift = index / SubBuckets + 1;
+    uint64_t mantissa = index % SubBuckets + SubBuckets;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+uint64_t
+LatencyHistogram::
+percentile(double percent) const
+{
+    uint64_t n = count();
+    if (!n) return 0;
+
+    uint64_t wanted = std::ceil(n * std::min(percent, 100.0) / 100.0);
+    wanted = std::max<uint64_t>(wanted, 1);
+
+    uint64_t seen = 0;
+    for (unsigned i = 0;  i < NumBuckets;  ++i) {
+        seen += counts[i].load(std::memory_order_relaxed);
+        if (seen >= wanted)
+            return std::min(highestEquivalentValue(i), max());
+    }
+
+    // The count was bumped before the bucket by a concurrent record().
+    return max();
+}
+
+void
+LatencyHistogram::
+add(const LatencyHistogram & other)
+{
+    for (unsigned i = 0;  i < NumBuckets;  ++i) {
+        uint64_t n = other.counts[i].load(std::memory_order_relaxed);
+        if (n) counts[i].fetch_add(n, std::memory_order_relaxed);
+    }
+    total.fetch_add(other.count(), std::memory_order_relaxed);
+    sum.fetch_add(other.sum.load(std::memory_order_relaxed),
+                  std::memory_order_relaxed);
+
+    uint64_t otherMax = other.max();
+    uint64_t current = maxValue.load(std::memory_order_relaxed);
+    while (otherMax > current
+           && !maxValue.compare_exchange_weak(current, otherMax,
+                                              std::memory_order_relaxed))
+        ;
+}
+
+void
+LatencyHistogram::
+clear()
+{
+    for (auto & bucket: counts)
+        bucket.store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+}
+
+Json::Value
+LatencyHistogram::
+toJson() const
+{
+    auto ms = [] (uint64_t micros) { return micros / 1000.0; };
+
+    Json::Value result;
+    result["count"] = count();
+    result["meanMs"] = mean() / 1000.0;
+    result["maxMs"] = ms(max());
+    result["p50Ms"] = ms(percentile(50));
+    result["p90Ms"] = ms(percentile(90));
+    result["p99Ms"] = ms(percentile(99));
+    result["p999Ms"] = ms(percentile(99.9));
+    return result;
+}
+
+} // namespace Datacratic
@@ -0,0 +1,135 @@
+/* latency_histogram.h                                             -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Fixed-size log-linear histogram of latencies.
+*/
+
+#pragma once
+
+#include "soa/jsoncpp/value.h"
+
+#include <atomic>
+#include <cstdint>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* LATENCY HISTOGRAM                                                         */
+/*****************************************************************************/
+
+/** Histogram of latencies in microseconds, in the style of HdrHistogram.
+
+    Values under 64us each get their own bucket; above that every power of
+    two is split into 32 linear buckets, so that any value is reported with
+    a relative error of at most 1/32.  Values above 2^48us are clamped.
+
+    The memory is fixed (about 11kB) and recording a value is a handful of
+    relaxed atomic increments, so a single thread can record while others
+    read the percentiles.  Readers may see a count that is slightly ahead
+    of the buckets, which doesn't matter for monitoring.
+*/
+struct LatencyHistogram {
+
+    enum {
+        SubBucketBits = 5,
+        SubBuckets = 1 << SubBucketBits,           ///< buckets per power of 2
+        LinearBuckets = 2 * SubBuckets,            ///< exact values below
+        MaxBits = 48,
+        NumBuckets = LinearBuckets + (MaxBits - SubBucketBits - 1) * SubBuckets
+    };
+
+    LatencyHistogram();
+
+    /** Copies are snapshots of the other histogram, which may still be
+        written to while it is copied.
+    */
+    LatencyHistogram(const LatencyHistogram & other);
+    LatencyHistogram & operator = (const LatencyHistogram & other);
+
+    void record(uint64_t micros)
+    {
+        if (micros >= (1ULL << MaxBits))
+            micros = (1ULL << MaxBits) - 1;
+
+        counts[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(micros, std::memory_order_relaxed);
+
+        uint64_t current = maxValue.load(std::memory_order_relaxed);
+        while (micros > current
+               && !maxValue.compare_exchange_weak(current, micros,
+                                                  std::memory_order_relaxed))
+            ;
+    }
+
+    /** Same as record(), for a histogram that a single thread writes to:
+        the counters are updated with relaxed loads and stores instead of
+        locked read-modify-writes.  Readers see the same thing as above.
+    */
+    void recordSingleWriter(uint64_t micros)
+    {
+        if (micros >= (1ULL << MaxBits))
+            micros = (1ULL << MaxBits) - 1;
+
+        increment(counts[bucketOf(micros)], 1);
+        increment(total, 1);
+        increment(sum, micros);
+
+        if (micros > maxValue.load(std::memory_order_relaxed))
+            maxValue.store(micros, std::memory_order_relaxed);
+    }
+
+    void recordSeconds(double seconds)
+    {
+        record(seconds <= 0.0 ? 0 : uint64_t(seconds * 1000000.0));
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maxValue.load(std::memory_order_relaxed); }
+    double mean() const;
+
+    /** Smallest value, in microseconds, that is above the given percentage
+        (between 0 and 100) of the recorded values.  Returns 0 if nothing was
+        recorded.
+    */
+    uint64_t percentile(double percent) const;
+
+    /** Add the values recorded in the other histogram to this one. */
+    void add(const LatencyHistogram & other);
+
+    void clear();
+
+    /** Count, mean, max and the usual percentiles, in milliseconds. */
+    Json::Value toJson() const;
+
+    static unsigned bucketOf(uint64_t micros)
+    {
+        if (micros < LinearBuckets)
+            return micros;
+
+        int msb = 63 - __builtin_clzll(micros);
+        int shift = msb - SubBucketBits;
+        return LinearBuckets
+            + (msb - SubBucketBits - 1) * SubBuckets
+            + ((micros >> shift) - SubBuckets);
+    }
+
+    /** Largest value that falls in the given bucket. */
+    static uint64_t highestEquivalentValue(unsigned bucket);
+
+private:
+    static void increment(std::atomic<uint64_t> & counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n,
+                      std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> counts[NumBuckets];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> maxValue;
+};
+
+} // namespace Datacratic
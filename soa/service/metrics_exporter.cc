@@ -0,0 +1,507 @@
+/* metrics_exporter.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Export of the aggregated stats as compact binary frames.
+*/
+
+#include "soa/service/metrics_exporter.h"
+#include "soa/types/varint.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/format.h"
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace Datacratic {
+
+namespace {
+
+const char MAGIC[8] = { 'R', 'T', 'B', 'M', 'T', 'R', 'C', '1' };
+
+const char * const Frame = "metrics frame";
+
+/** Connect the socket without blocking the dump thread for more than
+    500ms when the sink is unreachable.  The socket is left non-blocking,
+    which is how it's written to anyway.  Returns false with errno set on
+    failure.
+*/
+bool connectWithTimeout(int fd, const sockaddr * addr, socklen_t addrlen)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+        return false;
+
+    if (::connect(fd, addr, addrlen) == 0)
+        return true;
+    if (errno != EINPROGRESS)
+        return false;
+
+    struct pollfd events[] = {
+        { fd, POLLOUT, 0 }
+    };
+
+    int pollRes = poll(events, 1, 500 /* 500ms max timeout */);
+    if (pollRes == 0)
+        errno = ETIMEDOUT;
+    if (pollRes != 1)
+        return false;
+
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1)
+        return false;
+    errno = error;
+    return error == 0;
+}
+
+int64_t toMillis(Date date)
+{
+    return std::llround(date.secondsSinceEpoch() * 1000.0);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* METRICS FRAME ENCODER                                                     */
+/*****************************************************************************/
+
+MetricsFrameEncoder::
+MetricsFrameEncoder()
+    : started(false)
+{
+}
+
+void
+MetricsFrameEncoder::
+reset()
+{
+    started = false;
+    keys.clear();
+}
+
+void
+MetricsFrameEncoder::
+encode(const std::vector<StatReading> & readings,
+       std::string & output,
+       const std::string & prefix)
+{
+    if (!started) {
+        output.append(MAGIC, sizeof(MAGIC));
+        started = true;
+    }
+
+    size_t lengthPos = output.size();
+    output.append(4, '\0');
+
+    int64_t base = readings.empty() ? 0 : toMillis(readings[0].timestamp);
+    appendVarint(output, base);
+
+    // First pass: find the keys that the other end doesn't know yet
+    std::vector<uint32_t> ids;
+    ids.reserve(readings.size());
+    size_t numNewKeys = 0;
+    std::string newKeys;
+
+    for (auto & r: readings) {
+        key.assign(prefix);
+        key.append(r.name);
+        auto res = keys.insert(make_pair(key, keys.size()));
+        if (res.second) {
+            ++numNewKeys;
+            appendVarintString(newKeys, key);
+        }
+        ids.push_back(res.first->second);
+    }
+
+    appendVarint(output, numNewKeys);
+    output.append(newKeys);
+
+    appendVarint(output, readings.size());
+    for (unsigned i = 0;  i < readings.size();  ++i) {
+        appendVarint(output, ids[i]);
+        appendSignedVarint(output,
+                           toMillis(readings[i].timestamp) - base);
+        float value = readings[i].value;
+        char buf[4];
+        memcpy(buf, &value, 4);
+        output.append(buf, 4);
+    }
+
+    uint32_t length = output.size() - lengthPos - 4;
+    for (unsigned i = 0;  i < 4;  ++i)
+        output[lengthPos + i] = (char)(length >> (8 * i));
+}
+
+
+/*****************************************************************************/
+/* METRICS FRAME DECODER                                                     */
+/*****************************************************************************/
+
+MetricsFrameDecoder::
+MetricsFrameDecoder()
+    : started(false)
+{
+}
+
+void
+MetricsFrameDecoder::
+feed(const char * data, size_t len, const OnFrame & onFrame)
+{
+    buffer.append(data, len);
+
+    size_t pos = 0;
+
+    if (!started) {
+        if (buffer.size() < sizeof(MAGIC))
+            return;
+        if (memcmp(buffer.data(), MAGIC, sizeof(MAGIC)) != 0)
+            throw ML::Exception("metrics stream doesn't start with magic");
+        started = true;
+        pos = sizeof(MAGIC);
+    }
+
+    std::vector<StatReading> readings;
+
+    while (buffer.size() - pos >= 4) {
+        const unsigned char * l = (const unsigned char *)buffer.data() + pos;
+        uint32_t length = l[0] | (l[1] << 8) | (l[2] << 16)
+            | (uint32_t(l[3]) << 24);
+        if (buffer.size() - pos - 4 < length)
+            break;
+
+        const char * p = buffer.data() + pos + 4;
+        const char * end = p + length;
+
+        int64_t base = readVarint(p, end, Frame);
+
+        uint64_t numNewKeys = readVarint(p, end, Frame);
+        for (uint64_t i = 0;  i < numNewKeys;  ++i) {
+            std::string newKey;
+            readVarintString(p, end, newKey, Frame);
+            keys.push_back(std::move(newKey));
+        }
+
+        uint64_t numReadings = readVarint(p, end, Frame);
+        readings.clear();
+        readings.reserve(numReadings);
+        for (uint64_t i = 0;  i < numReadings;  ++i) {
+            uint64_t id = readVarint(p, end, Frame);
+            if (id >= keys.size())
+                throw ML::Exception("unknown key %lld in metrics frame",
+                                    (long long)id);
+            int64_t ts = base + readSignedVarint(p, end, Frame);
+            if (end - p < 4)
+                throw ML::Exception("truncated value in metrics frame");
+            float value;
+            memcpy(&value, p, 4);
+            p += 4;
+
+            readings.push_back(StatReading(keys[id], value,
+                                           Date::fromSecondsSinceEpoch
+                                               (ts / 1000.0)));
+        }
+
+        if (p != end)
+            throw ML::Exception("extra data at end of metrics frame");
+
+        pos += 4 + length;
+        onFrame(readings);
+    }
+
+    buffer.erase(0, pos);
+}
+
+
+/*****************************************************************************/
+/* METRICS SINK                                                              */
+/*****************************************************************************/
+
+std::shared_ptr<MetricsSink>
+MetricsSink::
+create(const std::string & uri)
+{
+    if (uri.compare(0, 6, "tcp://") == 0)
+        return std::make_shared<MetricsTcpSink>(uri.substr(6));
+    if (uri.compare(0, 7, "file://") == 0)
+        return std::make_shared<MetricsFileSink>(uri.substr(7));
+    throw ML::Exception("unknown metrics sink URI " + uri);
+}
+
+
+/*****************************************************************************/
+/* METRICS TCP SINK                                                          */
+/*****************************************************************************/
+
+MetricsTcpSink::
+MetricsTcpSink(const std::string & host, int port, double retryInterval)
+    : host(host), port(port), retryInterval(retryInterval),
+      fd(-1), generation_(0)
+{
+    connect();
+}
+
+MetricsTcpSink::
+MetricsTcpSink(const std::string & address, double retryInterval)
+    : retryInterval(retryInterval), fd(-1), generation_(0)
+{
+    auto pos = address.rfind(':');
+    if (pos == string::npos)
+        throw ML::Exception("metrics address " + address
+                            + " is not of the form host:port");
+    host = address.substr(0, pos);
+    port = std::stoi(address.substr(pos + 1));
+
+    connect();
+}
+
+MetricsTcpSink::
+~MetricsTcpSink()
+{
+    close();
+}
+
+bool
+MetricsTcpSink::
+connect()
+{
+    lastAttempt = Date::now();
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo * addrs = nullptr;
+    int res = getaddrinfo(host.c_str(), to_string(port).c_str(),
+                          &hints, &addrs);
+    if (res != 0) {
+        cerr << "error resolving metrics host " << host << ": "
+             << gai_strerror(res) << endl;
+        return false;
+    }
+
+    int saved_errno = 0;
+    for (addrinfo * ai = addrs;  ai;  ai = ai->ai_next) {
+        int tmpFd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (tmpFd == -1) {
+            saved_errno = errno;
+            continue;
+        }
+        if (connectWithTimeout(tmpFd, ai->ai_addr, ai->ai_addrlen)) {
+            fd = tmpFd;
+            break;
+        }
+        saved_errno = errno;
+        ::close(tmpFd);
+    }
+
+    freeaddrinfo(addrs);
+
+    if (fd == -1) {
+        cerr << "error connecting to metrics sink at " << host << ":"
+             << port << ": " << strerror(saved_errno) << endl;
+        return false;
+    }
+
+    ++generation_;
+    return true;
+}
+
+void
+MetricsTcpSink::
+close()
+{
+    if (fd != -1)
+        ::close(fd);
+    fd = -1;
+}
+
+bool
+MetricsTcpSink::
+write(const std::string & data)
+{
+    if (data.empty())
+        return true;
+
+    if (fd == -1) {
+        if (Date::now().secondsSince(lastAttempt) < retryInterval)
+            return false;
+        // A new connection starts a new stream, which the caller notices
+        // through the generation, so the data is for the old one
+        connect();
+        return false;
+    }
+
+    size_t done = 0;
+
+    while (done < data.size()) {
+        int res = ::send(fd, data.c_str() + done, data.size() - done,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (res > 0) {
+            done += res;
+            continue;
+        }
+
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Would block.  Poll on the socket for the timeout before
+            // giving up, like CarbonConnector does.
+            struct pollfd events[] = {
+                { fd, POLLOUT | POLLERR | POLLHUP | POLLNVAL, 0 }
+            };
+
+            int pollRes = poll(events, 1, 500 /* 500ms max timeout */);
+            if (pollRes == 1 && events[0].revents == POLLOUT)
+                continue;
+            if (pollRes == 0)
+                cerr << "timeout sending to metrics sink at " << host
+                     << ":" << port << endl;
+            else cerr << "error sending to metrics sink at " << host
+                      << ":" << port << endl;
+        }
+        else {
+            int saved_errno = errno;
+            cerr << "error sending to metrics sink at " << host << ":"
+                 << port << ": " << strerror(saved_errno) << endl;
+        }
+
+        // Part of a frame may have been sent, so the stream can't be
+        // continued
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+
+/*****************************************************************************/
+/* METRICS FILE SINK                                                         */
+/*****************************************************************************/
+
+MetricsFileSink::
+MetricsFileSink(const std::string & filename)
+    : filename(filename)
+{
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+        throw ML::Exception(errno, "opening metrics file " + filename,
+                            "MetricsFileSink");
+}
+
+MetricsFileSink::
+~MetricsFileSink()
+{
+    ::close(fd);
+}
+
+bool
+MetricsFileSink::
+write(const std::string & data)
+{
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t res = ::write(fd, data.c_str() + done, data.size() - done);
+        if (res == -1) {
+            if (errno == EINTR)
+                continue;
+            throw ML::Exception(errno, "writing metrics file " + filename,
+                                "MetricsFileSink::write");
+        }
+        done += res;
+    }
+    return true;
+}
+
+
+/*****************************************************************************/
+/* METRICS EXPORTER                                                          */
+/*****************************************************************************/
+
+MetricsExporter::
+MetricsExporter()
+    : generation(0)
+{
+}
+
+MetricsExporter::
+MetricsExporter(std::shared_ptr<MetricsSink> sink,
+                const std::string & path,
+                double dumpInterval,
+                std::function<void ()> onStop)
+    : generation(0)
+{
+    open(sink, path, dumpInterval, onStop);
+}
+
+MetricsExporter::
+~MetricsExporter()
+{
+    doShutdown();
+}
+
+void
+MetricsExporter::
+open(std::shared_ptr<MetricsSink> sink,
+     const std::string & path,
+     double dumpInterval,
+     std::function<void ()> onStop)
+{
+    stop();
+
+    if (!sink)
+        throw ML::Exception("MetricsExporter needs a sink");
+
+    this->sink = sink;
+    encoder.reset();
+    generation = sink->generation();
+
+    this->onPostShutdown = std::bind(&MetricsExporter::doShutdown, this);
+
+    MultiAggregator::open(path, OutputFn(), dumpInterval, onStop);
+}
+
+void
+MetricsExporter::
+doShutdown()
+{
+    stop();
+    sink.reset();
+}
+
+void
+MetricsExporter::
+doStat(const std::vector<StatReading> & values) const
+{
+    if (!sink)
+        return;
+
+    if (sink->generation() != generation) {
+        encoder.reset();
+        generation = sink->generation();
+    }
+
+    frame.clear();
+    encoder.encode(values, frame, prefix);
+
+    if (!sink->write(frame)) {
+        // The other end may not have seen the keys of this frame
+        encoder.reset();
+    }
+}
+
+} // namespace Datacratic
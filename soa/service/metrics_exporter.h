@@ -0,0 +1,231 @@
+/* metrics_exporter.h                                              -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Export of the aggregated stats as compact binary frames.
+*/
+
+#pragma once
+
+#include "soa/service/carbon_connector.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* METRICS FRAME ENCODER                                                     */
+/*****************************************************************************/
+
+/** Encodes batches of readings in binary frames.
+
+    A stream starts with the 8 byte magic "RTBMTRC1" and is followed by
+    frames.  Each frame is its 4 byte little endian length followed by:
+
+    - the varint timestamp of the frame, in milliseconds since the epoch;
+    - the varint number of keys that weren't sent yet on the stream, each
+      of which is a varint length and the bytes of the key.  They are
+      numbered in the order that they were sent;
+    - the varint number of readings, each of which is the varint number of
+      its key, the zigzag varint difference in milliseconds between its
+      timestamp and that of the frame and the 4 bytes of its value.
+
+    Each key is thus only sent once per stream, and a reading usually
+    takes 6 or 7 bytes instead of the 50 or so of a Carbon line.
+*/
+
+struct MetricsFrameEncoder {
+
+    MetricsFrameEncoder();
+
+    /** Start a new stream: the next frame will be preceded by the magic
+        and will send all of its keys again.
+    */
+    void reset();
+
+    /** Append the frame for the given readings to the output, with the
+        given prefix added to their names.
+    */
+    void encode(const std::vector<StatReading> & readings,
+                std::string & output,
+                const std::string & prefix = "");
+
+    size_t numKeys() const { return keys.size(); }
+
+private:
+    bool started;
+    std::unordered_map<std::string, uint32_t> keys;
+    std::string key;
+};
+
+
+/*****************************************************************************/
+/* METRICS FRAME DECODER                                                     */
+/*****************************************************************************/
+
+/** Decodes a stream written by MetricsFrameEncoder.  The data can be fed in
+    pieces of any size.
+*/
+
+struct MetricsFrameDecoder {
+
+    MetricsFrameDecoder();
+
+    typedef std::function<void (const std::vector<StatReading> &)> OnFrame;
+
+    /** Decode the complete frames in the data fed so far and call onFrame
+        for each of them.  Throws if the stream is corrupt.
+    */
+    void feed(const char * data, size_t len, const OnFrame & onFrame);
+
+    void feed(const std::string & data, const OnFrame & onFrame)
+    {
+        feed(data.data(), data.size(), onFrame);
+    }
+
+    /** Data fed that doesn't make a complete frame yet. */
+    size_t pending() const { return buffer.size(); }
+
+private:
+    bool started;
+    std::vector<std::string> keys;
+    std::string buffer;
+};
+
+
+/*****************************************************************************/
+/* METRICS SINK                                                              */
+/*****************************************************************************/
+
+/** Destination of the frames of a MetricsExporter. */
+
+struct MetricsSink {
+
+    virtual ~MetricsSink()
+    {
+    }
+
+    /** Write data to the stream.  Returns false if it was lost. */
+    virtual bool write(const std::string & data) = 0;
+
+    /** Number of the current stream.  Each time it changes (eg when a
+        connection is reopened), the exporter starts a new stream.
+    */
+    virtual uint64_t generation() const = 0;
+
+    /** Create a sink from its URI: tcp://host:port or file://path. */
+    static std::shared_ptr<MetricsSink> create(const std::string & uri);
+};
+
+
+/*****************************************************************************/
+/* METRICS TCP SINK                                                          */
+/*****************************************************************************/
+
+/** Sink that streams the frames over a persistent TCP connection, which is
+    reopened on the first write after retryInterval seconds when it fails.
+    Frames written while it's down are lost.  Connecting times out after
+    500ms so that an unreachable sink doesn't hold up the dump thread.
+*/
+
+struct MetricsTcpSink : public MetricsSink {
+
+    MetricsTcpSink(const std::string & host, int port,
+                   double retryInterval = 1.0);
+
+    /** Takes an address of the form host:port. */
+    MetricsTcpSink(const std::string & address,
+                   double retryInterval = 1.0);
+
+    ~MetricsTcpSink();
+
+    virtual bool write(const std::string & data);
+
+    virtual uint64_t generation() const { return generation_; }
+
+    bool isConnected() const { return fd != -1; }
+
+private:
+    std::string host;
+    int port;
+    double retryInterval;
+
+    int fd;
+    uint64_t generation_;
+    Date lastAttempt;
+
+    bool connect();
+    void close();
+};
+
+
+/*****************************************************************************/
+/* METRICS FILE SINK                                                         */
+/*****************************************************************************/
+
+/** Sink that writes the frames to a local file, mostly for testing.  The
+    file is truncated when it's opened.
+*/
+
+struct MetricsFileSink : public MetricsSink {
+
+    MetricsFileSink(const std::string & filename);
+
+    ~MetricsFileSink();
+
+    virtual bool write(const std::string & data);
+
+    virtual uint64_t generation() const { return 1; }
+
+private:
+    std::string filename;
+    int fd;
+};
+
+
+/*****************************************************************************/
+/* METRICS EXPORTER                                                          */
+/*****************************************************************************/
+
+/** Aggregator that sends each dump of its stats as a single binary frame to
+    a sink, rather than one line of text per stat like CarbonConnector.
+*/
+
+struct MetricsExporter : public MultiAggregator {
+
+    MetricsExporter();
+
+    MetricsExporter(std::shared_ptr<MetricsSink> sink,
+                    const std::string & path,
+                    double dumpInterval = 1.0,
+                    std::function<void ()> onStop
+                        = std::function<void ()>());
+
+    ~MetricsExporter();
+
+    void open(std::shared_ptr<MetricsSink> sink,
+              const std::string & path,
+              double dumpInterval = 1.0,
+              std::function<void ()> onStop
+                  = std::function<void ()>());
+
+    /** Override for doStat to send the frame to the sink. */
+    virtual void doStat(const std::vector<StatReading> & values) const;
+
+private:
+    void doShutdown();
+
+    std::shared_ptr<MetricsSink> sink;
+
+    // Only used by the dumping thread
+    mutable MetricsFrameEncoder encoder;
+    mutable uint64_t generation;
+    mutable std::string frame;
+};
+
+} // namespace Datacratic
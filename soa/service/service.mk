@@ -3,7 +3,8 @@
 
 
 LIBOPSTATS_SOURCES := \
-	statsd_connector.cc carbon_connector.cc stat_aggregator.cc process_stats.cc
+	statsd_connector.cc carbon_connector.cc stat_aggregator.cc process_stats.cc \
+	metrics_exporter.cc
 
 LIBOPSTATS_LINK := \
 	ACE arch utils boost_thread types
@@ -11,6 +12,9 @@ LIBOPSTATS_LINK := \
 $(eval $(call library,opstats,$(LIBOPSTATS_SOURCES),$(LIBOPSTATS_LINK)))
 
 
+$(eval $(call library,compressor,compressor.cc,arch utils z lzma))
+
+
 
 LIBRECOSET_ZEROMQ_SOURCES := \
 	socket_per_thread.cc \
@@ -46,6 +50,9 @@ LIBSERVICES_SOURCES := \
 	port_range_service.cc \
 	service_base.cc \
 	message_loop.cc \
+	shm_ring.cc \
+	latency_histogram.cc \
+	event_tracer.cc \
 	loop_monitor.cc \
 	named_endpoint.cc \
 	zookeeper_configuration_service.cc \
@@ -65,6 +72,7 @@ LIBSERVICES_SOURCES := \
 	http_client_v1.cc \
 	http_client_v2.cc \
 	http_parsers.cc \
+	http_compression.cc \
 	http_rest_proxy.cc \
 	xml_helpers.cc \
 	nprobe.cc \
@@ -74,7 +82,7 @@ LIBSERVICES_SOURCES := \
 	event_subscriber.cc \
 	nsq_client.cc 
 
-LIBSERVICES_LINK := opstats curl curlpp boost_regex runner_common zeromq zookeeper_mt ACE arch utils jsoncpp boost_thread zmq types tinyxml2 boost_system value_description
+LIBSERVICES_LINK := opstats curl curlpp boost_regex runner_common zeromq zookeeper_mt ACE arch utils jsoncpp boost_thread zmq types tinyxml2 boost_system value_description z compressor
 
 $(eval $(call library,services,$(LIBSERVICES_SOURCES),$(LIBSERVICES_LINK)))
 $(eval $(call set_compile_option,runner.cc,-DBIN=\"$(BIN)\"))
@@ -8,6 +8,7 @@
 #include "service_base.h"
 #include <iostream>
 #include "soa/service/carbon_connector.h"
+#include "soa/service/metrics_exporter.h"
 #include "zookeeper_configuration_service.h"
 #include "jml/arch/demangle.h"
 #include "jml/utils/exc_assert.h"
@@ -99,7 +100,7 @@ dump(std::ostream & stream) const
 /*****************************************************************************/
 
 CarbonEventService::
-CarbonEventService(std::shared_ptr<CarbonConnector> conn) :
+CarbonEventService(std::shared_ptr<MultiAggregator> conn) :
     connector(conn)
 {
 }
@@ -507,6 +508,24 @@ logToCarbon(std::shared_ptr<CarbonConnector> conn)
     events.reset(new CarbonEventService(conn));
 }
 
+void
+ServiceProxies::
+logToMetrics(std::shared_ptr<MetricsExporter> exporter)
+{
+    events.reset(new CarbonEventService(exporter));
+}
+
+void
+ServiceProxies::
+logToMetrics(const std::string & uri,
+             const std::string & prefix,
+             double dumpInterval)
+{
+    events.reset(new CarbonEventService
+                 (std::make_shared<MetricsExporter>(MetricsSink::create(uri),
+                                                    prefix, dumpInterval)));
+}
+
 
 void
 ServiceProxies::
@@ -639,7 +658,12 @@ bootstrap(const Json::Value& config)
         bankerUri = config.get("bankerHost", "").asString();
     }
 
-    if (config.isMember("carbon-uri")) {
+    // Binary metrics take over from Carbon when both are configured
+    if (config.isMember("metrics-uri")) {
+        double dumpInterval = config.get("metrics-dump-interval", 1.0).asDouble();
+        logToMetrics(config["metrics-uri"].asString(), install, dumpInterval);
+    }
+    else if (config.isMember("carbon-uri")) {
         const Json::Value& entry = config["carbon-uri"];
         vector<string> uris;
 
@@ -36,6 +36,7 @@ namespace Datacratic {
 
 class MultiAggregator;
 class CarbonConnector;
+class MetricsExporter;
 
 /*****************************************************************************/
 /* EVENT SERVICE                                                             */
@@ -86,9 +87,14 @@ struct NullEventService : public EventService {
 /* CARBON EVENT SERVICE                                                      */
 /*****************************************************************************/
 
+/** Event service that records the events into a MultiAggregator, which
+    dumps them periodically: a CarbonConnector or a MetricsExporter (see
+    ServiceProxies::logToMetrics()).
+*/
+
 struct CarbonEventService : public EventService {
 
-    CarbonEventService(std::shared_ptr<CarbonConnector> conn);
+    CarbonEventService(std::shared_ptr<MultiAggregator> conn);
     CarbonEventService(const std::string & connection,
                        const std::string & prefix = "",
                        double dumpInterval = 1.0);
@@ -102,7 +108,7 @@ struct CarbonEventService : public EventService {
                          float value,
                          std::initializer_list<int> extra = std::initializer_list<int>());
 
-    std::shared_ptr<CarbonConnector> connector;
+    std::shared_ptr<MultiAggregator> connector;
 };
 
 
@@ -422,6 +428,11 @@ struct ServiceProxies {
                      const std::string & prefix = "",
                      double dumpInterval = 1.0);
 
+    void logToMetrics(std::shared_ptr<MetricsExporter> exporter);
+    void logToMetrics(const std::string & uri,
+                      const std::string & prefix = "",
+                      double dumpInterval = 1.0);
+
     void useZookeeper(std::string url = "localhost:2181",
                       std::string prefix = "CWD",
                       std::string location = "global");
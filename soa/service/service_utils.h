@@ -148,6 +148,8 @@ struct ServiceProxyArguments
              "path to bootstrap.json file")
             ("carbon-connection,c", value(&carbonUri),
              "URI for connecting to carbon daemon")
+            ("metrics-uri", value(&metricsUri),
+             "URI of the binary metrics sink (tcp://host:port or file://path)")
             ("installation,I", value(&installation),
              "name of the current installation")
             ("location,L", value(&location),
@@ -193,7 +195,12 @@ struct ServiceProxyArguments
             services->config.reset(new NullConfigurationService);
         }
 
-        if (!carbonUri.empty()) {
+        // Binary metrics take over from Carbon when both are given
+        if (!metricsUri.empty()) {
+            ExcCheck(!installation.empty(), "installation is required");
+            services->logToMetrics(metricsUri, installation);
+        }
+        else if (!carbonUri.empty()) {
             ExcCheck(!installation.empty(), "installation is required");
             services->logToCarbon(carbonUri, installation);
         }
@@ -204,6 +211,7 @@ struct ServiceProxyArguments
     std::string bootstrap;
     std::string zookeeperUri;
     std::string carbonUri;
+    std::string metricsUri;
     std::string installation;
     std::string location;
     std::string preload;
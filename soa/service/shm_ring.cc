@@ -0,0 +1,562 @@
+/* shm_ring.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Ring buffers in POSIX shared memory.
+*/
+
+#include "shm_ring.h"
+#include "jml/arch/exception.h"
+#include "jml/utils/exc_assert.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using namespace std;
+using namespace ML;
+
+
+namespace Datacratic {
+
+namespace {
+
+const uint64_t RingMagic = 0x676e6952536d6853ULL;   // "ShmRing"
+const uint64_t LogMagic  = 0x00676f4c536d6853ULL;   // "ShmLog"
+
+/** Marks the end of the ring's data; the next message is at the start. */
+const uint32_t WrapMarker = 0xffffffff;
+
+size_t align8(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+}
+
+/** Bytes taken by a message: its length and number of frames, then the
+    length and contents of each frame, padded to a multiple of 8.
+*/
+size_t messageSize(const ShmFrame * frames, size_t numFrames)
+{
+    size_t size = 8;
+    for (size_t i = 0;  i < numFrames;  ++i)
+        size += 4 + frames[i].size;
+    return align8(size);
+}
+
+void writeMessage(char * dest, size_t size,
+                  const ShmFrame * frames, size_t numFrames)
+{
+    uint32_t header[2] = { uint32_t(size), uint32_t(numFrames) };
+    memcpy(dest, header, 8);
+    dest += 8;
+
+    for (size_t i = 0;  i < numFrames;  ++i) {
+        uint32_t len = frames[i].size;
+        memcpy(dest, &len, 4);
+        memcpy(dest + 4, frames[i].data, len);
+        dest += 4 + len;
+    }
+}
+
+/** Copy out the frames of the message at src, which can't extend past
+    limit.  Returns false if the message doesn't make sense, which only
+    happens when it's overwritten while being read.
+*/
+bool readMessage(const char * src, const char * limit,
+                 vector<string> & frames)
+{
+    if (limit - src < 8) return false;
+
+    uint32_t header[2];
+    memcpy(header, src, 8);
+    if (header[0] > limit - src) return false;
+
+    limit = src + header[0];
+    src += 8;
+
+    for (uint32_t i = 0;  i < header[1];  ++i) {
+        if (limit - src < 4) return false;
+        uint32_t len;
+        memcpy(&len, src, 4);
+        src += 4;
+        if (len > limit - src) return false;
+        frames.emplace_back(src, len);
+        src += len;
+    }
+
+    return true;
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SHM SEGMENT                                                               */
+/*****************************************************************************/
+
+ShmSegment::
+ShmSegment()
+    : data_(nullptr), size_(0), owner_(false)
+{
+}
+
+ShmSegment::
+~ShmSegment()
+{
+    close();
+}
+
+void
+ShmSegment::
+create(const string & name, size_t size)
+{
+    close();
+
+    // Get rid of whatever a crashed process may have left behind.
+    shm_unlink(name.c_str());
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1)
+        throw ML::Exception(errno, "shm_open failed for " + name);
+
+    int res = ftruncate(fd, size);
+    if (res == -1) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        throw ML::Exception(errno, "ftruncate failed for " + name);
+    }
+
+    void * addr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw ML::Exception(errno, "mmap failed for " + name);
+    }
+
+    name_ = name;
+    data_ = reinterpret_cast<char *>(addr);
+    size_ = size;
+    owner_ = true;
+}
+
+void
+ShmSegment::
+open(const string & name)
+{
+    close();
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd == -1)
+        throw ML::Exception(errno, "shm_open failed for " + name);
+
+    struct stat stats;
+    int res = fstat(fd, &stats);
+    if (res == -1) {
+        ::close(fd);
+        throw ML::Exception(errno, "fstat failed for " + name);
+    }
+
+    void * addr = mmap(0, stats.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+        throw ML::Exception(errno, "mmap failed for " + name);
+
+    name_ = name;
+    data_ = reinterpret_cast<char *>(addr);
+    size_ = stats.st_size;
+    owner_ = false;
+}
+
+void
+ShmSegment::
+close()
+{
+    if (!data_) return;
+
+    munmap(data_, size_);
+    if (owner_)
+        shm_unlink(name_.c_str());
+
+    name_.clear();
+    data_ = nullptr;
+    size_ = 0;
+    owner_ = false;
+}
+
+
+/*****************************************************************************/
+/* SHM RING                                                                  */
+/*****************************************************************************/
+
+struct ShmRing::Header {
+    uint64_t magic;
+    uint64_t capacity;
+
+    /// Both positions only ever grow; the offset in the data is the
+    /// position modulo the capacity.  They live on their own cache lines
+    /// since each side writes one of them.
+    alignas(64) std::atomic<uint64_t> writePos;
+    alignas(64) std::atomic<uint64_t> readPos;
+};
+
+ShmRing::
+ShmRing()
+    : header_(nullptr), data_(nullptr)
+{
+}
+
+size_t
+ShmRing::
+bytesNeeded(size_t capacity)
+{
+    // Keep whatever follows the ring aligned on a cache line.
+    return sizeof(Header) + ((capacity + 63) & ~size_t(63));
+}
+
+void
+ShmRing::
+init(char * mem, size_t capacity)
+{
+    ExcAssertEqual(capacity % 8, 0);
+    ExcAssertLess(capacity, 1ULL << 32);
+
+    header_ = new (mem) Header();
+    header_->magic = RingMagic;
+    header_->capacity = capacity;
+    header_->writePos = 0;
+    header_->readPos = 0;
+    data_ = mem + sizeof(Header);
+}
+
+void
+ShmRing::
+attach(char * mem)
+{
+    header_ = reinterpret_cast<Header *>(mem);
+    if (header_->magic != RingMagic)
+        throw ML::Exception("shared memory doesn't hold a ring");
+    data_ = mem + sizeof(Header);
+}
+
+bool
+ShmRing::
+tryWrite(const ShmFrame * frames, size_t numFrames)
+{
+    uint64_t capacity = header_->capacity;
+    size_t size = messageSize(frames, numFrames);
+    if (size > capacity / 2)
+        throw ML::Exception("message of %zd bytes too large for ring", size);
+
+    uint64_t writePos = header_->writePos.load(std::memory_order_relaxed);
+    uint64_t readPos = header_->readPos.load(std::memory_order_acquire);
+    uint64_t used = writePos - readPos;
+
+    uint64_t offset = writePos % capacity;
+    uint64_t tail = capacity - offset;
+
+    if (tail < size) {
+        if (used + tail + size > capacity)
+            return false;
+        memcpy(data_ + offset, &WrapMarker, 4);
+        writePos += tail;
+        offset = 0;
+    }
+    else if (used + size > capacity)
+        return false;
+
+    writeMessage(data_ + offset, size, frames, numFrames);
+    header_->writePos.store(writePos + size, std::memory_order_release);
+    return true;
+}
+
+bool
+ShmRing::
+tryRead(vector<string> & frames)
+{
+    uint64_t capacity = header_->capacity;
+    uint64_t readPos = header_->readPos.load(std::memory_order_relaxed);
+    uint64_t writePos = header_->writePos.load(std::memory_order_acquire);
+    if (readPos == writePos)
+        return false;
+
+    uint64_t offset = readPos % capacity;
+    uint32_t size;
+    memcpy(&size, data_ + offset, 4);
+
+    if (size == WrapMarker) {
+        readPos += capacity - offset;
+        offset = 0;
+        memcpy(&size, data_, 4);
+    }
+
+    // Only the two processes sharing the ring can write to it, so a
+    // message that doesn't make sense means that one of them is broken.
+    if (!readMessage(data_ + offset, data_ + capacity, frames))
+        throw ML::Exception("corrupt message in shared memory ring");
+
+    header_->readPos.store(readPos + size, std::memory_order_release);
+    return true;
+}
+
+bool
+ShmRing::
+empty() const
+{
+    return header_->readPos.load(std::memory_order_relaxed)
+        == header_->writePos.load(std::memory_order_acquire);
+}
+
+
+size_t
+ShmRing::
+capacity() const
+{
+    return header_->capacity;
+}
+
+
+/*****************************************************************************/
+/* SHM CHANNEL                                                               */
+/*****************************************************************************/
+
+void
+ShmChannel::
+create(const string & name, size_t toClientCapacity, size_t toServerCapacity)
+{
+    size_t toClientBytes = ShmRing::bytesNeeded(toClientCapacity);
+    segment.create(name,
+                   toClientBytes + ShmRing::bytesNeeded(toServerCapacity));
+    toClient.init(segment.data(), toClientCapacity);
+    toServer.init(segment.data() + toClientBytes, toServerCapacity);
+}
+
+void
+ShmChannel::
+open(const string & name)
+{
+    segment.open(name);
+    toClient.attach(segment.data());
+    toServer.attach(segment.data()
+                    + ShmRing::bytesNeeded(toClient.capacity()));
+}
+
+
+/*****************************************************************************/
+/* SHM LOG                                                                   */
+/*****************************************************************************/
+
+struct ShmLog::Header {
+    uint64_t magic;
+    uint64_t capacity;
+
+    /// End of the last message that the writer started to write.  Readers
+    /// check it after copying a message out to know if it was overwritten
+    /// while they were doing it, like the sequence number of a seqlock.
+    alignas(64) std::atomic<uint64_t> reserved;
+};
+
+ShmLog::
+ShmLog()
+    : header_(nullptr), data_(nullptr)
+{
+}
+
+size_t
+ShmLog::
+bytesNeeded(size_t capacity)
+{
+    return sizeof(Header) + capacity;
+}
+
+void
+ShmLog::
+init(char * mem, size_t capacity)
+{
+    ExcAssertEqual(capacity % 8, 0);
+    ExcAssertLess(capacity, 1ULL << 32);
+
+    header_ = new (mem) Header();
+    header_->magic = LogMagic;
+    header_->capacity = capacity;
+    header_->reserved = 0;
+    data_ = mem + sizeof(Header);
+}
+
+void
+ShmLog::
+attach(char * mem)
+{
+    header_ = reinterpret_cast<Header *>(mem);
+    if (header_->magic != LogMagic)
+        throw ML::Exception("shared memory doesn't hold a log");
+    data_ = mem + sizeof(Header);
+}
+
+uint64_t
+ShmLog::
+write(const ShmFrame * frames, size_t numFrames)
+{
+    uint64_t capacity = header_->capacity;
+    size_t size = messageSize(frames, numFrames);
+    if (size > capacity / 2)
+        throw ML::Exception("message of %zd bytes too large for log", size);
+
+    uint64_t position = header_->reserved.load(std::memory_order_relaxed);
+    uint64_t offset = position % capacity;
+    if (capacity - offset < size) {
+        position += capacity - offset;
+        offset = 0;
+    }
+
+    header_->reserved.store(position + size, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    writeMessage(data_ + offset, size, frames, numFrames);
+
+    // Readers learn about the position through another channel, whose
+    // release makes the message visible to them.
+    return position;
+}
+
+bool
+ShmLog::
+read(uint64_t position, vector<string> & frames) const
+{
+    uint64_t capacity = header_->capacity;
+    uint64_t offset = position % capacity;
+
+    size_t initialSize = frames.size();
+    bool valid = readMessage(data_ + offset, data_ + capacity, frames);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header_->reserved.load(std::memory_order_relaxed)
+        > position + capacity)
+        valid = false;
+
+    if (!valid)
+        frames.resize(initialSize);
+    return valid;
+}
+
+
+/*****************************************************************************/
+/* SHM RING SOURCE                                                           */
+/*****************************************************************************/
+
+ShmRingSource::
+ShmRingSource(ShmRing & ring, int wakeupFd)
+    : ring(ring), wakeupFd(wakeupFd)
+{
+}
+
+ShmRingSource::
+~ShmRingSource()
+{
+    ::close(wakeupFd);
+}
+
+bool
+ShmRingSource::
+processOne()
+{
+    vector<string> message;
+    if (ring.tryRead(message))
+        onMessage(std::move(message));
+
+    if (!ring.empty())
+        return true;
+
+    // Same race as with TypedMessageSink: the writer may have written
+    // between the check above and the read of the eventfd.
+    uint64_t value;
+    int res = ::read(wakeupFd, &value, sizeof(value));
+    (void) res;
+
+    return !ring.empty();
+}
+
+
+/*****************************************************************************/
+/* FILE DESCRIPTOR PASSING                                                   */
+/*****************************************************************************/
+
+void
+sendFds(int socket, const string & payload, const vector<int> & fds)
+{
+    ExcAssert(!payload.empty());
+
+    struct iovec iov;
+    iov.iov_base = const_cast<char *>(payload.data());
+    iov.iov_len = payload.size();
+
+    size_t controlSize = CMSG_SPACE(sizeof(int) * fds.size());
+    vector<char> control(controlSize);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = controlSize;
+
+    struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+    ssize_t res = sendmsg(socket, &msg, MSG_NOSIGNAL);
+    if (res == -1)
+        throw ML::Exception(errno, "sendmsg of file descriptors");
+    ExcAssertEqual(res, (ssize_t)payload.size());
+}
+
+vector<int>
+recvFds(int socket, string & payload, size_t maxFds)
+{
+    char buffer[4096];
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+
+    size_t controlSize = CMSG_SPACE(sizeof(int) * maxFds);
+    vector<char> control(controlSize);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = controlSize;
+
+    ssize_t res = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    if (res == -1)
+        throw ML::Exception(errno, "recvmsg of file descriptors");
+    if (res == 0)
+        throw ML::Exception("connection closed while receiving descriptors");
+
+    payload.assign(buffer, res);
+
+    vector<int> fds;
+    for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);  cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int * received = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+        fds.insert(fds.end(), received, received + n);
+    }
+
+    if (msg.msg_flags & MSG_CTRUNC) {
+        for (int fd: fds) ::close(fd);
+        throw ML::Exception("too many file descriptors received");
+    }
+
+    return fds;
+}
+
+} // namespace Datacratic
@@ -0,0 +1,238 @@
+/* shm_ring.h                                                      -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Ring buffers in POSIX shared memory, used to move messages between
+   processes on the same host without copying them through sockets.
+*/
+
+#pragma once
+
+#include "soa/service/async_event_source.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* SHM SEGMENT                                                               */
+/*****************************************************************************/
+
+/** POSIX shared memory segment mapped into our address space.  The process
+    that creates a segment owns its name and unlinks it when it's closed;
+    the processes that open it only map it.
+*/
+struct ShmSegment {
+    ShmSegment();
+    ~ShmSegment();
+
+    ShmSegment(const ShmSegment & other) = delete;
+    ShmSegment & operator = (const ShmSegment & other) = delete;
+
+    /** Create a new zero-filled segment.  Any stale segment with the same
+        name is replaced.
+    */
+    void create(const std::string & name, size_t size);
+
+    /** Map a segment created by another process. */
+    void open(const std::string & name);
+
+    void close();
+
+    char * data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string & name() const { return name_; }
+
+private:
+    std::string name_;
+    char * data_;
+    size_t size_;
+    bool owner_;
+};
+
+
+/*****************************************************************************/
+/* SHM FRAME                                                                 */
+/*****************************************************************************/
+
+/** Reference to one frame of a message to be written to shared memory.  The
+    messages keep the same multi-part shape as their zmq equivalents.
+*/
+struct ShmFrame {
+    ShmFrame(const std::string & str)
+        : data(str.data()), size(str.size())
+    {
+    }
+
+    ShmFrame(const char * data, size_t size)
+        : data(data), size(size)
+    {
+    }
+
+    const char * data;
+    size_t size;
+};
+
+
+/*****************************************************************************/
+/* SHM RING                                                                  */
+/*****************************************************************************/
+
+/** Single producer, single consumer ring of variable sized messages living
+    in memory shared by the two.  The ring doesn't own its memory, which
+    usually comes from a ShmSegment, and doesn't do any wakeups.
+*/
+struct ShmRing {
+    ShmRing();
+
+    /** Bytes of memory needed for a ring holding capacity bytes of
+        messages.  The capacity must be a multiple of 8.
+    */
+    static size_t bytesNeeded(size_t capacity);
+
+    /** Lay out an empty ring in the given memory. */
+    void init(char * mem, size_t capacity);
+
+    /** Use a ring laid out by another process. */
+    void attach(char * mem);
+
+    /** Write a message made of the given frames.  Returns false if there
+        isn't enough room for it.
+    */
+    bool tryWrite(const ShmFrame * frames, size_t numFrames);
+
+    bool tryWrite(std::initializer_list<ShmFrame> frames)
+    {
+        return tryWrite(frames.begin(), frames.size());
+    }
+
+    /** Read the next message, if there is one, appending its frames to the
+        given vector.
+    */
+    bool tryRead(std::vector<std::string> & frames);
+
+    bool empty() const;
+
+    size_t capacity() const;
+
+private:
+    struct Header;
+    Header * header_;
+    char * data_;
+};
+
+
+/*****************************************************************************/
+/* SHM CHANNEL                                                               */
+/*****************************************************************************/
+
+/** Pair of rings in a single segment, one for each direction of the
+    conversation between a server and one of its clients.
+*/
+struct ShmChannel {
+
+    void create(const std::string & name,
+                size_t toClientCapacity, size_t toServerCapacity);
+
+    void open(const std::string & name);
+
+    ShmSegment segment;
+    ShmRing toClient;
+    ShmRing toServer;
+};
+
+
+/*****************************************************************************/
+/* SHM LOG                                                                   */
+/*****************************************************************************/
+
+/** Ring of messages written by a single process and read by any number of
+    others.  The writer never waits: old messages get overwritten, which the
+    readers detect.  This is used to place a message in shared memory once
+    for all of its readers, who find it by its position in the log.
+*/
+struct ShmLog {
+    ShmLog();
+
+    static size_t bytesNeeded(size_t capacity);
+
+    void init(char * mem, size_t capacity);
+    void attach(char * mem);
+
+    /** Append a message and return its position.  Messages larger than
+        half the capacity of the log are refused with an exception.
+    */
+    uint64_t write(const ShmFrame * frames, size_t numFrames);
+
+    uint64_t write(std::initializer_list<ShmFrame> frames)
+    {
+        return write(frames.begin(), frames.size());
+    }
+
+    /** Read the message at the given position, appending its frames to the
+        given vector.  Returns false if it was overwritten.
+    */
+    bool read(uint64_t position, std::vector<std::string> & frames) const;
+
+private:
+    struct Header;
+    Header * header_;
+    char * data_;
+};
+
+
+/*****************************************************************************/
+/* SHM RING SOURCE                                                           */
+/*****************************************************************************/
+
+/** Event source that reads the messages of a ShmRing from a message loop.
+    The writer signals the given eventfd after each message it writes.
+*/
+struct ShmRingSource : public AsyncEventSource {
+
+    /** Takes ownership of the eventfd, which must be non-blocking. */
+    ShmRingSource(ShmRing & ring, int wakeupFd);
+    ~ShmRingSource();
+
+    std::function<void (std::vector<std::string> && message)> onMessage;
+
+    virtual int selectFd() const
+    {
+        return wakeupFd;
+    }
+
+    virtual bool poll() const
+    {
+        return !ring.empty();
+    }
+
+    virtual bool processOne();
+
+private:
+    ShmRing & ring;
+    int wakeupFd;
+};
+
+
+/*****************************************************************************/
+/* FILE DESCRIPTOR PASSING                                                   */
+/*****************************************************************************/
+
+/** Send file descriptors along with a payload over a connected unix domain
+    socket.  This is how the eventfds used for wakeups get shared.
+*/
+void sendFds(int socket, const std::string & payload,
+             const std::vector<int> & fds);
+
+/** Receive up to maxFds file descriptors and their payload from a unix
+    domain socket.  Blocks until they arrive.
+*/
+std::vector<int> recvFds(int socket, std::string & payload, size_t maxFds);
+
+} // namespace Datacratic
@@ -84,6 +84,20 @@ read(const std::string & prefix)
     return vector<StatReading>(1, StatReading(prefix, value, start));
 }
 
+void
+CounterAggregator::
+merge(StatAggregator & shard)
+{
+    double value = dynamic_cast<CounterAggregator &>(shard).reset().first;
+    if (value == 0.0)
+        return;
+
+    // Not through record(), whose float would round large totals
+    double oldval = total;
+
+    while (!ML::cmp_xchg(total, oldval, oldval + value));
+}
+
 
 /*****************************************************************************/
 /* GAUGE AGGREGATOR                                                          */
@@ -138,6 +152,26 @@ reset()
     return make_pair(current, start);
 }
 
+void
+GaugeAggregator::
+merge(StatAggregator & shard)
+{
+    std::unique_ptr<ML::distribution<float> > shardValues
+        (dynamic_cast<GaugeAggregator &>(shard).reset().first);
+    if (shardValues->empty())
+        return;
+
+    ML::distribution<float> * current = values;
+    while ((current = values) == 0 || !cmp_xchg(values, current,
+                                     (ML::distribution<float>*)0));
+
+    current->insert(current->end(), shardValues->begin(), shardValues->end());
+
+    memory_barrier();
+
+    values = current;
+}
+
 std::vector<StatReading>
 GaugeAggregator::
 read(const std::string & prefix)
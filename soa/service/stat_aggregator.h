@@ -52,6 +52,12 @@ struct StatAggregator {
     /** Read and reset the counter, providing output in Graphite's preferred
         format. */
     virtual std::vector<StatReading> read(const std::string & prefix) = 0;
+
+    /** Move what was recorded in the given aggregator, which must be of the
+        same type, into this one.  Used to merge the aggregators that are
+        recorded to by a single thread into the one that is read.
+    */
+    virtual void merge(StatAggregator & shard) = 0;
 };
 
 
@@ -74,6 +80,8 @@ struct CounterAggregator : public StatAggregator {
         format. */
     virtual std::vector<StatReading> read(const std::string & prefix);
 
+    virtual void merge(StatAggregator & shard);
+
 private:
     Date start;    //< Date at which we last cleared the counter
     double total;  //< total since we last added it up
@@ -114,6 +122,8 @@ struct GaugeAggregator : public StatAggregator {
     */
     virtual std::vector<StatReading> read(const std::string & prefix);
 
+    virtual void merge(StatAggregator & shard);
+
 private:
     Verbosity verbosity;
     Date start;  //< Date at which we last cleared the counter
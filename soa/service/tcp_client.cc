@@ -32,7 +32,8 @@ TcpClient(const OnClosed & onClosed, const OnReceivedData & onReceivedData,
                         maxMessages, recvBufSize),
       port_(-1),
       state_(TcpClientState::Disconnected),
-      noNagle_(false)
+      noNagle_(false),
+      connectingFd_(-1)
 {
 }
 
@@ -163,6 +164,8 @@ connect(const OnConnectionResult & onConnectionResult)
             onConnectionResult(TcpConnectionCode::ConnectionFailure);
             return;
         }
+        connectingFd_ = socketFd;
+        onConnectionResult_ = onConnectionResult;
         handleConnectionEventCb_ = [=] (const ::epoll_event & event) {
             this->handleConnectionEvent(socketFd, onConnectionResult);
         };
@@ -214,6 +217,8 @@ handleConnectionEvent(int socketFd, OnConnectionResult onConnectionResult)
     }
 
     removeFd(socketFd, true);
+    connectingFd_ = -1;
+    onConnectionResult_ = nullptr;
     if (connCode == Success) {
         errno = 0;
         setFd(socketFd);
@@ -231,3 +236,26 @@ handleConnectionEvent(int socketFd, OnConnectionResult onConnectionResult)
     TcpConnectionResult connResult(connCode, move(lostMessages));
     onConnectionResult(move(connResult));
 }
+
+void
+TcpClient::
+abortConnect()
+{
+    if (connectingFd_ == -1) {
+        return;
+    }
+
+    int socketFd(connectingFd_);
+    OnConnectionResult onConnectionResult(move(onConnectionResult_));
+    connectingFd_ = -1;
+
+    removeFd(socketFd, true);
+    disableQueue();
+    ::close(socketFd);
+    state_ = TcpClientState::Disconnected;
+    vector<string> lostMessages = emptyMessageQueue();
+    ML::futex_wake(state_);
+
+    TcpConnectionResult connResult(Timeout, move(lostMessages));
+    onConnectionResult(move(connResult));
+}
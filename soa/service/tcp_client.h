@@ -107,6 +107,10 @@ struct TcpClient : public AsyncWriterSource
     /* initiate or restore a connection to the target service */
     void connect(const OnConnectionResult & onConnectionResult);
 
+    /* abort a pending connection attempt, which will be reported with the
+       "Timeout" code */
+    void abortConnect();
+
     /* state of the connection */
     TcpClientState state() const
     { return TcpClientState(state_); }
@@ -121,6 +125,9 @@ private:
     int state_; /* TcpClientState */
     bool noNagle_;
 
+    int connectingFd_;
+    OnConnectionResult onConnectionResult_;
+
     EpollCallback handleConnectionEventCb_;
 };
 
@@ -0,0 +1,83 @@
+/* event_tracer_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the event tracer.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/event_tracer.h"
+#include <set>
+#include <thread>
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_event_tracer_rings )
+{
+    EventTracer tracer({ "receive", "process", "respond" }, 100);
+
+    // Each thread keeps the last 127 of its events in a ring of 128
+    auto doThread = [&] (int thread)
+        {
+            for (unsigned i = 0;  i < 1000;  ++i)
+                tracer.record(i % 3, thread * 1000 + i / 3);
+        };
+
+    std::thread t1(doThread, 1), t2(doThread, 2);
+    t1.join();
+    t2.join();
+
+    auto events = tracer.events();
+    BOOST_CHECK_EQUAL(events.size(), 254);
+
+    set<uint16_t> threads;
+    for (unsigned i = 0;  i < events.size();  ++i) {
+        if (i > 0)
+            BOOST_CHECK_LE(events[i - 1].ticks, events[i].ticks);
+        BOOST_CHECK_LT(events[i].stage, 3);
+        threads.insert(events[i].thread);
+    }
+    BOOST_CHECK_EQUAL(threads.size(), 2);
+
+    tracer.clear();
+    BOOST_CHECK_EQUAL(tracer.events().size(), 0);
+
+    tracer.record(0, 1);
+    BOOST_CHECK_EQUAL(tracer.events().size(), 1);
+
+    tracer.enable(false);
+    tracer.record(0, 2);
+    BOOST_CHECK_EQUAL(tracer.events().size(), 1);
+
+    Json::Value json = tracer.eventsJson();
+    BOOST_REQUIRE_EQUAL(json.size(), 1);
+    BOOST_CHECK_EQUAL(json[0]["stage"].asString(), "receive");
+    BOOST_CHECK_EQUAL(json[0]["id"].asString(), "0000000000000001");
+}
+
+BOOST_AUTO_TEST_CASE( test_event_tracer_breakdown )
+{
+    EventTracer tracer({ "receive", "process", "respond" });
+
+    for (unsigned i = 0;  i < 50;  ++i) {
+        uint64_t start = ML::ticks();
+        tracer.record(1, i);
+        tracer.record(2, i);
+        // Recorded after the fact, as when the id is only known later
+        tracer.record(0, i, start);
+    }
+
+    Json::Value breakdown = tracer.breakdown();
+    BOOST_CHECK_EQUAL(breakdown["events"].asInt(), 150);
+    BOOST_CHECK_EQUAL(breakdown["requests"].asInt(), 50);
+
+    // The first stage of each request has no latency
+    BOOST_CHECK_EQUAL(breakdown["stages"]["receive"]["count"].asInt(), 0);
+    BOOST_CHECK_EQUAL(breakdown["stages"]["process"]["count"].asInt(), 50);
+    BOOST_CHECK_EQUAL(breakdown["stages"]["respond"]["count"].asInt(), 50);
+    BOOST_CHECK(breakdown.isMember("total"));
+}
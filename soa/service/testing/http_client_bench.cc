@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <atomic>
 #include <memory>
 #include <string>
@@ -33,37 +34,69 @@ enum HttpMethod {
 
 /* bench methods */
 
+/* latencies of the requests performed by a bench, in seconds */
+struct BenchLatencies {
+    void record(double latency)
+    {
+        latencies.push_back(latency);
+    }
+
+    double percentile(double pct)
+    {
+        if (latencies.empty()) {
+            return 0.0;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        size_t idx = std::min<size_t>(latencies.size() * pct / 100,
+                                      latencies.size() - 1);
+        return latencies[idx];
+    }
+
+    vector<double> latencies;
+};
+
 double
 AsyncModelBench(HttpMethod method,
                 const string & baseUrl, const string & payload,
-                int maxReqs, int concurrency)
+                int maxReqs, int concurrency, int implVersion,
+                int pipelineDepth, BenchLatencies & latencies)
 {
     int numReqs, numResponses(0), numMissed(0);
     MessageLoop loop(1, 0, -1);
     loop.start();
 
-    auto client = make_shared<HttpClient>(baseUrl, concurrency);
+    auto client = make_shared<HttpClient>(baseUrl, concurrency, 0,
+                                          implVersion);
+    if (pipelineDepth > 1) {
+        client->setPipelineDepth(pipelineDepth);
+    }
     loop.addSource("client", client);
     client->waitConnectionState(AsyncEventSource::CONNECTED);
 
-    auto onResponse = [&] (const HttpRequest & rq, HttpClientError errorCode_,
-                           int status, string && headers, string && body) {
-        numResponses++;
-        // if (numResponses % 1000) {
-            // cerr << "resps: "  + to_string(numResponses) + "\n";
-        // }
-        if (numResponses == maxReqs) {
-            // cerr << "received all responses\n";
-            ML::futex_wake(numResponses);
-        }
-    };
-    auto cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
+    latencies.latencies.reserve(maxReqs);
+
     HttpRequest::Content content(payload, "application/binary");
 
     auto & clientRef = *client.get();
     string url("/");
     Date start = Date::now();
     for (numReqs = 0; numReqs < maxReqs;) {
+        /* one set of callbacks per request, in order to measure the latency
+           independently of the client implementation */
+        Date rqStart = Date::now();
+        auto onResponse = [&, rqStart] (const HttpRequest & rq,
+                                        HttpClientError errorCode_,
+                                        int status, string && headers,
+                                        string && body) {
+            latencies.record(Date::now().secondsSince(rqStart));
+            numResponses++;
+            if (numResponses == maxReqs) {
+                // cerr << "received all responses\n";
+                ML::futex_wake(numResponses);
+            }
+        };
+        auto cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
+
         bool result;
         if (method == GET) {
             result = clientRef.get(url, cbs);
@@ -97,6 +130,8 @@ AsyncModelBench(HttpMethod method,
     }
     Date end = Date::now();
 
+    cerr << "client stats:\n" << client->stats().toJson().toStyledString();
+
     loop.removeSource(client.get());
     client->waitConnectionState(AsyncEventSource::DISCONNECTED);
 
@@ -150,10 +185,13 @@ int main(int argc, char *argv[])
     unsigned int concurrency(0);
     unsigned int serverConcurrency(0);
     int model(0);
+    int implVersion(0);
+    int pipelineDepth(1);
     unsigned int maxReqs(0);
     string method("GET");
     unsigned int payloadSize(0);
 
+    bool useEchoServer(false);
     string serveriface("127.0.0.1");
     string clientiface(serveriface);
 
@@ -169,12 +207,18 @@ int main(int argc, char *argv[])
          "Method to use (\"GET\"*, \"PUT\", \"POST\")")
         ("model,m", value(&model),
          "Type of concurrency model (1 for async, 2 for threaded))")
+        ("impl,i", value(&implVersion),
+         "Version of the HttpClient implementation (async model only)")
+        ("pipeline-depth,p", value(&pipelineDepth),
+         "Number of requests pipelined per connection (async model only)")
         ("requests,r", value(&maxReqs),
          "total of number of requests to perform")
         ("payload-size,s", value(&payloadSize),
          "size of the response body")
         ("server-iface,S", value(&serveriface),
          "server address (\"none\" for no server)")
+        ("echo,e", value(&useEchoServer)->zero_tokens(),
+         "use a minimal server supporting HTTP pipelining")
         ("help,H", "show help");
 
     if (argc == 1) {
@@ -197,6 +241,7 @@ int main(int argc, char *argv[])
     auto proxies = make_shared<ServiceProxies>();
 
     HttpGetService service(proxies);
+    HttpEchoService echoService;
 
     if (concurrency == 0) {
         throw ML::Exception("'concurrency' must be specified");
@@ -214,14 +259,23 @@ int main(int argc, char *argv[])
         payload += randomString(128);
     }
 
+    int serverPort(-1);
     if (serveriface != "none") {
         cerr << "launching server\n";
-        service.portToUse = 20000;
+        if (useEchoServer) {
+            echoService.getPayload = payload;
+            echoService.start(serveriface);
+            serverPort = echoService.port();
+        }
+        else {
+            service.portToUse = 20000;
 
-        service.addResponse("GET", "/", 200, payload);
-        service.addResponse("PUT", "/", 200, "");
-        service.addResponse("POST", "/", 200, "");
-        service.start(serveriface, serverConcurrency);
+            service.addResponse("GET", "/", 200, payload);
+            service.addResponse("PUT", "/", 200, "");
+            service.addResponse("POST", "/", 200, "");
+            service.start(serveriface, serverConcurrency);
+            serverPort = service.port();
+        }
     }
 
     if (clientiface != "none") {
@@ -237,13 +291,14 @@ int main(int argc, char *argv[])
         string baseUrl;
         if (serveriface != "none") {
             baseUrl = ("http://" + serveriface
-                       + ":" + to_string(service.port()));
+                       + ":" + to_string(serverPort));
         }
         else {
             baseUrl = "http://" + clientiface;
         }
 
-        ::printf("model\tconc.\treqs\tsize\ttime_secs\tBps\tqps\n");
+        ::printf("model\tconc.\tdepth\treqs\tsize\ttime_secs\tBps\tqps"
+                 "\tp50_ms\tp99_ms\n");
 
         HttpMethod httpMethod;
         if (method == "GET") {
@@ -260,8 +315,11 @@ int main(int argc, char *argv[])
         }
 
         double delta;
+        BenchLatencies latencies;
         if (model == 1) {
-            delta = AsyncModelBench(httpMethod, baseUrl, payload, maxReqs, concurrency);
+            delta = AsyncModelBench(httpMethod, baseUrl, payload, maxReqs,
+                                    concurrency, implVersion, pipelineDepth,
+                                    latencies);
         }
         else if (model == 2) {
             delta = ThreadedModelBench(httpMethod, baseUrl, payload, maxReqs, concurrency);
@@ -271,8 +329,11 @@ int main(int argc, char *argv[])
         }
         double qps = maxReqs / delta;
         double bps = double(maxReqs * payload.size()) / delta;
-        ::printf("%d\t%u\t%u\t%u\t%f\t%f\t%f\n",
-                 model, concurrency, maxReqs, payloadSize, delta, bps, qps);
+        ::printf("%d\t%u\t%d\t%u\t%u\t%f\t%f\t%f\t%f\t%f\n",
+                 model, concurrency, pipelineDepth, maxReqs, payloadSize,
+                 delta, bps, qps,
+                 latencies.percentile(50) * 1000,
+                 latencies.percentile(99) * 1000);
     }
     else {
         while (1) {
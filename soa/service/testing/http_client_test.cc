@@ -750,3 +750,61 @@ BOOST_AUTO_TEST_CASE( test_http_client_connection_closed )
     service.shutdown();
 }
 #endif
+
+#if 1
+/* Ensure that a compressed response is decoded and that its headers report
+   the length of the decoded body. */
+BOOST_AUTO_TEST_CASE( test_http_client_compressed_response )
+{
+    cerr << "compressed_response\n";
+    ML::Watchdog watchdog(10);
+    auto proxies = make_shared<ServiceProxies>();
+
+    string content(4096, 'a');
+    HttpGetService service(proxies);
+    service.compressionThreshold = 1024;
+    service.addResponse("GET", "/big", 200, content);
+    service.start();
+    service.waitListening();
+
+    MessageLoop loop;
+    loop.start();
+
+    string baseUrl("http://127.0.0.1:" + to_string(service.port()));
+    auto client = make_shared<HttpClient>(baseUrl, 1);
+    client->enableCompressedResponses(true);
+    loop.addSource("client", client);
+    client->waitConnectionState(AsyncEventSource::CONNECTED);
+
+    int done(false);
+    int status(0);
+    string headers, body;
+    auto onResponse = [&] (const HttpRequest & rq,
+                           HttpClientError error, int status_,
+                           string && headers_, string && body_) {
+        status = status_;
+        headers = move(headers_);
+        body = move(body_);
+        done = true;
+        ML::futex_wake(done);
+    };
+    auto cbs = make_shared<HttpClientSimpleCallbacks>(onResponse);
+    client->get("/big", cbs);
+
+    while (!done) {
+        int oldDone = done;
+        ML::futex_wait(done, oldDone);
+    }
+
+    BOOST_CHECK_EQUAL(status, 200);
+    BOOST_CHECK_EQUAL(body, content);
+    BOOST_CHECK(headers.find("Content-Length: 4096\r\n") != string::npos);
+    BOOST_CHECK_EQUAL(headers.find("Content-Length:"),
+                      headers.rfind("Content-Length:"));
+
+    loop.removeSource(client.get());
+    client->waitConnectionState(AsyncEventSource::DISCONNECTED);
+    loop.shutdown();
+    service.shutdown();
+}
+#endif
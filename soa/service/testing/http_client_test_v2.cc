@@ -10,3 +10,70 @@ struct AtInit {
 } atInit;
 
 #include "http_client_test.cc"
+
+/* Ensure that pipelined requests are all answered in order over a limited
+   number of persistent connections. */
+BOOST_AUTO_TEST_CASE( test_http_client_v2_pipelining )
+{
+    cerr << "pipelining\n";
+    ML::Watchdog watchdog(30);
+
+    HttpEchoService service;
+    service.start();
+
+    string baseUrl("http://127.0.0.1:" + to_string(service.port()));
+
+    MessageLoop loop;
+    loop.start();
+
+    auto client = make_shared<HttpClient>(baseUrl, 2);
+    client->setPipelineDepth(8);
+    client->setIdleTimeout(0.5);
+    loop.addSource("client", client);
+    client->waitConnectionState(AsyncEventSource::CONNECTED);
+
+    int maxReqs(5000), numReqs(0), numResponses(0), numErrors(0);
+    auto onDone = [&] (const HttpRequest & rq,
+                       HttpClientError errorCode, int status,
+                       string && headers, string && body) {
+        if (errorCode != HttpClientError::None || status != 200
+            || body != rq.content_.str) {
+            numErrors++;
+        }
+        numResponses++;
+        if (numResponses == maxReqs) {
+            ML::futex_wake(numResponses);
+        }
+    };
+
+    while (numReqs < maxReqs) {
+        auto cbs = make_shared<HttpClientSimpleCallbacks>(onDone);
+        HttpRequest::Content content("request " + to_string(numReqs),
+                                     "text/plain");
+        if (client->post("/", cbs, content)) {
+            numReqs++;
+        }
+    }
+    while (numResponses < maxReqs) {
+        int old(numResponses);
+        ML::futex_wait(numResponses, old);
+    }
+
+    BOOST_CHECK_EQUAL(numErrors, 0);
+    BOOST_CHECK_EQUAL(service.numReqs, maxReqs);
+    BOOST_CHECK(service.numConnections <= 2);
+
+    HttpClientStats stats = client->stats();
+    BOOST_CHECK_EQUAL(stats.requests, maxReqs);
+    BOOST_CHECK_EQUAL(stats.responses, maxReqs);
+    BOOST_CHECK_EQUAL(stats.inFlight, 0);
+    BOOST_CHECK_EQUAL(stats.latency.count(), maxReqs);
+
+    /* idle connections are closed by the client */
+    ML::sleep(2.0);
+    stats = client->stats();
+    BOOST_CHECK_EQUAL(stats.reaped, service.numConnections);
+
+    loop.shutdown();
+    service.shutdown();
+}
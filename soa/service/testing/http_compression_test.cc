@@ -0,0 +1,111 @@
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <iostream>
+#include <thread>
+#include <boost/test/unit_test.hpp>
+
+#include "soa/service/http_compression.h"
+#include "soa/types/date.h"
+#include "soa/utils/print_utils.h"
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_content_encoding_negotiation )
+{
+    BOOST_CHECK_EQUAL(negotiateContentEncoding(""), CE_IDENTITY);
+    BOOST_CHECK_EQUAL(negotiateContentEncoding("gzip, deflate"), CE_GZIP);
+    BOOST_CHECK_EQUAL(negotiateContentEncoding("deflate"), CE_DEFLATE);
+    BOOST_CHECK_EQUAL(negotiateContentEncoding("GZIP;q=0, deflate;q=0.5"),
+                      CE_DEFLATE);
+    BOOST_CHECK_EQUAL(negotiateContentEncoding("br, identity"), CE_IDENTITY);
+    BOOST_CHECK_EQUAL(negotiateContentEncoding("*"), CE_GZIP);
+
+    BOOST_CHECK_EQUAL(parseContentEncoding(" gzip "), CE_GZIP);
+    BOOST_CHECK_EQUAL(parseContentEncoding("identity"), CE_IDENTITY);
+    BOOST_CHECK_THROW(parseContentEncoding("br"), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_content_round_trip )
+{
+    string content;
+    while (content.size() < 100000) {
+        content += "{\"id\":\"" + randomString(8) + "\",\"imp\":[]},";
+    }
+
+    for (HttpContentEncoding encoding: { CE_GZIP, CE_DEFLATE }) {
+        /* the same thread streams are reused for each message */
+        for (int i = 0; i < 3; i++) {
+            string compressed;
+            compressContent(encoding, content.c_str(), content.size(),
+                            compressed);
+            BOOST_CHECK(compressed.size() < content.size());
+
+            string decompressed("prefix");
+            decompressContent(encoding,
+                              compressed.c_str(), compressed.size(),
+                              decompressed);
+            BOOST_CHECK_EQUAL(decompressed, "prefix" + content);
+        }
+    }
+
+    /* truncated content, size limit */
+    string compressed;
+    compressContent(CE_GZIP, content.c_str(), content.size(), compressed);
+    string output;
+    BOOST_CHECK_THROW(decompressContent(CE_GZIP, compressed.c_str(),
+                                        compressed.size() / 2, output),
+                      ML::Exception);
+    output.clear();
+    BOOST_CHECK_THROW(decompressContent(CE_GZIP, compressed.c_str(),
+                                        compressed.size(), output, 1000),
+                      ML::Exception);
+    output.clear();
+    BOOST_CHECK_THROW(decompressContent(CE_GZIP, content.c_str(),
+                                        content.size(), output),
+                      ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( benchmark_content_compression )
+{
+    string content;
+    while (content.size() < 4096) {
+        content += "{\"id\":\"" + randomString(8) + "\",\"imp\":[]},";
+    }
+
+    auto doBench = [&] (int numThreads) {
+        int numMessages(20000);
+        auto threadFn = [&] () {
+            string compressed, decompressed;
+            for (int i = 0; i < numMessages; i++) {
+                compressed.clear();
+                decompressed.clear();
+                compressContent(CE_GZIP, content.c_str(), content.size(),
+                                compressed);
+                decompressContent(CE_GZIP,
+                                  compressed.c_str(), compressed.size(),
+                                  decompressed);
+            }
+        };
+
+        Date start = Date::now();
+        vector<thread> threads;
+        for (int i = 0; i < numThreads; i++) {
+            threads.emplace_back(threadFn);
+        }
+        for (auto & th: threads) {
+            th.join();
+        }
+        double elapsed = Date::now().secondsSince(start);
+        int total = numThreads * numMessages;
+        cerr << "threads: " << numThreads
+             << "; did " << total << " round trips of " << content.size()
+             << " bytes in " << elapsed << "s at " << total / elapsed
+             << "/s" << endl;
+    };
+
+    doBench(1);
+    doBench(4);
+}
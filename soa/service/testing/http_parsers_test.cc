@@ -253,5 +253,21 @@ BOOST_AUTO_TEST_CASE( http_parser_chunked_encoding_test )
                 "Transfer-Encoding: chunked\r\n"
                 "\r\n");
     BOOST_CHECK_EQUAL(numResponses, 3);
+
+    /* other transfer codings come before "chunked" */
+    feedData = "0\r\n\r\n";
+    parser.feed(feedData.c_str(), feedData.size());
+    bodyChunks.clear();
+
+    parser.feed("HTTP/1.1 200 This is some blabla\r\n"
+                "Transfer-Encoding: gzip, Chunked\r\n"
+                "\r\n");
+    BOOST_CHECK_EQUAL(numResponses, 4);
+
+    feedData = ("20\r\n" + chunk20 + "\r\n"
+                "0\r\n\r\n");
+    parser.feed(feedData.c_str(), feedData.size());
+    BOOST_CHECK_EQUAL(bodyChunks.size(), 1);
+    BOOST_CHECK_EQUAL(bodyChunks[0], chunk20);
 }
 #endif
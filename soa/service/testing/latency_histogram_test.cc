@@ -0,0 +1,94 @@
+/* latency_histogram_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the latency histogram.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/latency_histogram.h"
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_latency_histogram_buckets )
+{
+    // Every value falls in a bucket whose range contains it, and the
+    // buckets are contiguous.
+    uint64_t lowest = 0;
+    for (unsigned i = 0;  i < LatencyHistogram::NumBuckets;  ++i) {
+        uint64_t highest = LatencyHistogram::highestEquivalentValue(i);
+        BOOST_REQUIRE_EQUAL(LatencyHistogram::bucketOf(lowest), i);
+        BOOST_REQUIRE_EQUAL(LatencyHistogram::bucketOf(highest), i);
+        BOOST_REQUIRE_LE(highest - lowest, lowest / 32);
+        lowest = highest + 1;
+    }
+    BOOST_CHECK_EQUAL(lowest, 1ULL << LatencyHistogram::MaxBits);
+}
+
+BOOST_AUTO_TEST_CASE( test_latency_histogram_percentiles )
+{
+    LatencyHistogram histogram;
+    BOOST_CHECK_EQUAL(histogram.percentile(99), 0);
+
+    for (uint64_t i = 1;  i <= 10000;  ++i)
+        histogram.record(i * 10);
+
+    BOOST_CHECK_EQUAL(histogram.count(), 10000);
+    BOOST_CHECK_EQUAL(histogram.max(), 100000);
+    BOOST_CHECK_CLOSE(histogram.mean(), 50005.0, 0.001);
+
+    auto checkPercentile = [&] (double percent, double expected)
+        {
+            double value = histogram.percentile(percent);
+            BOOST_CHECK_GE(value, expected);
+            BOOST_CHECK_LE(value, expected * (1.0 + 1.0 / 32));
+        };
+
+    checkPercentile(50, 50000);
+    checkPercentile(99, 99000);
+    checkPercentile(99.9, 99900);
+    BOOST_CHECK_EQUAL(histogram.percentile(100), 100000);
+
+    LatencyHistogram other;
+    other.recordSeconds(10.0);
+    histogram.add(other);
+    BOOST_CHECK_EQUAL(histogram.count(), 10001);
+    BOOST_CHECK_EQUAL(histogram.max(), 10000000);
+
+    // Copies are independent snapshots
+    LatencyHistogram copy(histogram);
+    BOOST_CHECK_EQUAL(copy.count(), 10001);
+    BOOST_CHECK_EQUAL(copy.percentile(50), histogram.percentile(50));
+
+    histogram.clear();
+    BOOST_CHECK_EQUAL(histogram.count(), 0);
+    BOOST_CHECK_EQUAL(histogram.percentile(50), 0);
+    BOOST_CHECK_EQUAL(copy.count(), 10001);
+
+    copy = histogram;
+    BOOST_CHECK_EQUAL(copy.count(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_latency_histogram_single_writer )
+{
+    LatencyHistogram shared, single;
+
+    for (uint64_t i = 1;  i <= 1000;  ++i) {
+        shared.record(i * 37);
+        single.recordSingleWriter(i * 37);
+    }
+    single.recordSingleWriter(1ULL << 60);
+    shared.record(1ULL << 60);
+
+    BOOST_CHECK_EQUAL(single.count(), shared.count());
+    BOOST_CHECK_EQUAL(single.max(), shared.max());
+    BOOST_CHECK_EQUAL(single.mean(), shared.mean());
+    for (double percent: { 50.0, 90.0, 99.0, 100.0 })
+        BOOST_CHECK_EQUAL(single.percentile(percent),
+                          shared.percentile(percent));
+}
@@ -0,0 +1,188 @@
+/* metrics_exporter_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the binary metrics exporter.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/metrics_exporter.h"
+#include "jml/arch/exception.h"
+#include "jml/arch/timers.h"
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_frame_round_trip )
+{
+    Date now = Date::fromSecondsSinceEpoch(1400000000.25);
+
+    vector<StatReading> readings = {
+        { "requests", 10.0, now },
+        { "latency.mean", 1.5, now.plusSeconds(-0.5) },
+        { "latency.max", 12.25, now.plusSeconds(2.0) }
+    };
+
+    MetricsFrameEncoder encoder;
+    string stream;
+    encoder.encode(readings, stream, "router.");
+    size_t firstSize = stream.size();
+
+    // The keys are only sent the first time
+    readings[0].value = 11.0;
+    encoder.encode(readings, stream, "router.");
+    size_t secondSize = stream.size() - firstSize;
+    BOOST_CHECK_LT(secondSize, firstSize - 8 - 30);
+    BOOST_CHECK_EQUAL(encoder.numKeys(), 3);
+
+    vector<vector<StatReading> > frames;
+    auto onFrame = [&] (const vector<StatReading> & frame)
+        {
+            frames.push_back(frame);
+        };
+
+    // Feed it a byte at a time to check the reassembly
+    MetricsFrameDecoder decoder;
+    for (char c: stream)
+        decoder.feed(&c, 1, onFrame);
+    BOOST_CHECK_EQUAL(decoder.pending(), 0);
+
+    BOOST_REQUIRE_EQUAL(frames.size(), 2);
+    for (auto & frame: frames) {
+        BOOST_REQUIRE_EQUAL(frame.size(), 3);
+        BOOST_CHECK_EQUAL(frame[0].name, "router.requests");
+        BOOST_CHECK_EQUAL(frame[1].name, "router.latency.mean");
+        BOOST_CHECK_EQUAL(frame[1].value, 1.5);
+        BOOST_CHECK_EQUAL(frame[2].name, "router.latency.max");
+        BOOST_CHECK_EQUAL(frame[2].value, 12.25);
+        BOOST_CHECK_EQUAL(frame[1].timestamp.secondsSinceEpoch(),
+                          1399999999.75);
+        BOOST_CHECK_EQUAL(frame[2].timestamp.secondsSinceEpoch(),
+                          1400000002.25);
+    }
+    BOOST_CHECK_EQUAL(frames[0][0].value, 10.0);
+    BOOST_CHECK_EQUAL(frames[1][0].value, 11.0);
+
+    // After a reset, a new stream is started which has the keys again
+    encoder.reset();
+    string stream2;
+    encoder.encode(readings, stream2, "router.");
+    BOOST_CHECK_EQUAL(stream2.size(), firstSize);
+
+    // Corrupt streams are detected
+    MetricsFrameDecoder decoder2;
+    BOOST_CHECK_THROW(decoder2.feed("NOTMAGIC", onFrame), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_exporter_file_sink )
+{
+    string filename = "tmp/metrics_exporter_test.bin";
+
+    {
+        auto sink = MetricsSink::create("file://" + filename);
+        MetricsExporter exporter(sink, "test", 1.0);
+        for (unsigned i = 0;  i < 100;  ++i) {
+            exporter.recordHit("hits");
+            exporter.recordLevel("level", i);
+        }
+        // Stats are read once a second
+        ML::sleep(2.5);
+        exporter.stop();
+    }
+
+    std::ifstream stream(filename.c_str());
+    string data((std::istreambuf_iterator<char>(stream)),
+                std::istreambuf_iterator<char>());
+
+    // First value seen for each key
+    map<string, double> values;
+    int numFrames = 0;
+    MetricsFrameDecoder decoder;
+    decoder.feed(data, [&] (const vector<StatReading> & frame)
+                 {
+                     ++numFrames;
+                     for (auto & r: frame)
+                         values.insert(make_pair(r.name, r.value));
+                 });
+
+    BOOST_CHECK_GE(numFrames, 2);
+    BOOST_CHECK_EQUAL(decoder.pending(), 0);
+    BOOST_CHECK_EQUAL(values["test.hits"], 100.0);
+    BOOST_CHECK_EQUAL(values["test.level.mean"], 49.5);
+
+    unlink(filename.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( test_exporter_tcp_sink )
+{
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    BOOST_REQUIRE(listenFd != -1);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    BOOST_REQUIRE_EQUAL(::bind(listenFd, (sockaddr *)&addr, sizeof(addr)), 0);
+    BOOST_REQUIRE_EQUAL(listen(listenFd, 4), 0);
+    socklen_t addrLen = sizeof(addr);
+    getsockname(listenFd, (sockaddr *)&addr, &addrLen);
+    int port = ntohs(addr.sin_port);
+
+    auto sink = std::make_shared<MetricsTcpSink>("127.0.0.1", port, 0.0);
+    BOOST_REQUIRE(sink->isConnected());
+    BOOST_CHECK_EQUAL(sink->generation(), 1);
+
+    int fd = accept(listenFd, 0, 0);
+    BOOST_REQUIRE(fd != -1);
+
+    MetricsFrameEncoder encoder;
+    string frame;
+    encoder.encode({ { "a", 1.0, Date::now() } }, frame);
+    encoder.encode({ { "a", 2.0, Date::now() }, { "b", 3.0, Date::now() } },
+                   frame);
+    BOOST_CHECK(sink->write(frame));
+
+    vector<StatReading> received;
+    MetricsFrameDecoder decoder;
+    while (received.size() < 3) {
+        char buf[4096];
+        ssize_t res = recv(fd, buf, sizeof(buf), 0);
+        BOOST_REQUIRE(res > 0);
+        decoder.feed(buf, res, [&] (const vector<StatReading> & readings)
+                     {
+                         received.insert(received.end(),
+                                         readings.begin(), readings.end());
+                     });
+    }
+
+    BOOST_CHECK_EQUAL(received[0].name, "a");
+    BOOST_CHECK_EQUAL(received[1].name, "a");
+    BOOST_CHECK_EQUAL(received[2].name, "b");
+    BOOST_CHECK_EQUAL(received[2].value, 3.0);
+
+    // The other end goes away; writes fail until the sink reconnects, which
+    // starts a new stream
+    close(fd);
+    for (unsigned i = 0;  i < 100 && sink->isConnected();  ++i) {
+        sink->write(frame);
+        ML::sleep(0.01);
+    }
+    BOOST_CHECK(!sink->isConnected());
+
+    BOOST_CHECK(!sink->write(frame));
+    BOOST_CHECK(sink->isConnected());
+    BOOST_CHECK_EQUAL(sink->generation(), 2);
+
+    close(listenFd);
+}
@@ -0,0 +1,98 @@
+/* multi_aggregator_bench.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Benchmark of the recording of stats from many threads at once.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/carbon_connector.h"
+#include "jml/arch/timers.h"
+#include "jml/arch/format.h"
+#include <boost/thread/barrier.hpp>
+#include <iostream>
+#include <thread>
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+namespace {
+
+/** Run recordFn iter times on each of nthreads threads and return the number
+    of records per second over all of the threads.
+*/
+double runThreads(int nthreads, int iter,
+                  const std::function<void (int)> & recordFn)
+{
+    boost::barrier barrier(nthreads + 1);
+    vector<std::thread> threads;
+
+    for (int i = 0;  i < nthreads;  ++i) {
+        auto doThread = [&] ()
+            {
+                barrier.wait();
+                for (int j = 0;  j < iter;  ++j)
+                    recordFn(j);
+            };
+        threads.emplace_back(doThread);
+    }
+
+    ML::Timer timer;
+    barrier.wait();
+    for (auto & thread: threads)
+        thread.join();
+    double elapsed = timer.elapsed_wall();
+
+    return nthreads * iter / elapsed;
+}
+
+} // file scope
+
+
+BOOST_AUTO_TEST_CASE( bench_multi_aggregator_scaling )
+{
+    int iter = 200000;
+
+    // Stats are read once a second in the background, like in production
+    MultiAggregator agg("bench", [] (const std::vector<StatReading> &) {});
+
+    // Baseline: all of the threads recording to the same aggregators, which
+    // is what MultiAggregator used to do
+    CounterAggregator sharedCounter;
+    GaugeAggregator sharedGauge(GaugeAggregator::Outcome);
+
+    cerr << ML::format("%8s %16s %16s %16s %16s\n",
+                       "threads", "hits/s", "shared hits/s",
+                       "outcomes/s", "shared outcomes/s");
+
+    for (int nthreads = 1;  nthreads <= 32;  nthreads *= 2) {
+        double hits = runThreads(nthreads, iter, [&] (int i)
+                                 {
+                                     agg.recordHit("hits");
+                                 });
+        double sharedHits = runThreads(nthreads, iter, [&] (int i)
+                                       {
+                                           sharedCounter.record(1.0);
+                                       });
+        double outcomes = runThreads(nthreads, iter, [&] (int i)
+                                     {
+                                         agg.recordOutcome("outcome", i);
+                                     });
+        double sharedOutcomes = runThreads(nthreads, iter, [&] (int i)
+                                           {
+                                               sharedGauge.record(i);
+                                           });
+
+        // Don't let the shared gauge grow without bounds
+        delete sharedGauge.reset().first;
+
+        cerr << ML::format("%8d %16.0f %16.0f %16.0f %16.0f\n",
+                           nthreads, hits, sharedHits,
+                           outcomes, sharedOutcomes);
+    }
+}
@@ -0,0 +1,88 @@
+/* multi_aggregator_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Test for the merging of the per thread stats of the MultiAggregator.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/carbon_connector.h"
+#include "soa/service/stat_aggregator.h"
+#include "jml/arch/timers.h"
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <map>
+#include <mutex>
+
+
+using namespace std;
+using namespace Datacratic;
+using namespace ML;
+
+
+BOOST_AUTO_TEST_CASE( test_multi_aggregator_threads )
+{
+    // Each thread records to its own shard of the stats; we make sure that
+    // they are all merged, including those of the threads that have exited.
+
+    std::mutex lock;
+    std::map<std::string, float> readings;
+    std::atomic<int> numDumps(0);
+
+    auto recordReading = [&] (const std::vector<StatReading> & stats)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            for (auto & stat: stats)
+                readings[stat.name] = stat.value;
+            ++numDumps;
+        };
+
+    MultiAggregator agg("hello", recordReading, 0.0);
+
+    uint64_t nthreads = 8, iter = 10000;
+    boost::barrier barrier(nthreads);
+    boost::thread_group tg;
+
+    for (unsigned i = 0;  i < nthreads;  ++i) {
+        auto doThread = [&] ()
+            {
+                barrier.wait();
+
+                for (unsigned i = 0;  i < iter;  ++i) {
+                    agg.recordHit("hits");
+                    agg.recordOutcome("outcome", 1.0 + (i % 2));
+                }
+            };
+
+        tg.create_thread(doThread);
+    }
+
+    tg.join_all();
+
+    agg.dump();
+
+    for (unsigned i = 0;  i < 100 && numDumps < 1;  ++i)
+        ML::sleep(0.05);
+
+    std::unique_lock<std::mutex> guard(lock);
+    BOOST_CHECK_EQUAL(readings["hits"], iter * nthreads);
+    BOOST_CHECK_EQUAL(readings["outcome.count"], iter * nthreads);
+    BOOST_CHECK_EQUAL(readings["outcome.mean"], 1.5);
+    BOOST_CHECK_EQUAL(readings["outcome.lower"], 1.0);
+    BOOST_CHECK_EQUAL(readings["outcome.upper"], 2.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_counter_merge_precision )
+{
+    // Totals of a shard that a float can't hold are merged exactly
+    CounterAggregator shard, merged;
+    shard.record(1 << 24);
+    shard.record(1.0);
+    merged.record(1.0);
+
+    merged.merge(shard);
+    BOOST_CHECK_EQUAL(merged.reset().first, (1 << 24) + 2);
+}
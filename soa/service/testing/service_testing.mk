@@ -17,7 +17,12 @@ $(eval $(call test,epoll_wait_test,services,boost manual))
 $(eval $(call test,named_endpoint_test,services,boost manual))
 $(eval $(call test,zmq_named_pub_sub_test,services,boost manual))
 $(eval $(call test,zmq_endpoint_test,services,boost manual))
+$(eval $(call test,zmq_zero_copy_test,services,boost))
 $(eval $(call test,message_channel_test,services,boost))
+$(eval $(call test,shm_ring_test,services,boost))
+$(eval $(call test,latency_histogram_test,services,boost))
+$(eval $(call test,thread_buffers_test,services,boost))
+$(eval $(call test,event_tracer_test,services,boost))
 $(eval $(call test,rest_service_endpoint_test,services,boost))
 $(eval $(call test,multiple_service_test,services,boost manual))
 
@@ -31,6 +36,9 @@ $(eval $(call nodejs_test,opstats_js_test,opstats,,,manual))
 
 $(eval $(call test,statsd_connector_test,opstats,boost  manual))
 $(eval $(call test,carbon_connector_test,opstats endpoint,boost manual))
+$(eval $(call test,multi_aggregator_test,opstats,boost))
+$(eval $(call test,multi_aggregator_bench,opstats,boost manual))
+$(eval $(call test,metrics_exporter_test,opstats,boost))
 
 $(eval $(call test,endpoint_unit_test,endpoint,boost))
 $(eval $(call test,test_active_endpoint_nothing_listening,endpoint,boost manual))
@@ -67,6 +75,7 @@ $(eval $(call test,http_client_test_v2,services test_services,boost manual))
 $(eval $(call test,http_client_online_test,services test_services,boost manual))
 $(eval $(call test,http_client_bench,boost_program_options services test_services,boost manual))
 $(eval $(call test,http_parsers_test,services test_services,boost valgrind))
+$(eval $(call test,http_compression_test,services,boost))
 
 $(eval $(call test,logs_test,services,boost))
 
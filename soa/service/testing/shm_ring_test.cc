@@ -0,0 +1,164 @@
+/* shm_ring_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the shared memory rings.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "jml/utils/testing/watchdog.h"
+#include "soa/service/shm_ring.h"
+#include "jml/arch/format.h"
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <thread>
+
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_shm_ring_wrap_around )
+{
+    vector<char> mem(ShmRing::bytesNeeded(1024));
+    ShmRing ring;
+    ring.init(mem.data(), 1024);
+
+    BOOST_CHECK(ring.empty());
+
+    vector<string> frames;
+    BOOST_CHECK(!ring.tryRead(frames));
+
+    // Messages of odd sizes force the ring to wrap at every position.
+    for (int i = 0;  i < 1000;  ++i) {
+        string payload(i % 97, 'a' + i % 26);
+        string index = to_string(i);
+        BOOST_REQUIRE(ring.tryWrite({ index, payload }));
+
+        frames.clear();
+        BOOST_REQUIRE(ring.tryRead(frames));
+        BOOST_REQUIRE_EQUAL(frames.size(), 2);
+        BOOST_CHECK_EQUAL(frames[0], index);
+        BOOST_CHECK_EQUAL(frames[1], payload);
+        BOOST_CHECK(ring.empty());
+    }
+
+    // Fill it up; the last write has to fail without harm.
+    string payload(100, 'x');
+    int numWritten = 0;
+    while (ring.tryWrite({ payload }))
+        ++numWritten;
+    BOOST_CHECK_GT(numWritten, 5);
+
+    for (int i = 0;  i < numWritten;  ++i) {
+        frames.clear();
+        BOOST_REQUIRE(ring.tryRead(frames));
+        BOOST_CHECK_EQUAL(frames.at(0), payload);
+    }
+    BOOST_CHECK(ring.empty());
+
+    BOOST_CHECK_THROW(ring.tryWrite({ string(1000, 'x') }), ML::Exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_shm_channel_threads )
+{
+    Watchdog watchdog(30.0);
+
+    string name = ML::format("/shm_ring_test-%d", getpid());
+
+    ShmChannel server;
+    server.create(name, 4096, 4096);
+
+    ShmChannel client;
+    client.open(name);
+
+    const int numMessages = 100000;
+
+    std::thread reader([&] ()
+        {
+            vector<string> frames;
+            for (int i = 0;  i < numMessages;) {
+                frames.clear();
+                if (!client.toClient.tryRead(frames)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                BOOST_REQUIRE_EQUAL(frames.size(), 1);
+                BOOST_REQUIRE_EQUAL(frames[0], to_string(i));
+                ++i;
+            }
+        });
+
+    for (int i = 0;  i < numMessages;) {
+        if (server.toClient.tryWrite({ to_string(i) }))
+            ++i;
+        else std::this_thread::yield();
+    }
+
+    reader.join();
+
+    BOOST_CHECK(client.toClient.empty());
+    BOOST_CHECK(server.toServer.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_shm_log_overwrite )
+{
+    vector<char> mem(ShmLog::bytesNeeded(1024));
+    ShmLog log;
+    log.init(mem.data(), 1024);
+
+    ShmLog reader;
+    reader.attach(mem.data());
+
+    string payload(200, 'p');
+    uint64_t first = log.write({ string("first"), payload });
+
+    vector<string> frames;
+    BOOST_REQUIRE(reader.read(first, frames));
+    BOOST_CHECK_EQUAL(frames.at(0), "first");
+    BOOST_CHECK_EQUAL(frames.at(1), payload);
+
+    // The first message is still there for as long as it's not lapped.
+    uint64_t second = log.write({ string("second"), payload });
+    frames.clear();
+    BOOST_CHECK(reader.read(first, frames));
+
+    for (int i = 0;  i < 10;  ++i)
+        log.write({ payload });
+
+    frames.clear();
+    BOOST_CHECK(!reader.read(first, frames));
+    BOOST_CHECK(!reader.read(second, frames));
+    BOOST_CHECK(frames.empty());
+}
+
+BOOST_AUTO_TEST_CASE( test_send_fds )
+{
+    int sockets[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets), 0);
+
+    int wakeupFd = eventfd(0, EFD_NONBLOCK);
+    sendFds(sockets[0], "hello", { wakeupFd });
+
+    string payload;
+    vector<int> fds = recvFds(sockets[1], payload, 1);
+    BOOST_CHECK_EQUAL(payload, "hello");
+    BOOST_REQUIRE_EQUAL(fds.size(), 1);
+
+    // Both descriptors refer to the same eventfd.
+    uint64_t value = 3;
+    BOOST_CHECK_EQUAL(::write(fds[0], &value, sizeof(value)), 8);
+    value = 0;
+    BOOST_CHECK_EQUAL(::read(wakeupFd, &value, sizeof(value)), 8);
+    BOOST_CHECK_EQUAL(value, 3);
+
+    ::close(fds[0]);
+    ::close(wakeupFd);
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+}
@@ -1,3 +1,11 @@
+#include <algorithm>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "jml/arch/exception.h"
+
 #include "test_http_services.h"
 
 using namespace std;
@@ -149,3 +157,169 @@ handleHttpPayload(HttpTestConnHandler & handler,
 
     handler.sendResponse(200, response.toString(), "application/json");
 }
+
+HttpEchoService::
+HttpEchoService()
+    : numReqs(0), numConnections(0),
+      listenFd_(-1), port_(-1), shutdown_(false)
+{
+}
+
+HttpEchoService::
+~HttpEchoService()
+{
+    shutdown();
+}
+
+void
+HttpEchoService::
+start(const string & address)
+{
+    listenFd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd_ == -1) {
+        throw ML::Exception(errno, "socket");
+    }
+
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    if (::inet_aton(address.c_str(), &addr.sin_addr) == 0) {
+        throw ML::Exception("invalid address: " + address);
+    }
+    int res = ::bind(listenFd_, (struct sockaddr *) &addr, sizeof(addr));
+    if (res == -1) {
+        throw ML::Exception(errno, "bind");
+    }
+    res = ::listen(listenFd_, 1024);
+    if (res == -1) {
+        throw ML::Exception(errno, "listen");
+    }
+    socklen_t addrLen(sizeof(addr));
+    res = ::getsockname(listenFd_, (struct sockaddr *) &addr, &addrLen);
+    if (res == -1) {
+        throw ML::Exception(errno, "getsockname");
+    }
+    port_ = ntohs(addr.sin_port);
+
+    acceptThread_ = thread([&] () { this->runAcceptThread(); });
+}
+
+void
+HttpEchoService::
+shutdown()
+{
+    if (listenFd_ == -1) {
+        return;
+    }
+
+    shutdown_ = true;
+    ::shutdown(listenFd_, SHUT_RDWR);
+    acceptThread_.join();
+    ::close(listenFd_);
+    listenFd_ = -1;
+
+    {
+        std::unique_lock<std::mutex> guard(connLock_);
+        for (int fd: connFds_) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (auto & th: connThreads_) {
+        th.join();
+    }
+    connThreads_.clear();
+}
+
+void
+HttpEchoService::
+runAcceptThread()
+{
+    while (!shutdown_) {
+        int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        numConnections++;
+        std::unique_lock<std::mutex> guard(connLock_);
+        connFds_.push_back(fd);
+        connThreads_.emplace_back([&, fd] () {
+            this->runConnectionThread(fd);
+        });
+    }
+}
+
+void
+HttpEchoService::
+runConnectionThread(int fd)
+{
+    string buffer;
+    char recvBuffer[65536];
+
+    auto sendAll = [&] (const string & data) {
+        size_t sent(0);
+        while (sent < data.size()) {
+            ssize_t res = ::send(fd, data.c_str() + sent, data.size() - sent,
+                                 MSG_NOSIGNAL);
+            if (res <= 0) {
+                return false;
+            }
+            sent += res;
+        }
+        return true;
+    };
+
+    /* parses as many requests as possible from "buffer", all responses
+       being sent in one shot */
+    auto handleRequests = [&] () {
+        string responses;
+        size_t start(0);
+        while (true) {
+            size_t headerEnd = buffer.find("\r\n\r\n", start);
+            if (headerEnd == string::npos) {
+                break;
+            }
+            size_t contentLength(0);
+            size_t clPos = buffer.find("Content-Length:", start);
+            if (clPos != string::npos && clPos < headerEnd) {
+                contentLength = stoul(buffer.substr(clPos + 15,
+                                                    headerEnd - clPos - 15));
+            }
+            size_t bodyStart = headerEnd + 4;
+            if (buffer.size() < bodyStart + contentLength) {
+                break;
+            }
+            const string & body = (contentLength > 0
+                                   ? buffer.substr(bodyStart, contentLength)
+                                   : getPayload);
+            responses += ("HTTP/1.1 200 OK\r\n"
+                          "Content-Type: application/octet-stream\r\n"
+                          "Content-Length: " + to_string(body.size())
+                          + "\r\n\r\n");
+            responses += body;
+            numReqs++;
+            start = bodyStart + contentLength;
+        }
+        buffer.erase(0, start);
+
+        return responses.empty() || sendAll(responses);
+    };
+
+    while (!shutdown_) {
+        ssize_t res = ::recv(fd, recvBuffer, sizeof(recvBuffer), 0);
+        if (res <= 0) {
+            break;
+        }
+        buffer.append(recvBuffer, res);
+        if (!handleRequests()) {
+            break;
+        }
+    }
+
+    std::unique_lock<std::mutex> guard(connLock_);
+    connFds_.erase(std::find(connFds_.begin(), connFds_.end(), fd));
+    ::close(fd);
+}
@@ -3,7 +3,10 @@
 #include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "soa/service/http_endpoint.h"
 #include "soa/service/named_endpoint.h"
@@ -69,4 +72,40 @@ struct HttpUploadService : public HttpService
                            const std::string & payload);
 };
 
+
+/* A minimal HTTP/1.1 server with support for persistent connections and
+ * pipelined requests, each connection being served by its own thread. The
+ * body of the request is sent back as response, or "getPayload" for requests
+ * without body. */
+struct HttpEchoService
+{
+    HttpEchoService();
+    ~HttpEchoService();
+
+    /* listen on a random port of the given address */
+    void start(const std::string & address = "127.0.0.1");
+    void shutdown();
+
+    int port() const
+    {
+        return port_;
+    }
+
+    std::string getPayload;
+    std::atomic<size_t> numReqs;
+    std::atomic<size_t> numConnections;
+
+private:
+    void runAcceptThread();
+    void runConnectionThread(int fd);
+
+    int listenFd_;
+    int port_;
+    std::atomic<bool> shutdown_;
+    std::thread acceptThread_;
+    std::vector<std::thread> connThreads_;
+    std::vector<int> connFds_;
+    std::mutex connLock_;
+};
+
 } // namespace Datacratic
@@ -0,0 +1,84 @@
+/* thread_buffers_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the per thread rings of ThreadBuffers.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/thread_buffers.h"
+#include <string>
+#include <thread>
+
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_ring_full_and_drain )
+{
+    SpscSlotRing<string> ring(3);
+
+    auto push = [&] (const string & value)
+        {
+            return ring.push([&] (string & slot) { slot = value; });
+        };
+
+    // The capacity is rounded up to a power of two
+    for (unsigned i = 0;  i < 4;  ++i)
+        BOOST_CHECK(push(to_string(i)));
+    BOOST_CHECK(!push("4"));
+    BOOST_CHECK_EQUAL(ring.numPushed(), 4);
+    BOOST_CHECK_EQUAL(ring.numDropped(), 1);
+
+    // Stopping the drain leaves the rest for later
+    vector<string> drained;
+    BOOST_CHECK(!ring.drain([&] (string & slot)
+                            {
+                                drained.push_back(slot);
+                                return drained.size() < 2;
+                            }));
+    BOOST_CHECK(push("5"));
+
+    BOOST_CHECK(ring.drain([&] (string & slot)
+                           {
+                               drained.push_back(slot);
+                               return true;
+                           }));
+    BOOST_CHECK(drained == vector<string>({ "0", "1", "2", "3", "5" }));
+}
+
+BOOST_AUTO_TEST_CASE( test_thread_buffers )
+{
+    ThreadBuffers<int> buffers;
+
+    // Each thread gets its own ring, which is kept after it exits
+    unsigned nthreads = 4, iter = 1000;
+    vector<std::thread> threads;
+    for (unsigned i = 0;  i < nthreads;  ++i) {
+        threads.emplace_back([&,i] ()
+            {
+                auto & ring = buffers.local(iter);
+                for (unsigned j = 0;  j < iter;  ++j)
+                    ring.push([&] (int & slot) { slot = i; });
+            });
+    }
+    for (auto & thread: threads)
+        thread.join();
+
+    vector<unsigned> counts(nthreads);
+    BOOST_CHECK(buffers.drain([&] (int & slot)
+                              {
+                                  ++counts.at(slot);
+                                  return true;
+                              }));
+
+    for (unsigned i = 0;  i < nthreads;  ++i)
+        BOOST_CHECK_EQUAL(counts[i], iter);
+    BOOST_CHECK_EQUAL(buffers.numPushed(), nthreads * iter);
+    BOOST_CHECK_EQUAL(buffers.numDropped(), 0);
+
+    BOOST_CHECK_EQUAL(&buffers.local(10), &buffers.local(10));
+}
@@ -0,0 +1,110 @@
+/* zmq_zero_copy_test.cc
+   Copyright (c) 2014 Datacratic Inc.  All rights reserved.
+
+   Test that message parts are handed over to zmq without being copied.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/service/zmq_utils.h"
+#include "soa/service/zmq_named_pub_sub.h"
+
+using namespace std;
+using namespace ML;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_encode_zero_copy )
+{
+    // Small strings are copied
+    {
+        string small = "hello";
+        zmq::message_t msg = encodeMessage(std::move(small));
+        BOOST_CHECK_EQUAL(msg.size(), 5);
+        BOOST_CHECK_EQUAL(string(msg.data(), msg.size()), "hello");
+    }
+
+    // Large ones are handed over
+    {
+        string large(100000, 'x');
+        const char * data = large.data();
+        zmq::message_t msg = encodeMessage(std::move(large));
+        BOOST_CHECK_EQUAL(msg.size(), 100000);
+        BOOST_CHECK_EQUAL((const void *)msg.data(), (const void *)data);
+    }
+
+    // Shared strings are referred to, and released with the last message
+    std::weak_ptr<const string> weak;
+    {
+        auto shared = std::make_shared<const string>(100000, 'y');
+        weak = shared;
+        zmq::message_t msg = encodeMessage(shared);
+        BOOST_CHECK_EQUAL((const void *)msg.data(),
+                          (const void *)shared->data());
+
+        zmq::message_t copy = msg;
+        BOOST_CHECK_EQUAL((const void *)copy.data(),
+                          (const void *)shared->data());
+
+        shared.reset();
+        BOOST_CHECK(!weak.expired());
+    }
+    BOOST_CHECK(weak.expired());
+}
+
+BOOST_AUTO_TEST_CASE( test_shared_parts )
+{
+    auto context = std::make_shared<zmq::context_t>(1);
+
+    std::weak_ptr<const string> weak;
+    {
+        ZmqNamedPublisher publisher(context);
+
+        auto request = std::make_shared<const string>(50000, 'r');
+        weak = request;
+
+        zmq::message_t part1 = publisher.sharedPart(request);
+        zmq::message_t part2 = publisher.sharedPart(request);
+        BOOST_CHECK_EQUAL((const void *)part1.data(),
+                          (const void *)request->data());
+        BOOST_CHECK_EQUAL((const void *)part2.data(),
+                          (const void *)request->data());
+
+        // The parts are sent without copying the buffer
+        zmq::socket_t sender(*context, ZMQ_PAIR);
+        zmq::socket_t receiver(*context, ZMQ_PAIR);
+        receiver.bind("inproc://zero-copy-test");
+        sender.connect("inproc://zero-copy-test");
+
+        vector<zmq::message_t> messages;
+        publisher.encodeAll(messages, "CHANNEL", part1, string(20000, 's'),
+                            vector<string>{ "a", "b" });
+        BOOST_REQUIRE_EQUAL(messages.size(), 5);
+        BOOST_CHECK_EQUAL((const void *)messages[1].data(),
+                          (const void *)request->data());
+
+        for (unsigned i = 0;  i < messages.size();  ++i)
+            sender.send(messages[i],
+                        i == messages.size() - 1 ? 0 : ZMQ_SNDMORE);
+
+        vector<string> received = recvAll(receiver);
+        BOOST_REQUIRE_EQUAL(received.size(), 5);
+        BOOST_CHECK_EQUAL(received[0], "CHANNEL");
+        BOOST_CHECK_EQUAL(received[1], *request);
+        BOOST_CHECK_EQUAL(received[2], string(20000, 's'));
+        BOOST_CHECK_EQUAL(received[3], "a");
+        BOOST_CHECK_EQUAL(received[4], "b");
+
+        messages.clear();
+        part1.rebuild();
+        part2.rebuild();
+        request.reset();
+
+        // The cache still holds the string
+        BOOST_CHECK(!weak.expired());
+        publisher.clearSharedParts();
+        BOOST_CHECK(weak.expired());
+    }
+}
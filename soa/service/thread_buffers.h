@@ -0,0 +1,184 @@
+/* thread_buffers.h                                                -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Per thread single producer, single consumer rings through which many
+   threads hand items over to a single draining thread.
+*/
+
+#pragma once
+
+#include "jml/arch/thread_specific.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* SPSC SLOT RING                                                            */
+/*****************************************************************************/
+
+/** Single producer, single consumer ring of slots.  The slots are written
+    in place and stay allocated when they are drained, so that a producer
+    that keeps on publishing strings of similar sizes doesn't allocate.
+
+    When the ring is full, push() drops the item and counts it instead of
+    blocking the producer.
+*/
+template<typename Slot>
+struct SpscSlotRing {
+
+    SpscSlotRing(size_t capacity)
+        : writePos(0), readPos(0), numPushed_(0), numDropped_(0)
+    {
+        size_t size = 1;
+        while (size < capacity) size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    /** Write the next slot with fill(Slot &).  Returns false if the ring
+        was full.  Called by the producing thread only.
+    */
+    template<typename Fill>
+    bool push(const Fill & fill)
+    {
+        uint64_t pos = writePos.load(std::memory_order_relaxed);
+        if (pos - readPos.load(std::memory_order_acquire) > mask) {
+            // Only this thread writes them, so they don't need a locked
+            // read-modify-write
+            numDropped_.store(numDropped_.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+            return false;
+        }
+
+        fill(slots[pos & mask]);
+        writePos.store(pos + 1, std::memory_order_release);
+
+        numPushed_.store(numPushed_.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+        return true;
+    }
+
+    /** Pass the slots that were pushed to onSlot(Slot &), which may modify
+        them, until it returns false.  Returns false if it was stopped
+        before the ring was empty.  Called by the consuming thread only.
+    */
+    template<typename OnSlot>
+    bool drain(const OnSlot & onSlot)
+    {
+        uint64_t pos = readPos.load(std::memory_order_relaxed);
+        uint64_t end = writePos.load(std::memory_order_acquire);
+
+        bool more = true;
+        while (pos != end && more) {
+            // The slot is ours until readPos moves past it
+            more = onSlot(slots[pos & mask]);
+            ++pos;
+        }
+
+        readPos.store(pos, std::memory_order_release);
+        return more;
+    }
+
+    uint64_t numPushed() const
+    {
+        return numPushed_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t numDropped() const
+    {
+        return numDropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<Slot> slots;
+    uint64_t mask;
+
+    std::atomic<uint64_t> writePos;
+    char padding[64];
+    std::atomic<uint64_t> readPos;
+
+    std::atomic<uint64_t> numPushed_;
+    std::atomic<uint64_t> numDropped_;
+};
+
+
+/*****************************************************************************/
+/* THREAD BUFFERS                                                            */
+/*****************************************************************************/
+
+/** One SpscSlotRing for each thread that produces items, all drained by a
+    single consumer.  The rings of the threads that have exited are kept,
+    so that their last items are still drained.
+*/
+template<typename Slot>
+struct ThreadBuffers {
+
+    typedef SpscSlotRing<Slot> Ring;
+
+    /** Ring of the calling thread, created with the given capacity on its
+        first call.
+    */
+    Ring & local(size_t capacity)
+    {
+        std::shared_ptr<Ring> & ring = *threadRings.get();
+        if (!ring) {
+            ring = std::make_shared<Ring>(capacity);
+            std::lock_guard<std::mutex> guard(lock);
+            rings.push_back(ring);
+        }
+        return *ring;
+    }
+
+    /** Drain the rings of all of the threads, in turn, with onSlot; see
+        SpscSlotRing::drain().  Called by the consumer only.
+    */
+    template<typename OnSlot>
+    bool drain(const OnSlot & onSlot)
+    {
+        std::vector<std::shared_ptr<Ring> > current;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            current = rings;
+        }
+
+        for (auto & ring: current)
+            if (!ring->drain(onSlot))
+                return false;
+        return true;
+    }
+
+    uint64_t numPushed() const
+    {
+        uint64_t result = 0;
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto & ring: rings)
+            result += ring->numPushed();
+        return result;
+    }
+
+    uint64_t numDropped() const
+    {
+        uint64_t result = 0;
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto & ring: rings)
+            result += ring->numDropped();
+        return result;
+    }
+
+private:
+    /** Rings of all of the threads that ever produced; only registered and
+        read under the lock.
+    */
+    std::vector<std::shared_ptr<Ring> > rings;
+    mutable std::mutex lock;
+
+    ML::ThreadSpecificInstanceInfo<std::shared_ptr<Ring>, ThreadBuffers>
+        threadRings;
+};
+
+} // namespace Datacratic
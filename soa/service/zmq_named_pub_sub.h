@@ -10,6 +10,8 @@
 #include "zmq_endpoint.h"
 #include "typed_message_channel.h"
 #include <sys/utsname.h>
+#include <array>
+#include <mutex>
 #include "jml/arch/backtrace.h"
 
 namespace Datacratic {
@@ -27,7 +29,8 @@ struct ZmqNamedPublisher: public MessageLoop {
     ZmqNamedPublisher(std::shared_ptr<zmq::context_t> context,
                       int messageBufferSize = 65536)
         : publishEndpoint(context),
-          publishQueue(messageBufferSize)
+          publishQueue(messageBufferSize),
+          nextSharedPart(0)
     {
     }
 
@@ -90,28 +93,48 @@ struct ZmqNamedPublisher: public MessageLoop {
     //{
     //}
 
+    /** Arguments that are rvalue strings are handed over to zmq without
+        being copied; see encodeMessage(std::string &&).  Shared strings and
+        zmq messages are sent without being copied either.
+    */
     template<typename Head, typename... Tail>
     void encodeAll(std::vector<zmq::message_t> & messages,
-                   Head head,
+                   Head && head,
                    Tail&&... tail)
     {
-        messages.emplace_back(std::move(encodeMessage(head)));
+        encodePart(messages, std::forward<Head>(head));
         encodeAll(messages, std::forward<Tail>(tail)...);
     }
 
-    // Vectors treated specially... they are copied
-    template<typename... Tail>
-    void encodeAll(std::vector<zmq::message_t> & messages,
-                   const std::vector<std::string> & head,
-                   Tail&&... tail)
+    void encodeAll(std::vector<zmq::message_t> & messages)
     {
-        for (auto & m: head)
-            messages.emplace_back(std::move(encodeMessage(m)));
-        encodeAll(messages, std::forward<Tail>(tail)...);
     }
 
-    void encodeAll(std::vector<zmq::message_t> & messages)
+    template<typename Part>
+    void encodePart(std::vector<zmq::message_t> & messages, Part && part)
+    {
+        messages.emplace_back(encodeMessage(std::forward<Part>(part)));
+    }
+
+    // Vectors treated specially... they give one part per element
+    void encodePart(std::vector<zmq::message_t> & messages,
+                    const std::vector<std::string> & parts)
+    {
+        for (auto & m: parts)
+            messages.emplace_back(encodeMessage(m));
+    }
+
+    void encodePart(std::vector<zmq::message_t> & messages,
+                    std::vector<std::string> & parts)
+    {
+        encodePart(messages, const_cast<const std::vector<std::string> &>(parts));
+    }
+
+    void encodePart(std::vector<zmq::message_t> & messages,
+                    std::vector<std::string> && parts)
     {
+        for (auto & m: parts)
+            messages.emplace_back(encodeMessage(std::move(m)));
     }
 
     template<typename... Args>
@@ -122,7 +145,38 @@ struct ZmqNamedPublisher: public MessageLoop {
         
         encodeAll(messages, channel,
                   std::forward<Args>(args)...);
-        publishQueue.push(messages);
+        publishQueue.push(std::move(messages));
+    }
+
+    /** Return a message part for the given shared string, to be passed to
+        publish().  The part refers to the string's buffer, and the last
+        few parts are cached, so that publishing the same string on several
+        channels copies it zero times and only allocates its part once.
+    */
+    zmq::message_t sharedPart(const std::shared_ptr<const std::string> & str)
+    {
+        std::unique_lock<std::mutex> guard(sharedPartsLock);
+
+        for (auto & entry: sharedParts)
+            if (entry.first == str)
+                return entry.second;
+
+        zmq::message_t part = encodeMessage(str);
+        sharedParts[nextSharedPart] = std::make_pair(str, part);
+        nextSharedPart = (nextSharedPart + 1) % NumSharedParts;
+        return part;
+    }
+
+    /** Drop the cached shared parts, which releases the strings that they
+        refer to once they have been sent.
+    */
+    void clearSharedParts()
+    {
+        std::unique_lock<std::mutex> guard(sharedPartsLock);
+        for (auto & entry: sharedParts) {
+            entry.first.reset();
+            entry.second.rebuild();
+        }
     }
 
 private:
@@ -131,6 +185,14 @@ private:
 
     /// Queue of things to be published
     TypedMessageSink<std::vector<zmq::message_t> > publishQueue;
+
+    enum { NumSharedParts = 16 };
+
+    /// Parts most recently returned by sharedPart()
+    std::array<std::pair<std::shared_ptr<const std::string>, zmq::message_t>,
+               NumSharedParts> sharedParts;
+    int nextSharedPart;
+    std::mutex sharedPartsLock;
 };
 
 
@@ -145,6 +145,60 @@ inline zmq::message_t encodeMessage(const std::string & message)
     return message;
 }
 
+/** Strings smaller than this are copied into the message rather than handed
+    over to zmq, since zmq would allocate a buffer for them anyway.
+*/
+enum { ZmqZeroCopyThreshold = 1024 };
+
+/** The message takes ownership of the string's buffer, which is freed by
+    zmq once the message has been sent.  Small strings are copied.
+*/
+inline zmq::message_t encodeMessage(std::string && message)
+{
+    if (message.size() < ZmqZeroCopyThreshold)
+        return message;
+
+    std::string * owned = new std::string(std::move(message));
+    auto freeString = [] (void * data, void * hint)
+        {
+            delete reinterpret_cast<std::string *>(hint);
+        };
+    return zmq::message_t((void *)owned->data(), owned->size(),
+                          freeString, owned);
+}
+
+/** The message refers to the shared string's buffer, which is kept alive
+    until zmq has sent the message.  The string must not be modified until
+    then.
+*/
+inline zmq::message_t
+encodeMessage(const std::shared_ptr<const std::string> & message)
+{
+    if (!message)
+        return zmq::message_t();
+
+    auto ref = new std::shared_ptr<const std::string>(message);
+    auto freeRef = [] (void * data, void * hint)
+        {
+            delete reinterpret_cast<std::shared_ptr<const std::string> *>(hint);
+        };
+    return zmq::message_t((void *)message->data(), message->size(),
+                          freeRef, ref);
+}
+
+/** Messages are passed on by reference to the same buffer, which makes it
+    possible to send a frame to many peers without copying it.
+*/
+inline zmq::message_t encodeMessage(const zmq::message_t & message)
+{
+    return message;
+}
+
+inline zmq::message_t encodeMessage(zmq::message_t && message)
+{
+    return std::move(message);
+}
+
 inline zmq::message_t encodeMessage(const Utf8String & message)
 {
     return message.rawString();
@@ -0,0 +1,106 @@
+/* varint_test.cc
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Tests for the varint and zigzag codec.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include "soa/types/varint.h"
+#include <limits>
+
+using namespace std;
+using namespace Datacratic;
+
+
+BOOST_AUTO_TEST_CASE( test_varint_round_trip )
+{
+    vector<uint64_t> values = {
+        0, 1, 127, 128, 300, 16383, 16384, uint64_t(1) << 32,
+        numeric_limits<uint64_t>::max()
+    };
+
+    string data;
+    for (uint64_t val: values)
+        appendVarint(data, val);
+
+    BOOST_CHECK_EQUAL(data[0], 0);
+    BOOST_CHECK_EQUAL(data.size(), 1 + 1 + 1 + 2 + 2 + 2 + 3 + 5 + 10);
+
+    const char * p = data.data(), * e = p + data.size();
+    for (uint64_t val: values)
+        BOOST_CHECK_EQUAL(readVarint(p, e, "test data"), val);
+    BOOST_CHECK(p == e);
+
+    size_t pos = 0;
+    for (uint64_t val: values)
+        BOOST_CHECK_EQUAL(readVarint(data, pos, "test data"), val);
+    BOOST_CHECK_EQUAL(pos, data.size());
+}
+
+BOOST_AUTO_TEST_CASE( test_zigzag )
+{
+    BOOST_CHECK_EQUAL(zigzagEncode(0), 0);
+    BOOST_CHECK_EQUAL(zigzagEncode(-1), 1);
+    BOOST_CHECK_EQUAL(zigzagEncode(1), 2);
+    BOOST_CHECK_EQUAL(zigzagEncode(-2), 3);
+
+    vector<int64_t> values = {
+        0, -1, 1, -64, 64, numeric_limits<int64_t>::min(),
+        numeric_limits<int64_t>::max()
+    };
+
+    string data;
+    for (int64_t val: values)
+        appendSignedVarint(data, val);
+
+    // Small negative values stay small
+    BOOST_CHECK_EQUAL(data.size(), 1 + 1 + 1 + 1 + 2 + 10 + 10);
+
+    size_t pos = 0;
+    for (int64_t val: values)
+        BOOST_CHECK_EQUAL(readSignedVarint(data, pos, "test data"), val);
+}
+
+BOOST_AUTO_TEST_CASE( test_varint_bounds )
+{
+    string data;
+    appendVarintString(data, "hello");
+    appendVarint(data, 1000);
+
+    // Every truncation of the buffer is rejected without reading past it
+    for (size_t len = 0;  len < data.size();  ++len) {
+        string truncated(data, 0, len);
+        size_t pos = 0;
+        string str;
+        BOOST_CHECK_THROW({
+                readVarintString(truncated, pos, str, "test data");
+                readVarint(truncated, pos, "test data");
+            }, ML::Exception);
+    }
+
+    size_t pos = 0;
+    string str;
+    readVarintString(data, pos, str, "test data");
+    BOOST_CHECK_EQUAL(str, "hello");
+    BOOST_CHECK_EQUAL(readVarint(data, pos, "test data"), 1000);
+
+    // A position past the end and varints longer than 64 bits are refused
+    pos = data.size() + 1;
+    BOOST_CHECK_THROW(readVarint(data, pos, "test data"), ML::Exception);
+
+    string overlong(11, char(0x80));
+    overlong.push_back(0);
+    pos = 0;
+    BOOST_CHECK_THROW(readVarint(overlong, pos, "test data"), ML::Exception);
+
+    try {
+        pos = 0;
+        readVarint(string(1, char(0x80)), pos, "test data");
+        BOOST_CHECK(false);
+    } catch (const ML::Exception & exc) {
+        BOOST_CHECK_EQUAL(string(exc.what()), "truncated test data");
+    }
+}
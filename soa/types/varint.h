@@ -0,0 +1,119 @@
+/* varint.h                                                         -*- C++ -*-
+   Copyright (c) 2014 Datacratic.  All rights reserved.
+
+   Variable length encoding of integers, shared by the binary formats: seven
+   bits per byte, least significant group first, with the high bit set on
+   all but the last byte.  Signed integers are zigzag encoded first so that
+   small negative values stay small.
+*/
+
+#pragma once
+
+#include "jml/arch/exception.h"
+#include <string>
+#include <cstdint>
+
+
+namespace Datacratic {
+
+
+/*****************************************************************************/
+/* VARINT                                                                    */
+/*****************************************************************************/
+
+inline uint64_t zigzagEncode(int64_t val)
+{
+    return (uint64_t(val) << 1) ^ uint64_t(val >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t val)
+{
+    return int64_t(val >> 1) ^ -int64_t(val & 1);
+}
+
+inline void appendVarint(std::string & out, uint64_t val)
+{
+    while (val >= 0x80) {
+        out.push_back(char(val | 0x80));
+        val >>= 7;
+    }
+    out.push_back(char(val));
+}
+
+inline void appendSignedVarint(std::string & out, int64_t val)
+{
+    appendVarint(out, zigzagEncode(val));
+}
+
+/** Appends the varint length of the string followed by the string. */
+inline void appendVarintString(std::string & out, const std::string & str)
+{
+    appendVarint(out, str.size());
+    out.append(str);
+}
+
+/** Decodes the varint at p, which is moved past it.  Never reads at or past
+    e: throws "truncated <what>" if the buffer ends first, and rejects the
+    varints that don't fit in 64 bits.
+*/
+inline uint64_t readVarint(const char * & p, const char * e, const char * what)
+{
+    uint64_t result = 0;
+    for (int shift = 0;;  shift += 7) {
+        if (p == e)
+            throw ML::Exception("truncated %s", what);
+        if (shift > 63)
+            throw ML::Exception("invalid varint in %s", what);
+        uint8_t c = *p++;
+        result |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return result;
+    }
+}
+
+inline int64_t readSignedVarint(const char * & p, const char * e,
+                                const char * what)
+{
+    return zigzagDecode(readVarint(p, e, what));
+}
+
+/** Reads a string written by appendVarintString(). */
+inline void readVarintString(const char * & p, const char * e,
+                             std::string & result, const char * what)
+{
+    uint64_t size = readVarint(p, e, what);
+    if (size > uint64_t(e - p))
+        throw ML::Exception("truncated %s", what);
+    result.assign(p, size);
+    p += size;
+}
+
+/** Same as above, for formats that keep a position into a string. */
+inline uint64_t readVarint(const std::string & in, size_t & pos,
+                           const char * what)
+{
+    if (pos > in.size())
+        throw ML::Exception("truncated %s", what);
+    const char * p = in.data() + pos, * e = in.data() + in.size();
+    uint64_t result = readVarint(p, e, what);
+    pos = p - in.data();
+    return result;
+}
+
+inline int64_t readSignedVarint(const std::string & in, size_t & pos,
+                                const char * what)
+{
+    return zigzagDecode(readVarint(in, pos, what));
+}
+
+inline void readVarintString(const std::string & in, size_t & pos,
+                             std::string & result, const char * what)
+{
+    if (pos > in.size())
+        throw ML::Exception("truncated %s", what);
+    const char * p = in.data() + pos, * e = in.data() + in.size();
+    readVarintString(p, e, result, what);
+    pos = p - in.data();
+}
+
+} // namespace Datacratic